@@ -0,0 +1,173 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageAllocation.c
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//
+//----------------------------------------------------------------------
+
+#include "DiskImageUtils.h"
+#include "DiskImageAllocation.h"
+#include "DiskImageIO.h"
+
+typedef struct ExtentList {
+    VolumeExtent *extents;
+    size_t count;
+    size_t capacity;
+    size_t limit; // volume length; nothing is added past this
+}   ExtentList;
+
+// Append an extent. Extents must be added in ascending order of offset;
+// ones which touch or overlap the previous extent are merged into it.
+static int AddExtent(ExtentList *list, off_t offset, size_t length) {
+    VolumeExtent *last;
+    if (offset < 0 || offset >= list->limit) { return 0; }
+    if (offset + length > list->limit) { length = list->limit - offset; }
+    if (!length) { return 0; }
+    if (list->count) {
+        last = &list->extents[list->count-1];
+        if (offset <= last->offset + (off_t)last->length) {
+            if (offset + length > last->offset + last->length) {
+                last->length = offset + length - last->offset;
+            }
+            return 0;
+        }
+    }
+    if (list->count == list->capacity) {
+        size_t capacity = (list->capacity) ? list->capacity * 2 : 64;
+        VolumeExtent *p = realloc(list->extents, capacity * sizeof(VolumeExtent));
+        if (!p) { return ENOMEM; }
+        list->extents = p;
+        list->capacity = capacity;
+    }
+    list->extents[list->count].offset = offset;
+    list->extents[list->count].length = length;
+    list->count++;
+    return 0;
+}
+
+// Add one extent per run of set bits in an allocation bitmap. Bit 0 is
+// the most significant bit of the first byte, as on disk.
+static int AddBitmapRuns(ExtentList *list, const uchar *bitmap, size_t numBlocks,
+                         off_t firstBlockOffset, size_t blockSize) {
+    int result = 0;
+    size_t blk = 0, runStart;
+    while (blk < numBlocks && result == 0) {
+        // skip whole bytes of free blocks quickly
+        if ((blk & 7) == 0 && bitmap[blk >> 3] == 0x00) { blk += 8; continue; }
+        if (!(bitmap[blk >> 3] & (0x80 >> (blk & 7)))) { blk++; continue; }
+        runStart = blk;
+        while (blk < numBlocks) {
+            if ((blk & 7) == 0 && bitmap[blk >> 3] == 0xFF && blk + 8 <= numBlocks) {
+                blk += 8;
+            } else if (bitmap[blk >> 3] & (0x80 >> (blk & 7))) {
+                blk++;
+            } else {
+                break;
+            }
+        }
+        result = AddExtent(list, firstBlockOffset + (off_t)runStart * blockSize,
+                           (blk - runStart) * blockSize);
+    }
+    return result;
+}
+
+static int ReadFully(int fd, void *buf, size_t length, off_t offset) {
+    ssize_t count = IORead(fd, buf, length, offset);
+    if (count < 0) { return errno; }
+    return (count == length) ? 0 : EIO;
+}
+
+static int ReadHFSExtents(int fd, off_t hfsStart, ExtentList *list) {
+    MasterDirectoryBlock mdb;
+    int result;
+    uchar *bitmap;
+    off_t alStart, alEnd;
+    size_t mapLen;
+    if (ReadMasterDirectoryBlock(fd, hfsStart + (512*2), &mdb) != 0) { return -1; }
+    if (mdb.drAlBlkSiz == 0 || (mdb.drAlBlkSiz % 512) || mdb.drNmAlBlks == 0) {
+        return -1; // not a sane HFS volume
+    }
+    alStart = mdb.drAlBlSt * 512; // first allocation block, in bytes
+    alEnd = alStart + (off_t)mdb.drNmAlBlks * mdb.drAlBlkSiz;
+    mapLen = (mdb.drNmAlBlks + 7) / 8;
+    if (!(bitmap = malloc(mapLen))) { return ENOMEM; }
+    result = ReadFully(fd, bitmap, mapLen, hfsStart + mdb.drVBMSt * 512);
+    // boot blocks, MDB and volume bitmap
+    if (!result) { result = AddExtent(list, 0, alStart); }
+    if (!result) {
+        result = AddBitmapRuns(list, bitmap, mdb.drNmAlBlks, alStart, mdb.drAlBlkSiz);
+    }
+    // alternate MDB (second-to-last block) and anything after the last
+    // allocation block
+    if (!result && list->limit > 1024) {
+        off_t tail = list->limit - 1024;
+        if (alEnd < tail) { tail = alEnd; }
+        result = AddExtent(list, tail, list->limit - tail);
+    }
+    free(bitmap);
+    return result;
+}
+
+static int ReadHFSPlusExtents(int fd, off_t hfsStart, ExtentList *list) {
+    HFSPlusVolumeHeader vh;
+    int i, result = 0;
+    uchar *bitmap, *p;
+    size_t mapLen, bytesRemaining, count;
+    if (ReadHFSPlusVolumeHeader(fd, hfsStart + (512*2), &vh) != 0) { return -1; }
+    if (vh.blockSize == 0 || (vh.blockSize % 512) || vh.totalBlocks == 0) {
+        return -1; // not a sane HFS+ volume
+    }
+    mapLen = (vh.totalBlocks + 7) / 8;
+    if (!(p = bitmap = malloc(mapLen))) { return ENOMEM; }
+    // the allocation file's first eight extents are in the volume header;
+    // a bitmap fragmented beyond that would need the extents overflow file
+    bytesRemaining = mapLen;
+    for (i = 0; i < 8 && bytesRemaining && !result; i++) {
+        ulong startBlock, blockCount;
+        memcpy(&startBlock, vh.allocationFile.extents + i*8, 4);
+        memcpy(&blockCount, vh.allocationFile.extents + i*8 + 4, 4);
+        startBlock = (ulong) ntohl(startBlock);
+        blockCount = (ulong) ntohl(blockCount);
+        if (!blockCount) { break; }
+        count = (size_t)blockCount * vh.blockSize;
+        if (count > bytesRemaining) { count = bytesRemaining; }
+        result = ReadFully(fd, p, count, hfsStart + (off_t)startBlock * vh.blockSize);
+        p += count;
+        bytesRemaining -= count;
+    }
+    if (!result && bytesRemaining) { result = -1; }
+    // reserved area, volume header and (normally allocated) block 0
+    if (!result) { result = AddExtent(list, 0, 512*3); }
+    if (!result) {
+        result = AddBitmapRuns(list, bitmap, vh.totalBlocks, 0, vh.blockSize);
+    }
+    // alternate volume header
+    if (!result && list->limit > 1024) {
+        result = AddExtent(list, list->limit - 1024, 1024);
+    }
+    free(bitmap);
+    return result;
+}
+
+int ReadAllocatedExtents(int fd, off_t hfsStart, size_t hfsLen,
+                         VolumeExtent **extents, size_t *count) {
+    ExtentList list = {0};
+    ushort sig = 0;
+    int result = -1;
+    list.limit = hfsLen;
+    if (ReadUShort(fd, hfsStart + (512*2), &sig) != 0) { return -1; }
+    if (sig == 0x4244) { // 'BD' for HFS, including wrappers around HFS+
+        result = ReadHFSExtents(fd, hfsStart, &list);
+    } else if (sig == 0x482B || sig == 0x4858) { // 'H+' or 'HX'
+        result = ReadHFSPlusExtents(fd, hfsStart, &list);
+    }
+    if (result != 0) {
+        free(list.extents);
+        return result;
+    }
+    *extents = list.extents;
+    *count = list.count;
+    return 0;
+}
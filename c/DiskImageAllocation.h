@@ -0,0 +1,36 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageAllocation.h
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//
+//----------------------------------------------------------------------
+
+#ifndef __diskimageallocation_h__
+#define __diskimageallocation_h__
+
+#include "DiskImageUtils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A byte range within a volume, relative to the start of the volume
+typedef struct VolumeExtent {
+    off_t offset;
+    size_t length;
+}   VolumeExtent;
+
+// Build a sorted list of the parts of the HFS or HFS+ volume at hfsStart
+// which hold data: the system areas at both ends of the volume plus every
+// allocation block marked in use in the volume bitmap. Extents are
+// clipped to hfsLen. Caller must free *extents.
+int ReadAllocatedExtents(int fd, off_t hfsStart, size_t hfsLen,
+                         VolumeExtent **extents, size_t *count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __diskimageallocation_h__ */
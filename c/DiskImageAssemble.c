@@ -0,0 +1,182 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageAssemble.c
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//  Fri Oct 16 2026 -- volumes can come from UDIF images
+//
+//----------------------------------------------------------------------
+
+#include <pthread.h>
+#include "DiskImageUtils.h"
+#include "DiskImageAssemble.h"
+#include "DiskImageConvert.h"
+#include "DiskImagePool.h"
+#include "DiskImageIO.h"
+#include "DiskImageStats.h"
+#include "DiskImageDescribe.h"
+
+extern int quiet;
+
+typedef struct AssembleVolume {
+    const char *inPath;
+    int fd;
+    off_t hfsStart; // in the input
+    size_t hfsLen;
+    off_t wrStart; // in the output
+    int result; // from WriteHFSVolumeData
+}   AssembleVolume;
+
+typedef struct AssembleJob {
+    int ofd; // shared by the workers
+    int rw;
+    const CopyOptions *options;
+    AssembleVolume *volumes;
+    size_t count;
+    pthread_mutex_t lock; // keeps the report lines whole
+    size_t finished;
+}   AssembleJob;
+
+static void AssembleReport(AssembleJob *job, const AssembleVolume *vol) {
+    pthread_mutex_lock(&job->lock);
+    job->finished++;
+    fprintf(stdout, "[%zu/%zu] %s: ", job->finished, job->count, vol->inPath);
+    if (vol->result == 0) {
+        fprintf(stdout, "%.1f MB at offset %lld\n", vol->hfsLen / (1024.0*1024.0),
+                (long long)vol->wrStart);
+    } else if (vol->result == ECANCELED) {
+        fprintf(stdout, "cancelled\n");
+    } else {
+        fprintf(stdout, "failed (error %d: %s)\n", vol->result, strerror(vol->result));
+    }
+    fflush(stdout);
+    pthread_mutex_unlock(&job->lock);
+}
+
+static int AssembleTask(void *refCon, size_t taskIndex, unsigned worker) {
+    AssembleJob *job = (AssembleJob*)refCon;
+    AssembleVolume *vol = &job->volumes[taskIndex];
+    vol->result = WriteHFSVolumeData(job->ofd, vol->fd, vol->hfsStart, vol->wrStart,
+                                     vol->hfsLen, job->rw, job->options);
+    AssembleReport(job, vol);
+    return vol->result; // the image is no use without every volume
+}
+
+int AssembleImage(char *const *inPaths, size_t count, const char *outPath,
+                  const AssembleOptions *assemble, const CopyOptions *options,
+                  ImageIndex *index) {
+    AssembleJob job;
+    CopyOptions copyOptions = {0};
+    IOBackend backend;
+    size_t *lengths = NULL;
+    off_t *offsets = NULL;
+    size_t i, fileSize, total = 0;
+    off_t end;
+    unsigned workers;
+    StatsTimer timer;
+    int result = 0, wasQuiet = quiet;
+    memset(&job, 0, sizeof(job));
+    job.ofd = -1;
+    job.rw = assemble->rw;
+    if (options) { copyOptions = *options; }
+    copyOptions.digest = NULL; // one stream can't follow volumes copied at once
+    job.options = &copyOptions;
+    backend = copyOptions.backend;
+    pthread_mutex_init(&job.lock, NULL);
+
+    if (count < 1 || count > kDeviceMaxVolumes) {
+        tabprint(0, "A device image holds from 1 to %d volumes\n", kDeviceMaxVolumes);
+        result = EINVAL;
+        goto done;
+    }
+    job.volumes = calloc(count, sizeof(AssembleVolume));
+    lengths = calloc(count, sizeof(size_t));
+    offsets = calloc(count, sizeof(off_t));
+    if (!job.volumes || !lengths || !offsets) {
+        result = ENOMEM;
+        goto done;
+    }
+    for (i = 0; i < count; i++) { job.volumes[i].fd = -1; }
+    job.count = count;
+    for (i = 0; i < count; i++) {
+        AssembleVolume *vol = &job.volumes[i];
+        vol->inPath = inPaths[i];
+        StatsBegin(&timer, kStatsPhaseOpen);
+        vol->fd = OpenImage(vol->inPath, backend);
+        StatsEnd(&timer);
+        if (vol->fd == -1) {
+            result = errno;
+            tabprint(0, "Unable to open \"%s\" (%d)\n", vol->inPath, errno);
+            goto done;
+        }
+        StatsBegin(&timer, kStatsPhaseProbe);
+        result = ProbeFile(vol->fd, vol->inPath, index, copyOptions.partition, &fileSize,
+                           &vol->hfsStart, &vol->hfsLen);
+        StatsEnd(&timer);
+        if (result != 0) {
+            tabprint(0, "Unable to find HFS volume in \"%s\" (error %d)\n", vol->inPath,
+                     result);
+            goto done;
+        }
+        tabprint(0, "Volume %zu: \"%s\", offset %lld, length %lld\n", i + 1, vol->inPath,
+                 (long long)vol->hfsStart, (long long)vol->hfsLen);
+        lengths[i] = vol->hfsLen;
+    }
+
+    tabprint(0, "Output file: \"%s\"\n", outPath);
+    StatsBegin(&timer, kStatsPhaseOpen);
+    job.ofd = IOOpen(outPath, O_RDWR | O_CREAT | O_TRUNC, 0600, backend);
+    StatsEnd(&timer);
+    if (job.ofd == -1) {
+        result = errno;
+        tabprint(0, "Unable to create output file (%d)\n", errno);
+        goto done;
+    }
+    tabprint(0, "Writing Apple partition map device image\n");
+    if ((result = WriteDeviceHeader(job.ofd, lengths, count, job.rw, offsets)) != 0) {
+        goto done;
+    }
+    for (i = 0; i < count; i++) {
+        job.volumes[i].wrStart = offsets[i];
+        total += job.volumes[i].hfsLen;
+    }
+    end = offsets[count-1] + ((lengths[count-1] + 0x1FF) & ~(size_t)0x1FF);
+    // set the final length first, so that no copy extending the file
+    // over its trailing hole can cut short a volume beyond it
+    StatsCount(kStatsOtherCalls, 1);
+    if (ftruncate(job.ofd, end) != 0) {
+        result = errno;
+        goto done;
+    }
+    workers = (assemble->workers) ? assemble->workers : (unsigned)count;
+    if (workers > count) { workers = (unsigned)count; }
+    tabprint(0, "Copying %zu volumes (%.1f MB) on %u worker%s\n", count,
+             total / (1024.0*1024.0), workers, (workers == 1) ? "" : "s");
+    quiet = 1; // the workers' output would only interleave
+    result = PoolRun(workers, count, AssembleTask, &job);
+    quiet = wasQuiet;
+    tabprint(0, "\n");
+    if (result == 0) {
+        tabprint(0, "Wrote %lld bytes to output file.\n", (long long)end);
+    }
+done:
+    if (job.ofd != -1) {
+        StatsBegin(&timer, kStatsPhaseClose);
+        IOClose(job.ofd);
+        StatsEnd(&timer);
+        if (result != 0) {
+            tabprint(0, "%s; removing \"%s\"\n", (result == ECANCELED) ?
+                     "Assembly cancelled" : "The image could not be assembled", outPath);
+            unlink(outPath);
+        }
+    }
+    for (i = 0; i < job.count; i++) {
+        if (job.volumes[i].fd != -1) { IOClose(job.volumes[i].fd); }
+    }
+    free(job.volumes);
+    free(lengths);
+    free(offsets);
+    pthread_mutex_destroy(&job.lock);
+    return result;
+}
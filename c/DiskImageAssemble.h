@@ -0,0 +1,42 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageAssemble.h
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//
+//----------------------------------------------------------------------
+
+#ifndef __diskimageassemble_h__
+#define __diskimageassemble_h__
+
+#include "DiskImageUtils.h"
+#include "DiskImageCopy.h"
+#include "DiskImageIndex.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct AssembleOptions {
+    int rw; // leave the volumes writable
+    unsigned workers; // volumes copied at once (0 for all of them)
+}   AssembleOptions;
+
+// Build one bootable device image at outPath from the HFS volumes in the
+// count files of inPaths (raw volumes, or device images as ProbeFile
+// reads them), one partition each in the order given, behind the usual
+// map and driver. The header is written once, then the volumes are
+// copied into their slots at once, one worker each, with positional
+// writes. A failed or cancelled image is removed. Returns 0, -1 if an
+// input holds no HFS volume, EINVAL for more than kDeviceMaxVolumes, or
+// the first error (ECANCELED if the progress token was set).
+int AssembleImage(char *const *inPaths, size_t count, const char *outPath,
+                  const AssembleOptions *assemble, const CopyOptions *options,
+                  ImageIndex *index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __diskimageassemble_h__ */
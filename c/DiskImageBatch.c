@@ -0,0 +1,352 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageBatch.c
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//  Fri Oct 16 2026 -- a cancel stops the files not yet started
+//  Fri Oct 16 2026 -- compressed outputs are named .dmg
+//  Fri Oct 16 2026 -- and qcow2 outputs .qcow2
+//  Fri Oct 16 2026 -- manifest outputs keep their directories under the
+//                     output directory; clashing outputs are refused, and
+//                     earlier runs' outputs aren't converted again
+//  Fri Oct 16 2026 -- manifest entries naming "-" are refused
+//
+//----------------------------------------------------------------------
+
+#include <fts.h>
+#include <time.h>
+#include <pthread.h>
+#include "DiskImageUtils.h"
+#include "DiskImageBatch.h"
+#include "DiskImageConvert.h"
+#include "DiskImagePool.h"
+
+extern int quiet;
+
+typedef struct BatchFile {
+    char *inPath;
+    char *outPath;
+    int result; // from ConvertFile
+    int done; // set once the file has been tried
+    size_t bytes; // size of the output
+    double seconds;
+}   BatchFile;
+
+typedef struct BatchJob {
+    const BatchOptions *batch;
+    const CopyOptions *options;
+    ImageIndex *index;
+    BatchFile *files;
+    size_t count;
+    size_t capacity;
+    CopyBuffers *buffers; // one set per worker, allocated on first use
+    pthread_mutex_t lock; // keeps the report lines whole
+    size_t finished;
+}   BatchJob;
+
+static double BatchNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *JoinPath(const char *dir, const char *name, const char *ext) {
+    size_t len = strlen(dir) + strlen(name) + strlen(ext) + 2;
+    char *path = malloc(len);
+    if (path) {
+        snprintf(path, len, "%s%s%s%s", dir, (*dir) ? "/" : "", name, ext);
+    }
+    return path;
+}
+
+// relPath names the input relative to the tree (or manifest) it came from
+static int AddFile(BatchJob *job, const char *inPath, const char *relPath,
+                   const char *outPath) {
+    const char *ext = (job->options->compression) ? ".dmg" : (job->options->qcow2) ? ".qcow2" :
+                      (job->batch->iso) ? ".iso" : ".dsk";
+    BatchFile *file;
+    if (job->count == job->capacity) {
+        size_t capacity = (job->capacity) ? job->capacity * 2 : 256;
+        BatchFile *p = realloc(job->files, capacity * sizeof(BatchFile));
+        if (!p) { return ENOMEM; }
+        job->files = p;
+        job->capacity = capacity;
+    }
+    file = &job->files[job->count];
+    memset(file, 0, sizeof(BatchFile));
+    file->inPath = strdup(inPath);
+    if (outPath) {
+        file->outPath = strdup(outPath);
+    } else if (job->batch->outDir) {
+        file->outPath = JoinPath(job->batch->outDir, relPath, ext);
+    } else {
+        file->outPath = JoinPath("", inPath, ext);
+    }
+    if (!file->inPath || !file->outPath) {
+        free(file->inPath);
+        free(file->outPath);
+        return ENOMEM;
+    }
+    job->count++;
+    return 0;
+}
+
+static int AddTree(BatchJob *job, const char *root) {
+    char *paths[] = { (char*)root, NULL };
+    size_t rootLen = strlen(root);
+    const char *rel;
+    FTSENT *ent;
+    FTS *fts;
+    int result = 0;
+    if (!(fts = fts_open(paths, FTS_PHYSICAL | FTS_NOCHDIR, NULL))) { return errno; }
+    while (result == 0 && (ent = fts_read(fts)) != NULL) {
+        if (ent->fts_name[0] == '.' && ent->fts_level > 0) {
+            if (ent->fts_info == FTS_D) { fts_set(fts, ent, FTS_SKIP); }
+            continue; // hidden files and directories
+        }
+        if (ent->fts_info != FTS_F) { continue; }
+        rel = ent->fts_path + rootLen;
+        while (*rel == '/') { rel++; }
+        result = AddFile(job, ent->fts_path, rel, NULL);
+    }
+    fts_close(fts);
+    return result;
+}
+
+static int AddManifest(BatchJob *job, const char *manifest) {
+    FILE *fp = fopen(manifest, "r");
+    char *line = NULL, *tab, *name;
+    size_t size = 0;
+    ssize_t len;
+    int result = 0;
+    if (!fp) { return errno; }
+    while (result == 0 && (len = getline(&line, &size, fp)) != -1) {
+        while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) { line[--len] = 0; }
+        if (len == 0 || line[0] == '#') { continue; }
+        if ((tab = strchr(line, '\t')) != NULL) { *tab++ = 0; }
+        // under an output directory the input's own directories are kept,
+        // unless they climb out of it
+        for (name = line; *name == '/'; name++) { }
+        while (!strncmp(name, "./", 2)) { name += 2; }
+        if (!strcmp(name, "..") || !strncmp(name, "../", 3) || strstr(name, "/../") ||
+            (strlen(name) >= 3 && !strcmp(name + strlen(name) - 3, "/.."))) {
+            name = (strrchr(line, '/')) ? strrchr(line, '/') + 1 : line;
+        }
+        result = AddFile(job, line, name, (tab && *tab) ? tab : NULL);
+        if (result == 0 && (!strcmp(line, "-") || (tab && !strcmp(tab, "-")))) {
+            // only cvt2hfs and cvt2iso stream, and not from a worker
+            tabprint(1, "Not converting \"%s\": a batch can't use standard input or output\n",
+                     line);
+            job->files[job->count - 1].result = EINVAL;
+            job->files[job->count - 1].done = 1;
+        }
+    }
+    free(line);
+    fclose(fp);
+    return result;
+}
+
+static int ComparePaths(const void *a, const void *b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Order files by output path, then by where they are in the job
+static int CompareOutputs(const void *a, const void *b) {
+    const BatchFile *fa = *(BatchFile* const*)a, *fb = *(BatchFile* const*)b;
+    int order = strcmp(fa->outPath, fb->outPath);
+    return (order) ? order : (fa < fb) ? -1 : (fa > fb);
+}
+
+// Drop inputs which are another entry's output (left in the tree by an
+// earlier run), and fail (with EEXIST) any entry whose output an earlier
+// one already writes, as both would be converted over one another at once.
+// Entries refused already write nothing, so claim no output.
+static int CheckOutputs(BatchJob *job) {
+    char **outputs = malloc((job->count + 1) * sizeof(char*));
+    BatchFile **byOutput = malloc((job->count + 1) * sizeof(BatchFile*));
+    uchar *drop = calloc(job->count + 1, 1);
+    size_t i, n, m;
+    int result = 0;
+    if (!outputs || !byOutput || !drop) {
+        result = ENOMEM;
+        goto done;
+    }
+    for (i = 0, m = 0; i < job->count; i++) {
+        if (!job->files[i].done) { outputs[m++] = job->files[i].outPath; }
+    }
+    qsort(outputs, m, sizeof(char*), ComparePaths);
+    for (i = 0; i < job->count; i++) {
+        drop[i] = (bsearch(&job->files[i].inPath, outputs, m, sizeof(char*),
+                           ComparePaths) != NULL);
+    }
+    for (i = 0, n = 0; i < job->count; i++) {
+        if (drop[i]) {
+            tabprint(1, "Skipping \"%s\", the output of another file\n", job->files[i].inPath);
+            free(job->files[i].inPath);
+            free(job->files[i].outPath);
+            continue;
+        }
+        job->files[n++] = job->files[i];
+    }
+    job->count = n;
+    for (i = 0, m = 0; i < job->count; i++) {
+        if (!job->files[i].done) { byOutput[m++] = &job->files[i]; }
+    }
+    qsort(byOutput, m, sizeof(BatchFile*), CompareOutputs);
+    for (i = 1; i < m; i++) {
+        if (strcmp(byOutput[i]->outPath, byOutput[i - 1]->outPath) != 0) { continue; }
+        tabprint(1, "Not converting \"%s\": another file is already written to \"%s\"\n",
+                 byOutput[i]->inPath, byOutput[i]->outPath);
+        byOutput[i]->result = EEXIST;
+        byOutput[i]->done = 1;
+    }
+done:
+    free(outputs);
+    free(byOutput);
+    free(drop);
+    return result;
+}
+
+// Create the directories leading up to path, as mkdir -p would
+static int MakeParentDirs(const char *path) {
+    char *dir = strdup(path), *p;
+    int result = 0;
+    if (!dir) { return ENOMEM; }
+    for (p = dir + 1; *p && result == 0; p++) {
+        if (*p != '/') { continue; }
+        *p = 0;
+        if (mkdir(dir, 0755) != 0 && errno != EEXIST) { result = errno; }
+        *p = '/';
+    }
+    free(dir);
+    return result;
+}
+
+static void BatchReport(BatchJob *job, const BatchFile *file) {
+    pthread_mutex_lock(&job->lock);
+    job->finished++;
+    fprintf(stdout, "[%zu/%zu] %s: ", job->finished, job->count, file->inPath);
+    if (file->result == 0) {
+        fprintf(stdout, "%.1f MB in %.2f s (%.1f MB/s)\n", file->bytes / (1024.0*1024.0),
+                file->seconds, (file->seconds > 0) ?
+                file->bytes / (1024.0*1024.0) / file->seconds : 0.0);
+    } else if (file->result == -1) {
+        fprintf(stdout, "skipped, no HFS volume found\n");
+    } else if (file->result == ECANCELED) {
+        fprintf(stdout, "cancelled\n");
+    } else {
+        fprintf(stdout, "failed (error %d: %s)\n", file->result, strerror(file->result));
+    }
+    fflush(stdout);
+    pthread_mutex_unlock(&job->lock);
+}
+
+static int BatchTask(void *refCon, size_t taskIndex, unsigned worker) {
+    BatchJob *job = (BatchJob*)refCon;
+    BatchFile *file = &job->files[taskIndex];
+    CopyOptions options = *job->options;
+    struct stat sb;
+    double start = BatchNow();
+    if (file->done) { return 0; } // refused by CheckOutputs
+    if (!job->buffers[worker].data && CopyBuffersAlloc(&job->buffers[worker]) != 0) {
+        file->result = ENOMEM;
+    } else if ((file->result = MakeParentDirs(file->outPath)) == 0) {
+        options.buffers = &job->buffers[worker];
+        file->result = ConvertFile(job->batch->iso, file->inPath, file->outPath,
+                                   job->batch->rw, &options, job->index);
+    }
+    file->seconds = BatchNow() - start;
+    if (file->result == 0 && stat(file->outPath, &sb) == 0) {
+        file->bytes = sb.st_size;
+    }
+    file->done = 1;
+    BatchReport(job, file);
+    // one bad file mustn't stop the rest, but a cancel should
+    return (file->result == ECANCELED) ? ECANCELED : 0;
+}
+
+int BatchConvert(const char *source, const BatchOptions *batch,
+                 const CopyOptions *options, ImageIndex *index) {
+    BatchJob job;
+    CopyOptions defaults = {0};
+    struct stat sb;
+    unsigned workers = (batch->workers) ? batch->workers : PoolDefaultThreads();
+    size_t i, converted = 0, skipped = 0, failed = 0, cancelled = 0, bytes = 0;
+    double start, seconds;
+    int result, wasQuiet = quiet;
+    memset(&job, 0, sizeof(job));
+    job.batch = batch;
+    job.options = (options) ? options : &defaults;
+    job.index = index;
+    pthread_mutex_init(&job.lock, NULL);
+
+    if (stat(source, &sb) < 0) {
+        result = errno;
+    } else if (S_ISDIR(sb.st_mode)) {
+        result = AddTree(&job, source);
+    } else {
+        result = AddManifest(&job, source);
+    }
+    if (result == 0) { result = CheckOutputs(&job); }
+    if (result != 0) {
+        tabprint(0, "Unable to read \"%s\" (%d)\n", source, result);
+        failed = 1;
+        goto done;
+    }
+    if (workers > job.count) { workers = (job.count) ? (unsigned)job.count : 1; }
+    if (!(job.buffers = calloc(workers, sizeof(CopyBuffers)))) {
+        failed = 1;
+        goto done;
+    }
+    tabprint(0, "Converting %zu files on %u worker%s\n", job.count, workers,
+             (workers == 1) ? "" : "s");
+    start = BatchNow();
+    quiet = 1; // the workers' ConvertFile output would only interleave
+    PoolRun(workers, job.count, BatchTask, &job);
+    quiet = wasQuiet;
+
+    for (i = 0; i < job.count; i++) {
+        if (!job.files[i].done || job.files[i].result == ECANCELED) {
+            cancelled++;
+        } else if (job.files[i].result == 0) {
+            converted++;
+            bytes += job.files[i].bytes;
+        } else if (job.files[i].result == -1) {
+            skipped++;
+        } else {
+            failed++;
+        }
+    }
+    tabprint(0, "\n");
+    tabprint(0, "Converted %zu of %zu files (%zu skipped, %zu failed)\n",
+             converted, job.count, skipped, failed);
+    if (cancelled) {
+        tabprint(0, "Cancelled with %zu files not converted\n", cancelled);
+    }
+    seconds = BatchNow() - start;
+    tabprint(0, "Wrote %.1f MB in %.2f s (%.1f MB/s)\n", bytes / (1024.0*1024.0), seconds,
+             (seconds > 0) ? bytes / (1024.0*1024.0) / seconds : 0.0);
+    if (failed) {
+        tabprint(0, "Errors:\n");
+        for (i = 0; i < job.count; i++) {
+            if (job.files[i].done && job.files[i].result != 0 &&
+                job.files[i].result != -1 && job.files[i].result != ECANCELED) {
+                tabprint(1, "%s: error %d (%s)\n", job.files[i].inPath,
+                         job.files[i].result, strerror(job.files[i].result));
+            }
+        }
+    }
+done:
+    for (i = 0; i < job.count; i++) {
+        free(job.files[i].inPath);
+        free(job.files[i].outPath);
+    }
+    if (job.buffers) {
+        for (i = 0; i < workers; i++) { CopyBuffersFree(&job.buffers[i]); }
+    }
+    free(job.buffers);
+    free(job.files);
+    pthread_mutex_destroy(&job.lock);
+    return (int)failed;
+}
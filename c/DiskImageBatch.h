@@ -0,0 +1,49 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageBatch.h
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//  Fri Oct 16 2026 -- documented how outputs are named and checked
+//
+//----------------------------------------------------------------------
+
+#ifndef __diskimagebatch_h__
+#define __diskimagebatch_h__
+
+#include "DiskImageUtils.h"
+#include "DiskImageCopy.h"
+#include "DiskImageIndex.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct BatchOptions {
+    int iso; // convert to device images rather than raw HFS volumes
+    int rw; // leave the converted volumes writable
+    unsigned workers; // files converted at once (0 for one per CPU)
+    const char *outDir; // where outputs go (NULL to put them beside the inputs)
+}   BatchOptions;
+
+// Convert every file in a directory tree, or every file named in a
+// manifest (one path per line, optionally followed by a tab and the
+// output path; blank lines and lines starting with '#' are ignored).
+// Under outDir, an output keeps the input's path relative to the tree,
+// or the manifest's path for it. Files which are another entry's output
+// (from an earlier run) aren't converted, and an entry whose output an
+// earlier one writes fails rather than overwrite it, as does an entry
+// naming "-" (standard input or output) for either path.
+// Files are converted on a pool of workers which each keep one set of
+// copy buffers for all their jobs. A line is printed as each file
+// finishes, and a summary with any errors at the end. Files which hold
+// no HFS volume are skipped rather than counted as errors. Returns the
+// number of files which failed.
+int BatchConvert(const char *source, const BatchOptions *batch,
+                 const CopyOptions *options, ImageIndex *index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __diskimagebatch_h__ */
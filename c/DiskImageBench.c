@@ -0,0 +1,468 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageBench.c
+//
+//  Benchmarks for the conversion and describe paths, run by
+//  "make bench". Synthetic HFS, HFS+ and Apple Partition Map images are
+//  generated in a scratch directory, then each operation is timed with
+//  a cold and a warm page cache. Results are printed one per line as
+//  "name input cache key=value ...", so runs can be diffed across
+//  releases.
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//
+//----------------------------------------------------------------------
+
+#include <time.h>
+#include <sys/mman.h>
+#include "DiskImageUtils.h"
+#include "DiskImageConvert.h"
+#include "DiskImageDescribe.h"
+#include "DiskImageStats.h"
+
+#define kBenchVersion 1
+#define kBenchDescribeOps 200 // describes per timed run, they're quick
+#define kBenchDate 0xE0000000 // fixed HFS date (2023), so images are stable
+#define kBenchChunk (1024*1024)
+
+int verbose = 0;
+int quiet = 1;
+
+typedef struct BenchConfig {
+    const char *dir;
+    size_t volumeMB; // size of each image's volume data
+    double fill; // fraction of allocation blocks in use
+    unsigned partitions; // Apple_HFS partitions in the APM image
+    unsigned runs;
+    int keep; // leave the generated images behind
+}   BenchConfig;
+
+typedef struct BenchImage {
+    const char *name; // for the report
+    char path[PATH_MAX];
+    size_t volumeBytes; // bytes a conversion copies
+}   BenchImage;
+
+static const Progress kBenchProgress = { NULL, NULL, 0, NULL }; // no bar
+
+static double BenchNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Small deterministic generator, so every run builds the same images
+static ulong BenchRandom(ulonglong *state) {
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (ulong)(*state >> 33);
+}
+
+// Decide which allocation blocks are in use: runs of 1-64 blocks, used
+// with probability fill, which is roughly how a well-used volume looks
+static void FillBitmap(uchar *bitmap, ulong blocks, double fill, ulonglong *seed) {
+    ulong blk = 0, run, i;
+    int used;
+    while (blk < blocks) {
+        run = 1 + BenchRandom(seed) % 64;
+        used = (BenchRandom(seed) % 10000) < (ulong)(fill * 10000);
+        for (i = 0; i < run && blk < blocks; i++, blk++) {
+            if (used) { bitmap[blk / 8] |= 0x80 >> (blk % 8); }
+        }
+    }
+}
+
+static int IsBlockUsed(const uchar *bitmap, ulong blk) {
+    return (bitmap[blk / 8] & (0x80 >> (blk % 8))) != 0;
+}
+
+// Write [offset, offset+length) of the volume: random bytes in used
+// allocation blocks, zeros elsewhere
+static int WriteBlocks(int fd, off_t volStart, off_t dataStart, size_t blockSize,
+                       const uchar *bitmap, ulong blocks, ulonglong *seed) {
+    char *buf = malloc(kBenchChunk);
+    ulong blk, *p;
+    size_t pos, i;
+    int result = 0;
+    if (!buf) { return ENOMEM; }
+    for (blk = 0; blk < blocks && result == 0; ) {
+        for (pos = 0; pos + blockSize <= kBenchChunk && blk + pos / blockSize < blocks;
+             pos += blockSize) {
+            if (IsBlockUsed(bitmap, blk + pos / blockSize)) {
+                p = (ulong*)(buf + pos);
+                for (i = 0; i < blockSize / sizeof(ulong); i++) { p[i] = BenchRandom(seed) | 1; }
+            } else {
+                memset(buf + pos, 0, blockSize);
+            }
+        }
+        if (pwrite(fd, buf, pos, volStart + dataStart + (off_t)blk * blockSize) != pos) {
+            result = errno ? errno : EIO;
+        }
+        blk += pos / blockSize;
+    }
+    free(buf);
+    return result;
+}
+
+// Build an HFS volume of length bytes at volStart
+static int WriteHFSVolume(int fd, off_t volStart, size_t length, int bootable,
+                          double fill, ulonglong *seed) {
+    BootBlockHeader bb = {0};
+    MasterDirectoryBlock mdb = {0};
+    ulong alBlkSiz = 512 * ((length + 512 * 65535 - 1) / (512 * 65535));
+    ulong blocks, mapBlocks, alBlSt, used = 0, i;
+    uchar *bitmap;
+    int result;
+    // blocks 0-1 boot blocks, 2 MDB, then the bitmap; the last 1 KB holds
+    // the alternate MDB
+    blocks = (length - 3 * 512 - 1024) / alBlkSiz;
+    mapBlocks = (blocks / 8 + 511) / 512;
+    blocks = (length - (3 + mapBlocks) * 512 - 1024) / alBlkSiz;
+    if (blocks > 65535) { blocks = 65535; }
+    alBlSt = 3 + mapBlocks;
+    if (!(bitmap = calloc(mapBlocks, 512))) { return ENOMEM; }
+    FillBitmap(bitmap, blocks, fill, seed);
+    for (i = 0; i < blocks; i++) { used += IsBlockUsed(bitmap, i); }
+
+    if (bootable) {
+        bb.bbID = htons(0x4C4B); // 'LK'
+        bb.bbVersion = htons(0x0017);
+    }
+    mdb.drSigWord = htons(0x4244); // 'BD'
+    mdb.drCrDate = htonl(kBenchDate);
+    mdb.drLsMod = htonl(kBenchDate);
+    mdb.drVBMSt = htons(3);
+    mdb.drNmAlBlks = htons(blocks);
+    mdb.drAlBlkSiz = htonl(alBlkSiz);
+    mdb.drClpSiz = htonl(alBlkSiz * 4);
+    mdb.drAlBlSt = htons(alBlSt);
+    mdb.drNxtCNID = htonl(16);
+    mdb.drFreeBks = htons(blocks - used);
+    mdb.drVN[0] = 5;
+    memcpy(mdb.drVN + 1, "Bench", 5);
+
+    result = ftruncate(fd, volStart + length) ? errno : 0;
+    if (result == 0 && (pwrite(fd, &bb, sizeof(bb), volStart) != sizeof(bb) ||
+        pwrite(fd, &mdb, sizeof(mdb), volStart + 0x400) != sizeof(mdb) ||
+        pwrite(fd, &mdb, sizeof(mdb), volStart + length - 1024) != sizeof(mdb) ||
+        pwrite(fd, bitmap, mapBlocks * 512, volStart + 3 * 512) != mapBlocks * 512)) {
+        result = errno ? errno : EIO;
+    }
+    if (result == 0) {
+        result = WriteBlocks(fd, volStart, (off_t)alBlSt * 512, alBlkSiz, bitmap, blocks, seed);
+    }
+    free(bitmap);
+    return result;
+}
+
+// Build an HFS+ volume of length bytes at volStart, with 4 KB blocks and
+// the allocation file straight after the volume header
+static int WriteHFSPlusVolume(int fd, off_t volStart, size_t length, double fill,
+                              ulonglong *seed) {
+    HFSPlusVolumeHeader vh = {0};
+    const ulong blockSize = 4096;
+    ulong blocks = length / blockSize, mapBlocks, used = 0, i, be;
+    uchar *bitmap;
+    int result;
+    mapBlocks = (blocks / 8 + blockSize - 1) / blockSize;
+    if (!(bitmap = calloc(mapBlocks, blockSize))) { return ENOMEM; }
+    FillBitmap(bitmap, blocks, fill, seed);
+    // the header block, the bitmap itself and the alternate header block
+    for (i = 0; i <= mapBlocks; i++) { bitmap[i / 8] |= 0x80 >> (i % 8); }
+    bitmap[(blocks - 1) / 8] |= 0x80 >> ((blocks - 1) % 8);
+    for (i = 0; i < blocks; i++) { used += IsBlockUsed(bitmap, i); }
+
+    vh.signature = htons(0x482B); // 'H+'
+    vh.version = htons(4);
+    vh.createDate = htonl(kBenchDate);
+    vh.modifyDate = htonl(kBenchDate);
+    vh.blockSize = htonl(blockSize);
+    vh.totalBlocks = htonl(blocks);
+    vh.freeBlocks = htonl(blocks - used);
+    vh.nextCatalogID = htonl(16);
+    vh.allocationFile.logicalSize = OSSwapHostToBigInt64((ulonglong)mapBlocks * blockSize);
+    vh.allocationFile.totalBlocks = htonl(mapBlocks);
+    be = htonl(1); // startBlock
+    memcpy(vh.allocationFile.extents, &be, 4);
+    be = htonl(mapBlocks); // blockCount
+    memcpy(vh.allocationFile.extents + 4, &be, 4);
+
+    result = ftruncate(fd, volStart + length) ? errno : 0;
+    if (result == 0) {
+        // block 0 and the bitmap blocks are "used", so fill them with
+        // noise first and lay the real structures over the top
+        result = WriteBlocks(fd, volStart, 0, blockSize, bitmap, blocks, seed);
+    }
+    if (result == 0) {
+        char zeros[1024] = {0};
+        if (pwrite(fd, zeros, sizeof(zeros), volStart) != sizeof(zeros) ||
+            pwrite(fd, &vh, sizeof(vh), volStart + 0x400) != sizeof(vh) ||
+            pwrite(fd, &vh, sizeof(vh), volStart + length - 1024) != sizeof(vh) ||
+            pwrite(fd, bitmap, mapBlocks * blockSize, volStart + blockSize) !=
+                mapBlocks * blockSize) {
+            result = errno ? errno : EIO;
+        }
+    }
+    free(bitmap);
+    return result;
+}
+
+static void SetPartition(Partition *pme, ulong mapBlks, ulong start, ulong blocks,
+                         const char *name, const char *type, ulong status) {
+    memset(pme, 0, sizeof(Partition));
+    pme->pmSig = htons(0x504D); // 'PM'
+    pme->pmMapBlkCnt = htonl(mapBlks);
+    pme->pmPyPartStart = htonl(start);
+    pme->pmPartBlkCnt = htonl(blocks);
+    pme->pmDataCnt = htonl(blocks);
+    pme->pmPartStatus = htonl(status);
+    strncpy((char*)pme->pmPartName, name, sizeof(pme->pmPartName));
+    strncpy((char*)pme->pmPartType, type, sizeof(pme->pmPartType));
+}
+
+// Build a device image: DDR, partition map, a driver of random code with
+// a valid checksum at 0x8000, then count HFS volumes splitting length
+static int WriteAPMImage(int fd, size_t length, unsigned count, double fill,
+                         ulonglong *seed) {
+    DDRecord ddr = {0};
+    Partition pme;
+    uchar driver[9 * 1024];
+    const ulong mapBlks = 2 + count;
+    ulong volBlocks = (length / count) / 512, start = 0xC000 / 512, i;
+    int result = 0;
+    for (i = 0; i < sizeof(driver); i++) { driver[i] = (uchar)BenchRandom(seed); }
+
+    ddr.sbSig = htons(0x4552); // 'ER'
+    ddr.sbBlkSize = htons(512);
+    ddr.sbBlkCount = htonl(start + volBlocks * count);
+    ddr.sbDrvrCount = htons(1);
+    ddr.ddBlock = htonl(64);
+    ddr.ddSize = htons((sizeof(driver) + 511) / 512);
+    ddr.ddType = htons(1);
+    if (pwrite(fd, &ddr, sizeof(ddr), 0) != sizeof(ddr)) { return errno; }
+    SetPartition(&pme, mapBlks, 1, 63, "Apple", "Apple_partition_map", 0x37);
+    if (pwrite(fd, &pme, sizeof(pme), 512) != sizeof(pme)) { return errno; }
+    SetPartition(&pme, mapBlks, 64, 32, "Macintosh", "Apple_Driver43", 0x7F);
+    pme.pmBootSize = htonl(sizeof(driver));
+    pme.pmBootCksum = htonl(Checksum16(driver, sizeof(driver)));
+    strncpy((char*)pme.pmProcessor, "68000", sizeof(pme.pmProcessor));
+    if (pwrite(fd, &pme, sizeof(pme), 1024) != sizeof(pme)) { return errno; }
+    if (pwrite(fd, driver, sizeof(driver), 0x8000) != sizeof(driver)) { return errno; }
+    for (i = 0; i < count && result == 0; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "Bench %lu", (unsigned long)i + 1);
+        SetPartition(&pme, mapBlks, start, volBlocks, name, "Apple_HFS", 0x37);
+        if (pwrite(fd, &pme, sizeof(pme), (3 + i) * 512) != sizeof(pme)) { return errno; }
+        result = WriteHFSVolume(fd, (off_t)start * 512, (size_t)volBlocks * 512, 0, fill, seed);
+        start += volBlocks;
+    }
+    return result;
+}
+
+static int Generate(const BenchConfig *config, BenchImage *images) {
+    ulonglong seed = 0x4449534B; // 'DISK'
+    size_t length = config->volumeMB * 1024 * 1024;
+    int i, fd, result = 0;
+    images[0].name = "hfs";
+    images[1].name = "hfsplus";
+    images[2].name = "apm";
+    for (i = 0; i < 3 && result == 0; i++) {
+        snprintf(images[i].path, sizeof(images[i].path), "%s/bench-%s.img",
+                 config->dir, images[i].name);
+        if ((fd = open(images[i].path, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1) {
+            return errno;
+        }
+        if (i == 0) {
+            result = WriteHFSVolume(fd, 0, length, 1, config->fill, &seed);
+        } else if (i == 1) {
+            result = WriteHFSPlusVolume(fd, 0, length, config->fill, &seed);
+        } else {
+            result = WriteAPMImage(fd, length, config->partitions, config->fill, &seed);
+        }
+        // a conversion copies the first HFS partition of a device image
+        images[i].volumeBytes = (i == 2) ? (length / config->partitions) & ~511UL : length;
+        if (fsync(fd) != 0 && result == 0) { result = errno; }
+        close(fd);
+    }
+    return result;
+}
+
+// Best effort at evicting a file from the page cache
+static void DropCache(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) { return; }
+    fsync(fd);
+#if defined(POSIX_FADV_DONTNEED)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#else
+    struct stat sb;
+    void *p;
+    if (fstat(fd, &sb) == 0 && sb.st_size > 0 &&
+        (p = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0)) != MAP_FAILED) {
+        msync(p, sb.st_size, MS_INVALIDATE);
+        munmap(p, sb.st_size);
+    }
+#endif
+    close(fd);
+}
+
+typedef enum BenchOp {
+    kBenchConvertHFS = 0,
+    kBenchConvertISO,
+    kBenchDescribe,
+    kBenchChecksum
+}   BenchOp;
+
+static const char *kBenchOpNames[] = { "convert-hfs", "convert-iso", "describe", "checksum" };
+
+// Run op once on image; returns 0 or an error
+static int RunOp(BenchOp op, const BenchConfig *config, const BenchImage *image,
+                 const char *outPath) {
+    CopyOptions options = {0};
+    struct stat sb;
+    int i, fd, result = 0;
+    options.progress = &kBenchProgress;
+    switch (op) {
+        case kBenchConvertHFS:
+        case kBenchConvertISO:
+            result = ConvertFile(op == kBenchConvertISO, (char*)image->path, (char*)outPath,
+                                 0, &options, NULL);
+            break;
+        case kBenchDescribe:
+            for (i = 0; i < kBenchDescribeOps; i++) {
+                DescribeFile(image->path, kIOBackendPread, NULL);
+            }
+            break;
+        case kBenchChecksum:
+            if ((fd = open(image->path, O_RDONLY)) == -1) { return errno; }
+            if (fstat(fd, &sb) == 0) {
+                ComputeChecksum(fd, 0, sb.st_size);
+            }
+            close(fd);
+            break;
+    }
+    return result;
+}
+
+static int CompareDoubles(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Time config->runs runs of op and print the median
+static int Bench(BenchOp op, const BenchConfig *config, const BenchImage *image, int cold) {
+    char outPath[PATH_MAX];
+    double *seconds = calloc(config->runs, sizeof(double));
+    ulonglong totals[kStatsCounterCount];
+    double start, median, bytes;
+    unsigned run;
+    int result = 0;
+    struct stat sb;
+    if (!seconds) { return ENOMEM; }
+    snprintf(outPath, sizeof(outPath), "%s/bench-out.img", config->dir);
+    if (!cold) { result = RunOp(op, config, image, outPath); } // fill the cache
+    for (run = 0; run < config->runs && result == 0; run++) {
+        if (cold) { DropCache(image->path); }
+        StatsReset();
+        start = BenchNow();
+        result = RunOp(op, config, image, outPath);
+        seconds[run] = BenchNow() - start;
+    }
+    if (result != 0) {
+        fprintf(stderr, "%s %s failed (%d: %s)\n", kBenchOpNames[op], image->name,
+                result, strerror(result));
+        free(seconds);
+        return result;
+    }
+    StatsTotals(totals); // counts from the last run
+    qsort(seconds, config->runs, sizeof(double), CompareDoubles);
+    median = seconds[config->runs / 2];
+    if (op == kBenchConvertHFS || op == kBenchConvertISO) {
+        bytes = image->volumeBytes;
+    } else if (op == kBenchChecksum) {
+        bytes = (stat(image->path, &sb) == 0) ? sb.st_size : 0;
+    } else {
+        bytes = 0;
+    }
+    fprintf(stdout, "%-11s %-7s %-4s seconds=%.6f min=%.6f", kBenchOpNames[op], image->name,
+            (cold) ? "cold" : "warm", median, seconds[0]);
+    if (bytes > 0) {
+        fprintf(stdout, " MB/s=%.1f", (median > 0) ? bytes / (1024.0*1024.0) / median : 0.0);
+    } else {
+        fprintf(stdout, " ops/s=%.0f", (median > 0) ? kBenchDescribeOps / median : 0.0);
+    }
+    fprintf(stdout, " reads=%llu writes=%llu other=%llu readMB=%.1f writeMB=%.1f kernelMB=%.1f\n",
+            totals[kStatsReadCalls], totals[kStatsWriteCalls], totals[kStatsOtherCalls],
+            totals[kStatsBytesRead] / (1024.0*1024.0),
+            totals[kStatsBytesWritten] / (1024.0*1024.0),
+            totals[kStatsBytesCopied] / (1024.0*1024.0));
+    fflush(stdout);
+    unlink(outPath);
+    free(seconds);
+    return 0;
+}
+
+static void usage(const char *arg0) {
+    fprintf(stderr, "Usage: %s [-d dir] [-s MB] [-f fill] [-n partitions] [-r runs] [-k]\n", arg0);
+    fprintf(stderr, "  -d  Directory for the generated images (default /tmp)\n");
+    fprintf(stderr, "  -s  Size of each image's volume data in MB (default 64)\n");
+    fprintf(stderr, "  -f  Fraction of allocation blocks in use, 0 to 1 (default 0.5)\n");
+    fprintf(stderr, "  -n  Number of HFS partitions in the APM image (default 2)\n");
+    fprintf(stderr, "  -r  Timed runs of each benchmark; the median is reported (default 5)\n");
+    fprintf(stderr, "  -k  Keep the generated images\n");
+}
+
+int main(int argc, char **argv) {
+    BenchConfig config = { "/tmp", 64, 0.5, 2, 5, 0 };
+    BenchImage images[3];
+    BenchOp op;
+    int idx, i, cold, result = 0;
+    memset(images, 0, sizeof(images));
+
+    for (idx = 1; idx < argc; idx++) {
+        if (!strcmp(argv[idx], "-k")) {
+            config.keep = 1;
+        } else if (idx + 1 < argc && !strcmp(argv[idx], "-d")) {
+            config.dir = argv[++idx];
+        } else if (idx + 1 < argc && !strcmp(argv[idx], "-s")) {
+            config.volumeMB = strtoul(argv[++idx], NULL, 10);
+        } else if (idx + 1 < argc && !strcmp(argv[idx], "-f")) {
+            config.fill = atof(argv[++idx]);
+        } else if (idx + 1 < argc && !strcmp(argv[idx], "-n")) {
+            config.partitions = atoi(argv[++idx]);
+        } else if (idx + 1 < argc && !strcmp(argv[idx], "-r")) {
+            config.runs = atoi(argv[++idx]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (config.volumeMB < 1 || config.fill < 0 || config.fill > 1 ||
+        config.partitions < 1 || config.partitions > 60 || config.runs < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    fprintf(stdout, "# diskimagebench %d volume=%zuMB fill=%.2f partitions=%u runs=%u\n",
+            kBenchVersion, config.volumeMB, config.fill, config.partitions, config.runs);
+    if ((result = Generate(&config, images)) != 0) {
+        fprintf(stderr, "Unable to generate images in \"%s\" (%d: %s)\n", config.dir,
+                result, strerror(result));
+        goto done;
+    }
+    StatsEnable();
+    for (op = kBenchConvertHFS; op <= kBenchChecksum; op++) {
+        for (i = 0; i < 3; i++) {
+            if (op == kBenchChecksum && i != 2) { continue; } // driver checksums are APM only
+            for (cold = 1; cold >= 0; cold--) {
+                if (Bench(op, &config, &images[i], cold) != 0) { result = 1; }
+            }
+        }
+    }
+done:
+    if (!config.keep) {
+        for (i = 0; i < 3; i++) {
+            if (images[i].path[0]) { unlink(images[i].path); }
+        }
+    }
+    return result;
+}
@@ -7,12 +7,65 @@
 //  Modification History:
 //  Sun Jul 06 2025 (kcm) -- initial version
 //  Tue Jul 08 2025 (kcm) -- added option for read-only partition
+//  Fri Oct 16 2026 -- volume data copied by the DiskImageCopy engine
+//  Fri Oct 16 2026 -- added sparse output option
+//  Fri Oct 16 2026 -- added option to copy allocated blocks only
+//  Fri Oct 16 2026 -- image access goes through the DiskImageIO backends
+//  Fri Oct 16 2026 -- probe results can come from the probe index
+//  Fri Oct 16 2026 -- ConvertFile returns its result, for batch jobs
+//  Fri Oct 16 2026 -- a cancelled conversion removes its partial output
+//  Fri Oct 16 2026 -- each phase is timed for --stats
+//  Fri Oct 16 2026 -- optional digest file, hashed during the copy
+//  Fri Oct 16 2026 -- ProbeFile is shared with the verify verb
+//  Fri Oct 16 2026 -- any HFS partition of a device image can be selected
+//  Fri Oct 16 2026 -- added ExtractPartition, for splitting device images
+//  Fri Oct 16 2026 -- device image headers are built in memory for any number
+//                     of HFS volumes and written at once
+//  Fri Oct 16 2026 -- headers come from the DiskImageLayout engine; cvt2iso
+//                     writes the header and the start of the volume together
+//  Fri Oct 16 2026 -- UDIF images are converted in place, decompressing their
+//                     chunks on one thread per CPU
+//  Fri Oct 16 2026 -- optional UDIF output, the image compressed in chunks
+//                     on a thread pool
+//  Fri Oct 16 2026 -- Disk Copy 4.2 and DART images are converted in place,
+//                     checking Disk Copy checksums as the volume copies
+//  Fri Oct 16 2026 -- gzip and bzip2 images are decompressed as they copy,
+//                     on one thread per CPU where the stream allows
+//  Fri Oct 16 2026 -- optional qcow2 output, zero clusters left unallocated
+//  Fri Oct 16 2026 -- "-" converts standard input, or writes to standard
+//                     output strictly in order, lock bits set in the buffer
+//  Fri Oct 16 2026 -- a Disk Copy 4.2 checksum mismatch removes the output
 //
 //----------------------------------------------------------------------
 
 #include "DiskImageUtils.h"
 #include "DiskImageConvert.h"
-#include "Driver.h"
+#include "DiskImageCopy.h"
+#include "DiskImageIO.h"
+#include "DiskImageDescribe.h"
+#include "DiskImageStats.h"
+#include "DiskImageDigest.h"
+#include "DiskImagePartition.h"
+#include "DiskImageLayout.h"
+#include "DiskImageUDIF.h"
+#include "DiskImageQCOW2.h"
+#include "DiskImageFloppy.h"
+#include "DiskImageStream.h"
+#include "DiskImagePipe.h"
+#include "DiskImagePool.h"
+
+#define kDeviceLeadSize 0x10000 // volume bytes written along with the header
+#define kVolumeAttrOffset ((512*2) + 10) // drAtrb in the MDB
+#define kOutputPieceSize (1024*1024) // of a streamed output, read by a pool task at once
+
+// Set or clear the lock bits in drAtrb (big-endian, at attrs) as rw says
+static void SetLockBits(uchar *attrs, int rw) {
+    const ushort lockBits = (1 << HFSVolumeHardwareLockBit) | (1 << HFSVolumeSoftwareLockBit);
+    ushort volAttrs = (attrs[0] << 8) | attrs[1];
+    volAttrs = (rw) ? (volAttrs & ~lockBits) : (volAttrs | lockBits);
+    attrs[0] = volAttrs >> 8;
+    attrs[1] = volAttrs & 0xFF;
+}
 
 static int WriteHFSVolumeAttributes(int fd, off_t hfsStart, int rw) {
     int result = 0;
@@ -30,294 +83,870 @@ static int WriteHFSVolumeAttributes(int fd, off_t hfsStart, int rw) {
         volAttrs |= (1 << HFSVolumeSoftwareLockBit);
     }
     volAttrs = (ushort) htons(volAttrs);
-    if ((offset = lseek(fd, attrOffset, SEEK_SET)) == -1) {
-        return errno;
-    }
-    if ((offset = write(fd, &volAttrs, sizeof(volAttrs))) < 0) {
+    if (IOWrite(fd, &volAttrs, sizeof(volAttrs), attrOffset) < 0) {
         return errno;
     }
     return result;
 }
 
-static int WriteHFSVolumeData(int ofd, int fd, off_t rdStart, off_t wrStart, size_t hfsLen, int rw) {
+// Start the output's digest with what precedes the volume (the header
+// just written), and have it expect the lock bits the copy will patch.
+// If the first done bytes of the volume went out with the header, lock
+// bits and all, they are hashed as written, and from source (the bytes
+// as read) for the source stream.
+static int DigestOutputHeader(Digest *digest, int ofd, off_t wrStart, int rw,
+                              const char *source, size_t done) {
+    const ushort lockBits = (1 << HFSVolumeHardwareLockBit) | (1 << HFSVolumeSoftwareLockBit);
+    off_t pos = 0, end = wrStart + done;
+    size_t chunk;
+    char *buf;
+    while (pos < end) {
+        buf = DigestBuffer(digest);
+        chunk = (end - pos < 0x4000) ? end - pos : 0x4000;
+        memset(buf, 0, chunk); // the file may end short of the volume for now
+        if (IORead(ofd, buf, chunk, pos) < 0) { return errno; }
+        DigestSubmit(digest, buf, chunk, kDigestOutput);
+        pos += chunk;
+    }
+    for (pos = 0; pos < (off_t)done; pos += chunk) {
+        buf = DigestBuffer(digest);
+        chunk = (done - pos < 0x4000) ? done - pos : 0x4000;
+        memcpy(buf, source + pos, chunk);
+        DigestSubmit(digest, buf, chunk, kDigestSource);
+    }
+    if (!done) {
+        DigestPatch(digest, wrStart + kVolumeAttrOffset, (rw) ? ~lockBits : 0xFFFF,
+                    (rw) ? 0 : lockBits);
+    }
+    return 0;
+}
+
+// The extents past the first done bytes of the volume, relative to done
+static VolumeExtent *ExtentsAfter(const VolumeExtent *extents, size_t *count, size_t done) {
+    VolumeExtent *rest = malloc((*count + 1) * sizeof(VolumeExtent));
+    size_t i, n = 0;
+    off_t start, end;
+    if (!rest) { return NULL; }
+    for (i = 0; i < *count; i++) {
+        end = extents[i].offset + extents[i].length;
+        if (end <= (off_t)done) { continue; }
+        start = (extents[i].offset > (off_t)done) ? extents[i].offset : (off_t)done;
+        rest[n].offset = start - done;
+        rest[n].length = end - start;
+        n++;
+    }
+    *count = n;
+    return rest;
+}
+
+// Copy the volume past its first done bytes, which the caller has
+// already written with the lock bits set (source holds them as read);
+// with done 0 the lock bits are patched after the copy
+static int CopyHFSVolume(int ofd, int fd, off_t rdStart, off_t wrStart, size_t hfsLen,
+                         const char *source, size_t done, int rw,
+                         const CopyOptions *options) {
     int result = 0;
-    off_t rdCount, wrCount;
-    size_t chunkSize = 256*1024; // buffer 256K at a time
-    char *buf = malloc(chunkSize);
-    size_t bytesRemaining = hfsLen;
-    double percentComplete;
-    if ((rdCount = lseek(fd, rdStart, SEEK_SET)) == -1) { goto error; }
-    if ((wrCount = lseek(ofd, wrStart, SEEK_SET)) == -1) { goto error; }
-    while (bytesRemaining) {
-        rdCount = chunkSize;
-        if (bytesRemaining < rdCount) {
-            rdCount = bytesRemaining;
+    CopyStatus status;
+    StatsTimer timer;
+    VolumeExtent *extents = NULL, *rest;
+    size_t i, count = 0, used = 0;
+    if (options && options->digest) {
+        result = DigestOutputHeader(options->digest, ofd, wrStart, rw, source, done);
+        if (result != 0) {
+            return result;
+        }
+    }
+    StatsBegin(&timer, kStatsPhaseCopy);
+    if (options && options->allocatedOnly) {
+        if (ReadAllocatedExtents(fd, rdStart, hfsLen, &extents, &count) == 0) {
+            for (i = 0; i < count; i++) { used += extents[i].length; }
+            tabprint(1, "Copying %ld allocated extents (%.1f MB of %.1f MB)\n", count,
+                used / (1024.0*1024.0), hfsLen / (1024.0*1024.0));
+            if (done) {
+                rest = ExtentsAfter(extents, &count, done);
+                free(extents);
+                if (!(extents = rest)) { result = ENOMEM; }
+            }
+        } else {
+            tabprint(1, "Unable to read the volume bitmap; copying the whole volume\n");
         }
-        if ((rdCount = read(fd, buf, rdCount)) < 0) { goto error; }
-        if ((wrCount = write(ofd, buf, rdCount)) < 0) { goto error; }
-        bytesRemaining -= wrCount;
-        percentComplete = (double)(hfsLen-bytesRemaining)/hfsLen;
-        progress(percentComplete);
-    }
-    fprintf(stdout, "\n");
-    result = WriteHFSVolumeAttributes(ofd, wrStart, rw);
+    }
+    if (result != 0) {
+        // no memory for the extents
+    } else if (extents) {
+        result = CopyVolumeExtents(ofd, fd, rdStart + done, wrStart + done, hfsLen - done,
+                                   extents, count, options, &status);
+        free(extents);
+    } else {
+        result = CopyVolumeData(ofd, fd, rdStart + done, wrStart + done, hfsLen - done,
+                                options, &status);
+    }
+    StatsEnd(&timer);
+    if (result != 0) {
+        return result;
+    }
+    tabprint(0, "\n");
+    tabprint(0, "Copied volume data using %s\n", CopyMethodName(status.method));
+    if (status.bytesSkipped) {
+        tabprint(1, "Left %.1f MB of zero blocks as holes (%ld bytes)\n",
+            status.bytesSkipped / (1024.0*1024.0), status.bytesSkipped);
+    }
+    if (!done) {
+        // the copy has returned only after every stripe was written (when
+        // threaded), so the MDB is final and the lock bits are patched once
+        StatsBegin(&timer, kStatsPhaseAttributes);
+        result = WriteHFSVolumeAttributes(ofd, wrStart, rw);
+        StatsEnd(&timer);
+    }
     if (!result) {
         char *str = (rw) ? "writable" : "read-only";
         tabprint(0, "Marked HFS volume as %s\n", str);
     }
-    goto cleanup;
-error:
-    result = errno;
-    if (!result) { result = -1; }
-cleanup:
-    free(buf);
     return result;
 }
 
-static int WriteDriverDescriptionRecord(int fd, size_t hfsLen) {
-    DDRecord ddr = {0};
-    off_t count;
-    ushort blockSize = 0x200; // 512
-    // ddr, partition map and driver occupy first 0xC000 bytes of file,
-    // followed by the HFS volume data
-    ulong totalBytes = (0xC000 + hfsLen);
-    ulong totalBlks = totalBytes / blockSize;
-
-    ddr.sbSig = (ushort) htons(0x4552); // 'ER'
-    ddr.sbBlkSize = (ushort) htons(blockSize); // 512
-    ddr.sbBlkCount = (ulong) htonl(totalBlks);
-    ddr.sbDevType = (ushort) htons(1) ; // device type = 1
-    ddr.sbDevId = (ushort) htons(1) ; // device id = 1
-    ddr.sbDrvrCount = (ushort) htons(1);
-    ddr.ddBlock = (ulong) htonl(0x40); // block 64
-    ddr.ddSize = (ushort) htons(0x13); // needs 19 blocks
-    ddr.ddType = (ushort) htons(1); // MacOS = 1
+int WriteHFSVolumeData(int ofd, int fd, off_t rdStart, off_t wrStart, size_t hfsLen,
+                       int rw, const CopyOptions *options) {
+    return CopyHFSVolume(ofd, fd, rdStart, wrStart, hfsLen, NULL, 0, rw, options);
+}
 
-    // write driver descriptor record at offset 0
-    if ((count = lseek(fd, 0, SEEK_SET)) == -1) { return errno; }
-    if ((count = write(fd, &ddr, sizeof(DDRecord))) < 0) { return errno; }
+// Lay out a device image holding count volumes in layout (with room in
+// parts for count + 2 entries) and build its header in an I/O buffer of
+// kDeviceHeaderSize bytes, for the caller to free
+static int BuildDeviceHeader(const size_t *hfsLens, size_t count, int rw,
+                             LayoutPartition *parts, DeviceLayout *layout,
+                             off_t *hfsOffsets, char **header) {
+    size_t i;
+    int result;
+    if (count < 1 || count > kDeviceMaxVolumes) { return EINVAL; }
+    LayoutStandard(layout, parts, hfsLens, count, rw);
+    if ((result = LayoutPlace(layout)) != 0) { return result; }
+    if (!(*header = IOAllocBuffer(kDeviceHeaderSize))) { return ENOMEM; }
+    memset(*header, 0, kDeviceHeaderSize);
+    tabprint(1, "Building driver descriptor record and partition map\n");
+    for (i = 0; i < layout->count; i++) {
+        const LayoutPartition *p = &parts[i];
+        tabprint(2, "Partition %zu: %s (%s), blocks %lu to %lu\n", i,
+                 (p->driver) ? p->driver->name : p->name,
+                 (p->driver) ? p->driver->type : p->type,
+                 (unsigned long)p->start, (unsigned long)(p->start + p->blocks - 1));
+    }
+    LayoutBuildHeader(layout, *header);
+    for (i = 0; i < count; i++) {
+        hfsOffsets[i] = (off_t)parts[i + 2].start * kLayoutBlockSize;
+    }
     return 0;
 }
 
-/*
-    pmPartStatus (from IM:Devices 3-26):
-    Two words of status information about the partition.
-    The low-order byte of the low-order word contains status information
-    used only by the A/UX operating system:
-        Bit Meaning
-        0   Set if a valid partition map entry
-        1   Set if partition is already allocated; clear if available
-        2   Set if partition is in use; may be cleared after a system reset
-        3   Set if partition contains valid boot information
-        4   Set if partition allows reading
-        5   Set if partition allows writing
-        6   Set if boot code is position-independent
-        7   Unused
-*/
+int WriteDeviceHeader(int ofd, const size_t *hfsLens, size_t count, int rw,
+                      off_t *hfsOffsets) {
+    LayoutPartition parts[kDeviceMaxVolumes + 2];
+    DeviceLayout layout;
+    int result = 0;
+    StatsTimer timer;
+    char *header = NULL;
+    StatsBegin(&timer, kStatsPhaseHeader);
+    if ((result = BuildDeviceHeader(hfsLens, count, rw, parts, &layout, hfsOffsets,
+                                    &header)) == 0) {
+        // the whole header goes out in a single write
+        tabprint(1, "Writing header\n");
+        if (IOWrite(ofd, header, kDeviceHeaderSize, 0) < 0) { result = errno; }
+    }
+    StatsEnd(&timer);
+    free(header);
+    return result;
+}
 
-static int WriteApplePartitionMapEntry(int fd, int mapBlks) {
-    Partition pme = {0};
-    off_t count;
-    pme.pmSig = (ushort) htons(0x504D); // 'PM'
-    pme.pmMapBlkCnt = (ulong) htonl(mapBlks); // number of blocks in map
-    pme.pmPyPartStart = (ulong) htonl(1); // this one starts at block 1
-    pme.pmPartBlkCnt = (ulong) htonl(63); // 63 blocks in partition
-    strncpy(pme.pmPartName, "Apple", 5);
-    strncpy(pme.pmPartType, "Apple_partition_map", 19);
-    pme.pmDataCnt = (ulong) htonl(63); // same as pmPartBlkCnt
-    pme.pmPartStatus = (ulong) htonl(0x37); // see pmPartStatus flags
+static int WriteDeviceImage(int ofd, int fd, off_t hfsStart, size_t hfsLen,
+                            int rw, const CopyOptions *options) {
+    size_t leadLen = (hfsLen < kDeviceLeadSize) ? hfsLen : kDeviceLeadSize;
+    LayoutPartition parts[3];
+    DeviceLayout layout;
+    struct iovec iov[2];
+    StatsTimer timer;
+    char *header = NULL, *lead = NULL;
+    uchar attrHi = 0, attrLo = 0;
+    off_t wrStart;
+    int result;
+    StatsBegin(&timer, kStatsPhaseHeader);
+    if ((result = BuildDeviceHeader(&hfsLen, 1, rw, parts, &layout, &wrStart, &header)) != 0) {
+        goto done;
+    }
+    // the start of the volume (boot blocks and MDB) goes out with the
+    // header in one write, its lock bits set in memory beforehand
+    if (!(lead = IOAllocBuffer(kDeviceLeadSize))) {
+        result = ENOMEM;
+        goto done;
+    }
+    if (IORead(fd, lead, leadLen, hfsStart) != (ssize_t)leadLen) {
+        result = (errno) ? errno : EIO;
+        goto done;
+    }
+    if (leadLen < kVolumeAttrOffset + 2) {
+        leadLen = 0; // no MDB to patch; leave it all to the copy
+    } else {
+        attrHi = lead[kVolumeAttrOffset];
+        attrLo = lead[kVolumeAttrOffset + 1];
+        SetLockBits((uchar*)lead + kVolumeAttrOffset, rw);
+    }
+    iov[0].iov_base = header;
+    iov[0].iov_len = kDeviceHeaderSize;
+    iov[1].iov_base = lead;
+    iov[1].iov_len = leadLen;
+    tabprint(1, "Writing header and first %zu bytes of the volume\n", leadLen);
+    if (IOWritev(ofd, iov, (leadLen) ? 2 : 1, 0) < 0) {
+        result = errno;
+        goto done;
+    }
+    StatsEnd(&timer);
+    if (leadLen) {
+        // back to the bytes as read, for the source digest
+        lead[kVolumeAttrOffset] = attrHi;
+        lead[kVolumeAttrOffset + 1] = attrLo;
+    }
+    // write the rest of the HFS partition, from offset 0xC000 (49152)
+    tabprint(0, "Writing HFS volume data\n");
+    result = CopyHFSVolume(ofd, fd, hfsStart, wrStart, hfsLen, lead, leadLen, rw, options);
+    free(header);
+    free(lead);
+    return result;
+done:
+    StatsEnd(&timer);
+    free(header);
+    free(lead);
+    return result;
+}
+
+// What a compressed, qcow2 or streamed output is read from: the device header (if any),
+// then the volume with its lock bits set as rw says. If extents is set,
+// only those parts of the volume are read, and the rest reads as zeros.
+typedef struct OutputSource {
+    int fd;
+    off_t rdStart;
+    char *header; // wrStart bytes before the volume, or NULL
+    off_t wrStart;
+    size_t hfsLen;
+    int rw;
+    VolumeExtent *extents;
+    size_t count;
+}   OutputSource;
 
-    // write partition map entry at offset 0x200
-    if ((count = lseek(fd, 0x200, SEEK_SET)) == -1) { return errno; }
-    if ((count = write(fd, &pme, sizeof(Partition))) < 0) { return errno; }
+static int ReadVolumeRange(const OutputSource *src, char *buf, off_t start, off_t end) {
+    ssize_t got = IORead(src->fd, buf, end - start, src->rdStart + start);
+    if (got != end - start) { return (got < 0) ? errno : EIO; }
     return 0;
 }
 
-static int WriteDriverPartitionEntry(int fd, int mapBlks) {
-    Partition pme = {0};
-    off_t count;
-    pme.pmSig = (ushort) htons(0x504D); // 'PM'
-    pme.pmMapBlkCnt = (ulong) htonl(mapBlks); // number of blocks in map
-    pme.pmPyPartStart = (ulong) htonl(64); // this one starts at block 64
-    pme.pmPartBlkCnt = (ulong) htonl(32); // 32 blocks in partition
-    strncpy(pme.pmPartName, "Macintosh", 9);
-    strncpy(pme.pmPartType, "Apple_Driver43", 14);
-    pme.pmDataCnt = (ulong) htonl(32); // same as pmPartBlkCnt
-    pme.pmPartStatus = (ulong) htonl(0x7F); // see pmPartStatus flags
-    pme.pmBootSize = (ulong) htonl(sizeof(_Apple_Driver43));
-    pme.pmBootCksum = (ulong) htonl(0x0000F624); // 16-bit checksum
-    strncpy(pme.pmProcessor, "68000", 5); // processor type
-
-    // %%% mystery bytes. what is this doing? it seems to be necessary.
-    pme.pmPad[1] = 0x01; pme.pmPad[2] = 0x06;
-    pme.pmPad[11] = 0x01; pme.pmPad[13] - 0x07;
+// A UDIFSourceProc (or QCOW2SourceProc) for the output image; the lock
+// bits are set in buf, if it holds them
+static int ReadOutputImage(void *refCon, char *buf, size_t length, off_t offset) {
+    const OutputSource *src = (const OutputSource*)refCon;
+    off_t start, end, pos, stop;
+    size_t lo = 0, hi = src->count, mid;
+    int result = 0;
+    memset(buf, 0, length); // for the free blocks, and past the end of the volume
+    if (offset < src->wrStart) {
+        memcpy(buf, src->header + offset,
+               (src->wrStart - offset < (off_t)length) ? src->wrStart - offset : length);
+    }
+    // the part of the volume in range, relative to its start
+    start = ((offset > src->wrStart) ? offset : src->wrStart) - src->wrStart;
+    end = offset + length - src->wrStart;
+    if (end > (off_t)src->hfsLen) { end = src->hfsLen; }
+    if (start >= end) { return 0; }
+    buf += src->wrStart + start - offset;
+    if (!src->extents) {
+        result = ReadVolumeRange(src, buf, start, end);
+    } else {
+        while (lo < hi) { // first extent ending past start
+            mid = (lo + hi) / 2;
+            if (src->extents[mid].offset + (off_t)src->extents[mid].length <= start) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        for (; result == 0 && lo < src->count && src->extents[lo].offset < end; lo++) {
+            pos = (src->extents[lo].offset > start) ? src->extents[lo].offset : start;
+            stop = src->extents[lo].offset + src->extents[lo].length;
+            if (stop > end) { stop = end; }
+            result = ReadVolumeRange(src, buf + (pos - start), pos, stop);
+        }
+    }
+    if (result == 0 && start <= kVolumeAttrOffset && end >= kVolumeAttrOffset + 2) {
+        SetLockBits((uchar*)buf + (kVolumeAttrOffset - start), src->rw);
+    }
+    return result;
+}
 
-    // write driver partition entry at offset 0x400
-    if ((count = lseek(fd, 0x400, SEEK_SET)) == -1) { return errno; }
-    if ((count = write(fd, &pme, sizeof(Partition))) < 0) { return errno; }
+// Set src up to read the output image: the device image header (laid
+// out in parts and layout) before the volume if iso is set, and only the
+// volume's allocated extents if the options say so
+static int OpenOutputSource(int iso, int fd, off_t hfsStart, size_t hfsLen, int rw,
+                            const CopyOptions *options, LayoutPartition *parts,
+                            DeviceLayout *layout, OutputSource *src) {
+    StatsTimer timer;
+    size_t i, used = 0;
+    int result = 0;
+    memset(src, 0, sizeof(OutputSource));
+    src->fd = fd;
+    src->rdStart = hfsStart;
+    src->hfsLen = hfsLen;
+    src->rw = rw;
+    if (iso) {
+        StatsBegin(&timer, kStatsPhaseHeader);
+        result = BuildDeviceHeader(&hfsLen, 1, rw, parts, layout, &src->wrStart, &src->header);
+        StatsEnd(&timer);
+        if (result != 0) { return result; }
+    }
+    if (options->allocatedOnly) {
+        if (ReadAllocatedExtents(fd, hfsStart, hfsLen, &src->extents, &src->count) == 0) {
+            for (i = 0; i < src->count; i++) { used += src->extents[i].length; }
+            tabprint(1, "Reading %ld allocated extents (%.1f MB of %.1f MB)\n", src->count,
+                used / (1024.0*1024.0), hfsLen / (1024.0*1024.0));
+        } else {
+            tabprint(1, "Unable to read the volume bitmap; reading the whole volume\n");
+        }
+    }
     return 0;
 }
 
-static int WriteHFSPartitionEntry(int fd, int mapBlks, int writable, size_t hfsLen) {
-    Partition pme = {0};
-    off_t count;
-    ulong flags = (writable) ? 0xB7 : 0x97; // writable if bit 5 set
-    pme.pmSig = (ushort) htons(0x504D); // 'PM'
-    pme.pmMapBlkCnt = (ulong) htonl(mapBlks); // number of blocks in map
-    pme.pmPyPartStart = (ulong) htonl(96); // this one starts at block 96
-    pme.pmPartBlkCnt = (ulong) htonl(hfsLen/0x200); // size in blocks
-    strncpy(pme.pmPartName, "MacOS", 5);
-    strncpy(pme.pmPartType, "Apple_HFS", 9);
-    pme.pmDataCnt = (ulong) htonl(hfsLen/0x200); // same as pmPartBlkCnt
-    pme.pmPartStatus = (ulong) htonl(flags); // see pmPartStatus flags
+static void CloseOutputSource(OutputSource *src) {
+    free(src->extents);
+    free(src->header);
+}
 
-    // write HFS partition entry at offset 0x600
-    if ((count = lseek(fd, 0x600, SEEK_SET)) == -1) { return errno; }
-    if ((count = write(fd, &pme, sizeof(Partition))) < 0) { return errno; }
-    return 0;
+// Write the volume as a UDIF image compressed as options say: a device
+// image, with a blkx entry for the DDR and each map entry as hdiutil
+// makes them, if iso is set, or else the bare volume
+static int WriteCompressedImage(int iso, int ofd, int fd, off_t hfsStart, size_t hfsLen,
+                                int rw, const CopyOptions *options) {
+    LayoutPartition parts[3];
+    DeviceLayout layout;
+    UDIFRegion regions[4];
+    UDIFWriteOptions udifOptions = {0};
+    UDIFSummary summary;
+    OutputSource src;
+    StatsTimer timer;
+    size_t i, count = 1;
+    int result;
+    if ((result = OpenOutputSource(iso, fd, hfsStart, hfsLen, rw, options, parts, &layout,
+                                   &src)) != 0) {
+        return result;
+    }
+    memset(regions, 0, sizeof(regions));
+    if (iso) {
+        strcpy(regions[0].name, "Driver Descriptor Map (DDM : 0)");
+        regions[0].sectors = 1;
+        for (i = 0; i < layout.count; i++) {
+            const LayoutPartition *p = &parts[i];
+            snprintf(regions[count].name, sizeof(regions[count].name), "%s (%s : %zu)",
+                     (p->driver) ? p->driver->name : p->name,
+                     (p->driver) ? p->driver->type : p->type, i + 1);
+            regions[count].start = p->start;
+            regions[count].sectors = p->blocks;
+            count++;
+        }
+    } else {
+        strcpy(regions[0].name, "whole disk (Apple_HFS : 0)");
+        regions[0].sectors = (hfsLen + 511) / 512;
+    }
+    udifOptions.compression = options->compression;
+    udifOptions.threads = options->threads;
+    udifOptions.progress = options->progress;
+    StatsBegin(&timer, kStatsPhaseCopy);
+    result = UDIFWriteImage(ofd, regions, count, ReadOutputImage, &src, &udifOptions,
+                            &summary);
+    StatsEnd(&timer);
+    if (result == 0) {
+        tabprint(0, "\n");
+        tabprint(0, "Compressed %zu chunks with %s: %.1f MB stored of %.1f MB\n",
+                 summary.chunks, (options->compression == kUDIFChunkBzip2) ? "bzip2" : "zlib",
+                 summary.storedSize / (1024.0*1024.0), summary.imageSize / (1024.0*1024.0));
+        tabprint(1, "%zu compressed, %zu raw, %zu zero-fill\n",
+                 summary.zlib + summary.bzip2, summary.raw, summary.zero);
+        tabprint(0, "Marked HFS volume as %s\n", (rw) ? "writable" : "read-only");
+    }
+    CloseOutputSource(&src);
+    return result;
 }
 
-static int WriteDriverData(int fd) {
-    off_t count;
-    // driver goes after partition map at offset 0x8000 (32768)
-    if ((count = lseek(fd, 0x8000, SEEK_SET)) == -1) { return errno; }
-    if ((count = write(fd, &_Apple_Driver43[0], sizeof(_Apple_Driver43))) < 0) { return errno; }
-    return 0;
+// Write the same image WriteDeviceImage (iso) or WriteHFSVolumeData would,
+// as a qcow2 image whose all-zero clusters take no space
+static int WriteQCOW2Image(int iso, int ofd, int fd, off_t hfsStart, size_t hfsLen,
+                           int rw, const CopyOptions *options) {
+    LayoutPartition parts[3];
+    DeviceLayout layout;
+    QCOW2WriteOptions qcowOptions = {0};
+    QCOW2Summary summary;
+    OutputSource src;
+    StatsTimer timer;
+    int result;
+    if ((result = OpenOutputSource(iso, fd, hfsStart, hfsLen, rw, options, parts, &layout,
+                                   &src)) != 0) {
+        return result;
+    }
+    qcowOptions.threads = options->threads;
+    qcowOptions.progress = options->progress;
+    StatsBegin(&timer, kStatsPhaseCopy);
+    result = QCOW2WriteImage(ofd, src.wrStart + hfsLen, ReadOutputImage, &src, &qcowOptions,
+                             &summary);
+    StatsEnd(&timer);
+    if (result == 0) {
+        tabprint(0, "\n");
+        tabprint(0, "Allocated %zu of %zu clusters: %.1f MB stored of %.1f MB\n",
+                 summary.allocated, summary.clusters,
+                 summary.allocated * (double)(1 << kQCOW2ClusterBits) / (1024.0*1024.0),
+                 summary.imageSize / (1024.0*1024.0));
+        tabprint(0, "Marked HFS volume as %s\n", (rw) ? "writable" : "read-only");
+    }
+    CloseOutputSource(&src);
+    return result;
 }
 
-static int WriteDeviceImage(int ofd, int fd, off_t hfsStart, size_t hfsLen, int rw) {
-    int result = 0;
-    // number of blocks (entries) in our partition map
-    const int mapBlks = 3;
-    // write driver descriptor record (block 0)
-    tabprint(1, "Writing driver descriptor record\n");
-    if ((result = WriteDriverDescriptionRecord(ofd, hfsLen)) != 0) {
-        goto done;
+// Pieces of a streamed output, from start on, read side by side
+typedef struct OutputWindow {
+    OutputSource *src;
+    ulonglong size;
+    ulonglong start;
+    char **pieces;
+}   OutputWindow;
+
+static int ReadOutputPiece(void *refCon, size_t taskIndex, unsigned worker) {
+    OutputWindow *window = (OutputWindow*)refCon;
+    ulonglong offset = window->start + (ulonglong)taskIndex * kOutputPieceSize;
+    size_t length = (window->size - offset < kOutputPieceSize) ? window->size - offset :
+                    kOutputPieceSize;
+    return ReadOutputImage(window->src, window->pieces[taskIndex], length, offset);
+}
+
+// Write the same image WriteDeviceImage (iso) or WriteHFSVolumeData would
+// to ofd strictly in order, for a pipe: the header, then the volume, its
+// lock bits set in the piece holding the MDB before that goes out, as
+// nothing written can be gone back to. Pieces are read a window at a
+// time, on threads if the options say so, and written in order.
+static int WriteStreamedImage(int iso, int ofd, int fd, off_t hfsStart, size_t hfsLen,
+                              int rw, const CopyOptions *options, ulonglong *written) {
+    LayoutPartition parts[3];
+    DeviceLayout layout;
+    OutputSource src;
+    OutputWindow window = {0};
+    ProgressTracker tracker;
+    StatsTimer timer;
+    unsigned threads = (options->threads) ? options->threads : 1;
+    ulonglong pos = 0;
+    size_t i, n, length;
+    int result;
+    *written = 0;
+    if ((result = OpenOutputSource(iso, fd, hfsStart, hfsLen, rw, options, parts, &layout,
+                                   &src)) != 0) {
+        return result;
     }
-    // write partition map entry (block 1)
-    tabprint(1, "Writing Apple partition map\n");
-    if ((result = WriteApplePartitionMapEntry(ofd, mapBlks)) != 0) {
+    window.src = &src;
+    window.size = src.wrStart + hfsLen;
+    if (!(window.pieces = calloc(threads, sizeof(char*)))) {
+        result = ENOMEM;
         goto done;
     }
-    // write driver partition entry (block 2)
-    tabprint(1, "Writing driver partition\n");
-    if ((result = WriteDriverPartitionEntry(ofd, mapBlks)) != 0) {
-        goto done;
+    for (i = 0; i < threads; i++) {
+        if (!(window.pieces[i] = IOAllocBuffer(kOutputPieceSize))) {
+            result = ENOMEM;
+            goto done;
+        }
     }
-    // write HFS partition entry (block 3)
-    tabprint(1, "Writing HFS partition\n");
-    if ((result = WriteHFSPartitionEntry(ofd, mapBlks, rw, hfsLen)) != 0) {
-        goto done;
+    StatsBegin(&timer, kStatsPhaseCopy);
+    ProgressStart(&tracker, options->progress, window.size);
+    while (result == 0 && pos < window.size) {
+        window.start = pos;
+        n = (window.size - pos + kOutputPieceSize - 1) / kOutputPieceSize;
+        if (n > threads) { n = threads; }
+        result = PoolRun(threads, n, ReadOutputPiece, &window);
+        for (i = 0; result == 0 && i < n; i++) {
+            length = (window.size - pos < kOutputPieceSize) ? window.size - pos :
+                     kOutputPieceSize;
+            if (IOWriteNext(ofd, window.pieces[i], length) < 0) {
+                result = errno;
+                break;
+            }
+            pos += length;
+            result = ProgressAdvance(&tracker, length);
+        }
     }
-    // write driver: sizeof(_Apple_Driver43) at offset 0x8000 (32768)
-    tabprint(1, "Writing driver data\n");
-    if ((result = WriteDriverData(ofd)) != 0) {
-        goto done;
+    if (result == 0) { ProgressFinish(&tracker); }
+    StatsEnd(&timer);
+    *written = pos;
+    if (result == 0) {
+        tabprint(0, "\n");
+        tabprint(0, "Marked HFS volume as %s\n", (rw) ? "writable" : "read-only");
     }
-    // write HFS partition: hfsLen bytes at offset 0xC000 (49152)
-    tabprint(0, "Writing HFS volume data\n");
-    result = WriteHFSVolumeData(ofd, fd, hfsStart, 0xC000, hfsLen, rw);
 done:
+    if (window.pieces) {
+        for (i = 0; i < threads; i++) { free(window.pieces[i]); }
+    }
+    free(window.pieces);
+    CloseOutputSource(&src);
     return result;
 }
 
-// find the offset and length in bytes of the first HFS partition
-static int ProbePartitionMap(int fd, size_t fileSize, off_t *hfsStart, size_t *hfsLen) {
-    Partition pme;
-    char ptype[34];
-    const off_t kBlockSize = 512;
-    off_t pmeOffset = kBlockSize; // partition map starts at block 1
-    off_t partOffset; // in bytes
-    size_t partLength; // in bytes
-    memset(ptype, 0, sizeof(ptype));
+// find the offset and length in bytes of the HFS partition to convert:
+// map entry partition-1, or the first HFS one if partition is 0
+static int ProbePartitionMap(const ImageRecord *record, unsigned partition,
+                             off_t *hfsStart, size_t *hfsLen) {
+    const PartitionRecord *part;
+    ulong i;
 
-    while (pmeOffset) {
-        if (ReadPartitionMapEntry(fd, pmeOffset, &pme) != 0) { break; }
-        if (pme.pmSig != 0x504D) { break; } // 'PM'
-        partOffset = pme.pmPyPartStart * kBlockSize;
-        partLength = pme.pmPartBlkCnt * kBlockSize;
-        memcpy(ptype, (char*)pme.pmPartType, 32);
-        if (!strncmp(ptype, "Apple_HFS", strlen(ptype))) {
-            if (partOffset > fileSize) { return -1; } // bad
-            while ((partLength >= kBlockSize) &&
-                   ((partOffset + partLength) > fileSize)) {
-                // truncate partition length to fit inside file length
-                partLength -= kBlockSize;
-            }
-            *hfsStart = partOffset;
-            *hfsLen = partLength;
-            return 0;
+    for (i = 0; i < record->partitionCount; i++) {
+        part = &record->partitions[i];
+        if (partition && i != partition - 1) { continue; }
+        if (PartitionTypeIsHFS(part->type)) {
+            return PartitionExtent(part->start, part->blocks, record->fileSize,
+                                   hfsStart, hfsLen);
         }
-        pmeOffset += kBlockSize; // next partition map entry
     }
     return -1;
 }
 
-// find the offset and length in bytes of the HFS volume
-static int ProbeFile(int fd, size_t *fileSize, off_t *hfsStart, size_t *hfsLen) {
-    DDRecord ddr;
-    ushort hfsSig = 0;
-    int result = 0;
-    struct stat sb = {0};
-    if (fstat(fd, &sb) < 0) { return errno; }
-    *fileSize = sb.st_size;
-    if (ReadDriverDescriptorRecord(fd, 0, &ddr) != 0) { return -1; }
-
-    // secondary check for HFS or HFS+ sig if this is a volume image
-    if (!((ReadUShort(fd, 0x400, &hfsSig) == 0) &&
-        (hfsSig == 0x4244 || hfsSig == 0x482B))) { // HFS or HFS+
-        hfsSig = 0;
-    }
-    if (ddr.sbSig == 0x4552) { // 'ER'
-        return ProbePartitionMap(fd, sb.st_size, hfsStart, hfsLen);
-    } else if ((ddr.sbSig == 0x4C4B) || // 'LK'
-               (ddr.sbSig == 0x0000 && hfsSig != 0))  {
+// find the offset and length in bytes of the HFS volume, from the index
+// if it has a record for this file
+int ProbeFile(int fd, const char *path, ImageIndex *index, unsigned partition,
+              size_t *fileSize, off_t *hfsStart, size_t *hfsLen) {
+    ImageRecord *record = NULL;
+    ImageKey key;
+    int keyed = 0, result = -1;
+    if (index && IndexMakeKey(index, path, fd, &key) == 0) {
+        keyed = 1;
+        record = IndexLookup(index, &key);
+    }
+    if (!record) {
+        if (!(record = ProbeImage(fd))) { return errno; }
+        if (keyed && record->format != kImageFormatUnreadable) {
+            IndexStore(index, &key, path, record);
+        }
+    }
+    *fileSize = record->fileSize;
+    if (record->format == kImageFormatAPM) {
+        result = ProbePartitionMap(record, partition, hfsStart, hfsLen);
+    } else if (record->format == kImageFormatHFSBootable ||
+               record->format == kImageFormatHFS) {
         *hfsStart = 0;
         *hfsLen = *fileSize;
-        return 0;
+        result = 0;
     }
-    return -1; // can't get HFS volume
+    free(record);
+    return result; // -1 if we can't get HFS volume
 }
 
-void ConvertFile(int iso, char *inPath, char *outPath, int rw) {
+static void PrintDigest(FILE *file, const char *prefix, const DigestValue *value) {
+    int i;
+    fprintf(file, "%ssha256: ", prefix);
+    for (i = 0; i < 32; i++) { fprintf(file, "%02x", value->sha256[i]); }
+    fprintf(file, "\n%scrc32c: %08x\n", prefix, value->crc32c);
+}
+
+// Record the output's digests, and those of the source range it was
+// copied from, in "<outPath>.digests" beside it
+static int WriteDigestFile(const char *inPath, const char *outPath, off_t hfsStart, size_t hfsLen,
+                           const DigestValue *source, const DigestValue *output) {
+    char *path = malloc(strlen(outPath) + 9);
+    const char *name = strrchr(outPath, '/');
+    FILE *file;
+    int result = 0;
+    if (!path) { return ENOMEM; }
+    sprintf(path, "%s.digests", outPath);
+    if (!(file = fopen(path, "w"))) {
+        result = errno;
+        free(path);
+        return result;
+    }
+    fprintf(file, "file: %s\n", (name) ? name + 1 : outPath);
+    fprintf(file, "size: %llu\n", output->length);
+    PrintDigest(file, "", output);
+    fprintf(file, "source: %s\n", inPath);
+    fprintf(file, "source-offset: %lld\n", (long long)hfsStart);
+    fprintf(file, "source-length: %llu\n", (ulonglong)hfsLen);
+    if (source->length) {
+        PrintDigest(file, "source-", source);
+    } else { // only the allocated blocks were read
+        fprintf(file, "source-sha256: none (source partly unread)\n");
+    }
+    if (fclose(file) != 0) { result = errno; }
+    if (result == 0) { tabprint(0, "Wrote digests to \"%s\"\n", path); }
+    free(path);
+    return result;
+}
+
+// Write the volume at hfsStart in fd to outPath as a device image (iso),
+// an HFS volume image (hfs), or otherwise as raw bytes, reporting the
+// result. Either kind of image is compressed into a UDIF image, or
+// written as a qcow2 image, if the options say so. A cancelled output is
+// removed. If ofd isn't -1 the image goes to it (standard output) in
+// order instead, and ofd is closed.
+static int WriteOutputFile(int iso, int hfs, int fd, const char *inPath, off_t hfsStart,
+                           size_t hfsLen, const char *outPath, int ofd, int rw,
+                           const CopyOptions *options) {
     struct stat sb = {0};
-    int fd = -1, ofd = -1;
-    int result;
+    int result = 0;
+    IOBackend backend = (options) ? options->backend : kIOBackendPread;
+    int streamed = (ofd != -1);
+    int compressed = (hfs && options && options->compression);
+    int qcow2 = (hfs && options && options->qcow2);
+    CopyOptions digestOptions, streamOptions = {0};
+    CopyStatus status;
+    Digest *digest = NULL;
+    DigestValue source, output;
+    ulonglong written = 0;
+    StatsTimer timer;
+    if (streamed) {
+        tabprint(0, "Output: standard output\n");
+    } else {
+        tabprint(0, "Output file: \"%s\"\n", outPath);
+        StatsBegin(&timer, kStatsPhaseOpen);
+        ofd = IOOpen(outPath, O_RDWR | O_CREAT | O_TRUNC, 0600, backend);
+        StatsEnd(&timer);
+    }
+    if (ofd == -1) {
+        result = errno;
+        tabprint(0, "Unable to create output file (%d)\n", outPath, errno);
+        goto done;
+    }
+    if (streamed && options && options->writeDigests) {
+        tabprint(0, "Digests are not written for output to standard output\n");
+    } else if ((compressed || qcow2) && options->writeDigests) {
+        tabprint(0, "Digests are not written for compressed or qcow2 output\n");
+    } else if (options && options->writeDigests) { // hash alongside the copy
+        if (!(digest = CopyDigestCreate())) {
+            result = ENOMEM;
+            goto done;
+        }
+        digestOptions = *options;
+        digestOptions.digest = digest;
+        options = &digestOptions;
+    }
+    if (streamed) { // either of the below, front to back
+        tabprint(0, "Writing %s in order\n",
+                 (iso) ? "Apple partition map device image" : "HFS volume data");
+        if (options) { streamOptions = *options; }
+        result = WriteStreamedImage(iso, ofd, fd, hfsStart, hfsLen, rw, &streamOptions,
+                                    &written);
+    } else if (compressed) { // either of the below, in a UDIF container
+        tabprint(0, "Writing %s as a compressed UDIF image\n",
+                 (iso) ? "Apple partition map device image" : "HFS volume data");
+        result = WriteCompressedImage(iso, ofd, fd, hfsStart, hfsLen, rw, options);
+    } else if (qcow2) { // likewise, as a qcow2 image
+        tabprint(0, "Writing %s as a qcow2 image\n",
+                 (iso) ? "Apple partition map device image" : "HFS volume data");
+        result = WriteQCOW2Image(iso, ofd, fd, hfsStart, hfsLen, rw, options);
+    } else if (iso) { // Apple partition map device image
+        tabprint(0, "Writing Apple partition map device image\n");
+        result = WriteDeviceImage(ofd, fd, hfsStart, hfsLen, rw, options);
+    } else if (hfs) { // HFS volume image, just the raw bytes at offset 0
+        tabprint(0, "Writing HFS volume data\n");
+        result = WriteHFSVolumeData(ofd, fd, hfsStart, 0, hfsLen, rw, options);
+    } else { // some other partition, copied as it stands
+        tabprint(0, "Writing partition data\n");
+        StatsBegin(&timer, kStatsPhaseCopy);
+        result = CopyVolumeData(ofd, fd, hfsStart, 0, hfsLen, options, &status);
+        StatsEnd(&timer);
+    }
+    if (streamed) {
+        sb.st_size = written;
+    } else if (fstat(ofd, &sb) < 0) {
+        result = errno;
+    }
+    if (result == 0 && digest) {
+        DigestFinish(digest, &source, &output);
+        result = WriteDigestFile(inPath, outPath, hfsStart, hfsLen, &source, &output);
+    }
+    if (result == 0) {
+        tabprint(0, "Wrote %lld bytes to %s.\n", sb.st_size,
+                 (streamed) ? "standard output" : "output file");
+        if (!streamed && options && (options->sparse || options->allocatedOnly)) {
+            tabprint(0, "Output file uses %lld bytes on disk.\n", (long long)sb.st_blocks * 512);
+        }
+    } else if (result == ECANCELED && streamed) {
+        tabprint(0, "\n");
+        tabprint(0, "Conversion cancelled; the output is incomplete\n");
+    } else if (result == ECANCELED) {
+        tabprint(0, "\n");
+        tabprint(0, "Conversion cancelled; removing \"%s\"\n", outPath);
+        unlink(outPath);
+    } else if (result == EILSEQ && streamed) { // from a Disk Copy 4.2 image's last read
+        tabprint(0, "\n");
+        tabprint(0, "The image's data checksum doesn't match; the output is not to be trusted\n");
+    } else if (result == EILSEQ) {
+        tabprint(0, "\n");
+        tabprint(0, "The image's data checksum doesn't match; removing \"%s\"\n", outPath);
+        unlink(outPath);
+    } else {
+        tabprint(0, "An error occurred writing the image: %d\n", result);
+    }
+done:
+    if (digest) { DigestFree(digest); }
+    StatsBegin(&timer, kStatsPhaseClose);
+    if (ofd != -1) { IOClose(ofd); }
+    StatsEnd(&timer);
+    return result;
+}
+
+int ExtractPartition(int fd, const char *inPath, off_t offset, size_t length, int hfs,
+                     const char *outPath, int rw, const CopyOptions *options) {
+    CopyOptions plain;
+    if (options && (options->compression || options->qcow2)) { // split writes plain images
+        plain = *options;
+        plain.compression = 0;
+        plain.qcow2 = 0;
+        options = &plain;
+    }
+    return WriteOutputFile(0, hfs, fd, inPath, offset, length, outPath, -1, rw, options);
+}
+
+static void ReportDiskCopyChecksums(const FloppySummary *floppy) {
+    switch (floppy->checksum) {
+        case kFloppyChecksumGood:
+            tabprint(0, "Disk Copy 4.2 checksums match\n");
+            break;
+        case kFloppyChecksumBadData:
+            tabprint(0, "Disk Copy 4.2 data checksum doesn't match (0x%08lX in the header);\n",
+                     (unsigned long)floppy->dataChecksum);
+            tabprint(0, "the image is damaged\n");
+            break;
+        case kFloppyChecksumBadTags:
+            tabprint(0, "Disk Copy 4.2 tag checksum doesn't match; the tags aren't copied\n");
+            break;
+        default:
+            tabprint(1, "Disk Copy 4.2 checksums not checked (the whole disk wasn't read)\n");
+            break;
+    }
+}
+
+int ConvertFile(int iso, char *inPath, char *outPath, int rw, const CopyOptions *options,
+                ImageIndex *index) {
+    int fd = -1;
+    int result = 0;
     size_t fileSize;
     off_t hfsStart;
     size_t hfsLen;
-    if ((fd = open(inPath, O_RDONLY, 0)) == -1) {
+    IOBackend backend = (options) ? options->backend : kIOBackendPread;
+    unsigned partition = (options) ? options->partition : 0;
+    CopyOptions udifOptions = {0};
+    UDIFSummary udif;
+    FloppySummary floppy;
+    StreamSummary stream;
+    int compressed = 0, floppyImage = 0, streamed = 0, piped = 0;
+    int ofd = -1, savedStdout = -1;
+    StatsTimer timer;
+    if (!strcmp(outPath, "-")) {
+        // the image goes to standard output, so what we print goes to
+        // standard error until we return
+        fflush(stdout);
+        if ((ofd = dup(STDOUT_FILENO)) == -1 || (savedStdout = dup(STDOUT_FILENO)) == -1 ||
+            dup2(STDERR_FILENO, STDOUT_FILENO) == -1) {
+            result = errno;
+            tabprint(0, "Unable to write to standard output (%d)\n", errno);
+            goto done;
+        }
+        if (options && (options->compression || options->qcow2)) {
+            // both write their tables after the data, and the header last
+            tabprint(0, "UDIF and qcow2 images can't be written to standard output\n");
+            result = ESPIPE;
+            goto done;
+        }
+    }
+    StatsBegin(&timer, kStatsPhaseOpen);
+    fd = OpenImage(inPath, backend);
+    StatsEnd(&timer);
+    if (fd == -1) {
+        result = errno;
         tabprint(0, "Unable to open \"%s\" (%d)\n", inPath, errno);
         goto done;
     }
-    result = ProbeFile(fd, &fileSize, &hfsStart, &hfsLen);
+    if ((piped = PipeAttached(fd)) != 0) {
+        // read once, in order; the bitmap -a reads can lie past the
+        // volume's start, which would be gone by the time it's copied
+        if (options) { udifOptions = *options; }
+        udifOptions.threads = 1;
+        if (udifOptions.allocatedOnly) {
+            tabprint(0, "Copying the whole volume: -a doesn't apply to a pipe\n");
+            udifOptions.allocatedOnly = 0;
+        }
+        options = &udifOptions;
+        index = NULL; // which has nothing to go by
+    } else if ((compressed = UDIFAttached(fd, &udif)) != 0) {
+        // decompressing is the bottleneck, so spread it over the CPUs
+        // unless -j said otherwise (a digest still needs a serial copy)
+        if (options) { udifOptions = *options; }
+        if (udifOptions.threads == 0) { udifOptions.threads = PoolDefaultThreads(); }
+        options = &udifOptions;
+    } else if ((floppyImage = FloppyAttached(fd, &floppy)) != 0) {
+        // a floppy copies in a moment; in order, its checksum folds as it goes
+        if (options) { udifOptions = *options; }
+        udifOptions.threads = 1;
+        options = &udifOptions;
+    } else if ((streamed = StreamAttached(fd, &stream)) != 0) {
+        // stripes decode side by side from the stream's points, if they're
+        // close enough together; otherwise it can only be read in order
+        if (options) { udifOptions = *options; }
+        if (!stream.seekable) {
+            udifOptions.threads = 1;
+        } else if (udifOptions.threads == 0) {
+            udifOptions.threads = PoolDefaultThreads();
+        }
+        options = &udifOptions;
+    }
+    StatsBegin(&timer, kStatsPhaseProbe);
+    result = ProbeFile(fd, inPath, index, partition, &fileSize, &hfsStart, &hfsLen);
+    StatsEnd(&timer);
     tabprint(0, "Input file: \"%s\"\n", inPath);
-    tabprint(0, "Input file size: %ld bytes\n", fileSize);
-    if (result != 0) {
+    if (compressed) {
+        tabprint(0, "UDIF image: %zu chunks in %zu tables, %.1f MB stored\n", udif.chunks,
+                 udif.tables, udif.storedSize / (1024.0*1024.0));
+        tabprint(1, "zlib %zu, bzip2 %zu, ADC %zu, raw %zu, zero %zu\n", udif.zlib,
+                 udif.bzip2, udif.adc, udif.raw, udif.zero);
+        tabprint(0, "Image size: %ld bytes\n", fileSize);
+    } else if (floppyImage && floppy.format == kFloppyDiskCopy42) {
+        tabprint(0, "Disk Copy 4.2 image: \"%s\", %llu bytes of tags\n", floppy.name,
+                 floppy.tagSize);
+        tabprint(0, "Image size: %ld bytes\n", fileSize);
+    } else if (floppyImage) {
+        tabprint(0, "DART image: %zu blocks, %s\n", floppy.blocks,
+                 (floppy.compression == kDARTCompressRLE) ? "RLE compressed" :
+                 (floppy.compression == kDARTCompressLZH) ? "LZH compressed" : "uncompressed");
+        tabprint(0, "Image size: %ld bytes\n", fileSize);
+    } else if (streamed) {
+        tabprint(0, "%s stream: %zu member%s, %.1f MB compressed, %zu restart points%s\n",
+                 StreamFormatName(stream.format), stream.members,
+                 (stream.members == 1) ? "" : "s", stream.storedSize / (1024.0*1024.0),
+                 stream.points, (stream.seekable) ? "" : " (read in order)");
+        tabprint(0, "Image size: %ld bytes\n", fileSize);
+    } else if (piped) {
+        tabprint(0, "Input is a pipe, read in order\n");
+        tabprint(0, "Image size: %ld bytes, from its headers\n", fileSize);
+    } else {
+        tabprint(0, "Input file size: %ld bytes\n", fileSize);
+    }
+    if (result == -1 && partition) {
+        tabprint(0, "Partition %u is not an HFS volume in this image\n", partition - 1);
+        goto done;
+    } else if (result != 0) {
         tabprint(0, "Unable to find HFS volume (error %d)\n", result);
         goto done;
     } else {
         tabprint(0, "HFS volume found at offset %lld, length %lld\n", hfsStart, hfsLen);
     }
-    tabprint(0, "Output file: \"%s\"\n", outPath);
-    if ((ofd = open(outPath, O_RDWR | O_CREAT | O_TRUNC, 0600)) == -1) {
-        tabprint(0, "Unable to create output file (%d)\n", outPath, errno);
-        goto done;
-    }
-    if (iso) { // Apple partition map device image
-        tabprint(0, "Writing Apple partition map device image\n");
-        result = WriteDeviceImage(ofd, fd, hfsStart, hfsLen, rw);
-    } else { // HFS volume image, just the raw bytes at offset 0
-        tabprint(0, "Writing HFS volume data\n");
-        result = WriteHFSVolumeData(ofd, fd, hfsStart, 0, hfsLen, rw);
-    }
-    if (fstat(ofd, &sb) < 0) { result = errno; }
-    if (result == 0) {
-        tabprint(0, "Wrote %lld bytes to output file.\n", sb.st_size);
-    } else {
-        tabprint(0, "An error occurred writing the image: %d\n", result);
+    result = WriteOutputFile(iso, 1, fd, inPath, hfsStart, hfsLen, outPath, ofd, rw, options);
+    ofd = -1; // closed by WriteOutputFile
+    if (floppyImage && FloppyAttached(fd, &floppy) && floppy.format == kFloppyDiskCopy42) {
+        ReportDiskCopyChecksums(&floppy);
     }
 done:
-    if (fd != -1) { close(fd); }
+    StatsBegin(&timer, kStatsPhaseClose);
+    if (fd != -1) { IOClose(fd); }
     if (ofd != -1) { close(ofd); }
+    StatsEnd(&timer);
+    if (savedStdout != -1) {
+        fflush(stdout);
+        dup2(savedStdout, STDOUT_FILENO);
+        close(savedStdout);
+    }
+    return result;
 }
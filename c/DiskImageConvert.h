@@ -7,6 +7,18 @@
 //  Modification History:
 //  Sun Jul 06 2025 (kcm) -- initial version
 //  Tue Jul 08 2025 (kcm) -- added option for read-only partition
+//  Fri Oct 16 2026 -- added copy options (sparse output)
+//  Fri Oct 16 2026 -- added the probe index
+//  Fri Oct 16 2026 -- ConvertFile returns 0, -1 if the input holds no HFS
+//                     volume, or an errno value
+//  Fri Oct 16 2026 -- ECANCELED when the options' cancel token is set
+//  Fri Oct 16 2026 -- exported ProbeFile
+//  Fri Oct 16 2026 -- ProbeFile takes the partition to use
+//  Fri Oct 16 2026 -- added ExtractPartition
+//  Fri Oct 16 2026 -- exported the device header and volume writers
+//  Fri Oct 16 2026 -- WriteDeviceHeader builds from the standard DiskImageLayout
+//  Fri Oct 16 2026 -- ConvertFile writes UDIF images if the options' compression is set
+//  Fri Oct 16 2026 -- ConvertFile takes "-" for standard input and output
 //
 //----------------------------------------------------------------------
 
@@ -14,11 +26,53 @@
 #ifndef __diskimageconvert_h__
 #define __diskimageconvert_h__
 
+#include "DiskImageCopy.h"
+#include "DiskImageIndex.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-void ConvertFile(int iso, char *inFilePath, char *outFilePath, int rw);
+#define kDeviceHeaderSize 0xC000 // DDR, partition map and driver; volumes follow
+#define kDeviceMaxVolumes 61 // map entries left beside the map and driver
+
+// Convert the HFS volume in inFilePath to outFilePath. Either may be "-":
+// standard input is read in order if it's a pipe (see DiskImagePipe.h),
+// and standard output is written in order, never seeking, with what
+// would be printed going to standard error instead. Output to standard
+// output can't be compressed or qcow2 (ESPIPE).
+int ConvertFile(int iso, char *inFilePath, char *outFilePath, int rw,
+                const CopyOptions *options, ImageIndex *index);
+
+// Find the offset and length in bytes of the HFS volume in fd, using the
+// index if it has a record for path. In a device image this is map entry
+// partition-1 (as info numbers them), or the first HFS partition if
+// partition is 0; raw volume images ignore it. Returns 0, -1 if there is
+// no such HFS volume, or an errno.
+int ProbeFile(int fd, const char *path, ImageIndex *index, unsigned partition,
+              size_t *fileSize, off_t *hfsStart, size_t *hfsLen);
+
+// Write the header of a device image holding count HFS volumes of the
+// given lengths, with a map entry for each, in a single write. The
+// header is built from LayoutStandard (see DiskImageLayout.h), so the
+// volumes are laid out from kDeviceHeaderSize in whole 512-byte blocks,
+// and hfsOffsets gets where each one goes. Returns 0 or an errno value.
+int WriteDeviceHeader(int ofd, const size_t *hfsLens, size_t count, int rw,
+                      off_t *hfsOffsets);
+
+// Copy hfsLen bytes of HFS volume at rdStart in fd to wrStart in ofd and
+// set its lock bits as rw says. Only the volume's own range of ofd is
+// written, so copies into different ranges may run at once.
+int WriteHFSVolumeData(int ofd, int fd, off_t rdStart, off_t wrStart, size_t hfsLen,
+                       int rw, const CopyOptions *options);
+
+// Copy length bytes at offset in fd, an image opened from inPath, to a
+// new file at outPath: as an HFS volume image (with the lock bits set
+// as rw says) if hfs is set, or byte for byte otherwise. Safe to call on
+// several threads sharing fd. The options' compression is ignored.
+// Returns 0, ECANCELED, or an errno value.
+int ExtractPartition(int fd, const char *inPath, off_t offset, size_t length, int hfs,
+                     const char *outPath, int rw, const CopyOptions *options);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,536 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageCopy.c
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version (kernel copy and reflink paths)
+//  Fri Oct 16 2026 -- added sparse output mode
+//  Fri Oct 16 2026 -- added extent list copies (allocated blocks only)
+//  Fri Oct 16 2026 -- added io_uring engine
+//  Fri Oct 16 2026 -- added multi-threaded striped copies
+//  Fri Oct 16 2026 -- reads and writes go through the DiskImageIO backends
+//  Fri Oct 16 2026 -- scratch buffers can be reused across jobs
+//  Fri Oct 16 2026 -- progress callbacks and cancellation
+//  Fri Oct 16 2026 -- counts the engine's other system calls for --stats
+//  Fri Oct 16 2026 -- copied data can be hashed in the same pass
+//  Fri Oct 16 2026 -- filtered inputs are copied through user space
+//
+//----------------------------------------------------------------------
+
+#ifdef __linux__
+#define _GNU_SOURCE // copy_file_range
+#endif
+#include <pthread.h>
+#include "DiskImageUtils.h"
+#include "DiskImageCopy.h"
+#include "DiskImageIO.h"
+#include "DiskImagePool.h"
+#include "DiskImageURing.h"
+#include "DiskImageStats.h"
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h> // FICLONERANGE
+#endif
+
+#define kBufferedChunkSize (256*1024) // buffer 256K at a time
+#define kKernelChunkSize (8*1024*1024) // kernel copies are cheap, use 8MB
+#define kSparseBlockSize 4096 // granularity of the all-zero check
+#define kStripeSize (4*1024*1024) // unit of work for threaded copies
+
+// State shared by the copy paths for the duration of one job
+typedef struct CopyContext {
+    int ofd;
+    int fd;
+    int sparse;
+    int uring;
+    unsigned queueDepth;
+    unsigned threads;
+    int cached; // both files use the default (page cache) backend
+    int filtered; // the input is read through an IOFilter (e.g. UDIF)
+    pthread_mutex_t lock; // guards the counters below when threaded
+    ProgressTracker tracker; // bytes covered so far, of the whole job
+    off_t outSize; // size of the output before the job started
+    char *buffer; // kBufferedChunkSize staging buffer for serial copies
+    char *zeros; // kBufferedChunkSize zero bytes
+    Digest *digest; // hashes the data in order, if set
+    size_t methodBytes[kCopyMethodCount]; // bytes moved by each method
+    CopyStatus *status;
+}   CopyContext;
+
+const char *CopyMethodName(CopyMethod method) {
+    switch (method) {
+        case kCopyMethodClone: return "reflink clone";
+        case kCopyMethodKernel: return "in-kernel copy";
+        case kCopyMethodSparse: return "sparse read/write";
+        case kCopyMethodURing: return "io_uring";
+        case kCopyMethodStriped: return "striped pread/pwrite";
+        default: return "buffered read/write";
+    }
+}
+
+int CopyBuffersAlloc(CopyBuffers *buffers) {
+    buffers->data = IOAllocBuffer(kBufferedChunkSize);
+    buffers->zeros = calloc(1, kBufferedChunkSize);
+    if (!buffers->data || !buffers->zeros) {
+        CopyBuffersFree(buffers);
+        return ENOMEM;
+    }
+    return 0;
+}
+
+void CopyBuffersFree(CopyBuffers *buffers) {
+    free(buffers->data);
+    free(buffers->zeros);
+    buffers->data = NULL;
+    buffers->zeros = NULL;
+}
+
+// Account for bytes moved; returns ECANCELED if the job should stop
+static int CopyMoved(CopyContext *ctx, CopyMethod method, size_t count) {
+    int result;
+    pthread_mutex_lock(&ctx->lock);
+    ctx->methodBytes[method] += count;
+    ctx->status->bytesWritten += count;
+    result = ProgressAdvance(&ctx->tracker, count);
+    pthread_mutex_unlock(&ctx->lock);
+    return result;
+}
+
+// Queue data the copy has moved (NULL for a hole) for hashing
+static void CopyDigest(CopyContext *ctx, const void *data, size_t length, DigestStream streams) {
+    if (ctx->digest) {
+        DigestSubmit(ctx->digest, data, length, streams);
+    }
+}
+
+Digest *CopyDigestCreate(void) {
+    return DigestCreate(kBufferedChunkSize, 1);
+}
+
+static int URingMoved(void *refCon, size_t count) {
+    return CopyMoved((CopyContext*)refCon, kCopyMethodURing, count);
+}
+
+#ifdef __linux__
+// Errors which only mean "this filesystem (pair) can't do that", as
+// opposed to a real I/O failure. We fall back to a slower method on these.
+static int IsUnsupportedError(int err) {
+    return (err == EXDEV || err == ENOSYS || err == EOPNOTSUPP ||
+            err == ENOTSUP || err == EINVAL || err == ETXTBSY);
+}
+
+// Share the block-aligned bulk of the range between the two files, e.g.
+// on btrfs or XFS. Returns the number of bytes cloned (0 if none).
+static size_t CloneRange(CopyContext *ctx, off_t rdPos, off_t wrPos, size_t length) {
+    struct file_clone_range fcr;
+    struct stat sb = {0};
+    size_t blkSize, cloneLen;
+    StatsCount(kStatsOtherCalls, 1);
+    if (fstat(ctx->ofd, &sb) < 0) { return 0; }
+    blkSize = sb.st_blksize;
+    if (!blkSize || (rdPos % blkSize) || (wrPos % blkSize)) {
+        return 0; // offsets must line up on filesystem block boundaries
+    }
+    cloneLen = length - (length % blkSize);
+    if (!cloneLen) { return 0; }
+    fcr.src_fd = ctx->fd;
+    fcr.src_offset = rdPos;
+    fcr.src_length = cloneLen;
+    fcr.dest_offset = wrPos;
+    StatsCount(kStatsOtherCalls, 1);
+    if (ioctl(ctx->ofd, FICLONERANGE, &fcr) != 0) { return 0; }
+    StatsCount(kStatsBytesCopied, cloneLen);
+    CopyMoved(ctx, kCopyMethodClone, cloneLen); // a cancel is seen by the next chunk
+    return cloneLen;
+}
+
+static int KernelCopyRange(CopyContext *ctx, off_t *rdPos, off_t *wrPos,
+                           size_t *bytesRemaining) {
+    int result;
+    ssize_t count;
+    size_t chunk;
+    while (*bytesRemaining) {
+        chunk = kKernelChunkSize;
+        if (*bytesRemaining < chunk) {
+            chunk = *bytesRemaining;
+        }
+        count = copy_file_range(ctx->fd, rdPos, ctx->ofd, wrPos, chunk, 0);
+        StatsCount(kStatsOtherCalls, 1);
+        if (count < 0) {
+            if (errno == EINTR) { StatsCount(kStatsRetries, 1); continue; }
+            return errno;
+        }
+        StatsCount(kStatsBytesCopied, count);
+        if (count > 0 && count < chunk) { StatsCount(kStatsShortWrites, 1); }
+        if (count == 0) { return EIO; } // source ended early
+        *bytesRemaining -= count;
+        if ((result = CopyMoved(ctx, kCopyMethodKernel, count)) != 0) { return result; }
+    }
+    return 0;
+}
+#endif
+
+// Read a chunk of the source, or point straight into it if it is mapped
+static const char *ReadChunk(CopyContext *ctx, char *buf, size_t *length, off_t offset) {
+    const char *src = IOMapped(ctx->fd, offset, *length);
+    ssize_t count;
+    if (src) { return src; }
+    if ((count = IORead(ctx->fd, buf, *length, offset)) < 0) { return NULL; }
+    if (count == 0) { errno = EIO; return NULL; } // source ended early
+    *length = count;
+    return buf;
+}
+
+static int BufferedCopyRange(CopyContext *ctx, char *buf, off_t rdPos, off_t wrPos,
+                             size_t bytesRemaining, CopyMethod method) {
+    int result;
+    const char *src;
+    size_t chunk;
+    while (bytesRemaining) {
+        chunk = kBufferedChunkSize;
+        if (bytesRemaining < chunk) {
+            chunk = bytesRemaining;
+        }
+        if (ctx->digest) { buf = DigestBuffer(ctx->digest); } // hashed after we move on
+        if (!(src = ReadChunk(ctx, buf, &chunk, rdPos))) { return (errno) ? errno : EIO; }
+        if (IOWrite(ctx->ofd, src, chunk, wrPos) < 0) { return errno; }
+        CopyDigest(ctx, src, chunk, kDigestBoth);
+        rdPos += chunk;
+        wrPos += chunk;
+        bytesRemaining -= chunk;
+        if ((result = CopyMoved(ctx, method, chunk)) != 0) { return result; }
+    }
+    return 0;
+}
+
+// Make [offset, offset+length) of the output read back as zeros without
+// writing them. Past the original end of file nothing needs to be done,
+// since the file is extended over the gap when the copy finishes.
+static int ZeroRange(CopyContext *ctx, off_t offset, size_t length) {
+    ssize_t count;
+    size_t chunk;
+    if (offset >= ctx->outSize) { return 0; }
+    if (offset + length > ctx->outSize) { length = ctx->outSize - offset; }
+    StatsCount(kStatsOtherCalls, 1);
+#if defined(__linux__)
+    if (fallocate(ctx->ofd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, length) == 0) {
+        return 0;
+    }
+#elif defined(F_PUNCHHOLE)
+    fpunchhole_t punch = {0, 0, offset, length};
+    if (fcntl(ctx->ofd, F_PUNCHHOLE, &punch) == 0) {
+        return 0;
+    }
+#endif
+    // can't punch a hole here, so write the zeros after all
+    while (length) {
+        chunk = (length < kBufferedChunkSize) ? length : kBufferedChunkSize;
+        if ((count = IOWrite(ctx->ofd, ctx->zeros, chunk, offset)) < 0) { return errno; }
+        offset += count;
+        length -= count;
+    }
+    return 0;
+}
+
+// Leave a range of the output as a hole
+static int SkipRange(CopyContext *ctx, off_t wrPos, size_t length) {
+    int result = ZeroRange(ctx, wrPos, length);
+    if (result == 0) {
+        pthread_mutex_lock(&ctx->lock);
+        ctx->status->bytesSkipped += length;
+        result = ProgressAdvance(&ctx->tracker, length);
+        pthread_mutex_unlock(&ctx->lock);
+    }
+    return result;
+}
+
+// Write only the non-zero blocks of buf (len bytes destined for offset in
+// the output), leaving runs of zero blocks as holes.
+static int WriteSparseChunk(CopyContext *ctx, const char *buf, size_t len, off_t offset) {
+    int result = 0;
+    size_t pos = 0, runStart, blk;
+    int zero;
+    while (pos < len && result == 0) {
+        runStart = pos;
+        blk = (len - pos < kSparseBlockSize) ? len - pos : kSparseBlockSize;
+        zero = IsZeroFilled(buf + pos, blk);
+        // extend the run while blocks have the same zero/non-zero state
+        for (pos += blk; pos < len; pos += blk) {
+            blk = (len - pos < kSparseBlockSize) ? len - pos : kSparseBlockSize;
+            if (IsZeroFilled(buf + pos, blk) != zero) { break; }
+        }
+        if (zero) {
+            result = SkipRange(ctx, offset + runStart, pos - runStart);
+        } else if (IOWrite(ctx->ofd, buf + runStart, pos - runStart, offset + runStart) < 0) {
+            result = errno;
+        } else {
+            result = CopyMoved(ctx, kCopyMethodSparse, pos - runStart);
+        }
+    }
+    return result;
+}
+
+// Copy a range, skipping both holes in the source (found with SEEK_DATA
+// and SEEK_HOLE where supported, unless the input is filtered) and
+// all-zero blocks within its data.
+static int SparseCopyRange(CopyContext *ctx, char *buf, off_t rdPos, off_t wrPos,
+                           size_t bytesRemaining) {
+    int result = 0;
+    const off_t rdEnd = rdPos + bytesRemaining;
+    const off_t delta = wrPos - rdPos; // maps source offsets to output offsets
+    off_t pos = rdPos, dataEnd;
+    const char *src;
+    size_t chunk;
+
+    while (pos < rdEnd) {
+        dataEnd = rdEnd;
+#ifdef SEEK_DATA
+        // a filtered input's offsets are the image's, not the file's,
+        // so only its zero blocks are found, in WriteSparseChunk
+        if (!ctx->filtered) {
+            off_t next = lseek(ctx->fd, pos, SEEK_DATA);
+            StatsCount(kStatsOtherCalls, 2); // and SEEK_HOLE below
+            if (next == -1) {
+                // ENXIO: nothing but hole from here to end of file
+                next = (errno == ENXIO) ? rdEnd : pos;
+            }
+            if (next > rdEnd) { next = rdEnd; }
+            if (next > pos) {
+                if ((result = SkipRange(ctx, pos + delta, next - pos)) != 0) {
+                    return result;
+                }
+                CopyDigest(ctx, NULL, next - pos, kDigestBoth); // holes read as zeros
+                pos = next;
+                if (pos >= rdEnd) { break; }
+            }
+            if ((next = lseek(ctx->fd, pos, SEEK_HOLE)) != -1 && next < rdEnd) {
+                dataEnd = next;
+            }
+        }
+#endif
+        while (pos < dataEnd) {
+            chunk = kBufferedChunkSize;
+            if (dataEnd - pos < chunk) {
+                chunk = dataEnd - pos;
+            }
+            if (ctx->digest) { buf = DigestBuffer(ctx->digest); }
+            if (!(src = ReadChunk(ctx, buf, &chunk, pos))) {
+                result = (errno) ? errno : EIO;
+                return result;
+            }
+            if ((result = WriteSparseChunk(ctx, src, chunk, pos + delta)) != 0) {
+                return result;
+            }
+            CopyDigest(ctx, src, chunk, kDigestBoth);
+            pos += chunk;
+        }
+    }
+    return result;
+}
+
+// Copy one range of data with the cheapest method that works
+static int CopyRange(CopyContext *ctx, off_t rdPos, off_t wrPos, size_t length) {
+    int result = 0;
+    size_t bytesRemaining = length;
+#ifdef __linux__
+    // hashing needs every byte to pass through the user-space loop, and
+    // so does decoding a filtered input; the kernel would copy it as stored
+    if (ctx->digest || ctx->filtered) {
+        goto user;
+    }
+    // a reflink shares holes as well as data, so it suits sparse mode too
+    size_t count = CloneRange(ctx, rdPos, wrPos, bytesRemaining);
+    rdPos += count;
+    wrPos += count;
+    bytesRemaining -= count;
+    // the kernel paths below read through the page cache, which is what a
+    // non-default backend was chosen to avoid (or improve on)
+    if (!ctx->cached) {
+        goto user;
+    }
+    // the io_uring engine returns ENOSYS untouched when it can't run, and
+    // the kernel copy below picks up instead
+    if (bytesRemaining && ctx->uring && !ctx->sparse) {
+        result = URingCopyRange(ctx->ofd, ctx->fd, rdPos, wrPos, bytesRemaining,
+                                ctx->queueDepth, URingMoved, ctx);
+        if (result != ENOSYS) {
+            return result;
+        }
+        result = 0;
+    }
+    // copy_file_range can't tell us which blocks are zero, so sparse
+    // copies of the remainder go through the user-space loop instead
+    if (bytesRemaining && !ctx->sparse) {
+        result = KernelCopyRange(ctx, &rdPos, &wrPos, &bytesRemaining);
+        if (result != 0 && !IsUnsupportedError(result)) {
+            return result;
+        }
+        result = 0; // finish whatever is left with the buffered loop
+    }
+user:
+#endif
+    if (bytesRemaining && ctx->sparse) {
+        result = SparseCopyRange(ctx, ctx->buffer, rdPos, wrPos, bytesRemaining);
+    } else if (bytesRemaining) {
+        result = BufferedCopyRange(ctx, ctx->buffer, rdPos, wrPos, bytesRemaining,
+                                   kCopyMethodBuffered);
+    }
+    return result;
+}
+
+// Threaded copies split the extents into stripes which the pool's
+// workers copy independently with positional I/O
+typedef struct CopyStripe {
+    off_t rdPos;
+    off_t wrPos;
+    size_t length;
+}   CopyStripe;
+
+typedef struct StripeJob {
+    CopyContext *ctx;
+    CopyStripe *stripes;
+    size_t count;
+    size_t capacity;
+    char **buffers; // one per worker, allocated on first use
+}   StripeJob;
+
+static int AddStripes(StripeJob *job, off_t rdPos, off_t wrPos, size_t length) {
+    size_t chunk;
+    while (length) {
+        if (job->count == job->capacity) {
+            size_t capacity = (job->capacity) ? job->capacity * 2 : 256;
+            CopyStripe *p = realloc(job->stripes, capacity * sizeof(CopyStripe));
+            if (!p) { return ENOMEM; }
+            job->stripes = p;
+            job->capacity = capacity;
+        }
+        chunk = (length < kStripeSize) ? length : kStripeSize;
+        job->stripes[job->count].rdPos = rdPos;
+        job->stripes[job->count].wrPos = wrPos;
+        job->stripes[job->count].length = chunk;
+        job->count++;
+        rdPos += chunk;
+        wrPos += chunk;
+        length -= chunk;
+    }
+    return 0;
+}
+
+static int StripeTask(void *refCon, size_t taskIndex, unsigned worker) {
+    StripeJob *job = (StripeJob*)refCon;
+    CopyContext *ctx = job->ctx;
+    CopyStripe *stripe = &job->stripes[taskIndex];
+    StatsTimer timer;
+    int result;
+    if (!job->buffers[worker] && !(job->buffers[worker] = IOAllocBuffer(kBufferedChunkSize))) {
+        return ENOMEM;
+    }
+    StatsBegin(&timer, kStatsPhaseCopy); // charge the worker's I/O to the copy
+    if (ctx->sparse) {
+        result = SparseCopyRange(ctx, job->buffers[worker], stripe->rdPos, stripe->wrPos,
+                                 stripe->length);
+    } else {
+        result = BufferedCopyRange(ctx, job->buffers[worker], stripe->rdPos, stripe->wrPos,
+                                   stripe->length, kCopyMethodStriped);
+    }
+    StatsEnd(&timer);
+    return result;
+}
+
+int CopyVolumeExtents(int ofd, int fd, off_t rdStart, off_t wrStart, size_t length,
+                      const VolumeExtent *extents, size_t count,
+                      const CopyOptions *options, CopyStatus *status) {
+    int result = 0;
+    CopyContext ctx = {0};
+    CopyBuffers ownBuffers = {0};
+    CopyBuffers *buffers = (options) ? options->buffers : NULL;
+    StripeJob job = {0};
+    IOFilter filter;
+    struct stat sb = {0};
+    off_t pos = 0, end;
+    size_t i;
+    int m;
+    memset(status, 0, sizeof(CopyStatus));
+    ctx.ofd = ofd;
+    ctx.fd = fd;
+    ctx.sparse = (options) ? options->sparse : 0;
+    ctx.uring = (options) ? options->uring : 0;
+    ctx.queueDepth = (options) ? options->queueDepth : 0;
+    ctx.threads = (options) ? options->threads : 0;
+    ctx.digest = (options) ? options->digest : NULL;
+    if (ctx.digest) { ctx.threads = 0; } // the hashers need the data in order
+    ctx.cached = (IOBackendOf(fd) == kIOBackendPread && IOBackendOf(ofd) == kIOBackendPread);
+    ctx.filtered = (IOGetFilter(fd, &filter) == 0);
+    ctx.status = status;
+    StatsCount(kStatsOtherCalls, 1);
+    if (fstat(ofd, &sb) < 0) { return errno; }
+    ctx.outSize = sb.st_size;
+    if (!buffers) {
+        if ((result = CopyBuffersAlloc(&ownBuffers)) != 0) { return result; }
+        buffers = &ownBuffers;
+    }
+    ctx.buffer = buffers->data;
+    ctx.zeros = buffers->zeros;
+    pthread_mutex_init(&ctx.lock, NULL);
+    ProgressStart(&ctx.tracker, (options) ? options->progress : NULL, length);
+    job.ctx = &ctx;
+
+    for (i = 0; i < count && result == 0; i++) {
+        if (extents[i].offset >= length) { break; }
+        end = extents[i].offset + extents[i].length;
+        if (end > length) { end = length; }
+        if (extents[i].offset > pos) {
+            result = SkipRange(&ctx, wrStart + pos, extents[i].offset - pos);
+            if (result != 0) { break; }
+            CopyDigest(&ctx, NULL, extents[i].offset - pos, kDigestOutput); // source unread
+        }
+        if (ctx.threads > 1) { // copied below, once all stripes are known
+            result = AddStripes(&job, rdStart + extents[i].offset,
+                                wrStart + extents[i].offset, end - extents[i].offset);
+        } else {
+            result = CopyRange(&ctx, rdStart + extents[i].offset,
+                               wrStart + extents[i].offset, end - extents[i].offset);
+        }
+        pos = end;
+    }
+    if (result == 0 && job.count) {
+        if (!(job.buffers = calloc(ctx.threads, sizeof(char*)))) {
+            result = ENOMEM;
+        } else {
+            result = PoolRun(ctx.threads, job.count, StripeTask, &job);
+            for (i = 0; i < ctx.threads; i++) { free(job.buffers[i]); }
+            free(job.buffers);
+        }
+        free(job.stripes);
+    }
+    if (result == 0 && pos < length) {
+        result = SkipRange(&ctx, wrStart + pos, length - pos);
+        CopyDigest(&ctx, NULL, length - pos, kDigestOutput);
+    }
+    // extend the output over any trailing hole
+    if (result == 0) {
+        StatsCount(kStatsOtherCalls, 1);
+        if (fstat(ofd, &sb) == 0 && sb.st_size < wrStart + length) {
+            StatsCount(kStatsOtherCalls, 1);
+            if (ftruncate(ofd, wrStart + length) != 0) { result = errno; }
+        }
+    }
+    if (result == 0) {
+        ProgressFinish(&ctx.tracker);
+    }
+    status->method = (ctx.sparse) ? kCopyMethodSparse : kCopyMethodBuffered;
+    for (m = 0; m < kCopyMethodCount; m++) {
+        if (ctx.methodBytes[m] > ctx.methodBytes[status->method]) {
+            status->method = m;
+        }
+    }
+    pthread_mutex_destroy(&ctx.lock);
+    CopyBuffersFree(&ownBuffers);
+    return result;
+}
+
+int CopyVolumeData(int ofd, int fd, off_t rdStart, off_t wrStart, size_t length,
+                   const CopyOptions *options, CopyStatus *status) {
+    VolumeExtent all = {0, length};
+    return CopyVolumeExtents(ofd, fd, rdStart, wrStart, length, &all, 1, options, status);
+}
@@ -0,0 +1,108 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageCopy.h
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version (kernel copy and reflink paths)
+//  Fri Oct 16 2026 -- added sparse output mode
+//  Fri Oct 16 2026 -- added extent list copies (allocated blocks only)
+//  Fri Oct 16 2026 -- added io_uring engine
+//  Fri Oct 16 2026 -- added multi-threaded striped copies
+//  Fri Oct 16 2026 -- reads and writes go through the DiskImageIO backends
+//  Fri Oct 16 2026 -- scratch buffers can be reused across jobs
+//  Fri Oct 16 2026 -- progress callbacks and cancellation
+//  Fri Oct 16 2026 -- copied data can be hashed in the same pass
+//  Fri Oct 16 2026 -- option to pick the partition ConvertFile copies
+//  Fri Oct 16 2026 -- inputs with an IOFilter are decoded as they copy
+//  Fri Oct 16 2026 -- option for compressed (UDIF) output from ConvertFile
+//  Fri Oct 16 2026 -- and for qcow2 output
+//
+//----------------------------------------------------------------------
+
+#ifndef __diskimagecopy_h__
+#define __diskimagecopy_h__
+
+#include "DiskImageUtils.h"
+#include "DiskImageAllocation.h"
+#include "DiskImageIO.h"
+#include "DiskImageProgress.h"
+#include "DiskImageDigest.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Ways the copy engine can move bytes from the source image to the
+// output. The engine tries the cheapest one first and falls back
+// automatically; the method actually used is reported to the caller.
+typedef enum CopyMethod {
+    kCopyMethodBuffered = 0, // read()/write() through a user-space buffer
+    kCopyMethodKernel,       // copy_file_range(), data stays in the kernel
+    kCopyMethodClone,        // FICLONERANGE reflink, extents are shared
+    kCopyMethodSparse,       // read()/write() of non-zero blocks only
+    kCopyMethodURing,        // pipelined reads and writes through io_uring
+    kCopyMethodStriped,      // pread()/pwrite() of stripes on worker threads
+    kCopyMethodCount
+}   CopyMethod;
+
+// Scratch memory for the copy loops. A caller running many jobs can
+// allocate one set per thread and hand it to each job in CopyOptions,
+// rather than having every job allocate (and fault in) its own.
+typedef struct CopyBuffers {
+    char *data; // staging buffer for reads and writes
+    char *zeros; // all-zero source for filling ranges that can't be holes
+}   CopyBuffers;
+
+int CopyBuffersAlloc(CopyBuffers *buffers);
+void CopyBuffersFree(CopyBuffers *buffers);
+
+typedef struct CopyOptions {
+    int sparse; // leave holes in the output instead of writing zeros
+    int allocatedOnly; // copy only blocks in use according to the volume bitmap
+    int uring; // use the io_uring engine where available (ignored if sparse)
+    unsigned queueDepth; // io_uring buffers in flight (0 for the default)
+    unsigned threads; // copy stripes on this many threads (0 or 1 for serial)
+    IOBackend backend; // how the input and output files are accessed
+    CopyBuffers *buffers; // scratch memory to use (NULL to allocate per job)
+    const Progress *progress; // reporting and cancellation (NULL for a bar on stdout)
+    int writeDigests; // write "<output>.digests" with SHA-256 and CRC32C (ConvertFile)
+    Digest *digest; // hash what the copy moves (from CopyDigestCreate), or NULL
+    unsigned partition; // map entry to convert plus one, or 0 for the first
+                        // HFS partition (ConvertFile)
+    ulong compression; // write a UDIF image with chunks of this kind
+                       // (kUDIFChunkZlib or kUDIFChunkBzip2), or 0 (ConvertFile)
+    int qcow2; // write a qcow2 image, all-zero clusters unallocated (ConvertFile)
+}   CopyOptions;
+
+typedef struct CopyStatus {
+    CopyMethod method; // method that moved the bulk of the data
+    size_t bytesWritten; // bytes written (or cloned) to the output
+    size_t bytesSkipped; // all-zero bytes left as holes in the output
+}   CopyStatus;
+
+const char *CopyMethodName(CopyMethod method);
+
+// A digest whose buffers fit the copy loops. While one is set in the
+// options the copy runs serially through user space, since the kernel
+// paths never show us the data and stripes would hash out of order.
+Digest *CopyDigestCreate(void);
+
+// Copy length bytes at rdStart in fd to wrStart in ofd. Options may be
+// NULL for the defaults. Status is filled in even if the copy fails.
+// Returns ECANCELED if the progress options' token was set part way.
+// An input read through an IOFilter (a UDIF image, say) is copied by the
+// buffered loop, or the striped one with threads, which decode it.
+int CopyVolumeData(int ofd, int fd, off_t rdStart, off_t wrStart, size_t length,
+                   const CopyOptions *options, CopyStatus *status);
+
+// Same as CopyVolumeData, but only the given extents (relative to rdStart,
+// sorted by offset) are copied; the rest of the range is left as holes.
+int CopyVolumeExtents(int ofd, int fd, off_t rdStart, off_t wrStart, size_t length,
+                      const VolumeExtent *extents, size_t count,
+                      const CopyOptions *options, CopyStatus *status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __diskimagecopy_h__ */
@@ -6,159 +6,254 @@
 //
 //  Modification History:
 //  Thu Jul 03 2025 (kcm) -- initial version
+//  Fri Oct 16 2026 -- files are opened through a selectable I/O backend
+//  Fri Oct 16 2026 -- split into probing (to an ImageRecord) and printing,
+//                     so descriptions can come from the probe index
+//  Fri Oct 16 2026 -- probing is timed for --stats
+//  Fri Oct 16 2026 -- partitions come from the shared partition table, and
+//                     print any problems found validating them
+//  Fri Oct 16 2026 -- UDIF images are probed through the UDIF reader
+//  Fri Oct 16 2026 -- so are Disk Copy 4.2 and DART images, through DiskImageFloppy
+//  Fri Oct 16 2026 -- and gzip and bzip2 streams, through DiskImageStream
+//  Fri Oct 16 2026 -- and zstd and xz streams, in builds with their decoders
+//  Fri Oct 16 2026 -- "-" opens standard input, read in order if it's a pipe
+//  Fri Oct 16 2026 -- a refused pipe isn't described as an unsupported feature
 //
 //----------------------------------------------------------------------
 
 #include "DiskImageUtils.h"
 #include "DiskImageDescribe.h"
+#include "DiskImageIO.h"
+#include "DiskImageStats.h"
+#include "DiskImagePartition.h"
+#include "DiskImageUDIF.h"
+#include "DiskImageFloppy.h"
+#include "DiskImageStream.h"
+#include "DiskImagePipe.h"
 
 extern int verbose;
 const char *kVerifiedStr = "✔ VERIFIED";
 const char *kFailedStr = "✖ VERIFY FAILED";
 const char *kTruncedStr = "✖ TRUNCATED";
 
-void DescribeHFSPlusVolume(int fd, size_t offset, int tab) {
+static void ReadHFSPlusRecord(int fd, size_t offset, VolumeRecord *vol) {
     HFSPlusVolumeHeader vh;
-    int len;
-    char name[32];
+    if (ReadHFSPlusVolumeHeader(fd, offset, &vh) != 0) {
+        vol->status = kVolumeHeaderError;
+        return;
+    }
+    vol->createDate = vh.createDate;
+    vol->modifyDate = vh.modifyDate;
+    vol->blockSize = vh.blockSize;
+    vol->totalBlocks = vh.totalBlocks;
+    vol->freeBlocks = vh.freeBlocks;
+}
+
+static void PrintHFSPlusRecord(const VolumeRecord *vol, int tab) {
     char date[255];
-    memset(name, 0, sizeof(name));
     memset(date, 0, sizeof(date));
 
-    if (ReadHFSPlusVolumeHeader(fd, offset, &vh) != 0) {
+    if (vol->status == kVolumeHeaderError) {
         tabprint(tab, "Error reading HFS+ volume header\n");
         return;
     }
-    DateStringForHFSDate(vh.createDate, sizeof(date)-1, date);
+    DateStringForHFSDate(vol->createDate, sizeof(date)-1, date);
     tabprint(tab, "Created: %s\n", date);
-    DateStringForHFSDate(vh.modifyDate, sizeof(date)-1, date);
+    DateStringForHFSDate(vol->modifyDate, sizeof(date)-1, date);
     tabprint(tab, "Last modified: %s\n", date);
 
     tabprint(tab, "Capacity: %.1f MB (%ld bytes)\n",
-        (vh.blockSize*vh.totalBlocks) / (1024.0*1024.0),
-        (vh.blockSize*vh.totalBlocks));
+        (vol->blockSize*vol->totalBlocks) / (1024.0*1024.0),
+        (vol->blockSize*vol->totalBlocks));
     tabprint(tab, "Used: %.1f MB (%ld bytes)\n",
-        (vh.blockSize*(vh.totalBlocks-vh.freeBlocks)) / (1024.0*1024.0),
-        (vh.blockSize*(vh.totalBlocks-vh.freeBlocks)));
+        (vol->blockSize*(vol->totalBlocks-vol->freeBlocks)) / (1024.0*1024.0),
+        (vol->blockSize*(vol->totalBlocks-vol->freeBlocks)));
     tabprint(tab, "Free: %.1f MB (%ld bytes)\n",
-        (vh.blockSize*vh.freeBlocks) / (1024.0*1024.0),
-        (vh.blockSize*vh.freeBlocks));
+        (vol->blockSize*vol->freeBlocks) / (1024.0*1024.0),
+        (vol->blockSize*vol->freeBlocks));
 }
 
-void DescribeHFSVolume(int fd, size_t offset, int tab) {
+static void ReadVolumeRecord(int fd, size_t offset, VolumeRecord *vol) {
     BootBlockHeader bb;
     MasterDirectoryBlock mdb;
     off_t mdbOffset = offset + (512*2);
     int len;
+    memset(vol, 0, sizeof(VolumeRecord));
+
+    if (ReadBootBlockHeader(fd, offset, &bb) != 0) {
+        vol->status = kVolumeBootBlockError;
+        return;
+    }
+    vol->bootSig = bb.bbID;
+    vol->bootVersion = bb.bbVersion;
+    if (ReadMasterDirectoryBlock(fd, mdbOffset, &mdb) != 0) {
+        vol->status = kVolumeMDBError;
+        return;
+    }
+    vol->sigWord = mdb.drSigWord;
+    if (mdb.drSigWord == 0x4244) { // 'BD' for HFS
+        memcpy(vol->name, (char*)mdb.drVN+1, 27);
+        if ((len = mdb.drVN[0]) > 27) { len = 28; }
+        vol->name[len] = 0;
+        vol->createDate = mdb.drCrDate;
+        vol->modifyDate = mdb.drLsMod;
+        vol->blockSize = mdb.drAlBlkSiz;
+        vol->totalBlocks = mdb.drNmAlBlks;
+        vol->freeBlocks = mdb.drFreeBks;
+    } else if (mdb.drSigWord == 0x482B) { // 'H+' for HFS+
+        ReadHFSPlusRecord(fd, mdbOffset, vol);
+    }
+}
+
+static void PrintVolumeRecord(const VolumeRecord *vol, int tab) {
     char name[32];
     char date[255];
     memset(name, 0, sizeof(name));
     memset(date, 0, sizeof(date));
 
-    if (ReadBootBlockHeader(fd, offset, &bb) != 0) {
+    if (vol->status == kVolumeBootBlockError) {
         tabprint(tab, "Error reading HFS boot blocks\n");
         return;
     }
     if (verbose) {
-        ushort sig = htons(bb.bbID);
+        ushort sig = htons(vol->bootSig);
         memcpy(name, (char*)&sig, 2);
         name[2] = 0;
-        tabprint(tab, "Boot block signature: 0x%04X", bb.bbID);
-        if (bb.bbID == 0) {
+        tabprint(tab, "Boot block signature: 0x%04X", vol->bootSig);
+        if (vol->bootSig == 0) {
             tabprint(0, " (non-bootable volume)\n");
-        } else if (bb.bbID == 0x4C4B) { // 'LK'
+        } else if (vol->bootSig == 0x4C4B) { // 'LK'
             tabprint(0, " '%s' (bootable volume)\n", name);
         } else {
             tabprint(0, " '%s' (expected 0x4C4B)\n", name);
         }
-        tabprint(tab, "Boot block version: 0x%04X\n",bb.bbVersion);
+        tabprint(tab, "Boot block version: 0x%04X\n", vol->bootVersion);
     }
-    if (ReadMasterDirectoryBlock(fd, mdbOffset, &mdb) != 0) {
+    if (vol->status == kVolumeMDBError) {
         tabprint(tab, "Error reading volume information block\n");
         return;
     }
     if (verbose) {
-        ushort sig = htons(mdb.drSigWord);
+        ushort sig = htons(vol->sigWord);
         memcpy(name, (char*)&sig, 2);
         name[2] = 0;
-        tabprint(tab, "Volume signature: 0x%04X '%s' ", mdb.drSigWord, name);
-        if (mdb.drSigWord == 0x4244) { // 'BD' for HFS
+        tabprint(tab, "Volume signature: 0x%04X '%s' ", vol->sigWord, name);
+        if (vol->sigWord == 0x4244) { // 'BD' for HFS
             tabprint(0, "(HFS volume)\n");
-        } else if (mdb.drSigWord == 0x482B) { // 'H+' for HFS+
+        } else if (vol->sigWord == 0x482B) { // 'H+' for HFS+
             tabprint(0, "(HFS+ volume)\n");
         } else {
             tabprint(0, "(unrecognized format)\n");
         }
     }
-    if (mdb.drSigWord == 0x4244) { // 'BD' for HFS
-        memcpy(name, (char*)mdb.drVN+1, 27);
-        if ((len = mdb.drVN[0]) > 27) { len = 28; }
-        name[len] = 0;
-        tabprint(tab, "Volume: %s\n", name);
+    if (vol->sigWord == 0x4244) { // 'BD' for HFS
+        tabprint(tab, "Volume: %s\n", vol->name);
 
-        DateStringForHFSDate(mdb.drCrDate, sizeof(date)-1, date);
+        DateStringForHFSDate(vol->createDate, sizeof(date)-1, date);
         tabprint(tab, "Created: %s\n", date);
-        DateStringForHFSDate(mdb.drLsMod, sizeof(date)-1, date);
+        DateStringForHFSDate(vol->modifyDate, sizeof(date)-1, date);
         tabprint(tab, "Last modified: %s\n", date);
 
         tabprint(tab, "Capacity: %.1f MB (%ld bytes)\n",
-            (mdb.drAlBlkSiz*mdb.drNmAlBlks) / (1024.0*1024.0),
-            (mdb.drAlBlkSiz*mdb.drNmAlBlks));
+            (vol->blockSize*vol->totalBlocks) / (1024.0*1024.0),
+            (vol->blockSize*vol->totalBlocks));
         tabprint(tab, "Used: %.1f MB (%ld bytes)\n",
-            (mdb.drAlBlkSiz*(mdb.drNmAlBlks-mdb.drFreeBks)) / (1024.0*1024.0),
-            (mdb.drAlBlkSiz*(mdb.drNmAlBlks-mdb.drFreeBks)));
+            (vol->blockSize*(vol->totalBlocks-vol->freeBlocks)) / (1024.0*1024.0),
+            (vol->blockSize*(vol->totalBlocks-vol->freeBlocks)));
         tabprint(tab, "Free: %.1f MB (%ld bytes)\n",
-            (mdb.drAlBlkSiz*mdb.drFreeBks) / (1024.0*1024.0),
-            (mdb.drAlBlkSiz*mdb.drFreeBks));
-    } else if (mdb.drSigWord == 0x482B) { // 'H+' for HFS+
-        DescribeHFSPlusVolume(fd, mdbOffset, tab);
+            (vol->blockSize*vol->freeBlocks) / (1024.0*1024.0),
+            (vol->blockSize*vol->freeBlocks));
+    } else if (vol->sigWord == 0x482B) { // 'H+' for HFS+
+        PrintHFSPlusRecord(vol, tab);
     }
 }
 
-void DescribePartitionMap(int fd, size_t fileSize, int tab) {
-    Partition pme;
-    ulong cksum;
-    char pname[34], ptype[34];
+// Read the partition map into a record, growing it as entries are found
+static ImageRecord *ReadPartitionRecords(int fd, ImageRecord *record) {
+    PartitionTable *table = NULL;
+    const PartitionEntry *entry;
+    PartitionRecord *part;
+    ImageRecord *p;
+    ulong i;
+
+    if (ReadPartitionTable(fd, record->fileSize, &table) != 0) { return record; }
+    p = realloc(record, sizeof(ImageRecord) + table->count * sizeof(PartitionRecord));
+    if (!p) {
+        free(table);
+        return record;
+    }
+    record = p;
+    record->mapBlocks = table->mapBlocks;
+    record->partitionCount = table->count;
+    for (i = 0; i < table->count; i++) {
+        entry = &table->entries[i];
+        part = &record->partitions[i];
+        memset(part, 0, sizeof(PartitionRecord));
+        memcpy(part->name, entry->name, sizeof(entry->name));
+        memcpy(part->type, entry->type, sizeof(entry->type));
+        part->start = entry->start;
+        part->blocks = entry->blocks;
+        part->problems = entry->problems;
+        if (!strncmp(part->type, "Apple_Driver", 12)) {
+            part->bootSize = entry->bootSize;
+            part->bootCksum = entry->bootCksum;
+            // compute 16-bit checksum used by Apple_Driver* drivers
+            // (note that the stored value is actually 32 bits)
+            part->computedCksum = ComputeChecksum(fd, entry->offset, entry->bootSize);
+        }
+        if (PartitionTypeIsHFS(part->type)) {
+            ReadVolumeRecord(fd, entry->offset, &part->volume);
+        }
+    }
+    free(table);
+    record->length = sizeof(ImageRecord) + record->partitionCount * sizeof(PartitionRecord);
+    return record;
+}
+
+static void PrintPartitionRecords(const ImageRecord *record, int tab) {
+    const PartitionRecord *part;
     const off_t kBlockSize = 512;
-    off_t pmeOffset = kBlockSize; // partition map starts at block 1
     off_t partOffset; // in bytes
     size_t partLength; // in bytes
-    int i = 0;
-    memset(pname, 0, sizeof(pname));
-    memset(ptype, 0, sizeof(ptype));
-
-    while (pmeOffset) {
-        if (ReadPartitionMapEntry(fd, pmeOffset, &pme) != 0) { break; }
-        if (pme.pmSig != 0x504D) { break; } // 'PM'
-        partOffset = pme.pmPyPartStart * kBlockSize;
-        partLength = pme.pmPartBlkCnt * kBlockSize;
-        memcpy(pname, (char*)pme.pmPartName, 32);
-        memcpy(ptype, (char*)pme.pmPartType, 32);
+    ulong i, problem;
+
+    if (record->mapBlocks != record->partitionCount) {
+        tabprint(tab, ANSI_RED "✖ The partition map declares %u entries but holds %u"
+                 ANSI_RESET "\n", record->mapBlocks, record->partitionCount);
+    }
+    for (i = 0; i < record->partitionCount; i++) {
+        part = &record->partitions[i];
+        partOffset = part->start * kBlockSize;
+        partLength = part->blocks * kBlockSize;
         tabprint(tab, "\n");
-        tabprint(tab, "Partition %d: %s (%s)\n", i, pname, ptype);
+        tabprint(tab, "Partition %d: %s (%s)\n", i, part->name, part->type);
         tabprint(tab+1, "Size: %ld bytes (offset %ld to %ld)",
                 partLength, partOffset, partOffset + partLength);
-        if ((partOffset + partLength) > fileSize) {
+        if (part->problems & kPartitionTruncated) {
             tabprint(0, ANSI_RED " %s" ANSI_RESET, kTruncedStr);
         }
         tabprint(0, "\n");
-        if (!strncmp(ptype, "Apple_Driver", 12)) {
-            off_t drvOffset = pme.pmPyPartStart * kBlockSize;
-            off_t drvLength = pme.pmBootSize;
-            // compute 16-bit checksum used by Apple_Driver* drivers
-            // (note that the stored value is actually 32 bits)
-            ulong cksum = ComputeChecksum(fd, drvOffset, drvLength);
+        for (problem = kPartitionOutside; problem <= kPartitionMapCount; problem <<= 1) {
+            if (part->problems & problem) {
+                tabprint(tab+1, ANSI_RED "✖ Entry %s" ANSI_RESET "\n",
+                         PartitionProblemName(problem));
+            }
+        }
+        if (!strncmp(part->type, "Apple_Driver", 12)) {
+            off_t drvOffset = part->start * kBlockSize;
+            off_t drvLength = part->bootSize;
+            ulong cksum = part->computedCksum;
             tabprint(tab+1, "Code: %ld bytes (offset %ld in file)\n",
                     drvLength, drvOffset);
-            tabprint(tab+1, "Checksum: 0x%08X", pme.pmBootCksum);
-            if (!pme.pmBootCksum) {
+            tabprint(tab+1, "Checksum: 0x%08X", part->bootCksum);
+            if (!part->bootCksum) {
                 // boot code only enforces check if name prefix is 'Maci'
-                if (!strncmp(pname, "Maci", 4)) {
+                if (!strncmp(part->name, "Maci", 4)) {
                     tabprint(0, " (driver will not load)");
                 }
             } else { // there is a saved checksum to verify
                 tabprint(0, " (computed 0x%08X) ", cksum);
-                if (cksum == pme.pmBootCksum) {
+                if (cksum == part->bootCksum) {
                     tabprint(0, ANSI_GREEN "%s" ANSI_RESET, kVerifiedStr);
                 } else {
                     tabprint(0, ANSI_RED "%s" ANSI_RESET, kFailedStr);
@@ -166,66 +261,219 @@ void DescribePartitionMap(int fd, size_t fileSize, int tab) {
             }
             tabprint(0, "\n");
         }
-        if (!strncmp(ptype, "Apple_HFS", strlen(ptype))) {
-            DescribeHFSVolume(fd, pme.pmPyPartStart * kBlockSize, tab+1);
+        if (PartitionTypeIsHFS(part->type)) {
+            PrintVolumeRecord(&part->volume, tab+1);
         }
-        pmeOffset += kBlockSize; // next partition map entry
-        i++;
     }
 }
 
-void DescribeFile(const char *inPathname) {
+void DescribeHFSPlusVolume(int fd, size_t offset, int tab) {
+    VolumeRecord vol;
+    memset(&vol, 0, sizeof(vol));
+    ReadHFSPlusRecord(fd, offset, &vol);
+    PrintHFSPlusRecord(&vol, tab);
+}
+
+void DescribeHFSVolume(int fd, size_t offset, int tab) {
+    VolumeRecord vol;
+    ReadVolumeRecord(fd, offset, &vol);
+    PrintVolumeRecord(&vol, tab);
+}
+
+void DescribePartitionMap(int fd, size_t fileSize, int tab) {
+    ImageRecord *record = calloc(1, sizeof(ImageRecord));
+    if (!record) { return; }
+    record->fileSize = fileSize;
+    record = ReadPartitionRecords(fd, record);
+    PrintPartitionRecords(record, tab);
+    free(record);
+}
+
+int OpenImage(const char *path, IOBackend backend) {
+    int fd, result;
+    if (!strcmp(path, "-")) { path = "/dev/stdin"; }
+    if ((fd = IOOpen(path, O_RDONLY, 0, backend)) == -1) { return -1; }
+    // a pipe can't be read out of order, as the containers would read it
+    if ((result = PipeAttach(fd)) == -1 && (result = UDIFAttach(fd)) == -1 &&
+        (result = FloppyAttach(fd)) == -1) {
+        result = StreamAttach(fd);
+    }
+    if (result > 0) {
+        IOClose(fd);
+        errno = result;
+        return -1;
+    }
+    return fd;
+}
+
+ImageRecord *ProbeImage(int fd) {
+    ImageRecord *record = calloc(1, sizeof(ImageRecord));
     DDRecord ddr;
+    FloppySummary floppy;
+    StreamSummary stream;
     ushort hfsSig = 0;
-    struct stat sb = {0};
-    int tab = 1;
-    int fd;
-    char *name = basename((char*)inPathname);
-    tabprint(0, "Checking file \"%s\"\n",
-            (name) ? name : inPathname);
-
-    if ((fd = open(inPathname, O_RDONLY, 0)) == -1) { goto done; }
-    if (fstat(fd, &sb) < 0) { goto done; }
-    tabprint(0, "File size: %ld bytes\n", sb.st_size);
-    if (ReadDriverDescriptorRecord(fd, 0, &ddr) != 0) { goto done; }
+    off_t size;
+    if (!record) { return NULL; }
+    if ((size = IOSize(fd)) < 0) {
+        free(record);
+        return NULL;
+    }
+    record->length = sizeof(ImageRecord);
+    record->format = kImageFormatUnreadable;
+    record->fileSize = size; // of the image inside, for a container
+    record->container = (UDIFAttached(fd, NULL)) ? kImageContainerUDIF : kImageContainerNone;
+    if (FloppyAttached(fd, &floppy)) {
+        record->container = (floppy.format == kFloppyDART) ? kImageContainerDART :
+                            kImageContainerDiskCopy42;
+    } else if (StreamAttached(fd, &stream)) {
+        record->container = (stream.format == kStreamBzip2) ? kImageContainerBzip2 :
+                            (stream.format == kStreamZstd) ? kImageContainerZstd :
+                            (stream.format == kStreamXz) ? kImageContainerXz :
+                            kImageContainerGzip;
+    }
+    if (ReadImageHeader(fd) != 0) { return record; }
+    if (ReadDriverDescriptorRecord(fd, 0, &ddr) != 0) { return record; }
 
     // secondary check for HFS or HFS+ sig if this is a volume image
     if (!((ReadUShort(fd, 0x400, &hfsSig) == 0) &&
         (hfsSig == 0x4244 || hfsSig == 0x482B))) { // HFS or HFS+
         hfsSig = 0;
     }
-    if (ddr.sbSig == 0x4552 && verbose) { // 'ER'
-        size_t length = ddr.sbBlkSize * ddr.sbBlkCount;
-        ushort sig = htons(ddr.sbSig);
+    record->ddrSig = ddr.sbSig;
+    record->deviceSize = ddr.sbBlkSize * ddr.sbBlkCount;
+    if (ddr.sbSig == 0x4552) { // 'ER'
+        record->format = kImageFormatAPM;
+        record = ReadPartitionRecords(fd, record);
+    } else if (ddr.sbSig == 0x4C4B) { // 'LK'
+        record->format = kImageFormatHFSBootable;
+        ReadVolumeRecord(fd, 0, &record->volume);
+    } else if (ddr.sbSig == 0x0000 && hfsSig != 0) {
+        record->format = kImageFormatHFS;
+        ReadVolumeRecord(fd, 0, &record->volume);
+    } else {
+        record->format = kImageFormatUnknown;
+    }
+    return record;
+}
+
+ImageRecord *ProbeImagePath(ImageIndex *index, const char *path, ImageKey *key) {
+    ImageRecord *record = NULL;
+    int fd;
+    if ((fd = OpenImage(path, kIOBackendPread)) == -1) { return NULL; }
+    if (IndexMakeKey(index, path, fd, key) == 0) {
+        record = ProbeImage(fd);
+    }
+    IOClose(fd);
+    if (record && record->format == kImageFormatUnreadable) {
+        free(record);
+        record = NULL;
+    }
+    return record;
+}
+
+void PrintImageRecord(const ImageRecord *record) {
+    int tab = 1;
+    if (record->container != kImageContainerNone) {
+        tabprint(0, "Container: %s image, read in place\n",
+                 (record->container == kImageContainerUDIF) ? "UDIF (.dmg)" :
+                 (record->container == kImageContainerDART) ? "DART" :
+                 (record->container == kImageContainerGzip) ? "gzip" :
+                 (record->container == kImageContainerBzip2) ? "bzip2" :
+                 (record->container == kImageContainerZstd) ? "zstd" :
+                 (record->container == kImageContainerXz) ? "xz" : "Disk Copy 4.2");
+        tabprint(0, "Image size: %ld bytes\n", record->fileSize);
+    } else {
+        tabprint(0, "File size: %ld bytes\n", record->fileSize);
+    }
+    if (record->format == kImageFormatUnreadable) { return; }
+
+    if (record->ddrSig == 0x4552 && verbose) { // 'ER'
+        size_t length = record->deviceSize;
+        char name[4];
+        ushort sig = htons(record->ddrSig);
         memcpy(name, (char*)&sig, 2);
         name[2] = 0;
         if (length > 0) {
             tabprint(0, "Device size: %ld bytes", length);
-            if (length > sb.st_size) {
+            if (length > record->fileSize) {
                 tabprint(0, ANSI_RED " %s" ANSI_RESET, kTruncedStr);
             }
             tabprint(0, "\n");
         } else {
             tabprint(0, "Device size: (not specified)\n");
         }
-        tabprint(0, "Device signature: 0x%04X '%s'\n", ddr.sbSig, name);
+        tabprint(0, "Device signature: 0x%04X '%s'\n", record->ddrSig, name);
     }
-    if (ddr.sbSig == 0x4552) { // 'ER'
+    if (record->format == kImageFormatAPM) {
         tabprint(0, "File format: Apple Partition Map disk image\n");
-        DescribePartitionMap(fd, sb.st_size, tab);
-    } else if (ddr.sbSig == 0x4C4B) { // 'LK'
+        PrintPartitionRecords(record, tab);
+    } else if (record->format == kImageFormatHFSBootable) {
         tabprint(0, "File format: Apple HFS volume image (bootable)\n");
-        DescribeHFSVolume(fd, 0, tab);
-    } else if (ddr.sbSig == 0x0000 && hfsSig != 0) {
+        PrintVolumeRecord(&record->volume, tab);
+    } else if (record->format == kImageFormatHFS) {
         tabprint(0, "File format: Apple HFS volume image (not bootable)\n");
-        DescribeHFSVolume(fd, 0, tab);
+        PrintVolumeRecord(&record->volume, tab);
     } else {
         tabprint(0, "File is not a recognized disk image format.\n");
-        tabprint(0, "Currently this utility only recognizes raw HFS or Apple Partition Map format.\n");
+        tabprint(0, "Currently this utility only recognizes raw HFS or Apple Partition Map format,\n");
+        tabprint(0, "either as they are, inside a UDIF (.dmg), Disk Copy 4.2 or DART image,\n");
+        tabprint(0, "or compressed with gzip, bzip2, zstd or xz.\n");
+    }
+}
+
+int ProbeImageFile(const char *path, IOBackend backend, ImageIndex *index,
+                   ImageRecord **outRecord) {
+    ImageRecord *record = NULL;
+    ImageKey key;
+    StatsTimer timer;
+    int fd = -1, keyed = 0, result = 0;
+    StatsBegin(&timer, kStatsPhaseProbe);
+
+    // without content hashes, a hit in the index needs only a stat()
+    if (index && !IndexWantsHash(index) && IndexMakeKey(index, path, -1, &key) == 0) {
+        keyed = 1;
+        record = IndexLookup(index, &key);
+    }
+    if (!record) {
+        if ((fd = OpenImage(path, backend)) == -1) { result = errno; goto done; }
+        if (index && IndexWantsHash(index)) {
+            if (IndexMakeKey(index, path, fd, &key) != 0) { result = errno; goto done; }
+            keyed = 1;
+            record = IndexLookup(index, &key);
+        }
+    }
+    if (!record) {
+        if (!(record = ProbeImage(fd))) { result = (errno) ? errno : ENOMEM; goto done; }
+        if (keyed && record->format != kImageFormatUnreadable) {
+            IndexStore(index, &key, path, record);
+        }
     }
 done:
     if (fd != -1) {
-        close(fd);
+        IOClose(fd);
     }
+    StatsEnd(&timer);
+    *outRecord = record;
+    return result;
 }
 
+void DescribeFile(const char *inPathname, IOBackend backend, ImageIndex *index) {
+    ImageRecord *record = NULL;
+    char *name = basename((char*)inPathname);
+    int result;
+    tabprint(0, "Checking file \"%s\"\n",
+            (name) ? name : inPathname);
+
+    if ((result = ProbeImageFile(inPathname, backend, index, &record)) == 0) {
+        PrintImageRecord(record);
+    } else if (result == ENOTSUP && strcmp(inPathname, "-")) { // a pipe says why itself
+        tabprint(0, "File uses a feature this utility doesn't support (such as LZFSE\n");
+        tabprint(0, "or LZMA compression in a UDIF image, or zstd or xz compression in a\n");
+        tabprint(0, "build without those decoders).\n");
+    } else if (result == EINVAL) {
+        tabprint(0, "File is a UDIF, Disk Copy 4.2, DART, gzip, bzip2, zstd or xz image whose\n");
+        tabprint(0, "contents are damaged (or cut short), or a pipe which doesn't start\n");
+        tabprint(0, "with a device image or an HFS volume.\n");
+    }
+    free(record);
+}
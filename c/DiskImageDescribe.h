@@ -6,6 +6,12 @@
 //
 //  Modification History:
 //  Thu Jul 03 2025 (kcm) -- initial version
+//  Fri Oct 16 2026 -- files are opened through a selectable I/O backend
+//  Fri Oct 16 2026 -- added ProbeImage and the probe index
+//  Fri Oct 16 2026 -- added OpenImage, which reads UDIF images in place
+//  Fri Oct 16 2026 -- OpenImage reads Disk Copy 4.2 and DART images in place too
+//  Fri Oct 16 2026 -- and gzip and bzip2 streams
+//  Fri Oct 16 2026 -- OpenImage("-") reads standard input, through DiskImagePipe
 //
 //----------------------------------------------------------------------
 
@@ -13,6 +19,8 @@
 #define __diskimagedescribe_h__
 
 #include "DiskImageUtils.h"
+#include "DiskImageIO.h"
+#include "DiskImageIndex.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -21,7 +29,28 @@ extern "C" {
 void DescribeHFSPlusVolume(int fd, size_t offset, int tab);
 void DescribeHFSVolume(int fd, size_t offset, int tab);
 void DescribePartitionMap(int fd, size_t fileSize, int tab);
-void DescribeFile(const char *inPathname);
+void DescribeFile(const char *inPathname, IOBackend backend, ImageIndex *index);
+
+// IOOpen an image file for reading. If it is a UDIF (.dmg), Disk Copy 4.2
+// or DART image, or gzip or bzip2 compressed, reads of fd return the
+// image inside it. A path of "-" is standard input; a pipe there is read
+// in order, as a plain image (see DiskImagePipe.h). Returns -1 with
+// errno set if the file can't be opened, or is one of those but can't be
+// read.
+int OpenImage(const char *path, IOBackend backend);
+
+// Everything DescribeFile prints, as a malloc'd record, or NULL if the
+// file can't be stat'ed. A record whose format is kImageFormatUnreadable
+// has only its file size filled in.
+ImageRecord *ProbeImage(int fd);
+ImageRecord *ProbeImagePath(ImageIndex *index, const char *path, ImageKey *key);
+void PrintImageRecord(const ImageRecord *record);
+
+// The record for the file at path, from the index when it has a current
+// one, otherwise probed (and then stored in the index). Returns 0, or an
+// errno value if the file couldn't be opened or read.
+int ProbeImageFile(const char *path, IOBackend backend, ImageIndex *index,
+                   ImageRecord **record);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,481 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageDigest.c
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//
+//----------------------------------------------------------------------
+
+#include <pthread.h>
+#include "DiskImageUtils.h"
+#include "DiskImageIO.h"
+#include "DiskImageDigest.h"
+#if defined(__SHA__) && defined(__SSE4_1__)
+#define kSha256Intrinsics 1 // x86 SHA extensions
+#include <immintrin.h>
+#elif defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO)
+#define kSha256Intrinsics 2 // ARMv8 cryptography extensions (e.g. Apple silicon)
+#include <arm_neon.h>
+#endif
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#define kDigestSlots 8 // chunks queued between the copy and the hashers
+#define kDigestZerosSize (64*1024)
+
+//----------------------------------------------------------------------
+// SHA-256 (FIPS 180-4)
+//----------------------------------------------------------------------
+
+typedef struct Sha256 {
+    ulong state[8];
+    ulonglong length; // bytes so far
+    uchar block[64];
+    size_t used; // bytes waiting in block
+}   Sha256;
+
+static const ulong kSha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void Sha256Init(Sha256 *sha) {
+    static const ulong kInitial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(sha->state, kInitial, sizeof(kInitial));
+    sha->length = 0;
+    sha->used = 0;
+}
+
+#if kSha256Intrinsics == 1
+// Four rounds per step; the schedule for steps 4 on is built from the
+// previous four message vectors
+static void Sha256Blocks(Sha256 *sha, const uchar *p, size_t blocks) {
+    const __m128i kByteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i state0, state1, saved0, saved1, msg, tmp, w[4];
+    int i;
+    tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&sha->state[0]), 0xB1); // CDAB
+    state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&sha->state[4]), 0x1B); // EFGH
+    state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0); // CDGH
+    for (; blocks; blocks--, p += 64) {
+        saved0 = state0;
+        saved1 = state1;
+        for (i = 0; i < 16; i++) {
+            if (i < 4) {
+                w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + i*16)), kByteSwap);
+            } else {
+                tmp = _mm_alignr_epi8(w[(i+3) & 3], w[(i+2) & 3], 4);
+                w[i & 3] = _mm_sha256msg2_epu32(_mm_add_epi32(
+                    _mm_sha256msg1_epu32(w[i & 3], w[(i+1) & 3]), tmp), w[(i+3) & 3]);
+            }
+            msg = _mm_add_epi32(w[i & 3], _mm_loadu_si128((const __m128i*)&kSha256K[i*4]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E));
+        }
+        state0 = _mm_add_epi32(state0, saved0);
+        state1 = _mm_add_epi32(state1, saved1);
+    }
+    tmp = _mm_shuffle_epi32(state0, 0x1B); // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1); // DCHG
+    _mm_storeu_si128((__m128i*)&sha->state[0], _mm_blend_epi16(tmp, state1, 0xF0)); // DCBA
+    _mm_storeu_si128((__m128i*)&sha->state[4], _mm_alignr_epi8(state1, tmp, 8)); // HGFE
+}
+#elif kSha256Intrinsics == 2
+static void Sha256Blocks(Sha256 *sha, const uchar *p, size_t blocks) {
+    uint32x4_t state0 = vld1q_u32(&sha->state[0]), state1 = vld1q_u32(&sha->state[4]);
+    uint32x4_t saved0, saved1, msg, tmp, w[4];
+    int i;
+    for (; blocks; blocks--, p += 64) {
+        saved0 = state0;
+        saved1 = state1;
+        for (i = 0; i < 16; i++) {
+            if (i < 4) {
+                w[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(p + i*16)));
+            } else {
+                w[i & 3] = vsha256su1q_u32(vsha256su0q_u32(w[i & 3], w[(i+1) & 3]),
+                                           w[(i+2) & 3], w[(i+3) & 3]);
+            }
+            msg = vaddq_u32(w[i & 3], vld1q_u32(&kSha256K[i*4]));
+            tmp = state0;
+            state0 = vsha256hq_u32(state0, state1, msg);
+            state1 = vsha256h2q_u32(state1, tmp, msg);
+        }
+        state0 = vaddq_u32(state0, saved0);
+        state1 = vaddq_u32(state1, saved1);
+    }
+    vst1q_u32(&sha->state[0], state0);
+    vst1q_u32(&sha->state[4], state1);
+}
+#else
+static void Sha256Blocks(Sha256 *sha, const uchar *p, size_t blocks) {
+    ulong w[64], a, b, c, d, e, f, g, h, t1, t2;
+    int i;
+    for (; blocks; blocks--, p += 64) {
+        for (i = 0; i < 16; i++) {
+            w[i] = ((ulong)p[i*4] << 24) | ((ulong)p[i*4+1] << 16) |
+                   ((ulong)p[i*4+2] << 8) | p[i*4+3];
+        }
+        for (i = 16; i < 64; i++) {
+            ulong s0 = ROR32(w[i-15], 7) ^ ROR32(w[i-15], 18) ^ (w[i-15] >> 3);
+            ulong s1 = ROR32(w[i-2], 17) ^ ROR32(w[i-2], 19) ^ (w[i-2] >> 10);
+            w[i] = w[i-16] + s0 + w[i-7] + s1;
+        }
+        a = sha->state[0]; b = sha->state[1]; c = sha->state[2]; d = sha->state[3];
+        e = sha->state[4]; f = sha->state[5]; g = sha->state[6]; h = sha->state[7];
+        for (i = 0; i < 64; i++) {
+            t1 = h + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25)) + ((e & f) ^ (~e & g)) +
+                 kSha256K[i] + w[i];
+            t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        sha->state[0] += a; sha->state[1] += b; sha->state[2] += c; sha->state[3] += d;
+        sha->state[4] += e; sha->state[5] += f; sha->state[6] += g; sha->state[7] += h;
+    }
+}
+#endif
+
+static void Sha256Update(Sha256 *sha, const uchar *p, size_t length) {
+    size_t n;
+    sha->length += length;
+    if (sha->used) {
+        n = 64 - sha->used;
+        if (n > length) { n = length; }
+        memcpy(sha->block + sha->used, p, n);
+        sha->used += n;
+        p += n;
+        length -= n;
+        if (sha->used < 64) { return; }
+        Sha256Blocks(sha, sha->block, 1);
+        sha->used = 0;
+    }
+    Sha256Blocks(sha, p, length / 64);
+    p += length & ~(size_t)63;
+    length &= 63;
+    memcpy(sha->block, p, length);
+    sha->used = length;
+}
+
+static void Sha256Final(Sha256 *sha, uchar digest[32]) {
+    ulonglong bits = sha->length * 8;
+    int i;
+    sha->block[sha->used++] = 0x80;
+    if (sha->used > 56) {
+        memset(sha->block + sha->used, 0, 64 - sha->used);
+        Sha256Blocks(sha, sha->block, 1);
+        sha->used = 0;
+    }
+    memset(sha->block + sha->used, 0, 56 - sha->used);
+    for (i = 0; i < 8; i++) { sha->block[56 + i] = (uchar)(bits >> (56 - i*8)); }
+    Sha256Blocks(sha, sha->block, 1);
+    for (i = 0; i < 32; i++) { digest[i] = (uchar)(sha->state[i/4] >> (24 - (i%4)*8)); }
+}
+
+//----------------------------------------------------------------------
+// CRC32C, with the SSE4.2 or ARMv8 instruction where the compiler
+// targets it, and slicing-by-8 tables otherwise
+//----------------------------------------------------------------------
+
+#if !defined(__SSE4_2__) && !defined(__ARM_FEATURE_CRC32)
+static ulong gCrc32cTable[8][256];
+static pthread_once_t gCrc32cOnce = PTHREAD_ONCE_INIT;
+
+static void Crc32cInitTables(void) {
+    ulong crc;
+    int i, j;
+    for (i = 0; i < 256; i++) {
+        crc = i;
+        for (j = 0; j < 8; j++) { crc = (crc >> 1) ^ ((crc & 1) ? 0x82f63b78 : 0); }
+        gCrc32cTable[0][i] = crc;
+    }
+    for (i = 0; i < 256; i++) {
+        for (j = 1; j < 8; j++) {
+            crc = gCrc32cTable[j-1][i];
+            gCrc32cTable[j][i] = (crc >> 8) ^ gCrc32cTable[0][crc & 0xff];
+        }
+    }
+}
+#endif
+
+ulong Crc32c(ulong crc, const void *bytes, size_t length) {
+    const uchar *p = (const uchar*)bytes;
+    crc = ~crc;
+#if defined(__SSE4_2__) || defined(__ARM_FEATURE_CRC32)
+    ulonglong crc64 = crc, word;
+    for (; length && ((uintptr_t)p & 7); length--) {
+#if defined(__SSE4_2__)
+        crc64 = _mm_crc32_u8((ulong)crc64, *p++);
+#else
+        crc64 = __crc32cb((ulong)crc64, *p++);
+#endif
+    }
+    for (; length >= 8; length -= 8, p += 8) {
+        memcpy(&word, p, 8);
+#if defined(__SSE4_2__)
+        crc64 = _mm_crc32_u64(crc64, word);
+#else
+        crc64 = __crc32cd((ulong)crc64, word);
+#endif
+    }
+    for (; length; length--) {
+#if defined(__SSE4_2__)
+        crc64 = _mm_crc32_u8((ulong)crc64, *p++);
+#else
+        crc64 = __crc32cb((ulong)crc64, *p++);
+#endif
+    }
+    crc = (ulong)crc64;
+#else
+    pthread_once(&gCrc32cOnce, Crc32cInitTables);
+    for (; length && ((uintptr_t)p & 7); length--) {
+        crc = (crc >> 8) ^ gCrc32cTable[0][(crc ^ *p++) & 0xff];
+    }
+    for (; length >= 8; length -= 8, p += 8) {
+        ulong lo = crc ^ ((ulong)p[0] | ((ulong)p[1] << 8) | ((ulong)p[2] << 16) |
+                          ((ulong)p[3] << 24));
+        crc = gCrc32cTable[7][lo & 0xff] ^ gCrc32cTable[6][(lo >> 8) & 0xff] ^
+              gCrc32cTable[5][(lo >> 16) & 0xff] ^ gCrc32cTable[4][lo >> 24] ^
+              gCrc32cTable[3][p[4]] ^ gCrc32cTable[2][p[5]] ^
+              gCrc32cTable[1][p[6]] ^ gCrc32cTable[0][p[7]];
+    }
+    for (; length; length--) {
+        crc = (crc >> 8) ^ gCrc32cTable[0][(crc ^ *p++) & 0xff];
+    }
+#endif
+    return ~crc;
+}
+
+//----------------------------------------------------------------------
+// Hashing threads
+//----------------------------------------------------------------------
+
+typedef struct DigestChunk {
+    const char *data; // NULL for zeros
+    size_t length;
+    int streams;
+}   DigestChunk;
+
+// One stream's hasher, which takes every queued chunk in turn
+typedef struct DigestHasher {
+    Digest *digest;
+    int stream; // kDigestSource or kDigestOutput
+    Sha256 sha;
+    ulong crc;
+    ulonglong next; // sequence number of the next chunk to look at
+    pthread_t thread;
+    int running;
+}   DigestHasher;
+
+struct Digest {
+    pthread_mutex_t lock;
+    pthread_cond_t changed; // a chunk was queued, or one was hashed
+    DigestChunk slots[kDigestSlots];
+    char *buffers[kDigestSlots]; // DigestBuffer memory, one per slot
+    ulonglong submitted; // chunks queued so far
+    int finishing;
+    int sourceIncomplete;
+    DigestHasher hashers[2]; // output, then source if asked for
+    int hasherCount;
+    int patched;
+    ulonglong patchOffset;
+    ushort andMask, orMask;
+};
+
+static const uchar gDigestZeros[kDigestZerosSize];
+
+// Oldest chunk any hasher still needs; slots before it can be reused
+static ulonglong DigestOldest(Digest *digest) {
+    ulonglong oldest = digest->submitted;
+    int i;
+    for (i = 0; i < digest->hasherCount; i++) {
+        if (digest->hashers[i].next < oldest) { oldest = digest->hashers[i].next; }
+    }
+    return oldest;
+}
+
+static void DigestHash(DigestHasher *hasher, const uchar *p, size_t length) {
+    Sha256Update(&hasher->sha, p, length);
+    hasher->crc = Crc32c(hasher->crc, p, length);
+}
+
+// Hash bytes at the stream's current position, substituting the patched
+// field; the masks work a byte at a time, so a chunk may split the field
+static void DigestHashAt(DigestHasher *hasher, const uchar *p, size_t length) {
+    Digest *digest = hasher->digest;
+    ulonglong pos = hasher->sha.length, at;
+    size_t n;
+    uchar byte;
+    int i;
+    if (hasher->stream == kDigestOutput && digest->patched &&
+        digest->patchOffset + 2 > pos && digest->patchOffset < pos + length) {
+        for (i = 0; i < 2; i++) {
+            at = digest->patchOffset + i;
+            if (at < hasher->sha.length || at >= pos + length) { continue; }
+            n = at - hasher->sha.length;
+            DigestHash(hasher, p, n);
+            p += n;
+            byte = (*p++ & (uchar)(digest->andMask >> (8 - i*8))) |
+                   (uchar)(digest->orMask >> (8 - i*8));
+            DigestHash(hasher, &byte, 1);
+        }
+        length = pos + length - hasher->sha.length;
+    }
+    DigestHash(hasher, p, length);
+}
+
+static void *DigestThread(void *refCon) {
+    DigestHasher *hasher = (DigestHasher*)refCon;
+    Digest *digest = hasher->digest;
+    DigestChunk chunk;
+    size_t n;
+    pthread_mutex_lock(&digest->lock);
+    for (;;) {
+        while (hasher->next == digest->submitted && !digest->finishing) {
+            pthread_cond_wait(&digest->changed, &digest->lock);
+        }
+        if (hasher->next == digest->submitted) { break; }
+        chunk = digest->slots[hasher->next % kDigestSlots];
+        pthread_mutex_unlock(&digest->lock);
+        if (!(chunk.streams & hasher->stream)) {
+            // not part of this stream
+        } else if (chunk.data) {
+            DigestHashAt(hasher, (const uchar*)chunk.data, chunk.length);
+        } else {
+            for (; chunk.length; chunk.length -= n) {
+                n = (chunk.length < kDigestZerosSize) ? chunk.length : kDigestZerosSize;
+                DigestHashAt(hasher, gDigestZeros, n);
+            }
+        }
+        pthread_mutex_lock(&digest->lock);
+        hasher->next++;
+        pthread_cond_broadcast(&digest->changed);
+    }
+    pthread_mutex_unlock(&digest->lock);
+    return NULL;
+}
+
+static void DigestStop(Digest *digest) {
+    int i;
+    pthread_mutex_lock(&digest->lock);
+    digest->finishing = 1;
+    pthread_cond_broadcast(&digest->changed);
+    pthread_mutex_unlock(&digest->lock);
+    for (i = 0; i < digest->hasherCount; i++) {
+        if (digest->hashers[i].running) {
+            pthread_join(digest->hashers[i].thread, NULL);
+            digest->hashers[i].running = 0;
+        }
+    }
+}
+
+Digest *DigestCreate(size_t chunkSize, int withSource) {
+    Digest *digest = calloc(1, sizeof(Digest));
+    int i;
+    if (!digest) { return NULL; }
+    pthread_mutex_init(&digest->lock, NULL);
+    pthread_cond_init(&digest->changed, NULL);
+    digest->hasherCount = (withSource) ? 2 : 1;
+    for (i = 0; i < kDigestSlots; i++) {
+        if (!(digest->buffers[i] = IOAllocBuffer(chunkSize))) {
+            DigestFree(digest);
+            return NULL;
+        }
+    }
+    for (i = 0; i < digest->hasherCount; i++) {
+        DigestHasher *hasher = &digest->hashers[i];
+        hasher->digest = digest;
+        hasher->stream = (i == 0) ? kDigestOutput : kDigestSource;
+        Sha256Init(&hasher->sha);
+        if (pthread_create(&hasher->thread, NULL, DigestThread, hasher) != 0) {
+            DigestFree(digest);
+            return NULL;
+        }
+        hasher->running = 1;
+    }
+    return digest;
+}
+
+void DigestFree(Digest *digest) {
+    int i;
+    if (!digest) { return; }
+    DigestStop(digest);
+    for (i = 0; i < kDigestSlots; i++) { free(digest->buffers[i]); }
+    pthread_cond_destroy(&digest->changed);
+    pthread_mutex_destroy(&digest->lock);
+    free(digest);
+}
+
+// Wait until the next slot has been hashed by every stream
+static void DigestWaitForSlot(Digest *digest) {
+    while (digest->submitted - DigestOldest(digest) >= kDigestSlots) {
+        pthread_cond_wait(&digest->changed, &digest->lock);
+    }
+}
+
+char *DigestBuffer(Digest *digest) {
+    char *buffer;
+    pthread_mutex_lock(&digest->lock);
+    DigestWaitForSlot(digest);
+    buffer = digest->buffers[digest->submitted % kDigestSlots];
+    pthread_mutex_unlock(&digest->lock);
+    return buffer;
+}
+
+void DigestSubmit(Digest *digest, const void *data, size_t length, DigestStream streams) {
+    DigestChunk *chunk;
+    if (!length) { return; }
+    if (!data && streams == kDigestOutput) { digest->sourceIncomplete = 1; }
+    pthread_mutex_lock(&digest->lock);
+    DigestWaitForSlot(digest);
+    chunk = &digest->slots[digest->submitted % kDigestSlots];
+    chunk->data = (const char*)data;
+    chunk->length = length;
+    chunk->streams = streams;
+    digest->submitted++;
+    pthread_cond_broadcast(&digest->changed);
+    pthread_mutex_unlock(&digest->lock);
+}
+
+void DigestPatch(Digest *digest, ulonglong offset, ushort andMask, ushort orMask) {
+    digest->patched = 1;
+    digest->patchOffset = offset;
+    digest->andMask = andMask;
+    digest->orMask = orMask;
+}
+
+static void DigestValueOf(DigestHasher *hasher, DigestValue *value) {
+    value->length = hasher->sha.length;
+    value->crc32c = hasher->crc;
+    Sha256Final(&hasher->sha, value->sha256);
+}
+
+int DigestFinish(Digest *digest, DigestValue *source, DigestValue *output) {
+    int i;
+    DigestStop(digest);
+    memset(source, 0, sizeof(DigestValue));
+    memset(output, 0, sizeof(DigestValue));
+    for (i = 0; i < digest->hasherCount; i++) {
+        DigestHasher *hasher = &digest->hashers[i];
+        if (hasher->stream == kDigestOutput) {
+            DigestValueOf(hasher, output);
+        } else if (!digest->sourceIncomplete) {
+            DigestValueOf(hasher, source);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,67 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageDigest.h
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//
+//----------------------------------------------------------------------
+
+#ifndef __diskimagedigest_h__
+#define __diskimagedigest_h__
+
+#include "DiskImageUtils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct DigestValue {
+    uchar sha256[32];
+    ulong crc32c;
+    ulonglong length; // bytes hashed
+}   DigestValue;
+
+// The streams a chunk belongs to: the source region being copied, the
+// output file, or (for the copied data itself) both
+typedef enum DigestStream {
+    kDigestSource = 1,
+    kDigestOutput = 2,
+    kDigestBoth = 3
+}   DigestStream;
+
+// Hashes the data a copy moves on background threads (one per stream),
+// so that hashing overlaps the I/O rather than adding a second pass
+typedef struct Digest Digest;
+
+// Create a digest whose staging buffers hold chunkSize bytes. Without
+// withSource only the output stream is hashed.
+Digest *DigestCreate(size_t chunkSize, int withSource);
+void DigestFree(Digest *digest);
+
+// A buffer to read the next chunk into; it stays valid until the chunk
+// submitted after it has been hashed. Blocks while all are in use.
+char *DigestBuffer(Digest *digest);
+
+// Queue length bytes for hashing, in stream order. data may be a
+// DigestBuffer, memory that stays valid until DigestFinish, or NULL
+// for a run of zeros (a hole). Zeros sent to the output alone mean the
+// source skipped data, and leave its digest incomplete.
+void DigestSubmit(Digest *digest, const void *data, size_t length, DigestStream streams);
+
+// When the output stream reaches offset, hash the big-endian ushort
+// there as (value & andMask) | orMask, for a field patched after the copy
+void DigestPatch(Digest *digest, ulonglong offset, ushort andMask, ushort orMask);
+
+// Wait for the queued chunks and return the results; source is marked
+// by a zero length if it wasn't hashed, or only in part
+int DigestFinish(Digest *digest, DigestValue *source, DigestValue *output);
+
+// Standalone CRC32C (Castagnoli), continuing from crc (0 to start)
+ulong Crc32c(ulong crc, const void *bytes, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __diskimagedigest_h__ */
@@ -0,0 +1,504 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageFloppy.c
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//
+//----------------------------------------------------------------------
+
+#include <pthread.h>
+#include "DiskImageUtils.h"
+#include "DiskImageFloppy.h"
+#include "DiskImageIO.h"
+
+#define kFloppySectorSize 512
+#define kFloppyTagSize 12 // per sector
+#define kMacBinaryHeaderSize 128
+
+#define kDiskCopyHeaderSize 84
+#define kDiskCopyPrivate 0x0100
+#define kDiskCopyMaxData (64*1024*1024) // HD20 images are the largest
+
+#define kDARTBlockSectors 40
+#define kDARTBlockData (kDARTBlockSectors * kFloppySectorSize)
+#define kDARTBlockSize (kDARTBlockData + kDARTBlockSectors * kFloppyTagSize)
+#define kDARTMaxBlocks 72 // in a 1440K image; others have room for 40
+#define kDARTStoredRaw 0xFFFF // a block length for blocks stored as they are
+
+// LZHUF (Okumura's LHarc -lh1- coder): LZSS over a 4 KB window, matches
+// and literals coded with an adaptive Huffman tree
+#define kLZHWindow 4096
+#define kLZHMaxMatch 60
+#define kLZHThreshold 2
+#define kLZHChars (256 - kLZHThreshold + kLZHMaxMatch) // literals and lengths
+#define kLZHTable (kLZHChars * 2 - 1) // nodes in the tree
+#define kLZHRoot (kLZHTable - 1)
+#define kLZHMaxFreq 0x8000 // rebuild the tree when the root gets here
+
+typedef struct FloppyImage {
+    FloppySummary summary;
+    pthread_mutex_t lock; // guards the checksums and the decoded blocks
+    // Disk Copy 4.2
+    off_t dataStart; // of the sectors in the file
+    ulonglong verified; // bytes folded into sum, from the start
+    ulong sum;
+    // DART
+    off_t stored[kDARTMaxBlocks]; // where each block is in the file
+    ulong storedLength[kDARTMaxBlocks]; // as the header gives it (0 if absent)
+    int decoded[kDARTMaxBlocks];
+    char *data; // the disk's sectors, filled in as blocks are decoded
+}   FloppyImage;
+
+typedef struct LZHState {
+    const uchar *in;
+    size_t inLength;
+    size_t inPos;
+    unsigned bits; // next bits of input, from bit 15 down
+    int bitCount;
+    unsigned freq[kLZHTable + 1];
+    int parent[kLZHTable + kLZHChars]; // of nodes, then of leaves
+    int son[kLZHTable];
+}   LZHState;
+
+static ulong GetBE16(const uchar *p) {
+    return ((ulong)p[0] << 8) | p[1];
+}
+
+static ulong GetBE32(const uchar *p) {
+    return ((ulong)p[0] << 24) | ((ulong)p[1] << 16) | ((ulong)p[2] << 8) | p[3];
+}
+
+// Disk Copy 4.2's checksum: add each big-endian word, then rotate right
+static ulong DiskCopyChecksum(ulong sum, const uchar *p, size_t length) {
+    size_t i;
+    for (i = 0; i + 1 < length; i += 2) {
+        sum = (sum + GetBE16(p + i)) & 0xFFFFFFFF;
+        sum = ((sum >> 1) | (sum << 31)) & 0xFFFFFFFF;
+    }
+    return sum;
+}
+
+// Compare the folded data checksum, and the tags' (which leave out the
+// first sector's, as Disk Copy did), with the header's
+static int FinishChecksums(FloppyImage *image, int fd) {
+    FloppySummary *s = &image->summary;
+    uchar *tags = NULL;
+    ulong sum = 0;
+    ssize_t got;
+    if (image->sum != s->dataChecksum) {
+        s->checksum = kFloppyChecksumBadData;
+        return EILSEQ;
+    }
+    if (s->tagSize > kFloppyTagSize) {
+        if (!(tags = malloc(s->tagSize))) { return ENOMEM; }
+        got = IOReadRaw(fd, tags, s->tagSize, image->dataStart + s->imageSize);
+        if (got != (ssize_t)s->tagSize) {
+            free(tags);
+            return (got < 0) ? errno : EIO;
+        }
+        sum = DiskCopyChecksum(0, tags + kFloppyTagSize, s->tagSize - kFloppyTagSize);
+        free(tags);
+    }
+    s->checksum = (sum == s->tagChecksum) ? kFloppyChecksumGood : kFloppyChecksumBadTags;
+    return 0;
+}
+
+static ssize_t DiskCopyRead(void *refCon, int fd, void *buf, size_t length, off_t offset) {
+    FloppyImage *image = (FloppyImage*)refCon;
+    ulonglong end;
+    ssize_t got;
+    int result = 0;
+    if (offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((ulonglong)offset >= image->summary.imageSize) { return 0; }
+    if (length > image->summary.imageSize - offset) {
+        length = image->summary.imageSize - offset;
+    }
+    got = IOReadRaw(fd, buf, length, image->dataStart + offset);
+    if (got != (ssize_t)length) {
+        if (got >= 0) { errno = EIO; } // the file ends inside the sectors
+        return -1;
+    }
+    // fold in whatever this read adds to the run checked so far
+    pthread_mutex_lock(&image->lock);
+    end = (offset + length) & ~1ULL;
+    if (image->summary.checksum == kFloppyChecksumUnchecked &&
+        (ulonglong)offset <= image->verified && end > image->verified) {
+        image->sum = DiskCopyChecksum(image->sum, (uchar*)buf + (image->verified - offset),
+                                      end - image->verified);
+        image->verified = end;
+        if (image->verified == image->summary.imageSize) {
+            result = FinishChecksums(image, fd);
+        }
+    }
+    pthread_mutex_unlock(&image->lock);
+    if (result != 0) {
+        errno = result;
+        return -1;
+    }
+    return length;
+}
+
+// DART's "fast" compression: runs of big-endian words, each led by a
+// count; a positive count is followed by that many words, a negative one
+// by a single word to repeat
+static int DARTExpandRLE(const uchar *in, size_t inLength, uchar *out, size_t length) {
+    size_t ip = 0, op = 0, n;
+    short count;
+    while (op < length) {
+        if (inLength - ip < 2) { return EINVAL; }
+        count = (short)GetBE16(in + ip);
+        ip += 2;
+        if (count > 0) {
+            n = (size_t)count * 2;
+            if (n > inLength - ip || n > length - op) { return EINVAL; }
+            memcpy(out + op, in + ip, n);
+            ip += n;
+            op += n;
+        } else if (count < 0) {
+            n = (size_t)-count * 2;
+            if (inLength - ip < 2 || n > length - op) { return EINVAL; }
+            for (; n; n -= 2, op += 2) { memcpy(out + op, in + ip, 2); }
+            ip += 2;
+        } else {
+            return EINVAL;
+        }
+    }
+    return 0;
+}
+
+static int LZHBit(LZHState *s) {
+    int bit;
+    while (s->bitCount <= 8) {
+        // past the end, read zeros; the decoder looks a byte or two ahead
+        s->bits |= ((s->inPos < s->inLength) ? s->in[s->inPos] : 0) << (8 - s->bitCount);
+        s->inPos++;
+        s->bitCount += 8;
+    }
+    bit = (s->bits >> 15) & 1;
+    s->bits = (s->bits << 1) & 0xFFFF;
+    s->bitCount--;
+    return bit;
+}
+
+static int LZHByte(LZHState *s) {
+    int i, byte = 0;
+    for (i = 0; i < 8; i++) { byte = (byte << 1) | LZHBit(s); }
+    return byte;
+}
+
+static void LZHStart(LZHState *s) {
+    int i, j;
+    for (i = 0; i < kLZHChars; i++) {
+        s->freq[i] = 1;
+        s->son[i] = i + kLZHTable;
+        s->parent[i + kLZHTable] = i;
+    }
+    for (i = 0, j = kLZHChars; j <= kLZHRoot; i += 2, j++) {
+        s->freq[j] = s->freq[i] + s->freq[i + 1];
+        s->son[j] = i;
+        s->parent[i] = s->parent[i + 1] = j;
+    }
+    s->freq[kLZHTable] = 0xFFFF; // stops the searches in LZHUpdate
+    s->parent[kLZHRoot] = 0;
+}
+
+// Halve the frequencies and rebuild the tree from its leaves
+static void LZHRebuild(LZHState *s) {
+    int i, j, k;
+    unsigned f;
+    for (i = 0, j = 0; i < kLZHTable; i++) {
+        if (s->son[i] >= kLZHTable) {
+            s->freq[j] = (s->freq[i] + 1) / 2;
+            s->son[j] = s->son[i];
+            j++;
+        }
+    }
+    for (i = 0, j = kLZHChars; j < kLZHTable; i += 2, j++) {
+        f = s->freq[j] = s->freq[i] + s->freq[i + 1];
+        for (k = j - 1; f < s->freq[k]; k--) {}
+        k++;
+        memmove(&s->freq[k + 1], &s->freq[k], (j - k) * sizeof(s->freq[0]));
+        s->freq[k] = f;
+        memmove(&s->son[k + 1], &s->son[k], (j - k) * sizeof(s->son[0]));
+        s->son[k] = i;
+    }
+    for (i = 0; i < kLZHTable; i++) {
+        if ((k = s->son[i]) >= kLZHTable) {
+            s->parent[k] = i;
+        } else {
+            s->parent[k] = s->parent[k + 1] = i;
+        }
+    }
+}
+
+// Count one more of code c, keeping the tree ordered by frequency
+static void LZHUpdate(LZHState *s, int c) {
+    int i, j, l;
+    unsigned k;
+    if (s->freq[kLZHRoot] == kLZHMaxFreq) { LZHRebuild(s); }
+    c = s->parent[c + kLZHTable];
+    do {
+        k = ++s->freq[c];
+        if (k > s->freq[l = c + 1]) {
+            while (k > s->freq[++l]) {}
+            l--;
+            s->freq[c] = s->freq[l];
+            s->freq[l] = k;
+            i = s->son[c];
+            s->parent[i] = l;
+            if (i < kLZHTable) { s->parent[i + 1] = l; }
+            j = s->son[l];
+            s->son[l] = i;
+            s->parent[j] = c;
+            if (j < kLZHTable) { s->parent[j + 1] = c; }
+            s->son[c] = j;
+            c = l;
+        }
+    } while ((c = s->parent[c]) != 0);
+}
+
+static int LZHChar(LZHState *s) {
+    int c = s->son[kLZHRoot];
+    while (c < kLZHTable) { c = s->son[c + LZHBit(s)]; }
+    c -= kLZHTable;
+    LZHUpdate(s, c);
+    return c;
+}
+
+// A match's distance back: the upper 6 bits in a code of 3 to 8 bits
+// (shorter for nearer matches), then the lower 6 as they are
+static int LZHPosition(LZHState *s) {
+    int i = LZHByte(s), upper, bits;
+    if (i < 32) { upper = 0; bits = 3; }
+    else if (i < 80) { upper = 1 + (i - 32) / 16; bits = 4; }
+    else if (i < 144) { upper = 4 + (i - 80) / 8; bits = 5; }
+    else if (i < 192) { upper = 12 + (i - 144) / 4; bits = 6; }
+    else if (i < 240) { upper = 24 + (i - 192) / 2; bits = 7; }
+    else { upper = 48 + (i - 240); bits = 8; }
+    for (bits -= 2; bits > 0; bits--) { i = (i << 1) | LZHBit(s); }
+    return (upper << 6) | (i & 0x3F);
+}
+
+// DART's "best" compression
+static int LZHDecompress(const uchar *in, size_t inLength, uchar *out, size_t length) {
+    LZHState *s = calloc(1, sizeof(LZHState));
+    uchar window[kLZHWindow];
+    int c, r = kLZHWindow - kLZHMaxMatch, from, run, k;
+    size_t op = 0;
+    if (!s) { return ENOMEM; }
+    s->in = in;
+    s->inLength = inLength;
+    memset(window, ' ', sizeof(window));
+    LZHStart(s);
+    while (op < length && s->inPos <= inLength + 2) {
+        c = LZHChar(s);
+        if (c < 256) {
+            out[op++] = (uchar)c;
+            window[r++] = (uchar)c;
+            r &= kLZHWindow - 1;
+            continue;
+        }
+        from = (r - LZHPosition(s) - 1) & (kLZHWindow - 1);
+        run = c - 255 + kLZHThreshold;
+        for (k = 0; k < run && op < length; k++) {
+            c = window[(from + k) & (kLZHWindow - 1)];
+            out[op++] = (uchar)c;
+            window[r++] = (uchar)c;
+            r &= kLZHWindow - 1;
+        }
+    }
+    free(s);
+    return (op == length) ? 0 : EINVAL; // ran out of input first
+}
+
+// Decode block number index into the image's sectors; the tags are dropped
+static int DecodeDARTBlock(FloppyImage *image, int fd, size_t index) {
+    ulong stored = image->storedLength[index];
+    size_t length = (stored == kDARTStoredRaw) ? kDARTBlockSize :
+                    (image->summary.compression == kDARTCompressRLE) ? stored * 2 : stored;
+    char *in = NULL, *out = NULL;
+    ssize_t got;
+    int result = 0;
+    if (stored == 0) { return 0; } // not in the file; its sectors read as zeros
+    if (!(in = malloc(length)) || !(out = malloc(kDARTBlockSize))) {
+        result = ENOMEM;
+        goto done;
+    }
+    if ((got = IOReadRaw(fd, in, length, image->stored[index])) != (ssize_t)length) {
+        result = (got < 0) ? errno : EIO;
+        goto done;
+    }
+    if (stored == kDARTStoredRaw) {
+        memcpy(out, in, kDARTBlockSize);
+    } else if (image->summary.compression == kDARTCompressRLE) {
+        result = DARTExpandRLE((uchar*)in, length, (uchar*)out, kDARTBlockSize);
+    } else if (image->summary.compression == kDARTCompressLZH) {
+        result = LZHDecompress((uchar*)in, length, (uchar*)out, kDARTBlockSize);
+    } else {
+        result = EINVAL; // compressed blocks in an image that says it isn't
+    }
+    if (result == 0) {
+        memcpy(image->data + index * kDARTBlockData, out, kDARTBlockData);
+    }
+done:
+    free(in);
+    free(out);
+    return result;
+}
+
+static ssize_t DARTRead(void *refCon, int fd, void *buf, size_t length, off_t offset) {
+    FloppyImage *image = (FloppyImage*)refCon;
+    size_t first, last, i;
+    int result = 0;
+    if (offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((ulonglong)offset >= image->summary.imageSize) { return 0; }
+    if (length > image->summary.imageSize - offset) {
+        length = image->summary.imageSize - offset;
+    }
+    first = offset / kDARTBlockData;
+    last = (offset + length - 1) / kDARTBlockData;
+    pthread_mutex_lock(&image->lock);
+    for (i = first; result == 0 && i <= last; i++) {
+        if (!image->decoded[i] && (result = DecodeDARTBlock(image, fd, i)) == 0) {
+            image->decoded[i] = 1;
+        }
+    }
+    if (result == 0) { memcpy(buf, image->data + offset, length); }
+    pthread_mutex_unlock(&image->lock);
+    if (result != 0) {
+        errno = result;
+        return -1;
+    }
+    return length;
+}
+
+static void FloppyClose(void *refCon) {
+    FloppyImage *image = (FloppyImage*)refCon;
+    pthread_mutex_destroy(&image->lock);
+    free(image->data);
+    free(image);
+}
+
+// A Disk Copy 4.2 header at base: a name of up to 63 characters, sizes
+// that fit the file, and the private word Disk Copy always set
+static int ReadDiskCopyHeader(FloppyImage *image, const uchar *header, off_t base,
+                              off_t fileSize) {
+    FloppySummary *s = &image->summary;
+    ulonglong dataSize = GetBE32(header + 64), tagSize = GetBE32(header + 68);
+    if (header[0] > 63 || GetBE16(header + 82) != kDiskCopyPrivate) { return -1; }
+    if (dataSize == 0 || dataSize % kFloppySectorSize || dataSize > kDiskCopyMaxData ||
+        (tagSize && tagSize != dataSize / kFloppySectorSize * kFloppyTagSize)) {
+        return -1;
+    }
+    if (base + kDiskCopyHeaderSize + dataSize + tagSize > (ulonglong)fileSize) {
+        return EINVAL; // cut short
+    }
+    s->format = kFloppyDiskCopy42;
+    memcpy(s->name, header + 1, header[0]);
+    s->name[header[0]] = 0;
+    s->imageSize = dataSize;
+    s->tagSize = tagSize;
+    s->dataChecksum = GetBE32(header + 72);
+    s->tagChecksum = GetBE32(header + 76);
+    image->dataStart = base + kDiskCopyHeaderSize;
+    return 0;
+}
+
+// A DART header: compression, disk type and size in KB, then the stored
+// length of each block. DART has no signature, so the blocks must end
+// exactly where the file does.
+static int ReadDARTHeader(FloppyImage *image, const uchar *header, off_t fileSize) {
+    FloppySummary *s = &image->summary;
+    int compression = header[0], type = header[1];
+    ulong size = GetBE16(header + 2), length;
+    size_t i, blocks, entries = (size == 1440) ? kDARTMaxBlocks : 40;
+    off_t at = 4 + entries * 2;
+    if (compression > kDARTCompressNone || !((type >= 1 && type <= 3) ||
+        (type >= 16 && type <= 18))) {
+        return -1;
+    }
+    if (size != 400 && size != 720 && size != 800 && size != 1440) { return -1; }
+    blocks = size * 1024 / kDARTBlockData;
+    for (i = 0; i < entries; i++) {
+        length = GetBE16(header + 4 + i * 2);
+        if (i >= blocks) {
+            if (length) { return -1; }
+            continue;
+        }
+        image->stored[i] = at;
+        image->storedLength[i] = length;
+        at += (length == kDARTStoredRaw) ? kDARTBlockSize :
+              (compression == kDARTCompressRLE) ? length * 2 : length;
+        if (length) { s->blocks++; }
+    }
+    if (at != fileSize) { return -1; }
+    s->format = kFloppyDART;
+    s->compression = compression;
+    s->imageSize = (ulonglong)size * 1024;
+    s->tagSize = (ulonglong)blocks * kDARTBlockSectors * kFloppyTagSize;
+    return 0;
+}
+
+int FloppyAttach(int fd) {
+    uchar header[kMacBinaryHeaderSize + kDiskCopyHeaderSize];
+    FloppyImage *image = NULL;
+    IOFilter filter = {0};
+    off_t fileSize;
+    ssize_t got;
+    int result;
+    if ((fileSize = IOSize(fd)) < 0) { return errno; }
+    memset(header, 0, sizeof(header));
+    if ((got = IOReadRaw(fd, header, sizeof(header), 0)) < 0) { return errno; }
+    if (got < 4 + kDARTMaxBlocks * 2) { return -1; } // room for either header
+    if (!(image = calloc(1, sizeof(FloppyImage)))) { return ENOMEM; }
+    result = ReadDiskCopyHeader(image, header, 0, fileSize);
+    if (result == -1 && header[0] == 0 && header[74] == 0 && header[82] == 0 &&
+        header[1] >= 1 && header[1] <= 63) {
+        // a MacBinary header, which a download may have kept
+        result = ReadDiskCopyHeader(image, header + kMacBinaryHeaderSize,
+                                    kMacBinaryHeaderSize, fileSize);
+    }
+    if (result == -1) {
+        memset(image, 0, sizeof(FloppyImage));
+        result = ReadDARTHeader(image, header, fileSize);
+    }
+    if (result != 0) {
+        free(image);
+        return result;
+    }
+    pthread_mutex_init(&image->lock, NULL);
+    if (image->summary.format == kFloppyDART) {
+        if (!(image->data = calloc(1, image->summary.imageSize))) {
+            FloppyClose(image);
+            return ENOMEM;
+        }
+        filter.read = DARTRead;
+    } else {
+        filter.read = DiskCopyRead;
+    }
+    filter.close = FloppyClose;
+    filter.refCon = image;
+    filter.size = image->summary.imageSize;
+    if ((result = IOSetFilter(fd, &filter)) != 0) { FloppyClose(image); }
+    return result;
+}
+
+int FloppyAttached(int fd, FloppySummary *summary) {
+    IOFilter filter;
+    FloppyImage *image;
+    if (IOGetFilter(fd, &filter) != 0 || filter.close != FloppyClose) { return 0; }
+    if (summary) {
+        image = (FloppyImage*)filter.refCon;
+        pthread_mutex_lock(&image->lock);
+        *summary = image->summary;
+        pthread_mutex_unlock(&image->lock);
+    }
+    return 1;
+}
@@ -0,0 +1,74 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageFloppy.h
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//
+//----------------------------------------------------------------------
+
+#ifndef __diskimagefloppy_h__
+#define __diskimagefloppy_h__
+
+#include "DiskImageUtils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Disk Copy 4.2 and DART images, the formats most Macintosh floppies were
+// archived in, are read in place as UDIF images are: FloppyAttach sets an
+// IOFilter on the descriptor, so that IORead returns the disk's sectors.
+//
+// Disk Copy 4.2 keeps the sectors as they are after an 84-byte header (and
+// a MacBinary header, if the file kept one), with the 12-byte sector tags
+// after them. Its checksums are folded in as the sectors are read in
+// order, and checked by the read which reaches the end.
+//
+// DART keeps the disk in blocks of 40 sectors and their tags, each one
+// stored raw or compressed (RLE or LZH) on its own. A block is decoded the
+// first time one of its sectors is read.
+
+typedef enum FloppyFormat {
+    kFloppyNone = 0,
+    kFloppyDiskCopy42,
+    kFloppyDART
+}   FloppyFormat;
+
+typedef enum FloppyChecksum {
+    kFloppyChecksumUnchecked = 0, // not all of the sectors have been read in order
+    kFloppyChecksumGood,
+    kFloppyChecksumBadData, // the read which found it failed with EILSEQ
+    kFloppyChecksumBadTags // the sectors are good; the tags (which HFS ignores) aren't
+}   FloppyChecksum;
+
+#define kDARTCompressRLE  0 // "fast"
+#define kDARTCompressLZH  1 // "best"
+#define kDARTCompressNone 2
+
+typedef struct FloppySummary {
+    FloppyFormat format;
+    char name[64]; // of the disk (Disk Copy 4.2), as a C string
+    ulonglong imageSize; // bytes of sectors
+    ulonglong tagSize; // bytes of tags, which aren't part of the image
+    int compression; // how DART blocks are stored
+    size_t blocks; // DART blocks in the file
+    FloppyChecksum checksum; // Disk Copy 4.2
+    ulong dataChecksum; // as the header gives them
+    ulong tagChecksum;
+}   FloppySummary;
+
+// Look for a Disk Copy 4.2 or DART header at the start of fd (opened with
+// IOOpen) and, if there is one, filter fd through it. Returns 0, -1 if
+// the file is neither, or EINVAL if the header doesn't fit the file.
+int FloppyAttach(int fd);
+
+// Whether FloppyAttach has filtered fd, with what it knows so far if
+// summary isn't NULL
+int FloppyAttached(int fd, FloppySummary *summary);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __diskimagefloppy_h__ */
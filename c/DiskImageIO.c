@@ -0,0 +1,412 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageIO.c
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//  Fri Oct 16 2026 -- added the header cache
+//  Fri Oct 16 2026 -- counts calls, bytes, short transfers and retries for --stats
+//  Fri Oct 16 2026 -- added vectored writes
+//  Fri Oct 16 2026 -- added read filters
+//  Fri Oct 16 2026 -- added sequential reads and writes, for pipes
+//
+//----------------------------------------------------------------------
+
+#ifdef __linux__
+#define _GNU_SOURCE // O_DIRECT
+#endif
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include "DiskImageUtils.h"
+#include "DiskImageIO.h"
+#include "DiskImageStats.h"
+
+// Per-descriptor state, kept in a table indexed by fd so that the rest
+// of the code can keep passing plain file descriptors around
+typedef struct IOFile {
+    int open;
+    IOBackend backend;
+    char *map; // whole file, for kIOBackendMmap
+    size_t mapLen;
+    int twin; // cached descriptor for unaligned direct I/O, or -1
+    char *head; // first headLen bytes of the file, see IOCacheHead
+    size_t headLen;
+    IOFilter filter; // filter.read is set when the file holds the image
+}   IOFile;
+
+static pthread_rwlock_t gIOLock = PTHREAD_RWLOCK_INITIALIZER;
+static IOFile *gIOFiles = NULL;
+static int gIOFileCount = 0;
+
+static const char *kIOBackendNames[kIOBackendCount] = { "pread", "mmap", "direct" };
+
+const char *IOBackendName(IOBackend backend) {
+    return (backend < kIOBackendCount) ? kIOBackendNames[backend] : "unknown";
+}
+
+int IOBackendForName(const char *name, IOBackend *backend) {
+    int i;
+    for (i = 0; i < kIOBackendCount; i++) {
+        if (!strcmp(name, kIOBackendNames[i])) {
+            *backend = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static void IOLookup(int fd, IOFile *file) {
+    pthread_rwlock_rdlock(&gIOLock);
+    if (fd >= 0 && fd < gIOFileCount && gIOFiles[fd].open) {
+        *file = gIOFiles[fd];
+    } else {
+        memset(file, 0, sizeof(IOFile));
+        file->backend = kIOBackendPread;
+        file->twin = -1;
+    }
+    pthread_rwlock_unlock(&gIOLock);
+}
+
+static int IORegister(int fd, const IOFile *file) {
+    int result = 0;
+    pthread_rwlock_wrlock(&gIOLock);
+    if (fd >= gIOFileCount) {
+        int count = (fd + 1 > gIOFileCount * 2) ? fd + 1 : gIOFileCount * 2;
+        IOFile *p = realloc(gIOFiles, count * sizeof(IOFile));
+        if (p) {
+            memset(p + gIOFileCount, 0, (count - gIOFileCount) * sizeof(IOFile));
+            gIOFiles = p;
+            gIOFileCount = count;
+        } else {
+            result = ENOMEM;
+        }
+    }
+    if (!result) {
+        gIOFiles[fd] = *file;
+        gIOFiles[fd].open = 1;
+    }
+    pthread_rwlock_unlock(&gIOLock);
+    return result;
+}
+
+int IOOpen(const char *path, int flags, mode_t mode, IOBackend backend) {
+    IOFile file = {0};
+    struct stat sb = {0};
+    int fd;
+    file.twin = -1;
+    if (backend == kIOBackendMmap && (flags & O_ACCMODE) != O_RDONLY) {
+        backend = kIOBackendPread; // only the input is mapped
+    }
+    StatsCount(kStatsOtherCalls, 1);
+    if ((fd = open(path, flags, mode)) == -1) { return -1; }
+    if (backend == kIOBackendDirect) {
+#if defined(O_DIRECT)
+        // O_DIRECT needs aligned transfers, so keep a cached descriptor
+        // around for the odd header field which isn't
+        file.twin = fd;
+        StatsCount(kStatsOtherCalls, 1);
+        if ((fd = open(path, (flags | O_DIRECT) & ~(O_CREAT | O_TRUNC | O_EXCL))) == -1) {
+            fd = file.twin; // filesystem doesn't support it (e.g. tmpfs)
+            file.twin = -1;
+            backend = kIOBackendPread;
+        }
+#elif defined(F_NOCACHE)
+        if (fcntl(fd, F_NOCACHE, 1) == -1) { backend = kIOBackendPread; }
+#else
+        backend = kIOBackendPread;
+#endif
+    } else if (backend == kIOBackendMmap) {
+        StatsCount(kStatsOtherCalls, 3); // fstat, mmap, madvise
+        if (fstat(fd, &sb) == 0 && sb.st_size > 0 &&
+            (file.map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0)) != MAP_FAILED) {
+            file.mapLen = sb.st_size;
+            madvise(file.map, file.mapLen, MADV_SEQUENTIAL);
+        } else {
+            file.map = NULL;
+            backend = kIOBackendPread;
+        }
+    }
+    file.backend = backend;
+    if (IORegister(fd, &file) != 0) {
+        if (file.map) { munmap(file.map, file.mapLen); }
+        if (file.twin != -1) { close(file.twin); }
+        close(fd);
+        errno = ENOMEM;
+        return -1;
+    }
+    return fd;
+}
+
+int IOClose(int fd) {
+    IOFile file = {0};
+    pthread_rwlock_wrlock(&gIOLock);
+    if (fd >= 0 && fd < gIOFileCount && gIOFiles[fd].open) {
+        file = gIOFiles[fd];
+        memset(&gIOFiles[fd], 0, sizeof(IOFile));
+    }
+    pthread_rwlock_unlock(&gIOLock);
+    if (file.filter.close) { file.filter.close(file.filter.refCon); }
+    if (file.map) { munmap(file.map, file.mapLen); }
+    if (file.open && file.twin != -1) { close(file.twin); }
+    free(file.head);
+    StatsCount(kStatsOtherCalls, 1 + (file.map != NULL) + (file.open && file.twin != -1));
+    return close(fd);
+}
+
+IOBackend IOBackendOf(int fd) {
+    IOFile file;
+    IOLookup(fd, &file);
+    return file.backend;
+}
+
+static int IsDirectAligned(const void *buf, size_t length, off_t offset) {
+    return !(((uintptr_t)buf | length | (size_t)offset) & (kIODirectAlign - 1));
+}
+
+static ssize_t IOTransfer(const IOFile *file, int fd, int writing,
+                          char *buf, size_t length, off_t offset) {
+    size_t total = 0;
+    ssize_t count;
+    if (file->twin != -1 && !IsDirectAligned(buf, length, offset)) {
+        fd = file->twin;
+    }
+    while (total < length) {
+        count = (writing) ? pwrite(fd, buf + total, length - total, offset + total)
+                          : pread(fd, buf + total, length - total, offset + total);
+        StatsCount((writing) ? kStatsWriteCalls : kStatsReadCalls, 1);
+        if (count < 0) {
+            if (errno == EINTR) { StatsCount(kStatsRetries, 1); continue; }
+            if (errno == EINVAL && file->twin != -1 && fd != file->twin) {
+                fd = file->twin; // device wants bigger alignment than we used
+                StatsCount(kStatsRetries, 1);
+                continue;
+            }
+            return -1;
+        }
+        StatsCount((writing) ? kStatsBytesWritten : kStatsBytesRead, count);
+        if (count < length - total) {
+            StatsCount((writing) ? kStatsShortWrites : kStatsShortReads, 1);
+        }
+        if (count == 0) {
+            if (writing) { errno = EIO; return -1; }
+            break; // end of file
+        }
+        total += count;
+        if (fd != file->twin && file->twin != -1 &&
+            !IsDirectAligned(buf + total, length - total, offset + total)) {
+            fd = file->twin; // finish an unaligned remainder through the cache
+        }
+    }
+    return total;
+}
+
+// IORead past the head cache and any filter
+static ssize_t IOFileRead(const IOFile *file, int fd, void *buf, size_t length, off_t offset) {
+    if (file->map) {
+        if (offset >= file->mapLen) { return 0; }
+        if (length > file->mapLen - offset) { length = file->mapLen - offset; }
+        memcpy(buf, file->map + offset, length);
+        StatsCount(kStatsCachedReads, 1);
+        return length;
+    }
+    return IOTransfer(file, fd, 0, buf, length, offset);
+}
+
+ssize_t IORead(int fd, void *buf, size_t length, off_t offset) {
+    IOFile file;
+    IOLookup(fd, &file);
+    if (file.head && offset >= 0 && offset + length <= file.headLen) {
+        memcpy(buf, file.head + offset, length);
+        StatsCount(kStatsCachedReads, 1);
+        return length;
+    }
+    if (file.filter.read) {
+        return file.filter.read(file.filter.refCon, fd, buf, length, offset);
+    }
+    return IOFileRead(&file, fd, buf, length, offset);
+}
+
+ssize_t IOReadRaw(int fd, void *buf, size_t length, off_t offset) {
+    IOFile file;
+    IOLookup(fd, &file);
+    if (file.filter.read) { return IOFileRead(&file, fd, buf, length, offset); }
+    return IORead(fd, buf, length, offset);
+}
+
+static ssize_t IONext(int fd, int writing, char *buf, size_t length) {
+    size_t total = 0;
+    ssize_t count;
+    while (total < length) {
+        count = (writing) ? write(fd, buf + total, length - total)
+                          : read(fd, buf + total, length - total);
+        StatsCount((writing) ? kStatsWriteCalls : kStatsReadCalls, 1);
+        if (count < 0) {
+            if (errno == EINTR) { StatsCount(kStatsRetries, 1); continue; }
+            return -1;
+        }
+        StatsCount((writing) ? kStatsBytesWritten : kStatsBytesRead, count);
+        if (count < length - total) {
+            // the normal case for a pipe, which hands over what it holds
+            StatsCount((writing) ? kStatsShortWrites : kStatsShortReads, 1);
+        }
+        if (count == 0) {
+            if (writing) { errno = EIO; return -1; }
+            break; // end of input
+        }
+        total += count;
+    }
+    return total;
+}
+
+ssize_t IOReadNext(int fd, void *buf, size_t length) {
+    return IONext(fd, 0, buf, length);
+}
+
+ssize_t IOWriteNext(int fd, const void *buf, size_t length) {
+    return IONext(fd, 1, (char*)buf, length);
+}
+
+int IOSetFilter(int fd, const IOFilter *filter) {
+    int result = EBADF;
+    pthread_rwlock_wrlock(&gIOLock);
+    if (fd >= 0 && fd < gIOFileCount && gIOFiles[fd].open) {
+        // a cached head holds the file's bytes, not the image's
+        free(gIOFiles[fd].head);
+        gIOFiles[fd].head = NULL;
+        gIOFiles[fd].headLen = 0;
+        gIOFiles[fd].filter = *filter;
+        result = 0;
+    }
+    pthread_rwlock_unlock(&gIOLock);
+    return result;
+}
+
+int IOGetFilter(int fd, IOFilter *filter) {
+    IOFile file;
+    IOLookup(fd, &file);
+    if (!file.filter.read) { return -1; }
+    *filter = file.filter;
+    return 0;
+}
+
+off_t IOSize(int fd) {
+    IOFile file;
+    struct stat sb;
+    IOLookup(fd, &file);
+    if (file.filter.read) { return file.filter.size; }
+    StatsCount(kStatsOtherCalls, 1);
+    return (fstat(fd, &sb) < 0) ? -1 : sb.st_size;
+}
+
+ssize_t IOWrite(int fd, const void *buf, size_t length, off_t offset) {
+    IOFile file;
+    ssize_t count;
+    IOLookup(fd, &file);
+    count = IOTransfer(&file, fd, 1, (char*)buf, length, offset);
+    if (count > 0 && file.head && offset < file.headLen) {
+        // keep the cached copy in step with what is now on disk
+        size_t overlap = file.headLen - offset;
+        memcpy(file.head + offset, buf, (count < overlap) ? count : overlap);
+    }
+    return count;
+}
+
+ssize_t IOWritev(int fd, const struct iovec *iov, int count, off_t offset) {
+    IOFile file;
+    struct iovec vec[kIOMaxVectors];
+    struct iovec *v = vec;
+    size_t total = 0, done = 0, pos;
+    ssize_t n;
+    int i, vectors = count, aligned = 1, target = fd;
+    if (count < 1 || count > kIOMaxVectors) {
+        errno = EINVAL;
+        return -1;
+    }
+    IOLookup(fd, &file);
+    for (i = 0; i < count; i++) {
+        vec[i] = iov[i];
+        aligned = aligned && IsDirectAligned(iov[i].iov_base, iov[i].iov_len, offset + total);
+        total += iov[i].iov_len;
+    }
+    if (file.twin != -1 && !aligned) { target = file.twin; }
+    while (done < total) {
+        n = pwritev(target, v, count, offset + done);
+        StatsCount(kStatsWriteCalls, 1);
+        if (n < 0) {
+            if (errno == EINTR) { StatsCount(kStatsRetries, 1); continue; }
+            if (errno == EINVAL && file.twin != -1 && target != file.twin) {
+                target = file.twin; // device wants bigger alignment than we used
+                StatsCount(kStatsRetries, 1);
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) { errno = EIO; return -1; }
+        StatsCount(kStatsBytesWritten, n);
+        done += n;
+        if (done < total) {
+            StatsCount(kStatsShortWrites, 1);
+            // step over the vectors written, and into a partly written one
+            while ((size_t)n >= v->iov_len) { n -= v->iov_len; v++; count--; }
+            v->iov_base = (char*)v->iov_base + n;
+            v->iov_len -= n;
+        }
+    }
+    for (i = 0, pos = offset; file.head && i < vectors && pos < file.headLen;
+         pos += iov[i].iov_len, i++) {
+        // keep the cached copy in step with what is now on disk
+        size_t overlap = file.headLen - pos;
+        memcpy(file.head + pos, iov[i].iov_base,
+               (iov[i].iov_len < overlap) ? iov[i].iov_len : overlap);
+    }
+    return total;
+}
+
+int IOCacheHead(int fd, size_t length) {
+    IOFile file;
+    char *head;
+    ssize_t count;
+    IOLookup(fd, &file);
+    if (!file.open) { return EBADF; }
+    if ((file.map && !file.filter.read) || length <= file.headLen) {
+        return 0; // already in memory
+    }
+    if (file.head && file.headLen % kIODirectAlign) { return 0; } // hit end of file
+    length = (length + kIODirectAlign - 1) & ~(size_t)(kIODirectAlign - 1);
+    if (!(head = IOAllocBuffer(length))) { return ENOMEM; }
+    // only the part we don't have yet needs reading
+    if (file.headLen) { memcpy(head, file.head, file.headLen); }
+    if (file.filter.read) {
+        count = file.filter.read(file.filter.refCon, fd, head + file.headLen,
+                                 length - file.headLen, file.headLen);
+    } else {
+        count = IOTransfer(&file, fd, 0, head + file.headLen, length - file.headLen,
+                           file.headLen);
+    }
+    if (count < 0) {
+        free(head);
+        return errno;
+    }
+    pthread_rwlock_wrlock(&gIOLock);
+    free(gIOFiles[fd].head);
+    gIOFiles[fd].head = head;
+    gIOFiles[fd].headLen = file.headLen + count;
+    pthread_rwlock_unlock(&gIOLock);
+    return 0;
+}
+
+const void *IOMapped(int fd, off_t offset, size_t length) {
+    IOFile file;
+    IOLookup(fd, &file);
+    if (!file.map || file.filter.read || offset < 0 || offset + length > file.mapLen) {
+        return NULL;
+    }
+    return file.map + offset;
+}
+
+void *IOAllocBuffer(size_t length) {
+    void *p = NULL;
+    if (posix_memalign(&p, 4096, length) != 0) { return NULL; }
+    return p;
+}
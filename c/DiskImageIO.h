@@ -0,0 +1,106 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageIO.h
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//  Fri Oct 16 2026 -- added the header cache
+//  Fri Oct 16 2026 -- added IOWritev
+//  Fri Oct 16 2026 -- added read filters, for images inside containers
+//  Fri Oct 16 2026 -- added IOReadNext and IOWriteNext, for pipes
+//
+//----------------------------------------------------------------------
+
+#ifndef __diskimageio_h__
+#define __diskimageio_h__
+
+#include <sys/uio.h>
+#include "DiskImageUtils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// How image files are accessed. The backend is chosen when a file is
+// opened with IOOpen; all reads and writes then go through IORead and
+// IOWrite, which pick the right system calls for that file.
+typedef enum IOBackend {
+    kIOBackendPread = 0, // pread()/pwrite() through the page cache
+    kIOBackendMmap,      // input mapped read-only with sequential hints
+    kIOBackendDirect,    // O_DIRECT (F_NOCACHE on macOS), bypasses the cache
+    kIOBackendCount
+}   IOBackend;
+
+// Alignment of buffers, offsets and lengths for direct I/O
+#define kIODirectAlign 512
+
+const char *IOBackendName(IOBackend backend);
+int IOBackendForName(const char *name, IOBackend *backend);
+
+// open() a file for the given backend. Backends which don't apply to the
+// way a file is opened (e.g. mmap for an output file) fall back to pread.
+int IOOpen(const char *path, int flags, mode_t mode, IOBackend backend);
+int IOClose(int fd);
+IOBackend IOBackendOf(int fd);
+
+// Positional read and write which retry short transfers. IORead returns
+// fewer than length bytes only at end of file; both return -1 on error.
+// Files not opened with IOOpen are treated as kIOBackendPread.
+ssize_t IORead(int fd, void *buf, size_t length, off_t offset);
+ssize_t IOWrite(int fd, const void *buf, size_t length, off_t offset);
+
+// Write the buffers of iov one after another from offset, with as few
+// system calls as the kernel allows (one, normally). count may be up to
+// kIOMaxVectors. Returns the bytes written or -1, as IOWrite does.
+#define kIOMaxVectors 16
+ssize_t IOWritev(int fd, const struct iovec *iov, int count, off_t offset);
+
+// read() and write() at the descriptor's current position, for pipes
+// (and terminals), which can't be read or written at an offset. They
+// retry short transfers as IORead and IOWrite do, and return the same.
+ssize_t IOReadNext(int fd, void *buf, size_t length);
+ssize_t IOWriteNext(int fd, const void *buf, size_t length);
+
+// A filter presents a file whose bytes aren't the image itself (a
+// compressed container, say) as the image. Once one is set on a
+// descriptor, IORead and IOCacheHead return the image's bytes, which
+// read() produces from the file's own through IOReadRaw, and IOMapped
+// returns NULL. read() may be called on several threads at once.
+typedef struct IOFilter {
+    ssize_t (*read)(void *refCon, int fd, void *buf, size_t length, off_t offset);
+    void (*close)(void *refCon); // called by IOClose
+    void *refCon;
+    off_t size; // bytes in the image
+}   IOFilter;
+
+int IOSetFilter(int fd, const IOFilter *filter);
+
+// Copies the descriptor's filter to filter and returns 0, or -1 if it has none
+int IOGetFilter(int fd, IOFilter *filter);
+
+// IORead of the file's own bytes, past any filter
+ssize_t IOReadRaw(int fd, void *buf, size_t length, off_t offset);
+
+// Bytes in the image: the filter's size, or the file's. -1 on error.
+off_t IOSize(int fd);
+
+// For mapped files, a pointer to length bytes at offset, or NULL if the
+// file isn't mapped (or the range isn't inside it). Lets copy loops
+// write straight from the mapping without an intermediate memcpy.
+const void *IOMapped(int fd, off_t offset, size_t length);
+
+// Read the first length bytes of a file with one system call and keep
+// them, so the many small structure reads which follow are answered from
+// memory. Calling it again with a larger length reads only the part not
+// already cached. Reads that fall outside the cached bytes still go to
+// the file. The cache is freed by IOClose.
+int IOCacheHead(int fd, size_t length);
+
+// malloc() for I/O buffers, aligned so they suit every backend
+void *IOAllocBuffer(size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __diskimageio_h__ */
@@ -0,0 +1,512 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageIndex.c
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//  Fri Oct 16 2026 -- safe to share between threads
+//  Fri Oct 16 2026 -- version 2 records (partition problems, map size)
+//  Fri Oct 16 2026 -- version 3 records (container)
+//  Fri Oct 16 2026 -- an appended entry's space is claimed before its slot points at it
+//  Fri Oct 16 2026 -- files which aren't indexes are left alone, and entries are
+//                     bounds-checked before they are read
+//
+//----------------------------------------------------------------------
+
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include "DiskImageUtils.h"
+#include "DiskImageIndex.h"
+#include "DiskImageIO.h"
+
+// The index file is a header, an open-addressed table of fixed-size
+// slots hashed on (dev, ino), and a heap of variable-length entries (a
+// record followed by the image path) which new entries are appended to.
+// It is kept in host byte order, as it is only a cache for this machine.
+//
+// Writers take an exclusive flock() and write an entry before the slot
+// pointing at it. Readers take a shared lock and look things up in a
+// read-only mapping, remapping when a slot points past its end. When the
+// table fills up or IndexRebuild compacts it, a new file is written and
+// renamed over the old one, and the old one is marked obsolete so that
+// processes still reading it know to reopen.
+
+#define kIndexMagic 0x44495831 // 'DIX1'
+#define kIndexVersion 5 // bump when ImageRecord changes
+#define kIndexInitialSlots 1024
+#define kIndexHashSize (64*1024)
+
+typedef struct IndexHeader {
+    ulong magic;
+    ulong version;
+    ulong slotCount; // a power of two
+    ulong used;
+    ulonglong heapEnd; // file offset where the next entry goes
+    ulong obsolete; // set once a newer index has replaced this file
+    ulong pad[9];
+}   IndexHeader;
+
+typedef struct IndexSlot {
+    ImageKey key;
+    ulonglong offset; // of the entry, or 0 if the slot is empty
+    ulong recordLength;
+    ulong pathLength; // including the terminating nul
+}   IndexSlot;
+
+struct ImageIndex {
+    pthread_mutex_t lock; // flock() doesn't keep our own threads apart
+    char *path;
+    int hash;
+    int fd;
+    char *map;
+    size_t mapLen;
+    int create; // open with O_CREAT
+};
+
+static const IndexHeader *IndexMapHeader(ImageIndex *index) {
+    return (const IndexHeader*)index->map;
+}
+
+static const IndexSlot *IndexMapSlots(ImageIndex *index) {
+    return (const IndexSlot*)(index->map + sizeof(IndexHeader));
+}
+
+static ulonglong IndexHashKey(ulonglong dev, ulonglong ino) {
+    ulonglong h = (dev * 0x9E3779B97F4A7C15ULL) ^ ino;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static void IndexUnmap(ImageIndex *index) {
+    if (index->map) { munmap(index->map, index->mapLen); }
+    index->map = NULL;
+    index->mapLen = 0;
+}
+
+static int IndexMap(ImageIndex *index) {
+    struct stat sb;
+    IndexUnmap(index);
+    if (fstat(index->fd, &sb) < 0) { return errno; }
+    if (sb.st_size < sizeof(IndexHeader)) { return EINVAL; }
+    index->map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, index->fd, 0);
+    if (index->map == MAP_FAILED) {
+        index->map = NULL;
+        return errno;
+    }
+    index->mapLen = sb.st_size;
+    return 0;
+}
+
+static int IndexInitFile(int fd, ulong slotCount) {
+    IndexHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = kIndexMagic;
+    header.version = kIndexVersion;
+    header.slotCount = slotCount;
+    header.heapEnd = sizeof(IndexHeader) + (ulonglong)slotCount * sizeof(IndexSlot);
+    // down to nothing first, so whatever was there doesn't read as slots
+    if (ftruncate(fd, 0) < 0 || ftruncate(fd, header.heapEnd) < 0) { return errno; }
+    if (IOWrite(fd, &header, sizeof(header), 0) < 0) { return errno; }
+    return 0;
+}
+
+// Whether the mapped header and slot table are whole, and the table a
+// power of two in size, as IndexFindSlot needs
+static int IndexMapIsWhole(ImageIndex *index) {
+    const IndexHeader *header = IndexMapHeader(index);
+    return header->slotCount && !(header->slotCount & (header->slotCount - 1)) &&
+           sizeof(IndexHeader) + (ulonglong)header->slotCount * sizeof(IndexSlot) <=
+           index->mapLen;
+}
+
+// (Re)open the index file and map it, creating an empty index if the
+// file is new (and index->create is set). A file which isn't an index is
+// refused with EINVAL, and left as it is. Called with no lock held.
+static int IndexAttach(ImageIndex *index) {
+    const IndexHeader *header;
+    struct stat sb;
+    int result = 0;
+    IndexUnmap(index);
+    if (index->fd != -1) { close(index->fd); }
+    if ((index->fd = open(index->path, O_RDWR | ((index->create) ? O_CREAT : 0), 0644)) == -1) {
+        return errno;
+    }
+    if (flock(index->fd, LOCK_EX) < 0) { return errno; }
+    if (fstat(index->fd, &sb) < 0) {
+        result = errno;
+    } else if (sb.st_size == 0) {
+        result = IndexInitFile(index->fd, kIndexInitialSlots);
+    }
+    if (!result && !(result = IndexMap(index))) {
+        header = IndexMapHeader(index);
+        if (header->magic != kIndexMagic) {
+            result = EINVAL; // someone else's file
+        } else if (header->version != kIndexVersion || !IndexMapIsWhole(index)) {
+            // an older layout, or damaged: start again rather than guess
+            IndexUnmap(index);
+            if ((result = IndexInitFile(index->fd, kIndexInitialSlots)) == 0) {
+                result = IndexMap(index);
+            }
+        }
+    }
+    if (result) { IndexUnmap(index); }
+    flock(index->fd, LOCK_UN);
+    return result;
+}
+
+// Make sure we're looking at the current file, and that all of it is mapped
+static int IndexRefresh(ImageIndex *index) {
+    struct stat sb;
+    if (!index->map || IndexMapHeader(index)->obsolete) {
+        return IndexAttach(index);
+    }
+    if (fstat(index->fd, &sb) < 0) { return errno; }
+    if (sb.st_size != index->mapLen) { return IndexMap(index); }
+    return 0;
+}
+
+static ImageIndex *IndexOpenFile(const char *path, int hash, int create) {
+    ImageIndex *index = calloc(1, sizeof(ImageIndex));
+    int result;
+    if (!index) { return NULL; }
+    pthread_mutex_init(&index->lock, NULL);
+    index->fd = -1;
+    index->hash = hash;
+    index->create = create;
+    if (!(index->path = strdup(path))) {
+        result = ENOMEM;
+    } else {
+        result = IndexAttach(index);
+    }
+    if (result != 0) {
+        IndexClose(index);
+        errno = result;
+        return NULL;
+    }
+    return index;
+}
+
+ImageIndex *IndexOpen(const char *path, int hash) {
+    return IndexOpenFile(path, hash, 1);
+}
+
+ImageIndex *IndexOpenExisting(const char *path, int hash) {
+    return IndexOpenFile(path, hash, 0);
+}
+
+void IndexClose(ImageIndex *index) {
+    if (!index) { return; }
+    IndexUnmap(index);
+    if (index->fd != -1) { close(index->fd); }
+    pthread_mutex_destroy(&index->lock);
+    free(index->path);
+    free(index);
+}
+
+int IndexWantsHash(ImageIndex *index) {
+    return index->hash;
+}
+
+int IndexMakeKey(ImageIndex *index, const char *path, int fd, ImageKey *key) {
+    struct stat sb;
+    memset(key, 0, sizeof(ImageKey));
+    if (((fd != -1) ? fstat(fd, &sb) : stat(path, &sb)) < 0) { return errno; }
+    key->dev = sb.st_dev;
+    key->ino = sb.st_ino;
+    key->size = sb.st_size;
+#if defined(__APPLE__)
+    key->mtimeSec = sb.st_mtimespec.tv_sec;
+    key->mtimeNsec = sb.st_mtimespec.tv_nsec;
+#else
+    key->mtimeSec = sb.st_mtim.tv_sec;
+    key->mtimeNsec = sb.st_mtim.tv_nsec;
+#endif
+    if (index->hash && fd != -1) {
+        // FNV-1a over the header, which ReadImageHeader will want anyway
+        size_t length = (sb.st_size < kIndexHashSize) ? sb.st_size : kIndexHashSize;
+        ulonglong h = 0xCBF29CE484222325ULL;
+        uchar *buf = malloc(kIndexHashSize);
+        size_t i;
+        if (!buf) { return ENOMEM; }
+        if (IOCacheHead(fd, kIndexHashSize) != 0 || IORead(fd, buf, length, 0) < 0) {
+            free(buf);
+            return EIO;
+        }
+        for (i = 0; i < length; i++) {
+            h = (h ^ buf[i]) * 0x100000001B3ULL;
+        }
+        free(buf);
+        key->hash = h;
+        key->hashed = 1;
+    }
+    return 0;
+}
+
+static int IndexKeyMatches(const ImageKey *a, const ImageKey *b) {
+    return a->size == b->size && a->mtimeSec == b->mtimeSec &&
+           a->mtimeNsec == b->mtimeNsec && a->hashed == b->hashed &&
+           (!a->hashed || a->hash == b->hash);
+}
+
+// Slot holding (dev, ino), or the empty slot where it would go, or
+// slotCount if every slot is taken by something else
+static size_t IndexFindSlot(const IndexSlot *slots, ulong slotCount, const ImageKey *key) {
+    size_t mask = slotCount - 1;
+    size_t i = IndexHashKey(key->dev, key->ino) & mask;
+    size_t steps;
+    for (steps = 0; steps < slotCount; steps++) {
+        if (!slots[i].offset ||
+            (slots[i].key.dev == key->dev && slots[i].key.ino == key->ino)) {
+            return i;
+        }
+        i = (i + 1) & mask;
+    }
+    return slotCount;
+}
+
+// Whether slot's entry (a whole record, then a nul-terminated path) lies
+// inside the mapping
+static int IndexEntryFits(ImageIndex *index, const IndexSlot *slot) {
+    ulonglong end = slot->offset + slot->recordLength + slot->pathLength;
+    ulong length, partitionCount;
+    if (slot->recordLength < sizeof(ImageRecord) || slot->pathLength == 0 ||
+        slot->offset < sizeof(IndexHeader) || end < slot->offset || end > index->mapLen ||
+        index->map[end - 1] != '\0') {
+        return 0;
+    }
+    // entries follow paths of any length, so aren't aligned
+    memcpy(&length, index->map + slot->offset + offsetof(ImageRecord, length), sizeof(length));
+    memcpy(&partitionCount, index->map + slot->offset + offsetof(ImageRecord, partitionCount),
+           sizeof(partitionCount));
+    return length == slot->recordLength &&
+           sizeof(ImageRecord) + (ulonglong)partitionCount * sizeof(PartitionRecord) <= length;
+}
+
+ImageRecord *IndexLookup(ImageIndex *index, const ImageKey *key) {
+    const IndexHeader *header;
+    const IndexSlot *slot;
+    ImageRecord *record = NULL;
+    size_t i;
+    pthread_mutex_lock(&index->lock);
+    if (IndexRefresh(index) != 0) { goto unlock; }
+    if (flock(index->fd, LOCK_SH) < 0) { goto unlock; }
+    header = IndexMapHeader(index);
+    i = IndexFindSlot(IndexMapSlots(index), header->slotCount, key);
+    if (i == header->slotCount) { goto done; }
+    slot = &IndexMapSlots(index)[i];
+    if (slot->offset && IndexKeyMatches(&slot->key, key)) {
+        if (slot->offset + slot->recordLength > index->mapLen && IndexMap(index) != 0) {
+            goto done;
+        }
+        slot = &IndexMapSlots(index)[i]; // the same file, so the same slot
+        if (!IndexEntryFits(index, slot)) { goto done; } // damaged; treat as a miss
+        if ((record = malloc(slot->recordLength)) != NULL) {
+            memcpy(record, index->map + slot->offset, slot->recordLength);
+        }
+    }
+done:
+    flock(index->fd, LOCK_UN);
+unlock:
+    pthread_mutex_unlock(&index->lock);
+    return record;
+}
+
+// Append an entry and point the (dev, ino) slot at it, in the file open
+// on fd which is locked and mapped at map. Returns ENOSPC if the table is
+// more than half full and has to grow first.
+static int IndexAppend(int fd, const char *map, const ImageKey *key, const char *path,
+                       const ImageRecord *record, ulong recordLength) {
+    const IndexHeader *header = (const IndexHeader*)map;
+    const IndexSlot *slots = (const IndexSlot*)(map + sizeof(IndexHeader));
+    IndexHeader newHeader = *header;
+    IndexSlot slot;
+    size_t i = IndexFindSlot(slots, header->slotCount, key);
+    ulong pathLength = strlen(path) + 1;
+    int isNew;
+    if (i == header->slotCount) { return ENOSPC; } // full of others' slots
+    isNew = !slots[i].offset; // check now; the mapping sees our writes
+    if (isNew && (header->used + 1) * 2 > header->slotCount) {
+        return ENOSPC;
+    }
+    memset(&slot, 0, sizeof(slot));
+    slot.key = *key;
+    slot.offset = header->heapEnd;
+    slot.recordLength = recordLength;
+    slot.pathLength = pathLength;
+    // the entry, then the header claiming its space, and only then the
+    // slot, so a crash part way never leaves a slot pointing at space the
+    // next append would reuse (at worst used counts one slot too many)
+    if (IOWrite(fd, record, recordLength, slot.offset) < 0 ||
+        IOWrite(fd, path, pathLength, slot.offset + recordLength) < 0) {
+        return errno;
+    }
+    if (isNew) { newHeader.used++; }
+    newHeader.heapEnd = slot.offset + recordLength + pathLength;
+    if (IOWrite(fd, &newHeader, sizeof(newHeader), 0) < 0) { return errno; }
+    if (IOWrite(fd, &slot, sizeof(slot), sizeof(IndexHeader) + i * sizeof(IndexSlot)) < 0) {
+        return errno;
+    }
+    return 0;
+}
+
+typedef struct IndexWriter {
+    char *tmpPath;
+    int fd;
+    char *map;
+    size_t mapLen;
+}   IndexWriter;
+
+// Map the header and slot table of a new file; entries are only ever
+// appended past them, so the one mapping stays good while it is filled
+static int IndexWriterMap(IndexWriter *w) {
+    struct stat sb;
+    if (fstat(w->fd, &sb) < 0) { return errno; }
+    w->map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, w->fd, 0);
+    if (w->map == MAP_FAILED) {
+        w->map = NULL;
+        return errno;
+    }
+    w->mapLen = sb.st_size;
+    return 0;
+}
+
+// Copy every live entry of the current file that keep() accepts into a
+// new file with room for at least minSlots, then swap it into place.
+// Called with the exclusive lock held on the current file.
+typedef int (*IndexKeepProc)(void *refCon, const IndexSlot *slot, const char *entry,
+                             IndexWriter *w);
+
+static int IndexRewrite(ImageIndex *index, ulong minSlots, IndexKeepProc keep, void *refCon) {
+    const IndexHeader *header = IndexMapHeader(index);
+    const IndexSlot *slots = IndexMapSlots(index);
+    IndexWriter w = { NULL, -1, NULL, 0 };
+    ulong slotCount = kIndexInitialSlots, i;
+    ulong obsolete = 1;
+    int result;
+    while (slotCount < minSlots * 2) { slotCount *= 2; }
+    if (!(w.tmpPath = malloc(strlen(index->path) + 8))) { return ENOMEM; }
+    sprintf(w.tmpPath, "%s.new", index->path);
+    if ((w.fd = open(w.tmpPath, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1) {
+        result = errno;
+        goto done;
+    }
+    if ((result = IndexInitFile(w.fd, slotCount)) != 0) { goto done; }
+    if ((result = IndexWriterMap(&w)) != 0) { goto done; }
+    for (i = 0; i < header->slotCount && !result; i++) {
+        if (!slots[i].offset || !IndexEntryFits(index, &slots[i])) { continue; }
+        if (keep) {
+            result = keep(refCon, &slots[i], index->map + slots[i].offset, &w);
+        } else {
+            result = IndexAppend(w.fd, w.map, &slots[i].key,
+                                 index->map + slots[i].offset + slots[i].recordLength,
+                                 (const ImageRecord*)(index->map + slots[i].offset),
+                                 slots[i].recordLength);
+        }
+    }
+    if (!result && rename(w.tmpPath, index->path) < 0) { result = errno; }
+    if (!result) {
+        // tell anyone still reading the old file to reopen
+        IOWrite(index->fd, &obsolete, sizeof(obsolete), offsetof(IndexHeader, obsolete));
+    }
+done:
+    if (w.map) { munmap(w.map, w.mapLen); }
+    if (w.fd != -1) { close(w.fd); }
+    if (result) { unlink(w.tmpPath); }
+    free(w.tmpPath);
+    return result;
+}
+
+int IndexStore(ImageIndex *index, const ImageKey *key, const char *path,
+               const ImageRecord *record) {
+    int result, tries;
+    pthread_mutex_lock(&index->lock);
+    for (tries = 0; tries < 4; tries++) {
+        if ((result = IndexRefresh(index)) != 0) { break; }
+        if (flock(index->fd, LOCK_EX) < 0) {
+            result = errno;
+            break;
+        }
+        // another process may have replaced or grown the file meanwhile
+        if ((result = IndexMap(index)) == 0 && !IndexMapHeader(index)->obsolete) {
+            result = IndexAppend(index->fd, index->map, key, path, record, record->length);
+            if (result == ENOSPC) {
+                result = IndexRewrite(index, IndexMapHeader(index)->used + 1, NULL, NULL);
+                if (!result) { result = EAGAIN; } // store into the new file
+            }
+        } else if (!result) {
+            result = EAGAIN;
+        }
+        flock(index->fd, LOCK_UN);
+        if (result != EAGAIN) { break; }
+        IndexUnmap(index); // forces IndexRefresh to reattach
+    }
+    pthread_mutex_unlock(&index->lock);
+    return result;
+}
+
+typedef struct IndexRebuildState {
+    ImageIndex *index;
+    IndexProbeProc proc;
+    size_t kept, updated, dropped;
+}   IndexRebuildState;
+
+static int IndexRebuildEntry(void *refCon, const IndexSlot *slot, const char *entry,
+                             IndexWriter *w) {
+    IndexRebuildState *state = (IndexRebuildState*)refCon;
+    const char *path = entry + slot->recordLength;
+    ImageRecord *record;
+    ImageKey key;
+    struct stat sb;
+    int result;
+    if (stat(path, &sb) < 0 || sb.st_dev != slot->key.dev || sb.st_ino != slot->key.ino) {
+        state->dropped++; // gone, or a different file now has that name
+        return 0;
+    }
+    if (!state->index->hash && !slot->key.hashed && sb.st_size == slot->key.size) {
+        ImageKey current;
+        if (IndexMakeKey(state->index, path, -1, &current) == 0 &&
+            IndexKeyMatches(&slot->key, &current)) {
+            state->kept++;
+            return IndexAppend(w->fd, w->map, &slot->key, path,
+                               (const ImageRecord*)entry, slot->recordLength);
+        }
+    }
+    // changed, or hashed keys which can only be checked by reading the file
+    if (!(record = state->proc(state->index, path, &key))) {
+        state->dropped++;
+        return 0;
+    }
+    if (slot->key.hashed && key.hashed && IndexKeyMatches(&slot->key, &key)) {
+        state->kept++;
+    } else {
+        state->updated++;
+    }
+    result = IndexAppend(w->fd, w->map, &key, path, record, record->length);
+    free(record);
+    return result;
+}
+
+int IndexRebuild(ImageIndex *index, IndexProbeProc proc) {
+    IndexRebuildState state = { index, proc, 0, 0, 0 };
+    int result;
+    pthread_mutex_lock(&index->lock);
+    if ((result = IndexRefresh(index)) == 0 && flock(index->fd, LOCK_EX) < 0) {
+        result = errno;
+    } else if (result == 0) {
+        if ((result = IndexMap(index)) == 0) {
+            result = IndexRewrite(index, IndexMapHeader(index)->used, IndexRebuildEntry, &state);
+        }
+        flock(index->fd, LOCK_UN);
+    }
+    if (!result) { result = IndexAttach(index); }
+    pthread_mutex_unlock(&index->lock);
+    if (!result) {
+        tabprint(0, "Kept %ld, updated %ld, dropped %ld entries\n",
+                 state.kept, state.updated, state.dropped);
+    }
+    return result;
+}
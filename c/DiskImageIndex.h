@@ -0,0 +1,140 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageIndex.h
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//  Fri Oct 16 2026 -- partition records carry the problems found validating them
+//  Fri Oct 16 2026 -- image records say which container the image was read from
+//  Fri Oct 16 2026 -- added the Disk Copy 4.2 and DART containers
+//  Fri Oct 16 2026 -- added the gzip and bzip2 containers
+//  Fri Oct 16 2026 -- added the zstd and xz containers
+//  Fri Oct 16 2026 -- IndexOpenExisting, for reindex
+//
+//----------------------------------------------------------------------
+
+#ifndef __diskimageindex_h__
+#define __diskimageindex_h__
+
+#include "DiskImageUtils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// What probing an image found: everything DescribeFile prints and
+// ConvertFile needs to plan a conversion, so that either can run from a
+// cached record without touching the image.
+typedef enum ImageFormat {
+    kImageFormatUnknown = 0,
+    kImageFormatAPM,         // Apple Partition Map device image
+    kImageFormatHFSBootable, // raw HFS volume with 'LK' boot blocks
+    kImageFormatHFS,         // raw HFS or HFS+ volume, not bootable
+    kImageFormatUnreadable   // the header couldn't be read
+}   ImageFormat;
+
+// What the image was read out of, for images stored inside another format
+typedef enum ImageContainer {
+    kImageContainerNone = 0, // the file is the image
+    kImageContainerUDIF,     // a UDIF (.dmg) image, see DiskImageUDIF.h
+    kImageContainerDiskCopy42, // a Disk Copy 4.2 image, see DiskImageFloppy.h
+    kImageContainerDART,     // a DART image, likewise
+    kImageContainerGzip,     // a gzip stream, see DiskImageStream.h
+    kImageContainerBzip2,    // a bzip2 stream, likewise
+    kImageContainerZstd,     // a zstd stream, likewise
+    kImageContainerXz        // an xz stream, likewise
+}   ImageContainer;
+
+typedef enum VolumeStatus {
+    kVolumeOK = 0,
+    kVolumeBootBlockError,   // couldn't read the boot blocks
+    kVolumeMDBError,         // couldn't read the master directory block
+    kVolumeHeaderError       // couldn't read the HFS+ volume header
+}   VolumeStatus;
+
+typedef struct VolumeRecord {
+    ulong status; // VolumeStatus
+    ushort bootSig;
+    ushort bootVersion;
+    ushort sigWord; // 'BD' or 'H+' from the MDB
+    ushort pad;
+    char name[32]; // HFS only
+    ulong createDate;
+    ulong modifyDate;
+    ulong blockSize;
+    ulong totalBlocks;
+    ulong freeBlocks;
+}   VolumeRecord;
+
+typedef struct PartitionRecord {
+    char name[34];
+    char type[34];
+    ulong start; // in 512-byte blocks
+    ulong blocks;
+    ulong bootSize; // Apple_Driver* only
+    ulong bootCksum; // as stored in the map entry
+    ulong computedCksum; // over the driver code
+    ulong problems; // PartitionProblem bits from validating the entry
+    VolumeRecord volume; // Apple_HFS only
+}   PartitionRecord;
+
+typedef struct ImageRecord {
+    ulong length; // bytes in the record, including the partitions
+    ulong format; // ImageFormat
+    ulonglong fileSize;
+    ulonglong deviceSize; // from the DDR
+    ushort ddrSig;
+    ushort container; // ImageContainer
+    ushort pad[2];
+    VolumeRecord volume; // raw volume images only
+    ulong partitionCount;
+    ulong mapBlocks; // pmMapBlkCnt from the first map entry
+    PartitionRecord partitions[];
+}   ImageRecord;
+
+// Identifies one version of one image file. hashed is set when the key
+// also carries a hash of the image header, which catches files rewritten
+// in place without their size or mtime changing.
+typedef struct ImageKey {
+    ulonglong dev;
+    ulonglong ino;
+    ulonglong size;
+    long long mtimeSec;
+    ulong mtimeNsec;
+    ulong hashed;
+    ulonglong hash;
+}   ImageKey;
+
+typedef struct ImageIndex ImageIndex;
+
+// Builds a fresh record for path (for IndexRebuild); the caller frees it
+typedef ImageRecord *(*IndexProbeProc)(ImageIndex *index, const char *path, ImageKey *key);
+
+// Open, creating if needed, the index file at path. With hash set, keys
+// made by IndexMakeKey include a hash of the first 64 KB of each image.
+// Returns NULL with errno set, EINVAL if the file isn't an index.
+ImageIndex *IndexOpen(const char *path, int hash);
+// Likewise, but only if the file is there already (ENOENT if not)
+ImageIndex *IndexOpenExisting(const char *path, int hash);
+void IndexClose(ImageIndex *index);
+
+// Fill in the key for an image: a stat() alone, plus one read of the
+// image header (fd must then be open on it) when the index hashes.
+int IndexMakeKey(ImageIndex *index, const char *path, int fd, ImageKey *key);
+int IndexWantsHash(ImageIndex *index);
+
+// Look up a key; returns a malloc'd copy of the record, or NULL if the
+// index has nothing for that file or only a stale record for it
+ImageRecord *IndexLookup(ImageIndex *index, const ImageKey *key);
+int IndexStore(ImageIndex *index, const ImageKey *key, const char *path,
+               const ImageRecord *record);
+
+// Re-check every entry: drop the ones whose files are gone, re-probe the
+// ones whose files changed, and compact the result into a new file
+int IndexRebuild(ImageIndex *index, IndexProbeProc proc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __diskimageindex_h__ */
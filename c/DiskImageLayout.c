@@ -0,0 +1,208 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageLayout.c
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//
+//----------------------------------------------------------------------
+
+#include "DiskImageUtils.h"
+#include "DiskImageLayout.h"
+#include "Driver.h"
+
+/*
+    pmPartStatus (from IM:Devices 3-26):
+    Two words of status information about the partition.
+    The low-order byte of the low-order word contains status information
+    used only by the A/UX operating system:
+        Bit Meaning
+        0   Set if a valid partition map entry
+        1   Set if partition is already allocated; clear if available
+        2   Set if partition is in use; may be cleared after a system reset
+        3   Set if partition contains valid boot information
+        4   Set if partition allows reading
+        5   Set if partition allows writing
+        6   Set if boot code is position-independent
+        7   Unused
+*/
+
+const LayoutDriver kLayoutDriver43 = {
+    "Macintosh", "Apple_Driver43", _Apple_Driver43, sizeof(_Apple_Driver43),
+    0x0000F624, // 16-bit checksum
+    1, // MacOS
+    "68000",
+    0x7F,
+    // %%% mystery bytes. what is this doing? it seems to be necessary.
+    { 0x00, 0x01, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00 }
+};
+
+static ulong BlocksFor(size_t length) {
+    return (ulong)((length + kLayoutBlockSize - 1) / kLayoutBlockSize);
+}
+
+void LayoutStandard(DeviceLayout *layout, LayoutPartition *parts,
+                    const size_t *volumeLengths, size_t count, int rw) {
+    size_t i;
+    memset(parts, 0, (count + 2) * sizeof(LayoutPartition));
+    parts[0].kind = kLayoutMap;
+    strcpy(parts[0].name, "Apple");
+    parts[0].type = "Apple_partition_map";
+    parts[0].start = 1;
+    parts[0].blocks = 63; // all of the space before the driver
+    parts[0].status = 0x37;
+    parts[1].kind = kLayoutDriver;
+    parts[1].start = 64; // 0x8000
+    parts[1].blocks = 32;
+    parts[1].driver = &kLayoutDriver43;
+    for (i = 0; i < count; i++) {
+        LayoutPartition *part = &parts[i + 2];
+        part->kind = kLayoutVolume;
+        if (i == 0) {
+            strcpy(part->name, "MacOS");
+        } else {
+            snprintf(part->name, sizeof(part->name), "MacOS %zu", i + 1);
+        }
+        part->type = "Apple_HFS";
+        part->status = (rw) ? 0xB7 : 0x97; // writable if bit 5 set
+        part->length = volumeLengths[i];
+    }
+    layout->headerBlocks = kLayoutHeaderBlocks;
+    layout->partitions = parts;
+    layout->count = count + 2;
+}
+
+int LayoutPlace(DeviceLayout *layout) {
+    LayoutPartition *p, *q;
+    ulong next = 1; // block 0 is the DDR
+    size_t i, j, maps = 0;
+    for (i = 0; i < layout->count; i++) {
+        p = &layout->partitions[i];
+        if (!p->start) {
+            p->start = (p->kind == kLayoutVolume && next < layout->headerBlocks) ?
+                       layout->headerBlocks : next;
+        }
+        if (!p->blocks) {
+            p->blocks = (p->kind == kLayoutMap) ? (ulong)layout->count :
+                        (p->kind == kLayoutDriver) ? BlocksFor(p->driver->codeSize) :
+                        BlocksFor(p->length);
+        }
+        switch (p->kind) {
+            case kLayoutMap:
+                // the entries are the blocks from 1, so that's where it goes
+                if (p->start != 1 || p->blocks < layout->count) { return EINVAL; }
+                maps++;
+                break;
+            case kLayoutDriver:
+                if (!p->driver || p->driver->codeSize > (size_t)p->blocks * kLayoutBlockSize) {
+                    return EINVAL;
+                }
+                break;
+            case kLayoutVolume:
+                if (p->length > (size_t)p->blocks * kLayoutBlockSize) { return EINVAL; }
+                break;
+        }
+        if (p->kind != kLayoutVolume && p->start + p->blocks > layout->headerBlocks) {
+            return EINVAL; // the header is all that gets written for these
+        }
+        next = p->start + p->blocks;
+    }
+    if (maps != 1) { return EINVAL; }
+    for (i = 0; i < layout->count; i++) {
+        p = &layout->partitions[i];
+        for (j = i + 1; j < layout->count; j++) {
+            q = &layout->partitions[j];
+            if ((ulonglong)p->start < (ulonglong)q->start + q->blocks &&
+                (ulonglong)q->start < (ulonglong)p->start + p->blocks) {
+                return EINVAL;
+            }
+        }
+    }
+    return 0;
+}
+
+ulonglong LayoutDeviceSize(const DeviceLayout *layout) {
+    ulonglong end = layout->headerBlocks;
+    size_t i;
+    for (i = 0; i < layout->count; i++) {
+        const LayoutPartition *p = &layout->partitions[i];
+        if ((ulonglong)p->start + p->blocks > end) { end = (ulonglong)p->start + p->blocks; }
+    }
+    return end * kLayoutBlockSize;
+}
+
+static void BuildDriverDescriptorRecord(const DeviceLayout *layout, char *header) {
+    DDRecord ddr = {0};
+    uchar *extra = ddr.ddPad;
+    ushort drivers = 0;
+    ulong block;
+    ushort size, type;
+    size_t i;
+
+    ddr.sbSig = (ushort) htons(0x4552); // 'ER'
+    ddr.sbBlkSize = (ushort) htons(kLayoutBlockSize); // 512
+    ddr.sbBlkCount = (ulong) htonl(LayoutDeviceSize(layout) / kLayoutBlockSize);
+    ddr.sbDevType = (ushort) htons(1) ; // device type = 1
+    ddr.sbDevId = (ushort) htons(1) ; // device id = 1
+    for (i = 0; i < layout->count; i++) {
+        const LayoutPartition *p = &layout->partitions[i];
+        if (p->kind != kLayoutDriver) { continue; }
+        block = (ulong) htonl(p->start);
+        size = (ushort) htons(BlocksFor(p->driver->codeSize));
+        type = (ushort) htons(p->driver->osType);
+        if (drivers == 0) {
+            ddr.ddBlock = block;
+            ddr.ddSize = size;
+            ddr.ddType = type;
+        } else if (extra + 8 <= ddr.ddPad + sizeof(ddr.ddPad)) {
+            // further drivers follow as ddBlock/ddSize/ddType triples
+            memcpy(extra, &block, 4);
+            memcpy(extra + 4, &size, 2);
+            memcpy(extra + 6, &type, 2);
+            extra += 8;
+        } else {
+            continue;
+        }
+        drivers++;
+    }
+    ddr.sbDrvrCount = (ushort) htons(drivers);
+    memcpy(header, &ddr, sizeof(DDRecord));
+}
+
+static void BuildMapEntry(const DeviceLayout *layout, const LayoutPartition *p,
+                          char *header, size_t entry) {
+    Partition pme = {0};
+    const LayoutDriver *driver = (p->kind == kLayoutDriver) ? p->driver : NULL;
+    const char *name = (driver) ? driver->name : p->name;
+    const char *type = (driver) ? driver->type : p->type;
+    pme.pmSig = (ushort) htons(0x504D); // 'PM'
+    pme.pmMapBlkCnt = (ulong) htonl(layout->count); // number of blocks in map
+    pme.pmPyPartStart = (ulong) htonl(p->start);
+    pme.pmPartBlkCnt = (ulong) htonl(p->blocks);
+    strncpy((char*)pme.pmPartName, name, sizeof(pme.pmPartName));
+    strncpy((char*)pme.pmPartType, type, sizeof(pme.pmPartType));
+    pme.pmDataCnt = (ulong) htonl(p->blocks); // same as pmPartBlkCnt
+    pme.pmPartStatus = (ulong) htonl((driver) ? driver->status : p->status);
+    if (driver) {
+        pme.pmBootSize = (ulong) htonl(driver->codeSize);
+        pme.pmBootCksum = (ulong) htonl(driver->checksum);
+        strncpy((char*)pme.pmProcessor, driver->processor, sizeof(pme.pmProcessor));
+        memcpy(pme.pmPad, driver->pad, sizeof(driver->pad));
+    }
+    // entry n of the map is block n + 1
+    memcpy(header + (entry + 1) * kLayoutBlockSize, &pme, sizeof(Partition));
+}
+
+void LayoutBuildHeader(const DeviceLayout *layout, char *header) {
+    size_t i;
+    BuildDriverDescriptorRecord(layout, header);
+    for (i = 0; i < layout->count; i++) {
+        const LayoutPartition *p = &layout->partitions[i];
+        BuildMapEntry(layout, p, header, i);
+        if (p->kind == kLayoutDriver) {
+            memcpy(header + (size_t)p->start * kLayoutBlockSize, p->driver->code,
+                   p->driver->codeSize);
+        }
+    }
+}
@@ -0,0 +1,88 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageLayout.h
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//
+//----------------------------------------------------------------------
+
+#ifndef __diskimagelayout_h__
+#define __diskimagelayout_h__
+
+#include "DiskImageUtils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A device image header (DDR, partition map and driver code) described
+// as data: a list of partitions in map order, which LayoutPlace gives
+// their blocks and LayoutBuildHeader turns into the bytes of the header.
+// Changing the drivers, the sizes or the order of the partitions means
+// changing the list, not the code that writes it.
+
+#define kLayoutBlockSize 512
+#define kLayoutHeaderBlocks 96 // 0xC000 bytes: DDR, map and driver
+
+typedef enum LayoutKind {
+    kLayoutMap = 0,  // the partition map itself
+    kLayoutDriver,   // boot driver, its code carried in the header
+    kLayoutVolume    // volume data, copied in after the header
+}   LayoutKind;
+
+typedef struct LayoutDriver {
+    const char *name; // pmPartName
+    const char *type; // pmPartType
+    const uchar *code;
+    size_t codeSize;
+    ulong checksum; // pmBootCksum, as the ROM computes it
+    ushort osType; // ddType in the DDR (MacOS = 1)
+    const char *processor; // pmProcessor
+    ulong status; // pmPartStatus
+    uchar pad[16]; // leading pmPad bytes the driver's entry carries
+}   LayoutDriver;
+
+typedef struct LayoutPartition {
+    LayoutKind kind;
+    char name[33];
+    const char *type; // map and volumes; drivers use their own
+    ulong start; // first block, or 0 to follow the partition before
+    ulong blocks; // or 0 to fit the map, driver code or volume length
+    ulong status; // pmPartStatus (map and volumes)
+    const LayoutDriver *driver; // kLayoutDriver only
+    size_t length; // kLayoutVolume only: bytes of volume data
+}   LayoutPartition;
+
+typedef struct DeviceLayout {
+    ulong headerBlocks; // the map and drivers must fit before this block
+    LayoutPartition *partitions; // in map order
+    size_t count;
+}   DeviceLayout;
+
+// The Apple_Driver43 SCSI driver every image gets by default
+extern const LayoutDriver kLayoutDriver43;
+
+// The layout cvt2iso and assemble use: the map, Apple_Driver43, then one
+// Apple_HFS partition per volume ("MacOS", "MacOS 2", ...). parts must
+// have room for count + 2 entries.
+void LayoutStandard(DeviceLayout *layout, LayoutPartition *parts,
+                    const size_t *volumeLengths, size_t count, int rw);
+
+// Resolve every partition's start and blocks, and check that the map
+// has room for its entries, that the map and drivers fit in the header,
+// and that nothing overlaps. Returns 0 or EINVAL.
+int LayoutPlace(DeviceLayout *layout);
+
+// Bytes in the whole device, once placed
+ulonglong LayoutDeviceSize(const DeviceLayout *layout);
+
+// Fill header (headerBlocks * kLayoutBlockSize bytes, zeroed by the
+// caller) from a placed layout
+void LayoutBuildHeader(const DeviceLayout *layout, char *header);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __diskimagelayout_h__ */
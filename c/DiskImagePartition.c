@@ -0,0 +1,135 @@
+//----------------------------------------------------------------------
+//
+//  DiskImagePartition.c
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//
+//----------------------------------------------------------------------
+
+#include "DiskImageUtils.h"
+#include "DiskImagePartition.h"
+#include "DiskImageIO.h"
+
+#define kPartitionBlockSize 512
+#define kPartitionMaxEntries 4096 // far beyond any real map; bounds a corrupt count
+
+int PartitionExtent(ulong start, ulong blocks, ulonglong fileSize,
+                    off_t *offset, size_t *length) {
+    ulonglong begin = (ulonglong)start * kPartitionBlockSize;
+    ulonglong bytes = (ulonglong)blocks * kPartitionBlockSize;
+    if (begin > fileSize) { return -1; }
+    if (begin + bytes > fileSize) {
+        // truncate partition length to fit inside file length
+        bytes = (fileSize - begin) - (fileSize - begin) % kPartitionBlockSize;
+    }
+    *offset = begin;
+    *length = bytes;
+    return 0;
+}
+
+int PartitionTypeIsHFS(const char *type) {
+    return !strcmp(type, "Apple_HFS") || !strcmp(type, "Apple_HFSX");
+}
+
+const char *PartitionProblemName(ulong problem) {
+    switch (problem) {
+        case kPartitionTruncated: return "runs past the end of the file";
+        case kPartitionOutside: return "starts past the end of the file";
+        case kPartitionEmpty: return "holds no blocks";
+        case kPartitionOverlaps: return "overlaps another partition";
+        case kPartitionMapCount: return "disagrees about the size of the map";
+    }
+    return "unknown problem";
+}
+
+static void DecodeEntry(const Partition *pme, ulonglong fileSize, PartitionEntry *entry) {
+    ulonglong end = ((ulonglong)pme->pmPyPartStart + pme->pmPartBlkCnt) * kPartitionBlockSize;
+    memcpy(entry->name, pme->pmPartName, 32);
+    memcpy(entry->type, pme->pmPartType, 32);
+    memcpy(entry->processor, pme->pmProcessor, 16);
+    entry->start = pme->pmPyPartStart;
+    entry->blocks = pme->pmPartBlkCnt;
+    entry->mapBlocks = pme->pmMapBlkCnt;
+    entry->dataStart = pme->pmLgDataStart;
+    entry->dataCount = pme->pmDataCnt;
+    entry->status = pme->pmPartStatus;
+    entry->bootSize = pme->pmBootSize;
+    entry->bootCksum = pme->pmBootCksum;
+    if (PartitionExtent(entry->start, entry->blocks, fileSize,
+                        &entry->offset, &entry->length) != 0) {
+        entry->offset = (off_t)entry->start * kPartitionBlockSize;
+        entry->length = 0;
+        entry->problems |= kPartitionOutside;
+    }
+    if (end > fileSize) { entry->problems |= kPartitionTruncated; }
+    if (!entry->blocks) { entry->problems |= kPartitionEmpty; }
+}
+
+// Mark entries whose blocks collide; free space claims none
+static void FindOverlaps(PartitionTable *table) {
+    PartitionEntry *a, *b;
+    ulong i, j;
+    for (i = 0; i < table->count; i++) {
+        a = &table->entries[i];
+        if (!a->blocks || !strcmp(a->type, "Apple_Free")) { continue; }
+        for (j = i + 1; j < table->count; j++) {
+            b = &table->entries[j];
+            if (!b->blocks || !strcmp(b->type, "Apple_Free")) { continue; }
+            if ((ulonglong)a->start < (ulonglong)b->start + b->blocks &&
+                (ulonglong)b->start < (ulonglong)a->start + a->blocks) {
+                a->problems |= kPartitionOverlaps;
+                b->problems |= kPartitionOverlaps;
+            }
+        }
+    }
+}
+
+int ReadPartitionTable(int fd, ulonglong fileSize, PartitionTable **table) {
+    Partition first, pme;
+    PartitionTable *t;
+    char *map;
+    size_t count, length;
+    ssize_t got;
+    ulong i;
+
+    *table = NULL;
+    if (fileSize < 2 * kPartitionBlockSize) { return -1; } // no room for a map
+    if (ReadPartitionMapEntry(fd, kPartitionBlockSize, &first) != 0) {
+        return (errno) ? errno : EIO;
+    }
+    if (first.pmSig != 0x504D) { return -1; } // 'PM'
+    count = first.pmMapBlkCnt;
+    if (count > kPartitionMaxEntries) { count = kPartitionMaxEntries; }
+    if (count > fileSize / kPartitionBlockSize - 1) {
+        count = fileSize / kPartitionBlockSize - 1;
+    }
+    if (count < 1) { count = 1; }
+    length = count * kPartitionBlockSize;
+    if (!(map = malloc(length))) { return ENOMEM; }
+    if ((got = IORead(fd, map, length, kPartitionBlockSize)) < 0) {
+        free(map);
+        return (errno) ? errno : EIO;
+    }
+    if ((size_t)got < length) { count = got / kPartitionBlockSize; }
+    if (!(t = calloc(1, sizeof(PartitionTable) + count * sizeof(PartitionEntry)))) {
+        free(map);
+        return ENOMEM;
+    }
+    t->fileSize = fileSize;
+    t->mapBlocks = first.pmMapBlkCnt;
+    for (i = 0; i < count; i++) {
+        memcpy(&pme, map + i * kPartitionBlockSize, sizeof(Partition));
+        SwapPartitionMapEntry(&pme);
+        if (pme.pmSig != 0x504D) { break; } // end of the map
+        DecodeEntry(&pme, fileSize, &t->entries[i]);
+        if (pme.pmMapBlkCnt != t->mapBlocks) {
+            t->entries[i].problems |= kPartitionMapCount;
+        }
+    }
+    t->count = i;
+    free(map);
+    FindOverlaps(t);
+    *table = t;
+    return 0;
+}
@@ -0,0 +1,73 @@
+//----------------------------------------------------------------------
+//
+//  DiskImagePartition.h
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//
+//----------------------------------------------------------------------
+
+#ifndef __diskimagepartition_h__
+#define __diskimagepartition_h__
+
+#include "DiskImageUtils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Things found wrong with a map entry while validating it (bit flags)
+typedef enum PartitionProblem {
+    kPartitionTruncated = 1 << 0,  // runs past the end of the file
+    kPartitionOutside = 1 << 1,    // starts past the end of the file
+    kPartitionEmpty = 1 << 2,      // holds no blocks
+    kPartitionOverlaps = 1 << 3,   // shares blocks with another partition
+    kPartitionMapCount = 1 << 4    // pmMapBlkCnt disagrees with the first entry
+}   PartitionProblem;
+
+typedef struct PartitionEntry {
+    char name[33];
+    char type[33];
+    char processor[17];
+    ulong start; // in 512-byte blocks
+    ulong blocks;
+    ulong mapBlocks; // pmMapBlkCnt as this entry gives it
+    ulong dataStart; // logical data area, in blocks
+    ulong dataCount;
+    ulong status; // pmPartStatus
+    ulong bootSize; // boot code, in bytes
+    ulong bootCksum;
+    off_t offset; // in bytes
+    size_t length; // in bytes, cut back to whole blocks inside the file
+    ulong problems; // PartitionProblem bits
+}   PartitionEntry;
+
+typedef struct PartitionTable {
+    ulonglong fileSize;
+    ulong mapBlocks; // entries the first one says the map holds
+    ulong count; // entries read, up to the first without a 'PM' signature
+    PartitionEntry entries[];
+}   PartitionTable;
+
+// Read the Apple partition map of fd, a file of fileSize bytes, with one
+// read of the pmMapBlkCnt blocks the first entry declares, then decode
+// and validate every entry. Returns 0 and a malloc'd table, -1 if the
+// file has no partition map, or an errno value.
+int ReadPartitionTable(int fd, ulonglong fileSize, PartitionTable **table);
+
+// Byte range of a partition, cut back to the whole blocks that fit in a
+// file of fileSize bytes. Returns -1 if it starts past the end of the file.
+int PartitionExtent(ulong start, ulong blocks, ulonglong fileSize,
+                    off_t *offset, size_t *length);
+
+// True for the partition types which hold an HFS or HFS+ volume
+int PartitionTypeIsHFS(const char *type);
+
+// Short description of one PartitionProblem bit
+const char *PartitionProblemName(ulong problem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __diskimagepartition_h__ */
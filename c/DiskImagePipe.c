@@ -0,0 +1,217 @@
+//----------------------------------------------------------------------
+//
+//  DiskImagePipe.c
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//  Fri Oct 16 2026 -- compressed and container formats are refused by name
+//
+//----------------------------------------------------------------------
+
+#include <pthread.h>
+#include "DiskImageUtils.h"
+#include "DiskImagePipe.h"
+#include "DiskImageIO.h"
+
+#define kPipeWindow (4*1024*1024) // bytes held to begin with
+#define kPipeMaxWindow (64*1024*1024) // held while reads skip ahead
+#define kPipeBlockSize 512
+
+typedef struct PipeImage {
+    pthread_mutex_t lock; // reads move the window, so one at a time
+    ulonglong size; // of the image, from its headers
+    char *head; // the first headLen bytes of the input
+    size_t headLen;
+    char *window; // bytes base to end of the input
+    size_t capacity;
+    ulonglong base;
+    ulonglong end;
+    int ended; // the input has run out
+}   PipeImage;
+
+static ulong GetBE16(const uchar *p) {
+    return ((ulong)p[0] << 8) | p[1];
+}
+
+static ulong GetBE32(const uchar *p) {
+    return ((ulong)p[0] << 24) | ((ulong)p[1] << 16) | ((ulong)p[2] << 8) | p[3];
+}
+
+// Read what the pipe holds onto the end of the window, for a read at
+// offset at. If the window is full, a read which follows on from it has
+// all but its last kPipeBehind bytes dropped; one further on (the probe
+// skipping from one partition to the next) has it grow instead, keeping
+// the bytes passed over for when a volume among them is copied.
+static int Fill(PipeImage *image, int fd, ulonglong at) {
+    ssize_t got;
+    ulonglong keep;
+    char *p;
+    if (image->end - image->base == image->capacity) {
+        if (at > image->end && image->capacity < kPipeMaxWindow &&
+            (p = realloc(image->window, image->capacity * 2))) {
+            image->window = p;
+            image->capacity *= 2;
+        } else {
+            keep = image->end - kPipeBehind;
+            memmove(image->window, image->window + (keep - image->base), image->end - keep);
+            image->base = keep;
+        }
+    }
+    got = IOReadNext(fd, image->window + (image->end - image->base),
+                     image->capacity - (image->end - image->base));
+    if (got < 0) { return errno; }
+    if (got == 0) { image->ended = 1; }
+    image->end += got;
+    return 0;
+}
+
+static ssize_t PipeRead(void *refCon, int fd, void *buf, size_t length, off_t offset) {
+    PipeImage *image = (PipeImage*)refCon;
+    ulonglong at;
+    size_t pos = 0, n;
+    int result = 0;
+    if (offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((ulonglong)offset >= image->size) { return 0; }
+    if (length > image->size - offset) { length = image->size - offset; }
+    pthread_mutex_lock(&image->lock);
+    while (pos < length && result == 0) {
+        at = offset + pos;
+        if (at < image->headLen) {
+            n = (image->headLen - at < length - pos) ? image->headLen - at : length - pos;
+            memcpy((char*)buf + pos, image->head + at, n);
+            pos += n;
+        } else if (at < image->base) {
+            result = ESPIPE; // read past already
+        } else if (at < image->end) {
+            n = (image->end - at < length - pos) ? image->end - at : length - pos;
+            memcpy((char*)buf + pos, image->window + (at - image->base), n);
+            pos += n;
+        } else if (image->ended) {
+            break; // cut short of the size its headers give
+        } else {
+            result = Fill(image, fd, at);
+        }
+    }
+    pthread_mutex_unlock(&image->lock);
+    if (result != 0) {
+        errno = result;
+        return -1;
+    }
+    return pos;
+}
+
+static void PipeClose(void *refCon) {
+    PipeImage *image = (PipeImage*)refCon;
+    pthread_mutex_destroy(&image->lock);
+    free(image->head);
+    free(image->window);
+    free(image);
+}
+
+// The size of the image starting with head: a device image's from its
+// driver descriptor record and partition map, or a volume's from its MDB
+// (where the alternate MDB and a spare block follow the last allocation
+// block) or HFS+ volume header. 0 if it is neither.
+static ulonglong ImageSize(const uchar *head, size_t headLen) {
+    const uchar *p = head + 0x400;
+    ulonglong size = 0, end;
+    size_t i, count;
+    if (headLen >= 2 * kPipeBlockSize && GetBE16(head) == 0x4552) { // 'ER'
+        size = (ulonglong)GetBE16(head + 2) * GetBE32(head + 4);
+        count = GetBE32(head + kPipeBlockSize + 4);
+        for (i = 1; i <= count && (i + 1) * kPipeBlockSize <= headLen; i++) {
+            p = head + i * kPipeBlockSize;
+            if (GetBE16(p) != 0x504D) { break; } // 'PM'
+            end = ((ulonglong)GetBE32(p + 8) + GetBE32(p + 12)) * kPipeBlockSize;
+            if (end > size) { size = end; }
+        }
+    } else if (headLen >= 0x400 + kPipeBlockSize && GetBE16(p) == 0x4244) { // 'BD'
+        size = (ulonglong)GetBE16(p + 28) * kPipeBlockSize +
+               (ulonglong)GetBE16(p + 18) * GetBE32(p + 20) + 2 * kPipeBlockSize;
+    } else if (headLen >= 0x400 + kPipeBlockSize &&
+               (GetBE16(p) == 0x482B || GetBE16(p) == 0x4858)) { // 'H+' or 'HX'
+        size = (ulonglong)GetBE32(p + 40) * GetBE32(p + 44);
+    }
+    return size;
+}
+
+// The name of the compressed or container format head starts with, if
+// it's one the other readers handle only in a file they can seek in (a
+// UDIF image is known by its trailer, so only if all of it is in head, or
+// by the zlib header of its first chunk)
+static const char *ContainerName(const uchar *head, size_t headLen, int ended) {
+    const uchar *dc42 = head;
+    if (headLen < 6) { return NULL; }
+    if (head[0] == 0x1F && head[1] == 0x8B) { return "gzip"; }
+    if (!memcmp(head, "BZh", 3) && head[3] >= '1' && head[3] <= '9') { return "bzip2"; }
+    if (!memcmp(head, "\x28\xB5\x2F\xFD", 4) ||
+        ((head[0] & 0xF0) == 0x50 && !memcmp(head + 1, "\x2A\x4D\x18", 3))) {
+        return "zstd";
+    }
+    if (!memcmp(head, "\xFD" "7zXZ\0", 6)) { return "xz"; }
+    if (headLen >= 128 + 84 && head[0] == 0 && head[1] >= 1 && head[1] <= 63) {
+        dc42 = head + 128; // behind a MacBinary header
+    }
+    if (headLen >= (size_t)(dc42 - head) + 84 && dc42[0] <= 63 &&
+        GetBE16(dc42 + 82) == 0x0100 && GetBE32(dc42 + 64) &&
+        GetBE32(dc42 + 64) % kPipeBlockSize == 0) {
+        return "Disk Copy 4.2";
+    }
+    if ((ended && headLen >= kPipeBlockSize &&
+         GetBE32(head + headLen - kPipeBlockSize) == 0x6B6F6C79) || // 'koly'
+        (head[0] == 0x78 && ((head[0] << 8) | head[1]) % 31 == 0)) {
+        return "UDIF (.dmg)";
+    }
+    return NULL;
+}
+
+int PipeAttach(int fd) {
+    PipeImage *image = NULL;
+    IOFilter filter = {0};
+    const char *container;
+    ssize_t got;
+    int result = 0;
+    if (lseek(fd, 0, SEEK_CUR) != -1 || errno != ESPIPE) { return -1; }
+    if (!(image = calloc(1, sizeof(PipeImage)))) { return ENOMEM; }
+    pthread_mutex_init(&image->lock, NULL);
+    image->head = malloc(kPipeHeadSize);
+    image->window = malloc(kPipeWindow);
+    image->capacity = kPipeWindow;
+    if (!image->head || !image->window) {
+        result = ENOMEM;
+    } else if ((got = IOReadNext(fd, image->head, kPipeHeadSize)) < 0) {
+        result = errno;
+    } else {
+        image->headLen = got;
+        image->base = image->end = got;
+        image->ended = (got < kPipeHeadSize);
+        if ((image->size = ImageSize((uchar*)image->head, image->headLen)) != 0) {
+            // a device image or a volume
+        } else if ((container = ContainerName((uchar*)image->head, image->headLen,
+                                              image->ended)) != NULL) {
+            tabprint(0, "Piped input is in %s format, which can only be read from a file;\n",
+                     container);
+            tabprint(0, "give its file instead, or unpack it before the pipe\n");
+            result = ENOTSUP;
+        } else {
+            result = EINVAL;
+        }
+    }
+    if (result == 0) {
+        filter.read = PipeRead;
+        filter.close = PipeClose;
+        filter.refCon = image;
+        filter.size = image->size;
+        result = IOSetFilter(fd, &filter);
+    }
+    if (result != 0) { PipeClose(image); }
+    return result;
+}
+
+int PipeAttached(int fd) {
+    IOFilter filter;
+    return IOGetFilter(fd, &filter) == 0 && filter.read == PipeRead;
+}
@@ -0,0 +1,52 @@
+//----------------------------------------------------------------------
+//
+//  DiskImagePipe.h
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//  Fri Oct 16 2026 -- compressed and container formats are refused by name
+//
+//----------------------------------------------------------------------
+
+#ifndef __diskimagepipe_h__
+#define __diskimagepipe_h__
+
+#include "DiskImageUtils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// An image piped in (from a decompressor, say) can be read only once,
+// in order. PipeAttach sets an IOFilter on such a descriptor which reads
+// it that way, keeping the first kPipeHeadSize bytes (the headers the
+// probe reads) and the last kPipeBehind bytes it has read (the start of
+// the volume, which the probe reads a little way into), and answers
+// reads from those; a read further back fails with ESPIPE. A read past
+// what has been read so far reads on to it, keeping the bytes between
+// (up to 64 MB of them), as the probe reads the MDB of every partition
+// before a volume among them is copied.
+//
+// A pipe has no size, so the image's comes from its own headers: the
+// device size in the driver descriptor record (or the end of the last
+// map entry, if that is further), or the extent of a bare HFS or HFS+
+// volume. Anything piped in after that is left unread.
+
+#define kPipeHeadSize (64*1024)
+#define kPipeBehind (1024*1024)
+
+// If fd (opened with IOOpen) is a pipe, filter it as above. Returns 0,
+// -1 if fd isn't a pipe (it can be read at any offset), ENOTSUP (saying
+// so) if the input is compressed or in a container (gzip, bzip2, zstd,
+// xz, UDIF or Disk Copy 4.2), whose readers need to seek, or EINVAL if
+// the start of the input isn't a device image or an HFS volume.
+int PipeAttach(int fd);
+
+// Whether PipeAttach has filtered fd
+int PipeAttached(int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __diskimagepipe_h__ */
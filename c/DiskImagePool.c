@@ -0,0 +1,154 @@
+//----------------------------------------------------------------------
+//
+//  DiskImagePool.c
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//
+//----------------------------------------------------------------------
+
+#include <pthread.h>
+#include "DiskImageUtils.h"
+#include "DiskImagePool.h"
+
+// A worker's share of the task indices. The owner takes tasks from the
+// front; thieves take them from the back.
+typedef struct PoolQueue {
+    pthread_mutex_t lock;
+    size_t next;
+    size_t end;
+}   PoolQueue;
+
+typedef struct Pool {
+    unsigned numThreads;
+    PoolQueue *queues;
+    PoolTaskProc proc;
+    void *refCon;
+    pthread_mutex_t resultLock;
+    int result;
+}   Pool;
+
+typedef struct PoolWorker {
+    Pool *pool;
+    unsigned index;
+}   PoolWorker;
+
+static int PoolFailed(Pool *pool) {
+    int result;
+    pthread_mutex_lock(&pool->resultLock);
+    result = pool->result;
+    pthread_mutex_unlock(&pool->resultLock);
+    return result;
+}
+
+static int PoolTake(Pool *pool, unsigned worker, size_t *task) {
+    PoolQueue *queue = &pool->queues[worker];
+    unsigned i, victim;
+    size_t most;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->next < queue->end) {
+        *task = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+        return 1;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    for (;;) {
+        // pick the queue with the most work left; the unlocked reads are
+        // only a hint, the steal itself is checked under the lock
+        most = 0;
+        victim = worker;
+        for (i = 0; i < pool->numThreads; i++) {
+            size_t left = pool->queues[i].end - pool->queues[i].next;
+            if (i != worker && pool->queues[i].end > pool->queues[i].next && left > most) {
+                most = left;
+                victim = i;
+            }
+        }
+        if (victim == worker) { return 0; } // nothing left anywhere
+        queue = &pool->queues[victim];
+        pthread_mutex_lock(&queue->lock);
+        if (queue->next < queue->end) {
+            *task = --queue->end;
+            pthread_mutex_unlock(&queue->lock);
+            return 1;
+        }
+        pthread_mutex_unlock(&queue->lock);
+    }
+}
+
+static void *PoolWorkerMain(void *arg) {
+    PoolWorker *worker = (PoolWorker*)arg;
+    Pool *pool = worker->pool;
+    size_t task;
+    int result;
+    while (!PoolFailed(pool) && PoolTake(pool, worker->index, &task)) {
+        if ((result = pool->proc(pool->refCon, task, worker->index)) != 0) {
+            pthread_mutex_lock(&pool->resultLock);
+            if (!pool->result) { pool->result = result; }
+            pthread_mutex_unlock(&pool->resultLock);
+        }
+    }
+    return NULL;
+}
+
+unsigned PoolDefaultThreads(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (unsigned)count : 1;
+}
+
+int PoolRun(unsigned numThreads, size_t count, PoolTaskProc proc, void *refCon) {
+    Pool pool = {0};
+    PoolWorker *workers = NULL;
+    pthread_t *threads = NULL;
+    unsigned i, started = 0;
+    size_t task, share;
+    int result;
+    if (numThreads > count) { numThreads = (unsigned)count; }
+    if (numThreads <= 1) { // nothing to share out
+        for (task = 0; task < count; task++) {
+            if ((result = proc(refCon, task, 0)) != 0) { return result; }
+        }
+        return 0;
+    }
+    pool.numThreads = numThreads;
+    pool.proc = proc;
+    pool.refCon = refCon;
+    pthread_mutex_init(&pool.resultLock, NULL);
+    pool.queues = calloc(numThreads, sizeof(PoolQueue));
+    workers = calloc(numThreads, sizeof(PoolWorker));
+    threads = calloc(numThreads, sizeof(pthread_t));
+    if (!pool.queues || !workers || !threads) {
+        pool.result = ENOMEM;
+        goto cleanup;
+    }
+    // deal out contiguous blocks so neighbouring tasks stay on one thread
+    share = count / numThreads;
+    for (i = 0; i < numThreads; i++) {
+        pthread_mutex_init(&pool.queues[i].lock, NULL);
+        pool.queues[i].next = i * share;
+        pool.queues[i].end = (i == numThreads-1) ? count : (i+1) * share;
+    }
+    for (i = 0; i < numThreads; i++) {
+        workers[i].pool = &pool;
+        workers[i].index = i;
+        if (pthread_create(&threads[i], NULL, PoolWorkerMain, &workers[i]) != 0) {
+            break; // the threads already running will steal the rest
+        }
+        started++;
+    }
+    if (!started) {
+        PoolWorkerMain(&workers[0]);
+    }
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (i = 0; i < numThreads; i++) {
+        pthread_mutex_destroy(&pool.queues[i].lock);
+    }
+cleanup:
+    pthread_mutex_destroy(&pool.resultLock);
+    free(threads);
+    free(workers);
+    free(pool.queues);
+    return pool.result;
+}
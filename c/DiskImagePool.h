@@ -0,0 +1,38 @@
+//----------------------------------------------------------------------
+//
+//  DiskImagePool.h
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//
+//----------------------------------------------------------------------
+
+#ifndef __diskimagepool_h__
+#define __diskimagepool_h__
+
+#include "DiskImageUtils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Performs task number taskIndex on worker thread number worker (which is
+// less than the thread count, so it can index per-thread state). A
+// non-zero return stops the pool from starting any more tasks.
+typedef int (*PoolTaskProc)(void *refCon, size_t taskIndex, unsigned worker);
+
+// Run tasks 0..count-1 on up to numThreads worker threads and wait for
+// them all to finish. Each worker starts with its own contiguous block
+// of tasks and, once that runs dry, steals from the back of the busiest
+// remaining worker, so slow tasks don't hold up the rest. Returns the
+// first non-zero task result, or 0.
+int PoolRun(unsigned numThreads, size_t count, PoolTaskProc proc, void *refCon);
+
+// Number of online CPUs, for a default thread count
+unsigned PoolDefaultThreads(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __diskimagepool_h__ */
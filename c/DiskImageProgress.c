@@ -0,0 +1,92 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageProgress.c
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//
+//----------------------------------------------------------------------
+
+#include <time.h>
+#include "DiskImageUtils.h"
+#include "DiskImageProgress.h"
+
+extern int quiet;
+
+#define kPBStr "##################################################"
+#define kPBWidth 50
+
+static const Progress kDefaultProgress = { ProgressPrintBar, NULL, 0, NULL };
+
+static double ProgressNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void CancelTokenCancel(CancelToken *token) {
+    __atomic_store_n(&token->cancelled, 1, __ATOMIC_RELAXED);
+}
+
+int CancelTokenIsCancelled(const CancelToken *token) {
+    return __atomic_load_n(&token->cancelled, __ATOMIC_RELAXED);
+}
+
+static void ProgressReport(ProgressTracker *tracker, double now, int finished) {
+    ProgressInfo info;
+    info.bytesDone = tracker->bytesDone;
+    info.bytesTotal = tracker->bytesTotal;
+    info.seconds = now - tracker->start;
+    info.bytesPerSecond = (info.seconds > 0) ? info.bytesDone / info.seconds : 0;
+    info.secondsLeft = (info.bytesPerSecond > 0) ?
+        (info.bytesTotal - info.bytesDone) / info.bytesPerSecond : -1;
+    info.finished = finished;
+    tracker->progress->proc(tracker->progress->refCon, &info);
+}
+
+void ProgressStart(ProgressTracker *tracker, const Progress *progress, ulonglong bytesTotal) {
+    tracker->progress = (progress) ? progress : &kDefaultProgress;
+    tracker->bytesTotal = bytesTotal;
+    tracker->bytesDone = 0;
+    tracker->start = ProgressNow();
+    tracker->nextReport = tracker->start; // report once straight away
+}
+
+int ProgressAdvance(ProgressTracker *tracker, ulonglong count) {
+    const Progress *progress = tracker->progress;
+    double now;
+    tracker->bytesDone += count;
+    if (progress->cancel && CancelTokenIsCancelled(progress->cancel)) {
+        return ECANCELED;
+    }
+    if (progress->proc && (now = ProgressNow()) >= tracker->nextReport) {
+        tracker->nextReport = now + ((progress->interval > 0) ?
+            progress->interval : kProgressDefaultInterval);
+        ProgressReport(tracker, now, 0);
+    }
+    return 0;
+}
+
+void ProgressFinish(ProgressTracker *tracker) {
+    if (tracker->progress->proc) {
+        ProgressReport(tracker, ProgressNow(), 1);
+    }
+}
+
+void ProgressPrintBar(void *refCon, const ProgressInfo *info) {
+    double fraction = (info->bytesTotal) ? (double)info->bytesDone / info->bytesTotal : 1.0;
+    int val = (int) (fraction * 100);
+    int lpad = (int) (fraction * kPBWidth);
+    int rpad = kPBWidth - lpad;
+    double seconds = (info->finished) ? info->seconds : info->secondsLeft;
+    if (quiet) { return; }
+    fprintf(stdout, "\r%3d%% [%.*s%*s] %6.1f MB/s", val, lpad, kPBStr, rpad, "",
+            info->bytesPerSecond / (1024.0*1024.0));
+    if (seconds >= 0) {
+        fprintf(stdout, ", %d:%02d %s ", (int)seconds / 60, (int)seconds % 60,
+                (info->finished) ? "elapsed" : "left");
+    } else {
+        fprintf(stdout, "%16s", "");
+    }
+    fflush(stdout);
+}
@@ -0,0 +1,74 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageProgress.h
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//
+//----------------------------------------------------------------------
+
+#ifndef __diskimageprogress_h__
+#define __diskimageprogress_h__
+
+#include "DiskImageUtils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define kProgressDefaultInterval 0.1 // seconds between reports
+
+typedef struct ProgressInfo {
+    ulonglong bytesDone;
+    ulonglong bytesTotal;
+    double seconds; // since the job started
+    double bytesPerSecond; // average over the job so far
+    double secondsLeft; // estimate, or -1 until there is a rate to go by
+    int finished; // set on the last report of a job
+}   ProgressInfo;
+
+typedef void (*ProgressProc)(void *refCon, const ProgressInfo *info);
+
+// Set from any thread, or from a signal handler, to make a running job
+// stop at its next chunk and return ECANCELED
+typedef struct CancelToken {
+    int cancelled;
+}   CancelToken;
+
+void CancelTokenCancel(CancelToken *token);
+int CancelTokenIsCancelled(const CancelToken *token);
+
+// How a caller wants to hear about a job. proc (if not NULL) is called
+// at most once per interval while the job runs, and once more when it
+// finishes; cancel (if not NULL) is checked after every chunk.
+typedef struct Progress {
+    ProgressProc proc;
+    void *refCon;
+    double interval; // seconds between reports (0 for the default)
+    CancelToken *cancel;
+}   Progress;
+
+// Per-job state for the engine. Calls to ProgressAdvance must be
+// serialized by the caller (the copy engine holds its lock).
+typedef struct ProgressTracker {
+    const Progress *progress;
+    ulonglong bytesTotal;
+    ulonglong bytesDone;
+    double start;
+    double nextReport;
+}   ProgressTracker;
+
+void ProgressStart(ProgressTracker *tracker, const Progress *progress, ulonglong bytesTotal);
+// Returns ECANCELED once the job's token is set, otherwise 0
+int ProgressAdvance(ProgressTracker *tracker, ulonglong count);
+void ProgressFinish(ProgressTracker *tracker);
+
+// A ProgressProc drawing a bar with the rate and time left on stdout
+// (nothing if quiet is set); used when no Progress is given
+void ProgressPrintBar(void *refCon, const ProgressInfo *info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __diskimageprogress_h__ */
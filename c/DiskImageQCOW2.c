@@ -0,0 +1,262 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageQCOW2.c
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//
+//----------------------------------------------------------------------
+
+#include "DiskImageUtils.h"
+#include "DiskImageQCOW2.h"
+#include "DiskImageIO.h"
+#include "DiskImagePool.h"
+
+#define kQCOW2ClusterSize (1 << kQCOW2ClusterBits)
+#define kQCOW2Magic 0x514649FB // 'QFI' 0xFB
+#define kQCOW2Version 3
+#define kQCOW2HeaderLength 104 // of the version 3 header, without extensions
+#define kQCOW2RefcountOrder 4 // 16-bit refcounts
+#define kQCOW2Copied 0x8000000000000000ULL // in entries for clusters with a refcount of one
+#define kQCOW2TableEntries (kQCOW2ClusterSize / 8) // in an L2 table or a refcount table cluster
+#define kQCOW2Refcounts (kQCOW2ClusterSize / 2) // in a refcount block
+#define kQCOW2PieceClusters 16 // read by a pool task at once
+#define kQCOW2PieceSize (kQCOW2PieceClusters * kQCOW2ClusterSize)
+
+// A piece of a window of the image being written, read by a pool worker
+typedef struct QCOW2Piece {
+    ulonglong start; // byte offset in the image
+    size_t length; // whole clusters, the last padded with zeros
+    char *data;
+    uchar zero[kQCOW2PieceClusters]; // which clusters are all zeros
+}   QCOW2Piece;
+
+typedef struct QCOW2Writer {
+    QCOW2SourceProc source;
+    void *refCon;
+    ulonglong size;
+    QCOW2Piece *pieces;
+}   QCOW2Writer;
+
+static void PutBE16(uchar *p, ulong value) {
+    p[0] = (uchar)(value >> 8);
+    p[1] = (uchar)value;
+}
+
+static void PutBE32(uchar *p, ulong value) {
+    p[0] = (uchar)(value >> 24);
+    p[1] = (uchar)(value >> 16);
+    p[2] = (uchar)(value >> 8);
+    p[3] = (uchar)value;
+}
+
+static void PutBE64(uchar *p, ulonglong value) {
+    PutBE32(p, (ulong)(value >> 32));
+    PutBE32(p + 4, (ulong)value);
+}
+
+static int ReadPiece(void *refCon, size_t taskIndex, unsigned worker) {
+    QCOW2Writer *writer = (QCOW2Writer*)refCon;
+    QCOW2Piece *p = &writer->pieces[taskIndex];
+    size_t length = (writer->size - p->start < p->length) ? writer->size - p->start : p->length;
+    size_t i;
+    int result;
+    if (length < p->length) { memset(p->data + length, 0, p->length - length); }
+    if ((result = writer->source(writer->refCon, p->data, length, p->start)) != 0) {
+        return result;
+    }
+    for (i = 0; i < p->length / kQCOW2ClusterSize; i++) {
+        p->zero[i] = IsZeroFilled(p->data + i * kQCOW2ClusterSize, kQCOW2ClusterSize);
+    }
+    return 0;
+}
+
+// Write the clusters of a window which aren't zeros one after another
+// from *next, and map them
+static int StorePieces(int ofd, const QCOW2Piece *pieces, size_t n, ulonglong *map,
+                       ulonglong *next, QCOW2Summary *summary) {
+    struct iovec iov[kIOMaxVectors];
+    const QCOW2Piece *p;
+    off_t offset = *next;
+    size_t i, c, bytes = 0;
+    int vectors = 0;
+    char *data;
+    for (i = 0; i < n; i++) {
+        p = &pieces[i];
+        for (c = 0; c < p->length / kQCOW2ClusterSize; c++) {
+            if (p->zero[c]) { continue; }
+            data = p->data + c * kQCOW2ClusterSize;
+            map[(p->start >> kQCOW2ClusterBits) + c] = *next;
+            *next += kQCOW2ClusterSize;
+            summary->allocated++;
+            if (vectors && (char*)iov[vectors - 1].iov_base + iov[vectors - 1].iov_len == data) {
+                iov[vectors - 1].iov_len += kQCOW2ClusterSize; // a run of clusters
+            } else {
+                if (vectors == kIOMaxVectors) {
+                    if (IOWritev(ofd, iov, vectors, offset) < 0) { return errno; }
+                    offset += bytes;
+                    bytes = 0;
+                    vectors = 0;
+                }
+                iov[vectors].iov_base = data;
+                iov[vectors].iov_len = kQCOW2ClusterSize;
+                vectors++;
+            }
+            bytes += kQCOW2ClusterSize;
+        }
+    }
+    if (vectors && IOWritev(ofd, iov, vectors, offset) < 0) { return errno; }
+    return 0;
+}
+
+// Whether any of the clusters L1 entry i covers is mapped
+static int TableUsed(const ulonglong *map, size_t clusters, size_t i) {
+    size_t j;
+    for (j = i * kQCOW2TableEntries; j < clusters && j < (i + 1) * kQCOW2TableEntries; j++) {
+        if (map[j]) { return 1; }
+    }
+    return 0;
+}
+
+int QCOW2WriteImage(int ofd, ulonglong size, QCOW2SourceProc source, void *refCon,
+                    const QCOW2WriteOptions *options, QCOW2Summary *summary) {
+    QCOW2Writer writer = { source, refCon, size, NULL };
+    QCOW2Summary written = {0};
+    ProgressTracker tracker;
+    unsigned threads = (options->threads) ? options->threads : PoolDefaultThreads();
+    size_t window = (size_t)threads * 2; // pieces read at once
+    size_t clusters = (size + kQCOW2ClusterSize - 1) >> kQCOW2ClusterBits;
+    size_t l1Entries = (clusters + kQCOW2TableEntries - 1) / kQCOW2TableEntries;
+    size_t l1Clusters = (l1Entries * 8 + kQCOW2ClusterSize - 1) / kQCOW2ClusterSize;
+    size_t l2Tables = 0, refBlocks = 0, refClusters = 0, total, blocks, tableClusters;
+    size_t i, j, n;
+    ulonglong *map = NULL, next = kQCOW2ClusterSize, pos = 0, at;
+    ulonglong l1Start, refStart, refTableStart;
+    uchar *table = NULL, *l1 = NULL, *refTable = NULL;
+    int result = 0;
+
+    if (!l1Clusters) { l1Clusters = 1; }
+    map = calloc((clusters) ? clusters : 1, sizeof(ulonglong));
+    writer.pieces = calloc(window, sizeof(QCOW2Piece));
+    table = calloc(1, kQCOW2ClusterSize);
+    if (!map || !writer.pieces || !table) {
+        result = ENOMEM;
+        goto done;
+    }
+    for (i = 0; i < window; i++) {
+        if (!(writer.pieces[i].data = IOAllocBuffer(kQCOW2PieceSize))) {
+            result = ENOMEM;
+            goto done;
+        }
+    }
+
+    // read a window of pieces at a time, then store what isn't zeros in
+    // order after the header cluster
+    ProgressStart(&tracker, options->progress, size);
+    while (result == 0 && pos < size) {
+        ulonglong bytes = 0;
+        for (n = 0; n < window && pos < size; n++) {
+            QCOW2Piece *p = &writer.pieces[n];
+            p->start = pos;
+            p->length = (size - pos < kQCOW2PieceSize) ?
+                        (size - pos + kQCOW2ClusterSize - 1) & ~(ulonglong)(kQCOW2ClusterSize - 1) :
+                        kQCOW2PieceSize;
+            bytes += (size - pos < p->length) ? size - pos : p->length;
+            pos += p->length;
+        }
+        if ((result = PoolRun(threads, n, ReadPiece, &writer)) == 0) {
+            result = StorePieces(ofd, writer.pieces, n, map, &next, &written);
+        }
+        if (result == 0) { result = ProgressAdvance(&tracker, bytes); }
+    }
+    if (result != 0) { goto done; }
+    ProgressFinish(&tracker);
+
+    // after the data: the L2 tables in use, the L1 table, then the refcount
+    // blocks and the refcount table, which have to count themselves too
+    for (i = 0; i < l1Entries; i++) {
+        if (TableUsed(map, clusters, i)) { l2Tables++; }
+    }
+    for (;;) {
+        total = (next >> kQCOW2ClusterBits) + l2Tables + l1Clusters + refBlocks + refClusters;
+        blocks = (total + kQCOW2Refcounts - 1) / kQCOW2Refcounts;
+        tableClusters = (blocks * 8 + kQCOW2ClusterSize - 1) / kQCOW2ClusterSize;
+        if (blocks == refBlocks && tableClusters == refClusters) { break; }
+        refBlocks = blocks;
+        refClusters = tableClusters;
+    }
+    l1Start = next + (ulonglong)l2Tables * kQCOW2ClusterSize;
+    refStart = l1Start + (ulonglong)l1Clusters * kQCOW2ClusterSize;
+    refTableStart = refStart + (ulonglong)refBlocks * kQCOW2ClusterSize;
+    if (!(l1 = calloc(l1Clusters, kQCOW2ClusterSize)) ||
+        !(refTable = calloc(refClusters, kQCOW2ClusterSize))) {
+        result = ENOMEM;
+        goto done;
+    }
+    for (i = 0, at = next; i < l1Entries; i++) {
+        if (!TableUsed(map, clusters, i)) { continue; }
+        memset(table, 0, kQCOW2ClusterSize);
+        for (j = 0; j < kQCOW2TableEntries && i * kQCOW2TableEntries + j < clusters; j++) {
+            if (map[i * kQCOW2TableEntries + j]) {
+                PutBE64(table + j * 8, map[i * kQCOW2TableEntries + j] | kQCOW2Copied);
+            }
+        }
+        if (IOWrite(ofd, table, kQCOW2ClusterSize, at) < 0) {
+            result = errno;
+            goto done;
+        }
+        PutBE64(l1 + i * 8, at | kQCOW2Copied);
+        at += kQCOW2ClusterSize;
+    }
+    if (IOWrite(ofd, l1, l1Clusters * kQCOW2ClusterSize, l1Start) < 0) {
+        result = errno;
+        goto done;
+    }
+    for (i = 0; i < refBlocks; i++) {
+        memset(table, 0, kQCOW2ClusterSize);
+        for (j = 0; j < kQCOW2Refcounts && i * kQCOW2Refcounts + j < total; j++) {
+            PutBE16(table + j * 2, 1);
+        }
+        at = refStart + (ulonglong)i * kQCOW2ClusterSize;
+        if (IOWrite(ofd, table, kQCOW2ClusterSize, at) < 0) {
+            result = errno;
+            goto done;
+        }
+        PutBE64(refTable + i * 8, at);
+    }
+    if (IOWrite(ofd, refTable, refClusters * kQCOW2ClusterSize, refTableStart) < 0) {
+        result = errno;
+        goto done;
+    }
+
+    // the header goes last, so an unfinished file isn't taken for an image
+    memset(table, 0, kQCOW2ClusterSize);
+    PutBE32(table, kQCOW2Magic);
+    PutBE32(table + 4, kQCOW2Version);
+    PutBE32(table + 20, kQCOW2ClusterBits);
+    PutBE64(table + 24, size);
+    PutBE32(table + 36, (ulong)l1Entries);
+    PutBE64(table + 40, l1Start);
+    PutBE64(table + 48, refTableStart);
+    PutBE32(table + 56, (ulong)refClusters);
+    PutBE32(table + 96, kQCOW2RefcountOrder);
+    PutBE32(table + 100, kQCOW2HeaderLength); // no extensions follow
+    if (IOWrite(ofd, table, kQCOW2ClusterSize, 0) < 0) {
+        result = errno;
+        goto done;
+    }
+    written.imageSize = size;
+    written.clusters = clusters;
+    written.fileSize = (ulonglong)total * kQCOW2ClusterSize;
+    if (summary) { *summary = written; }
+done:
+    if (writer.pieces) {
+        for (i = 0; i < window; i++) { free(writer.pieces[i].data); }
+    }
+    free(writer.pieces);
+    free(map);
+    free(table);
+    free(l1);
+    free(refTable);
+    return result;
+}
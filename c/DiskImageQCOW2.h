@@ -0,0 +1,60 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageQCOW2.h
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//
+//----------------------------------------------------------------------
+
+#ifndef __diskimageqcow2_h__
+#define __diskimageqcow2_h__
+
+#include "DiskImageUtils.h"
+#include "DiskImageProgress.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// qcow2, QEMU's own image format, stores an image in clusters which are
+// allocated only once something is written to them. A two-level table
+// (the L1 table, then L2 tables) maps clusters of the image to clusters
+// of the file, and clusters it doesn't map read as zeros; refcount
+// tables count the references to each cluster of the file.
+//
+// QCOW2WriteImage writes an image that way in one pass: every cluster
+// of it which isn't all zeros, in image order after the header cluster,
+// then the tables, whose sizes are known only once the data is down, and
+// last the header. The image is read a window at a time on a thread
+// pool, each worker finding which of its clusters are zeros.
+
+#define kQCOW2ClusterBits 16 // 64 KB clusters, as qemu-img makes them
+
+// Fill length bytes of buf with the image from offset. Returns 0 or an
+// errno value. Called on several threads at once.
+typedef int (*QCOW2SourceProc)(void *refCon, char *buf, size_t length, off_t offset);
+
+typedef struct QCOW2WriteOptions {
+    unsigned threads; // read on this many threads (0 for one per CPU)
+    const Progress *progress; // reporting and cancellation (NULL for a bar on stdout)
+}   QCOW2WriteOptions;
+
+typedef struct QCOW2Summary {
+    ulonglong imageSize; // bytes in the image (its virtual size)
+    size_t clusters; // in the image
+    size_t allocated; // of those, written to the file
+    ulonglong fileSize;
+}   QCOW2Summary;
+
+// Write the size-byte image to ofd (opened with IOOpen, and empty) as a
+// qcow2 (version 3) image. summary (if not NULL) gets what was written.
+// Returns 0, ECANCELED if the progress token was set, or an errno value.
+int QCOW2WriteImage(int ofd, ulonglong size, QCOW2SourceProc source, void *refCon,
+                    const QCOW2WriteOptions *options, QCOW2Summary *summary);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __diskimageqcow2_h__ */
@@ -0,0 +1,386 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageScan.c
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//  Fri Oct 16 2026 -- partitions list the problems found validating them
+//  Fri Oct 16 2026 -- records name the container of a UDIF image
+//  Fri Oct 16 2026 -- and of Disk Copy 4.2 and DART images
+//  Fri Oct 16 2026 -- and of gzip and bzip2 streams
+//  Fri Oct 16 2026 -- and of zstd and xz streams
+//
+//----------------------------------------------------------------------
+
+#include <fts.h>
+#include <time.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include "DiskImageUtils.h"
+#include "DiskImageScan.h"
+#include "DiskImageDescribe.h"
+#include "DiskImagePool.h"
+#include "DiskImagePartition.h"
+
+extern int verbose;
+
+#define kScanFlushSize (256*1024) // bytes of records gathered per write
+
+// Unicode for Mac OS Roman bytes 0x80-0xFF, which HFS volume names use
+static const ushort kMacRomanHigh[128] = {
+    0x00C4, 0x00C5, 0x00C7, 0x00C9, 0x00D1, 0x00D6, 0x00DC, 0x00E1,
+    0x00E0, 0x00E2, 0x00E4, 0x00E3, 0x00E5, 0x00E7, 0x00E9, 0x00E8,
+    0x00EA, 0x00EB, 0x00ED, 0x00EC, 0x00EE, 0x00EF, 0x00F1, 0x00F3,
+    0x00F2, 0x00F4, 0x00F6, 0x00F5, 0x00FA, 0x00F9, 0x00FB, 0x00FC,
+    0x2020, 0x00B0, 0x00A2, 0x00A3, 0x00A7, 0x2022, 0x00B6, 0x00DF,
+    0x00AE, 0x00A9, 0x2122, 0x00B4, 0x00A8, 0x2260, 0x00C6, 0x00D8,
+    0x221E, 0x00B1, 0x2264, 0x2265, 0x00A5, 0x00B5, 0x2202, 0x2211,
+    0x220F, 0x03C0, 0x222B, 0x00AA, 0x00BA, 0x03A9, 0x00E6, 0x00F8,
+    0x00BF, 0x00A1, 0x00AC, 0x221A, 0x0192, 0x2248, 0x2206, 0x00AB,
+    0x00BB, 0x2026, 0x00A0, 0x00C0, 0x00C3, 0x00D5, 0x0152, 0x0153,
+    0x2013, 0x2014, 0x201C, 0x201D, 0x2018, 0x2019, 0x00F7, 0x25CA,
+    0x00FF, 0x0178, 0x2044, 0x20AC, 0x2039, 0x203A, 0xFB01, 0xFB02,
+    0x2021, 0x00B7, 0x201A, 0x201E, 0x2030, 0x00C2, 0x00CA, 0x00C1,
+    0x00CB, 0x00C8, 0x00CD, 0x00CE, 0x00CF, 0x00CC, 0x00D3, 0x00D4,
+    0xF8FF, 0x00D2, 0x00DA, 0x00DB, 0x00D9, 0x0131, 0x02C6, 0x02DC,
+    0x00AF, 0x02D8, 0x02D9, 0x02DA, 0x00B8, 0x02DD, 0x02DB, 0x02C7
+};
+
+// A growable string, one per worker, reused for every record it formats
+typedef struct ScanText {
+    char *data;
+    size_t length;
+    size_t capacity;
+    int failed; // ran out of memory
+}   ScanText;
+
+typedef struct ScanJob {
+    const ScanOptions *options;
+    ImageIndex *index;
+    char **paths;
+    size_t count;
+    size_t capacity;
+    ScanText *texts; // one per worker
+    pthread_mutex_t lock; // guards out and the counts below
+    ScanText out; // records waiting to be written
+    size_t images;
+    size_t failed;
+}   ScanJob;
+
+static void TextAppend(ScanText *text, const char *bytes, size_t len) {
+    if (text->length + len + 1 > text->capacity) {
+        size_t capacity = (text->capacity) ? text->capacity : 4096;
+        char *p;
+        while (capacity < text->length + len + 1) { capacity *= 2; }
+        if (!(p = realloc(text->data, capacity))) {
+            text->failed = 1;
+            return;
+        }
+        text->data = p;
+        text->capacity = capacity;
+    }
+    memcpy(text->data + text->length, bytes, len);
+    text->length += len;
+    text->data[text->length] = 0;
+}
+
+static void TextPrintf(ScanText *text, const char *format, ...) {
+    char buf[256];
+    va_list args;
+    int len;
+    va_start(args, format);
+    len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (len > 0) {
+        TextAppend(text, buf, ((size_t)len < sizeof(buf)) ? (size_t)len : sizeof(buf) - 1);
+    }
+}
+
+// Append one code point as UTF-8
+static void TextAppendUnicode(ScanText *text, ulong c) {
+    char buf[3];
+    if (c < 0x80) {
+        buf[0] = (char)c;
+        TextAppend(text, buf, 1);
+    } else if (c < 0x800) {
+        buf[0] = (char)(0xC0 | (c >> 6));
+        buf[1] = (char)(0x80 | (c & 0x3F));
+        TextAppend(text, buf, 2);
+    } else {
+        buf[0] = (char)(0xE0 | (c >> 12));
+        buf[1] = (char)(0x80 | ((c >> 6) & 0x3F));
+        buf[2] = (char)(0x80 | (c & 0x3F));
+        TextAppend(text, buf, 3);
+    }
+}
+
+// Append a quoted JSON string. Paths are passed through as the file
+// system spells them; macRoman strings (from HFS) are converted to UTF-8.
+static void TextAppendString(ScanText *text, const char *str, int macRoman) {
+    const uchar *p = (const uchar*)str;
+    TextAppend(text, "\"", 1);
+    for (; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            char esc[2] = { '\\', (char)*p };
+            TextAppend(text, esc, 2);
+        } else if (*p < 0x20) {
+            TextPrintf(text, "\\u%04x", *p);
+        } else if (*p >= 0x80 && macRoman) {
+            TextAppendUnicode(text, kMacRomanHigh[*p - 0x80]);
+        } else {
+            TextAppend(text, (const char*)p, 1);
+        }
+    }
+    TextAppend(text, "\"", 1);
+}
+
+// HFS dates count seconds from 1904; emit them as ISO 8601 without a
+// zone, since HFS (unlike HFS+) stores local time
+static void TextAppendDate(ScanText *text, ulong hfsDate) {
+    time_t t = (time_t)hfsDate - 2082844800;
+    struct tm tm;
+    char buf[32];
+    if (hfsDate == 0 || !gmtime_r(&t, &tm) ||
+        !strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm)) {
+        TextAppend(text, "null", 4);
+        return;
+    }
+    TextPrintf(text, "\"%s\"", buf);
+}
+
+static const char *FormatName(ulong format) {
+    switch (format) {
+        case kImageFormatAPM: return "apm";
+        case kImageFormatHFSBootable: return "hfs-bootable";
+        case kImageFormatHFS: return "hfs";
+        case kImageFormatUnreadable: return "unreadable";
+        default: return "unknown";
+    }
+}
+
+static const char *ContainerName(ulong container) {
+    switch (container) {
+        case kImageContainerUDIF: return "udif";
+        case kImageContainerDiskCopy42: return "dc42";
+        case kImageContainerDART: return "dart";
+        case kImageContainerGzip: return "gzip";
+        case kImageContainerBzip2: return "bzip2";
+        case kImageContainerZstd: return "zstd";
+        case kImageContainerXz: return "xz";
+        default: return "none";
+    }
+}
+
+static void FormatVolume(ScanText *text, const VolumeRecord *vol) {
+    static const char *kStatus[] = { "ok", "boot-block-error", "mdb-error", "header-error" };
+    ulonglong blockSize = vol->blockSize;
+    TextPrintf(text, "{\"status\":\"%s\"",
+               (vol->status < 4) ? kStatus[vol->status] : "unknown");
+    if (vol->status == kVolumeBootBlockError) {
+        TextAppend(text, "}", 1);
+        return;
+    }
+    TextPrintf(text, ",\"bootSignature\":%u,\"bootVersion\":%u,\"bootable\":%s",
+               vol->bootSig, vol->bootVersion, (vol->bootSig == 0x4C4B) ? "true" : "false");
+    if (vol->status == kVolumeMDBError) {
+        TextAppend(text, "}", 1);
+        return;
+    }
+    TextPrintf(text, ",\"signature\":%u,\"kind\":\"%s\"", vol->sigWord,
+               (vol->sigWord == 0x4244) ? "hfs" : (vol->sigWord == 0x482B) ? "hfs+" : "unknown");
+    if ((vol->sigWord == 0x4244 || vol->sigWord == 0x482B) && vol->status == kVolumeOK) {
+        if (vol->sigWord == 0x4244) {
+            TextAppend(text, ",\"name\":", 8);
+            TextAppendString(text, vol->name, 1);
+        }
+        TextAppend(text, ",\"created\":", 11);
+        TextAppendDate(text, vol->createDate);
+        TextAppend(text, ",\"modified\":", 12);
+        TextAppendDate(text, vol->modifyDate);
+        TextPrintf(text, ",\"blockSize\":%u,\"totalBlocks\":%u,\"freeBlocks\":%u",
+                   vol->blockSize, vol->totalBlocks, vol->freeBlocks);
+        TextPrintf(text, ",\"capacity\":%llu,\"used\":%llu,\"free\":%llu",
+                   blockSize * vol->totalBlocks,
+                   blockSize * (vol->totalBlocks - vol->freeBlocks),
+                   blockSize * vol->freeBlocks);
+    }
+    TextAppend(text, "}", 1);
+}
+
+static void FormatPartition(ScanText *text, const ImageRecord *record, ulong i) {
+    const PartitionRecord *part = &record->partitions[i];
+    ulonglong offset = (ulonglong)part->start * 512;
+    ulonglong length = (ulonglong)part->blocks * 512;
+    ulong problem;
+    int first = 1;
+    TextPrintf(text, "{\"index\":%u,\"name\":", i);
+    TextAppendString(text, part->name, 1);
+    TextAppend(text, ",\"type\":", 8);
+    TextAppendString(text, part->type, 1);
+    TextPrintf(text, ",\"start\":%u,\"blocks\":%u,\"offset\":%llu,\"length\":%llu,\"truncated\":%s",
+               part->start, part->blocks, offset, length,
+               (part->problems & kPartitionTruncated) ? "true" : "false");
+    if (part->problems) {
+        TextAppend(text, ",\"problems\":[", 13);
+        for (problem = 1; problem <= kPartitionMapCount; problem <<= 1) {
+            if (!(part->problems & problem)) { continue; }
+            if (!first) { TextAppend(text, ",", 1); }
+            TextAppendString(text, PartitionProblemName(problem), 0);
+            first = 0;
+        }
+        TextAppend(text, "]", 1);
+    }
+    if (!strncmp(part->type, "Apple_Driver", 12)) {
+        TextPrintf(text, ",\"driver\":{\"size\":%u,\"checksum\":%u,\"computedChecksum\":%u,"
+                   "\"verified\":%s}", part->bootSize, part->bootCksum, part->computedCksum,
+                   (part->bootCksum && part->bootCksum == part->computedCksum) ? "true" : "false");
+    }
+    if (PartitionTypeIsHFS(part->type)) {
+        TextAppend(text, ",\"volume\":", 10);
+        FormatVolume(text, &part->volume);
+    }
+    TextAppend(text, "}", 1);
+}
+
+// One line of NDJSON for a probed image, or for a file that failed
+static void FormatRecord(ScanText *text, const char *path, const ImageRecord *record,
+                         int error) {
+    ulong i;
+    text->length = 0;
+    text->failed = 0;
+    TextAppend(text, "{\"path\":", 8);
+    TextAppendString(text, path, 0);
+    if (!record) {
+        TextPrintf(text, ",\"error\":%d,\"message\":", error);
+        TextAppendString(text, strerror(error), 0);
+        TextAppend(text, "}\n", 2);
+        return;
+    }
+    TextPrintf(text, ",\"size\":%llu,\"format\":\"%s\"", record->fileSize,
+               FormatName(record->format));
+    if (record->container != kImageContainerNone) {
+        TextPrintf(text, ",\"container\":\"%s\"", ContainerName(record->container));
+    }
+    if (record->format == kImageFormatAPM) {
+        TextPrintf(text, ",\"deviceSignature\":%u,\"deviceSize\":%llu,\"truncated\":%s",
+                   record->ddrSig, record->deviceSize,
+                   (record->deviceSize > record->fileSize) ? "true" : "false");
+        TextAppend(text, ",\"partitions\":[", 15);
+        for (i = 0; i < record->partitionCount; i++) {
+            if (i) { TextAppend(text, ",", 1); }
+            FormatPartition(text, record, i);
+        }
+        TextAppend(text, "]", 1);
+    } else if (record->format == kImageFormatHFSBootable ||
+               record->format == kImageFormatHFS) {
+        TextAppend(text, ",\"volume\":", 10);
+        FormatVolume(text, &record->volume);
+    }
+    TextAppend(text, "}\n", 2);
+}
+
+// Write out the gathered records; called with the lock held
+static void ScanFlush(ScanJob *job) {
+    if (job->out.length) {
+        fwrite(job->out.data, 1, job->out.length, stdout);
+        job->out.length = 0;
+    }
+}
+
+static int ScanTask(void *refCon, size_t taskIndex, unsigned worker) {
+    ScanJob *job = (ScanJob*)refCon;
+    ScanText *text = &job->texts[worker];
+    const char *path = job->paths[taskIndex];
+    ImageRecord *record = NULL;
+    int result, image;
+
+    result = ProbeImageFile(path, job->options->backend, job->index, &record);
+    image = (record && record->format != kImageFormatUnknown &&
+             record->format != kImageFormatUnreadable);
+    if (result != 0 || image || job->options->all) {
+        FormatRecord(text, path, (result == 0) ? record : NULL, result);
+        pthread_mutex_lock(&job->lock);
+        if (text->failed) {
+            result = ENOMEM;
+        } else {
+            TextAppend(&job->out, text->data, text->length);
+            if (job->out.length >= kScanFlushSize) { ScanFlush(job); }
+        }
+        if (result != 0) { job->failed++; }
+        if (image) { job->images++; }
+        pthread_mutex_unlock(&job->lock);
+    }
+    free(record);
+    return 0; // keep going past unreadable files
+}
+
+static int AddPath(ScanJob *job, const char *path) {
+    if (job->count == job->capacity) {
+        size_t capacity = (job->capacity) ? job->capacity * 2 : 256;
+        char **p = realloc(job->paths, capacity * sizeof(char*));
+        if (!p) { return ENOMEM; }
+        job->paths = p;
+        job->capacity = capacity;
+    }
+    if (!(job->paths[job->count] = strdup(path))) { return ENOMEM; }
+    job->count++;
+    return 0;
+}
+
+static int AddTree(ScanJob *job, const char *root) {
+    char *paths[] = { (char*)root, NULL };
+    FTSENT *ent;
+    FTS *fts;
+    int result = 0;
+    if (!(fts = fts_open(paths, FTS_PHYSICAL | FTS_NOCHDIR, NULL))) { return errno; }
+    while (result == 0 && (ent = fts_read(fts)) != NULL) {
+        if (ent->fts_name[0] == '.' && ent->fts_level > 0) {
+            if (ent->fts_info == FTS_D) { fts_set(fts, ent, FTS_SKIP); }
+            continue; // hidden files and directories
+        }
+        if (ent->fts_info == FTS_F) {
+            result = AddPath(job, ent->fts_path);
+        }
+    }
+    fts_close(fts);
+    return result;
+}
+
+int ScanTree(const char *root, const ScanOptions *options, ImageIndex *index) {
+    ScanJob job;
+    unsigned workers = (options->workers) ? options->workers : PoolDefaultThreads();
+    size_t i;
+    int result;
+    memset(&job, 0, sizeof(job));
+    job.options = options;
+    job.index = index;
+    pthread_mutex_init(&job.lock, NULL);
+
+    if ((result = AddTree(&job, root)) != 0) {
+        fprintf(stderr, "Unable to read \"%s\" (%d)\n", root, result);
+        job.failed = 1;
+        goto done;
+    }
+    if (workers > job.count) { workers = (job.count) ? (unsigned)job.count : 1; }
+    if (!(job.texts = calloc(workers, sizeof(ScanText)))) {
+        job.failed = 1;
+        goto done;
+    }
+    PoolRun(workers, job.count, ScanTask, &job);
+    ScanFlush(&job);
+    fflush(stdout);
+    if (verbose) {
+        fprintf(stderr, "Scanned %zu files: %zu images, %zu unreadable\n",
+                job.count, job.images, job.failed);
+    }
+done:
+    for (i = 0; i < job.count; i++) { free(job.paths[i]); }
+    if (job.texts) {
+        for (i = 0; i < workers; i++) { free(job.texts[i].data); }
+    }
+    free(job.texts);
+    free(job.paths);
+    free(job.out.data);
+    pthread_mutex_destroy(&job.lock);
+    return (int)job.failed;
+}
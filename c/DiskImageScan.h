@@ -0,0 +1,39 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageScan.h
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//
+//----------------------------------------------------------------------
+
+#ifndef __diskimagescan_h__
+#define __diskimagescan_h__
+
+#include "DiskImageUtils.h"
+#include "DiskImageIO.h"
+#include "DiskImageIndex.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ScanOptions {
+    unsigned workers; // files probed at once (0 for one per CPU)
+    IOBackend backend;
+    int all; // also emit records for files that aren't disk images
+}   ScanOptions;
+
+// Probe every file under root (a directory tree, or a single file) on a
+// pool of workers and write one JSON object per line to stdout, holding
+// everything "info" would print for that image. Records are written in
+// the order files finish, through one shared buffer flushed in large
+// blocks rather than per line. Returns the number of files which could
+// not be read.
+int ScanTree(const char *root, const ScanOptions *options, ImageIndex *index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __diskimagescan_h__ */
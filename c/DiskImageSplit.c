@@ -0,0 +1,190 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageSplit.c
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//  Fri Oct 16 2026 -- UDIF images are split in place
+//
+//----------------------------------------------------------------------
+
+#include <time.h>
+#include <pthread.h>
+#include "DiskImageUtils.h"
+#include "DiskImageSplit.h"
+#include "DiskImageConvert.h"
+#include "DiskImagePartition.h"
+#include "DiskImagePool.h"
+#include "DiskImageIO.h"
+#include "DiskImageDescribe.h"
+
+extern int quiet;
+
+typedef struct SplitPart {
+    const PartitionEntry *entry;
+    ulong number; // index in the map
+    int hfs;
+    char *outPath;
+    int result; // from ExtractPartition
+    int done; // set once the partition has been tried
+    double seconds;
+}   SplitPart;
+
+typedef struct SplitJob {
+    const char *inPath;
+    int fd; // shared by the workers
+    const SplitOptions *split;
+    const CopyOptions *options;
+    SplitPart *parts;
+    size_t count;
+    pthread_mutex_t lock; // keeps the report lines whole
+    size_t finished;
+}   SplitJob;
+
+static double SplitNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *PartitionPath(const SplitOptions *split, const char *inPath, ulong number,
+                           int hfs) {
+    const char *dir = (split->outDir) ? split->outDir : "";
+    const char *name = (split->outDir && strrchr(inPath, '/')) ?
+                       strrchr(inPath, '/') + 1 : inPath;
+    size_t len = strlen(dir) + strlen(name) + 32;
+    char *path = malloc(len);
+    if (path) {
+        snprintf(path, len, "%s%s%s.p%u.%s", dir, (*dir) ? "/" : "", name, number,
+                 (hfs) ? "dsk" : "bin");
+    }
+    return path;
+}
+
+static void SplitReport(SplitJob *job, const SplitPart *part) {
+    pthread_mutex_lock(&job->lock);
+    job->finished++;
+    fprintf(stdout, "[%zu/%zu] Partition %u: %s (%s): ", job->finished, job->count,
+            part->number, part->entry->name, part->entry->type);
+    if (part->result == 0) {
+        fprintf(stdout, "%.1f MB to \"%s\" in %.2f s\n", part->entry->length / (1024.0*1024.0),
+                part->outPath, part->seconds);
+    } else if (part->result == ECANCELED) {
+        fprintf(stdout, "cancelled\n");
+    } else {
+        fprintf(stdout, "failed (error %d: %s)\n", part->result, strerror(part->result));
+    }
+    fflush(stdout);
+    pthread_mutex_unlock(&job->lock);
+}
+
+static int SplitTask(void *refCon, size_t taskIndex, unsigned worker) {
+    SplitJob *job = (SplitJob*)refCon;
+    SplitPart *part = &job->parts[taskIndex];
+    double start = SplitNow();
+    part->result = ExtractPartition(job->fd, job->inPath, part->entry->offset,
+                                    part->entry->length, part->hfs, part->outPath,
+                                    job->split->rw, job->options);
+    part->seconds = SplitNow() - start;
+    part->done = 1;
+    SplitReport(job, part);
+    // one bad partition mustn't stop the rest, but a cancel should
+    return (part->result == ECANCELED) ? ECANCELED : 0;
+}
+
+int SplitFile(const char *inPath, const SplitOptions *split, const CopyOptions *options) {
+    SplitJob job;
+    CopyOptions defaults = {0};
+    PartitionTable *table = NULL;
+    const PartitionEntry *entry;
+    off_t fileSize;
+    unsigned workers;
+    size_t i, written = 0, bytes = 0;
+    double start, seconds;
+    int result, wasQuiet = quiet;
+    memset(&job, 0, sizeof(job));
+    job.inPath = inPath;
+    job.split = split;
+    job.options = (options) ? options : &defaults;
+    pthread_mutex_init(&job.lock, NULL);
+
+    if ((job.fd = OpenImage(inPath, job.options->backend)) == -1) {
+        result = errno;
+        tabprint(0, "Unable to open \"%s\" (%d)\n", inPath, errno);
+        goto done;
+    }
+    tabprint(0, "Input file: \"%s\"\n", inPath);
+    if ((fileSize = IOSize(job.fd)) < 0 || ReadImageHeader(job.fd) != 0) {
+        result = (errno) ? errno : EIO;
+        tabprint(0, "Unable to read the image header (%d)\n", result);
+        goto done;
+    }
+    if ((result = ReadPartitionTable(job.fd, fileSize, &table)) != 0) {
+        if (result == -1) {
+            tabprint(0, "No Apple partition map found; nothing to split\n");
+        } else {
+            tabprint(0, "Unable to read the partition map (%d)\n", result);
+        }
+        goto done;
+    }
+    if (split->outDir && mkdir(split->outDir, 0755) != 0 && errno != EEXIST) {
+        result = errno;
+        tabprint(0, "Unable to create \"%s\" (%d)\n", split->outDir, result);
+        goto done;
+    }
+    if (!(job.parts = calloc(table->count, sizeof(SplitPart)))) {
+        result = ENOMEM;
+        goto done;
+    }
+    for (i = 0; i < table->count; i++) {
+        entry = &table->entries[i];
+        if (!strcmp(entry->type, "Apple_Free")) { continue; }
+        if (!entry->length) {
+            tabprint(1, "Skipping partition %zu: %s (%s), which has no data in the file\n",
+                     i, entry->name, entry->type);
+            continue;
+        }
+        job.parts[job.count].entry = entry;
+        job.parts[job.count].number = i;
+        job.parts[job.count].hfs = PartitionTypeIsHFS(entry->type);
+        if (!(job.parts[job.count].outPath = PartitionPath(split, inPath, i,
+                                                           job.parts[job.count].hfs))) {
+            result = ENOMEM;
+            goto done;
+        }
+        job.count++;
+    }
+    workers = (split->workers) ? split->workers : (unsigned)job.count;
+    if (workers > job.count) { workers = (job.count) ? (unsigned)job.count : 1; }
+    tabprint(0, "Writing %zu partitions on %u worker%s\n", job.count, workers,
+             (workers == 1) ? "" : "s");
+    start = SplitNow();
+    quiet = 1; // the workers' output would only interleave
+    result = PoolRun(workers, job.count, SplitTask, &job);
+    quiet = wasQuiet;
+
+    for (i = 0; i < job.count; i++) {
+        if (!job.parts[i].done) { continue; }
+        if (job.parts[i].result == 0) {
+            written++;
+            bytes += job.parts[i].entry->length;
+        } else if (result == 0) {
+            result = job.parts[i].result; // the first error
+        }
+    }
+    seconds = SplitNow() - start;
+    tabprint(0, "\n");
+    tabprint(0, "Wrote %zu of %zu partitions: %.1f MB in %.2f s (%.1f MB/s)\n", written,
+             job.count, bytes / (1024.0*1024.0), seconds,
+             (seconds > 0) ? bytes / (1024.0*1024.0) / seconds : 0.0);
+    if (result == ECANCELED) {
+        tabprint(0, "Split cancelled; partly written partitions were removed\n");
+    }
+done:
+    for (i = 0; i < job.count; i++) { free(job.parts[i].outPath); }
+    free(job.parts);
+    free(table);
+    if (job.fd != -1) { IOClose(job.fd); }
+    pthread_mutex_destroy(&job.lock);
+    return result;
+}
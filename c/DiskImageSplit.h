@@ -0,0 +1,40 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageSplit.h
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//
+//----------------------------------------------------------------------
+
+#ifndef __diskimagesplit_h__
+#define __diskimagesplit_h__
+
+#include "DiskImageUtils.h"
+#include "DiskImageCopy.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct SplitOptions {
+    int rw; // leave the HFS volumes writable
+    unsigned workers; // partitions written at once (0 for all of them)
+    const char *outDir; // where outputs go (NULL to put them beside the input)
+}   SplitOptions;
+
+// Write every partition of the Apple Partition Map image at inPath to a
+// file of its own, named "<input>.p<n>.dsk" for HFS volumes (as cvt2hfs
+// would write them) and "<input>.p<n>.bin" for anything else (the map
+// itself, drivers, other systems' partitions), where n is the entry's
+// number as info prints it. Free space and entries with no data in the
+// file are skipped. The partitions are copied at once, one worker each,
+// sharing the open input. Returns 0, -1 if the image has no partition
+// map, or the first error (ECANCELED if the progress token was set).
+int SplitFile(const char *inPath, const SplitOptions *split, const CopyOptions *options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __diskimagesplit_h__ */
@@ -0,0 +1,132 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageStats.c
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//  Fri Oct 16 2026 -- added StatsReset and StatsTotals for the benchmark
+//
+//----------------------------------------------------------------------
+
+#include <time.h>
+#include "DiskImageUtils.h"
+#include "DiskImageStats.h"
+
+int gStatsEnabled = 0;
+
+static ulonglong gStatsCounters[kStatsPhaseCount][kStatsCounterCount];
+static ulonglong gStatsNanos[kStatsPhaseCount]; // time spent in each phase
+static ulonglong gStatsEntries[kStatsPhaseCount]; // times each phase was entered
+static double gStatsStart;
+static __thread StatsPhase gStatsPhase; // per thread, starts as kStatsPhaseOther
+
+static const char *kStatsPhaseNames[kStatsPhaseCount] = {
+    "other", "open", "probe", "header", "copy", "attributes", "close"
+};
+
+static const char *kStatsCounterNames[kStatsCounterCount] = {
+    "readCalls", "writeCalls", "otherCalls", "bytesRead", "bytesWritten",
+    "bytesCopied", "cachedReads", "shortReads", "shortWrites", "retries"
+};
+
+static double StatsNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void StatsEnable(void) {
+    gStatsStart = StatsNow();
+    gStatsEnabled = 1;
+}
+
+void StatsAdd(StatsCounter counter, ulonglong n) {
+    __atomic_fetch_add(&gStatsCounters[gStatsPhase][counter], n, __ATOMIC_RELAXED);
+}
+
+void StatsBegin(StatsTimer *timer, StatsPhase phase) {
+    timer->phase = phase;
+    timer->outer = gStatsPhase;
+    timer->start = (gStatsEnabled) ? StatsNow() : 0;
+    gStatsPhase = phase;
+}
+
+void StatsEnd(StatsTimer *timer) {
+    if (gStatsEnabled && timer->start) {
+        ulonglong nanos = (ulonglong)((StatsNow() - timer->start) * 1e9);
+        __atomic_fetch_add(&gStatsNanos[timer->phase], nanos, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&gStatsEntries[timer->phase], 1, __ATOMIC_RELAXED);
+    }
+    gStatsPhase = timer->outer;
+}
+
+void StatsReset(void) {
+    int p, c;
+    for (p = 0; p < kStatsPhaseCount; p++) {
+        for (c = 0; c < kStatsCounterCount; c++) {
+            __atomic_store_n(&gStatsCounters[p][c], 0, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&gStatsNanos[p], 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&gStatsEntries[p], 0, __ATOMIC_RELAXED);
+    }
+    gStatsStart = StatsNow();
+}
+
+void StatsTotals(ulonglong totals[kStatsCounterCount]) {
+    int p, c;
+    for (c = 0; c < kStatsCounterCount; c++) {
+        totals[c] = 0;
+        for (p = 0; p < kStatsPhaseCount; p++) {
+            totals[c] += __atomic_load_n(&gStatsCounters[p][c], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void StatsPrintJSON(FILE *stream) {
+    ulonglong totals[kStatsCounterCount] = {0};
+    int p, c;
+    fprintf(stream, "{\"seconds\":%.6f,\"phases\":{", StatsNow() - gStatsStart);
+    for (p = 0; p < kStatsPhaseCount; p++) {
+        fprintf(stream, "%s\"%s\":{\"seconds\":%.6f,\"entries\":%llu", (p) ? "," : "",
+                kStatsPhaseNames[p], gStatsNanos[p] / 1e9, gStatsEntries[p]);
+        for (c = 0; c < kStatsCounterCount; c++) {
+            fprintf(stream, ",\"%s\":%llu", kStatsCounterNames[c], gStatsCounters[p][c]);
+            totals[c] += gStatsCounters[p][c];
+        }
+        fprintf(stream, "}");
+    }
+    fprintf(stream, "},\"total\":{");
+    for (c = 0; c < kStatsCounterCount; c++) {
+        fprintf(stream, "%s\"%s\":%llu", (c) ? "," : "", kStatsCounterNames[c], totals[c]);
+    }
+    fprintf(stream, "}}\n");
+}
+
+static void StatsPrintRow(FILE *stream, const char *name, double seconds, const ulonglong *n) {
+    fprintf(stream, "%-11s %9.3f %8llu %8llu %8llu %10.1f %10.1f %10.1f %7llu %6llu %7llu\n",
+            name, seconds, n[kStatsReadCalls], n[kStatsWriteCalls], n[kStatsOtherCalls],
+            n[kStatsBytesRead] / (1024.0*1024.0), n[kStatsBytesWritten] / (1024.0*1024.0),
+            n[kStatsBytesCopied] / (1024.0*1024.0), n[kStatsCachedReads],
+            n[kStatsShortReads] + n[kStatsShortWrites], n[kStatsRetries]);
+}
+
+void StatsPrint(FILE *stream, int json) {
+    ulonglong totals[kStatsCounterCount] = {0};
+    int p, c;
+    if (json) {
+        StatsPrintJSON(stream);
+        return;
+    }
+    fprintf(stream, "\n%-11s %9s %8s %8s %8s %10s %10s %10s %7s %6s %7s\n", "Phase", "Seconds",
+            "Reads", "Writes", "Other", "Read MB", "Write MB", "Kernel MB", "Cached",
+            "Short", "Retries");
+    for (p = kStatsPhaseOpen; p <= kStatsPhaseCount; p++) {
+        int phase = p % kStatsPhaseCount; // "other" goes last
+        for (c = 0; c < kStatsCounterCount; c++) { totals[c] += gStatsCounters[phase][c]; }
+        if (!gStatsEntries[phase] && phase != kStatsPhaseOther) { continue; }
+        StatsPrintRow(stream, kStatsPhaseNames[phase], gStatsNanos[phase] / 1e9,
+                      gStatsCounters[phase]);
+    }
+    StatsPrintRow(stream, "total", StatsNow() - gStatsStart, totals);
+    fflush(stream);
+}
@@ -0,0 +1,79 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageStats.h
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//  Fri Oct 16 2026 -- added StatsReset and StatsTotals for the benchmark
+//
+//----------------------------------------------------------------------
+
+#ifndef __diskimagestats_h__
+#define __diskimagestats_h__
+
+#include "DiskImageUtils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Stages of a job. Counters are charged to the phase the calling thread
+// is in; anything outside a timed phase goes to kStatsPhaseOther.
+typedef enum StatsPhase {
+    kStatsPhaseOther = 0,
+    kStatsPhaseOpen,       // opening the input and creating the output
+    kStatsPhaseProbe,      // reading the image header and partition map
+    kStatsPhaseHeader,     // writing the DDR, partition map and driver
+    kStatsPhaseCopy,       // copying the volume data
+    kStatsPhaseAttributes, // patching the volume's lock bits
+    kStatsPhaseClose,      // closing (and unmapping) the files
+    kStatsPhaseCount
+}   StatsPhase;
+
+typedef enum StatsCounter {
+    kStatsReadCalls = 0,   // pread() and friends
+    kStatsWriteCalls,      // pwrite() and friends
+    kStatsOtherCalls,      // open, close, fstat, lseek, copy_file_range, ...
+    kStatsBytesRead,       // through read calls
+    kStatsBytesWritten,    // through write calls
+    kStatsBytesCopied,     // moved inside the kernel (copy_file_range, clones, io_uring)
+    kStatsCachedReads,     // reads served from a mapping or the header cache
+    kStatsShortReads,      // calls that returned less than asked for
+    kStatsShortWrites,
+    kStatsRetries,         // calls repeated after EINTR, EAGAIN or a fallback
+    kStatsCounterCount
+}   StatsCounter;
+
+extern int gStatsEnabled;
+
+// Counting costs one branch when statistics are off
+#define StatsCount(counter, n) \
+    do { if (gStatsEnabled) { StatsAdd((counter), (n)); } } while (0)
+
+typedef struct StatsTimer {
+    StatsPhase phase;
+    StatsPhase outer; // restored when the timer ends
+    double start;
+}   StatsTimer;
+
+void StatsEnable(void);
+void StatsAdd(StatsCounter counter, ulonglong n);
+
+// Move the calling thread into phase until StatsEnd, timing it. Phases
+// nest; time spent on several threads at once is added up.
+void StatsBegin(StatsTimer *timer, StatsPhase phase);
+void StatsEnd(StatsTimer *timer);
+
+// Clear every counter and timer (e.g. between benchmark runs)
+void StatsReset(void);
+// Sum each counter over all the phases
+void StatsTotals(ulonglong totals[kStatsCounterCount]);
+
+// Write the totals so far as a table, or as one JSON object
+void StatsPrint(FILE *stream, int json);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __diskimagestats_h__ */
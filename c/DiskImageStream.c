@@ -0,0 +1,750 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageStream.c
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//  Fri Oct 16 2026 -- zstd frames and xz blocks, in builds with their decoders
+//
+//----------------------------------------------------------------------
+
+#include <pthread.h>
+#include <zlib.h>
+#include <bzlib.h>
+
+// The zstd and xz decoders are built in only when the Makefile asks for
+// them (make ZSTD=1 XZ=1) and their headers are found
+#if defined(WITH_ZSTD) && defined(__has_include)
+#if __has_include(<zstd.h>)
+#define HAVE_ZSTD 1
+#include <zstd.h>
+#endif
+#endif
+#if defined(WITH_XZ) && defined(__has_include)
+#if __has_include(<lzma.h>)
+#define HAVE_XZ 1
+#include <lzma.h>
+#endif
+#endif
+
+#include "DiskImageUtils.h"
+#include "DiskImageStream.h"
+#include "DiskImageIO.h"
+
+#define kStreamSpan (2*1024*1024) // decoded bytes between points inside a gzip member
+#define kStreamMaxSpan (16*1024*1024) // points further apart aren't worth seeking between
+#define kStreamHistory 32768 // inflate's window
+#define kStreamInput (256*1024) // compressed bytes read at a time
+#define kStreamOutput (1024*1024) // decoded bytes a decoder holds
+#define kStreamKept (64*1024) // of which kept when it fills, for reads a little way back
+#define kStreamDecoders 16 // kept between reads
+
+// A place decoding can start
+typedef struct StreamPoint {
+    ulonglong out; // offset in the image
+    ulonglong in; // offset in the file (of the byte after, if bits)
+    int bits; // bits of the byte before in which come after the point
+    uchar *history; // the 32 KB decoded before out, or NULL at a member's start
+    int check; // xz: the integrity check of the block's stream
+}   StreamPoint;
+
+typedef struct StreamDecoder {
+    int busy; // a read is using it (guarded by the image's lock)
+    ulonglong used; // when last read, for eviction
+    int live; // its decoder is initialised
+    int ended; // the member (or xz block) it was decoding has ended
+    z_stream z;
+    bz_stream bz;
+#ifdef HAVE_ZSTD
+    ZSTD_DStream *zstd; // kept when it ends, to be started again
+#endif
+#ifdef HAVE_XZ
+    lzma_stream xz;
+    lzma_block block; // the xz block's options, which xz reads until it ends
+#endif
+    ulonglong in; // offset in the file of the next byte to read
+    uchar *input;
+    size_t inUsed; // bytes of input decoded, of inLength
+    size_t inLength;
+    char *output; // decoded bytes, from outStart
+    ulonglong outStart;
+    size_t outLength;
+}   StreamDecoder;
+
+typedef struct StreamImage {
+    StreamSummary summary;
+    StreamPoint *points; // in image order
+    size_t capacity;
+    pthread_mutex_t lock; // guards choosing decoders
+    StreamDecoder decoders[kStreamDecoders];
+    ulonglong clock;
+}   StreamImage;
+
+// Add a point; window is inflate's output buffer, with left bytes of it
+// not yet written over, or NULL at the start of a member
+static int AddPoint(StreamImage *image, ulonglong out, ulonglong in, int bits,
+                    const uchar *window, size_t left) {
+    StreamPoint *point;
+    if (image->summary.points == image->capacity) {
+        size_t capacity = (image->capacity) ? image->capacity * 2 : 64;
+        StreamPoint *p = realloc(image->points, capacity * sizeof(StreamPoint));
+        if (!p) { return ENOMEM; }
+        image->points = p;
+        image->capacity = capacity;
+    }
+    point = &image->points[image->summary.points];
+    point->out = out;
+    point->in = in;
+    point->bits = bits;
+    point->history = NULL;
+    point->check = 0;
+    if (window) {
+        if (!(point->history = malloc(kStreamHistory))) { return ENOMEM; }
+        // the oldest bytes are those about to be written over
+        memcpy(point->history, window + kStreamHistory - left, left);
+        memcpy(point->history + left, window, kStreamHistory - left);
+    }
+    image->summary.points++;
+    return 0;
+}
+
+// The last point at or before offset
+static const StreamPoint *FindPoint(const StreamImage *image, ulonglong offset) {
+    size_t lo = 0, hi = image->summary.points, mid;
+    while (hi - lo > 1) {
+        mid = (lo + hi) / 2;
+        if (image->points[mid].out <= offset) { lo = mid; } else { hi = mid; }
+    }
+    return &image->points[lo];
+}
+
+static void EndDecoder(StreamImage *image, StreamDecoder *d) {
+    if (!d->live) { return; }
+    if (image->summary.format == kStreamBzip2) {
+        BZ2_bzDecompressEnd(&d->bz);
+#ifdef HAVE_XZ
+    } else if (image->summary.format == kStreamXz) {
+        lzma_end(&d->xz);
+#endif
+    } else if (image->summary.format == kStreamGzip) {
+        inflateEnd(&d->z);
+    }
+    d->live = 0;
+}
+
+#ifdef HAVE_XZ
+// Set d's xz decoder up for the block at point, from its header
+static int StartXzBlock(int fd, StreamDecoder *d, const StreamPoint *point) {
+    uchar header[LZMA_BLOCK_HEADER_SIZE_MAX];
+    lzma_filter filters[LZMA_FILTERS_MAX + 1];
+    lzma_block *block = &d->block;
+    lzma_ret ret;
+    int i;
+    memset(block, 0, sizeof(*block));
+    if (IOReadRaw(fd, header, 1, point->in) != 1) { return EIO; }
+    block->version = 1;
+    block->check = (lzma_check)point->check;
+    block->filters = filters;
+    block->header_size = lzma_block_header_size_decode(header[0]);
+    if (IOReadRaw(fd, header, block->header_size, point->in) != (ssize_t)block->header_size) {
+        return EIO;
+    }
+    if (lzma_block_header_decode(block, NULL, header) != LZMA_OK) { return EINVAL; }
+    memset(&d->xz, 0, sizeof(d->xz)); // LZMA_STREAM_INIT
+    ret = lzma_block_decoder(&d->xz, block);
+    // the decoder has what it needs of the filters' options
+    for (i = 0; filters[i].id != LZMA_VLI_UNKNOWN; i++) { free(filters[i].options); }
+    block->filters = NULL;
+    if (ret != LZMA_OK) {
+        lzma_end(&d->xz);
+        return (ret == LZMA_MEM_ERROR) ? ENOMEM : EINVAL;
+    }
+    d->in = point->in + block->header_size;
+    return 0;
+}
+#endif
+
+// Set d up to decode from point; what it has decoded already is kept
+static int StartDecoder(StreamImage *image, int fd, StreamDecoder *d,
+                        const StreamPoint *point) {
+    uchar byte;
+    int ret;
+    EndDecoder(image, d);
+    if (!d->input && !(d->input = malloc(kStreamInput))) { return ENOMEM; }
+    if (!d->output && !(d->output = malloc(kStreamOutput))) { return ENOMEM; }
+    memset(&d->z, 0, sizeof(d->z));
+    memset(&d->bz, 0, sizeof(d->bz));
+    d->in = point->in;
+    d->inUsed = d->inLength = 0;
+    d->ended = 0;
+    if (image->summary.format == kStreamBzip2) {
+        ret = (BZ2_bzDecompressInit(&d->bz, 0, 0) == BZ_OK) ? Z_OK : Z_MEM_ERROR;
+#ifdef HAVE_ZSTD
+    } else if (image->summary.format == kStreamZstd) {
+        if (!d->zstd && !(d->zstd = ZSTD_createDStream())) { return ENOMEM; }
+        ret = (ZSTD_isError(ZSTD_initDStream(d->zstd))) ? Z_MEM_ERROR : Z_OK;
+#endif
+#ifdef HAVE_XZ
+    } else if (image->summary.format == kStreamXz) {
+        if ((ret = StartXzBlock(fd, d, point)) != 0) { return ret; }
+#endif
+    } else if (!point->history) {
+        ret = inflateInit2(&d->z, 15 + 16); // a gzip header, then deflate data
+    } else {
+        ret = inflateInit2(&d->z, -15); // raw deflate data, from the middle of a member
+    }
+    if (ret != Z_OK) { return ENOMEM; }
+    d->live = 1;
+    if (point->history) {
+        if (point->bits) {
+            if (IOReadRaw(fd, &byte, 1, point->in - 1) != 1) { return EIO; }
+            inflatePrime(&d->z, point->bits, byte >> (8 - point->bits));
+        }
+        inflateSetDictionary(&d->z, point->history, kStreamHistory);
+    }
+    return 0;
+}
+
+// Decode some more of the image onto the end of d's output
+static int Decode(StreamImage *image, int fd, StreamDecoder *d) {
+    ulonglong end = d->outStart + d->outLength;
+    const StreamPoint *point;
+    unsigned availIn, availOut;
+    ssize_t got;
+    int ret, result;
+    if (d->ended) { // carry on with the next member, which has a point of its own
+        point = FindPoint(image, end);
+        if (point->out != end || point->history) { return EINVAL; }
+        if ((result = StartDecoder(image, fd, d, point)) != 0) { return result; }
+    }
+    if (d->outLength == kStreamOutput) {
+        memmove(d->output, d->output + kStreamOutput - kStreamKept, kStreamKept);
+        d->outStart += kStreamOutput - kStreamKept;
+        d->outLength = kStreamKept;
+    }
+    if (d->inUsed == d->inLength) {
+        if ((got = IOReadRaw(fd, d->input, kStreamInput, d->in)) < 0) { return errno; }
+        if (got == 0) { return EINVAL; } // the file ends inside the stream
+        d->inUsed = 0;
+        d->inLength = got;
+        d->in += got;
+    }
+    availIn = (unsigned)(d->inLength - d->inUsed);
+    availOut = (unsigned)(kStreamOutput - d->outLength);
+    if (image->summary.format == kStreamBzip2) {
+        d->bz.next_in = (char*)d->input + d->inUsed;
+        d->bz.avail_in = availIn;
+        d->bz.next_out = d->output + d->outLength;
+        d->bz.avail_out = availOut;
+        ret = BZ2_bzDecompress(&d->bz);
+        d->inUsed = d->inLength - d->bz.avail_in;
+        d->outLength = kStreamOutput - d->bz.avail_out;
+        if (ret == BZ_STREAM_END) {
+            d->ended = 1;
+        } else if (ret != BZ_OK) {
+            return (ret == BZ_MEM_ERROR) ? ENOMEM : EINVAL;
+        }
+#ifdef HAVE_ZSTD
+    } else if (image->summary.format == kStreamZstd) {
+        // carries on into the next frame by itself, so never ends
+        ZSTD_inBuffer zin = { d->input, d->inLength, d->inUsed };
+        ZSTD_outBuffer zout = { d->output, kStreamOutput, d->outLength };
+        size_t zret = ZSTD_decompressStream(d->zstd, &zout, &zin);
+        d->inUsed = zin.pos;
+        d->outLength = zout.pos;
+        if (ZSTD_isError(zret)) { return EINVAL; }
+#endif
+#ifdef HAVE_XZ
+    } else if (image->summary.format == kStreamXz) {
+        lzma_ret xret;
+        d->xz.next_in = d->input + d->inUsed;
+        d->xz.avail_in = availIn;
+        d->xz.next_out = (uint8_t*)d->output + d->outLength;
+        d->xz.avail_out = availOut;
+        xret = lzma_code(&d->xz, LZMA_RUN);
+        d->inUsed = d->inLength - d->xz.avail_in;
+        d->outLength = kStreamOutput - d->xz.avail_out;
+        if (xret == LZMA_STREAM_END) { // the block's end; the next has a point of its own
+            d->ended = 1;
+        } else if (xret != LZMA_OK && xret != LZMA_BUF_ERROR) {
+            return (xret == LZMA_MEM_ERROR) ? ENOMEM : EINVAL;
+        }
+#endif
+    } else {
+        d->z.next_in = d->input + d->inUsed;
+        d->z.avail_in = availIn;
+        d->z.next_out = (Bytef*)d->output + d->outLength;
+        d->z.avail_out = availOut;
+        ret = inflate(&d->z, Z_NO_FLUSH);
+        d->inUsed = d->inLength - d->z.avail_in;
+        d->outLength = kStreamOutput - d->z.avail_out;
+        if (ret == Z_STREAM_END) {
+            d->ended = 1;
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            return (ret == Z_MEM_ERROR) ? ENOMEM : EINVAL;
+        }
+    }
+    return 0;
+}
+
+// A decoder for a read from offset: one which has got to offset, or
+// nearly, or else the least recently used one, started from the point
+// before offset. If every decoder is busy the read gets one of its own.
+static StreamDecoder *TakeDecoder(StreamImage *image, int fd, ulonglong offset, int *result) {
+    const StreamPoint *point = FindPoint(image, offset);
+    StreamDecoder *d, *victim = NULL;
+    int i;
+    pthread_mutex_lock(&image->lock);
+    for (i = 0; i < kStreamDecoders; i++) {
+        d = &image->decoders[i];
+        if (d->busy) { continue; }
+        if (d->live && d->outStart <= offset && d->outStart + d->outLength >= point->out) {
+            // no further from offset than the point is
+            d->busy = 1;
+            d->used = ++image->clock;
+            pthread_mutex_unlock(&image->lock);
+            return d;
+        }
+        if (!victim || d->used < victim->used) { victim = d; }
+    }
+    if (victim) {
+        victim->busy = 1;
+        victim->used = ++image->clock;
+    }
+    pthread_mutex_unlock(&image->lock);
+    if (!victim && !(victim = calloc(1, sizeof(StreamDecoder)))) {
+        *result = ENOMEM;
+        return NULL;
+    }
+    victim->outStart = point->out;
+    victim->outLength = 0;
+    *result = StartDecoder(image, fd, victim, point);
+    return victim;
+}
+
+static void FreeDecoder(StreamImage *image, StreamDecoder *d) {
+    EndDecoder(image, d);
+#ifdef HAVE_ZSTD
+    ZSTD_freeDStream(d->zstd); // NULL is fine
+    d->zstd = NULL;
+#endif
+    free(d->input);
+    free(d->output);
+    d->input = NULL;
+    d->output = NULL;
+}
+
+static void GiveBackDecoder(StreamImage *image, StreamDecoder *d, int result) {
+    if (d < image->decoders || d >= image->decoders + kStreamDecoders) { // the read's own
+        FreeDecoder(image, d);
+        free(d);
+        return;
+    }
+    pthread_mutex_lock(&image->lock);
+    if (result != 0) { EndDecoder(image, d); } // not to be carried on from
+    d->busy = 0;
+    pthread_mutex_unlock(&image->lock);
+}
+
+static ssize_t StreamRead(void *refCon, int fd, void *buf, size_t length, off_t offset) {
+    StreamImage *image = (StreamImage*)refCon;
+    StreamDecoder *d;
+    ulonglong at, end;
+    size_t pos = 0, n;
+    int result = 0;
+    if (offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((ulonglong)offset >= image->summary.imageSize) { return 0; }
+    if (length > image->summary.imageSize - offset) {
+        length = image->summary.imageSize - offset;
+    }
+    if (!(d = TakeDecoder(image, fd, offset, &result)) || result != 0) {
+        if (d) { GiveBackDecoder(image, d, result); }
+        errno = result;
+        return -1;
+    }
+    while (pos < length && result == 0) {
+        at = offset + pos;
+        end = d->outStart + d->outLength;
+        if (at < end) {
+            n = (end - at < length - pos) ? end - at : length - pos;
+            memcpy((char*)buf + pos, d->output + (at - d->outStart), n);
+            pos += n;
+        } else {
+            result = Decode(image, fd, d);
+        }
+    }
+    GiveBackDecoder(image, d, result);
+    if (result != 0) {
+        errno = result;
+        return -1;
+    }
+    return length;
+}
+
+static void StreamClose(void *refCon) {
+    StreamImage *image = (StreamImage*)refCon;
+    size_t i;
+    for (i = 0; i < kStreamDecoders; i++) { FreeDecoder(image, &image->decoders[i]); }
+    for (i = 0; i < image->summary.points; i++) { free(image->points[i].history); }
+    pthread_mutex_destroy(&image->lock);
+    free(image->points);
+    free(image);
+}
+
+// Whether magic starts a zstd frame, or a skippable frame (which pzstd
+// writes ahead of each frame, holding its size)
+static int IsZstdFrame(const uchar *magic) {
+    return !memcmp(magic, "\x28\xB5\x2F\xFD", 4);
+}
+
+static int IsSkippableFrame(const uchar *magic) {
+    return (magic[0] & 0xF0) == 0x50 && !memcmp(magic + 1, "\x2A\x4D\x18", 3);
+}
+
+// Whether the file has another gzip member, bzip2 stream or zstd frame
+// at offset
+static int MemberFollows(StreamImage *image, int fd, ulonglong offset) {
+    uchar magic[4];
+    if (IOReadRaw(fd, magic, sizeof(magic), offset) != sizeof(magic)) { return 0; }
+    if (image->summary.format == kStreamBzip2) {
+        return magic[0] == 'B' && magic[1] == 'Z' && magic[2] == 'h' &&
+               magic[3] >= '1' && magic[3] <= '9';
+    } else if (image->summary.format == kStreamZstd) {
+        return IsZstdFrame(magic);
+    }
+    return magic[0] == 0x1F && magic[1] == 0x8B && magic[2] == 8;
+}
+
+// Decode every gzip member, adding a point at each one's start and at
+// block boundaries every kStreamSpan bytes within it. Anything after the
+// last member (padding, say) is ignored, as gunzip ignores it.
+static int IndexGzip(StreamImage *image, int fd, uchar *input, uchar *window) {
+    z_stream z;
+    ulonglong in = 0, out = 0, last = 0;
+    unsigned have, room;
+    ssize_t got;
+    int ret, result;
+    memset(&z, 0, sizeof(z));
+    if (inflateInit2(&z, 15 + 16) != Z_OK) { return ENOMEM; }
+    result = AddPoint(image, 0, 0, 0, NULL, 0);
+    image->summary.members = 1;
+    while (result == 0) {
+        if (z.avail_in == 0) {
+            if ((got = IOReadRaw(fd, input, kStreamInput, in)) < 0) {
+                result = errno;
+                break;
+            }
+            if (got == 0) { // cut short
+                result = EINVAL;
+                break;
+            }
+            z.next_in = input;
+            z.avail_in = (unsigned)got;
+        }
+        if (z.avail_out == 0) {
+            z.next_out = window;
+            z.avail_out = kStreamHistory;
+        }
+        have = z.avail_in;
+        room = z.avail_out;
+        ret = inflate(&z, Z_BLOCK); // stops at each block boundary
+        in += have - z.avail_in;
+        out += room - z.avail_out;
+        if (ret == Z_STREAM_END) {
+            if (!MemberFollows(image, fd, in)) { break; }
+            inflateReset(&z);
+            result = AddPoint(image, out, in, 0, NULL, 0);
+            image->summary.members++;
+            last = out;
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            result = (ret == Z_MEM_ERROR) ? ENOMEM : EINVAL;
+        } else if ((z.data_type & 128) && !(z.data_type & 64) && out - last >= kStreamSpan) {
+            // between blocks, and not after the last one
+            result = AddPoint(image, out, in, z.data_type & 7, window, z.avail_out);
+            last = out;
+        }
+    }
+    inflateEnd(&z);
+    image->summary.imageSize = out;
+    image->summary.storedSize = in;
+    return result;
+}
+
+// Decode every bzip2 stream, adding a point at each one's start
+static int IndexBzip2(StreamImage *image, int fd, uchar *input, uchar *scratch) {
+    bz_stream bz;
+    ulonglong in = 0, out = 0;
+    unsigned have;
+    ssize_t got;
+    int ret, result;
+    memset(&bz, 0, sizeof(bz));
+    if (BZ2_bzDecompressInit(&bz, 0, 0) != BZ_OK) { return ENOMEM; }
+    result = AddPoint(image, 0, 0, 0, NULL, 0);
+    image->summary.members = 1;
+    while (result == 0) {
+        if (bz.avail_in == 0) {
+            if ((got = IOReadRaw(fd, input, kStreamInput, in)) < 0) {
+                result = errno;
+                break;
+            }
+            if (got == 0) {
+                result = EINVAL;
+                break;
+            }
+            bz.next_in = (char*)input;
+            bz.avail_in = (unsigned)got;
+        }
+        bz.next_out = (char*)scratch;
+        bz.avail_out = kStreamInput;
+        have = bz.avail_in;
+        ret = BZ2_bzDecompress(&bz);
+        in += have - bz.avail_in;
+        out += kStreamInput - bz.avail_out;
+        if (ret == BZ_STREAM_END) {
+            if (!MemberFollows(image, fd, in)) { break; }
+            BZ2_bzDecompressEnd(&bz);
+            memset(&bz, 0, sizeof(bz)); // the rest of input is read again
+            if (BZ2_bzDecompressInit(&bz, 0, 0) != BZ_OK) { return ENOMEM; }
+            result = AddPoint(image, out, in, 0, NULL, 0);
+            image->summary.members++;
+        } else if (ret != BZ_OK) {
+            result = (ret == BZ_MEM_ERROR) ? ENOMEM : EINVAL;
+        }
+    }
+    BZ2_bzDecompressEnd(&bz);
+    image->summary.imageSize = out;
+    image->summary.storedSize = in;
+    return result;
+}
+
+#ifdef HAVE_ZSTD
+// Decode every zstd frame, adding a point at each one's start. zstd
+// itself writes one frame; pzstd writes one per block.
+static int IndexZstd(StreamImage *image, int fd, uchar *input, uchar *scratch) {
+    ZSTD_DStream *zds = ZSTD_createDStream();
+    ZSTD_inBuffer zin = { input, 0, 0 };
+    ZSTD_outBuffer zout;
+    ulonglong in = 0, out = 0;
+    uchar magic[4];
+    size_t have, ret;
+    ssize_t got;
+    int result;
+    if (!zds || ZSTD_isError(ZSTD_initDStream(zds))) {
+        ZSTD_freeDStream(zds);
+        return ENOMEM;
+    }
+    result = AddPoint(image, 0, 0, 0, NULL, 0);
+    image->summary.members = MemberFollows(image, fd, 0); // not a skippable frame
+    while (result == 0) {
+        if (zin.pos == zin.size) {
+            if ((got = IOReadRaw(fd, input, kStreamInput, in)) < 0) {
+                result = errno;
+                break;
+            }
+            if (got == 0) {
+                result = EINVAL;
+                break;
+            }
+            zin.pos = 0;
+            zin.size = got;
+        }
+        zout.dst = scratch;
+        zout.size = kStreamInput;
+        zout.pos = 0;
+        have = zin.pos;
+        ret = ZSTD_decompressStream(zds, &zout, &zin);
+        in += zin.pos - have;
+        out += zout.pos;
+        if (ZSTD_isError(ret)) {
+            result = EINVAL;
+        } else if (ret == 0) { // a frame, or a skippable one, has ended
+            if (MemberFollows(image, fd, in)) {
+                if (image->points[image->summary.points - 1].out == out) {
+                    // only a skippable frame since the last point
+                    image->points[image->summary.points - 1].in = in;
+                } else {
+                    result = AddPoint(image, out, in, 0, NULL, 0);
+                }
+                image->summary.members++;
+            } else if (IOReadRaw(fd, magic, sizeof(magic), in) != sizeof(magic) ||
+                       !IsSkippableFrame(magic)) {
+                break;
+            }
+        }
+    }
+    ZSTD_freeDStream(zds);
+    image->summary.imageSize = out;
+    image->summary.storedSize = in;
+    return result;
+}
+#endif
+
+#ifdef HAVE_XZ
+// Read the xz index at the end of each stream, from the last stream
+// back, adding a point at the start of every block. xz -T writes a
+// block every few dictionaries' worth; plain xz, one per stream.
+static int IndexXz(StreamImage *image, int fd) {
+    uchar buf[LZMA_STREAM_HEADER_SIZE];
+    lzma_stream_flags header, footer;
+    lzma_index *index = NULL, *stream;
+    lzma_index_iter iter;
+    uint64_t memLimit;
+    ulonglong pos, padding;
+    uchar *indexBuf;
+    size_t indexPos;
+    off_t size = IOSize(fd);
+    int result = 0;
+    if (size < 0) { return errno; }
+    pos = size;
+    while (pos > 0 && result == 0) {
+        // stream padding, then the stream's footer, index and blocks
+        padding = 0;
+        while (pos >= 4 && IOReadRaw(fd, buf, 4, pos - 4) == 4 &&
+               !memcmp(buf, "\0\0\0\0", 4)) {
+            pos -= 4;
+            padding += 4;
+        }
+        stream = NULL;
+        indexBuf = NULL;
+        if (pos < 2 * LZMA_STREAM_HEADER_SIZE ||
+            IOReadRaw(fd, buf, sizeof(buf), pos - sizeof(buf)) != sizeof(buf) ||
+            lzma_stream_footer_decode(&footer, buf) != LZMA_OK ||
+            pos - 2 * LZMA_STREAM_HEADER_SIZE < footer.backward_size) {
+            result = EINVAL;
+        } else if (!(indexBuf = malloc(footer.backward_size))) {
+            result = ENOMEM;
+        } else {
+            pos -= LZMA_STREAM_HEADER_SIZE + footer.backward_size;
+            indexPos = 0;
+            memLimit = UINT64_MAX;
+            if (IOReadRaw(fd, indexBuf, footer.backward_size, pos) !=
+                (ssize_t)footer.backward_size ||
+                lzma_index_buffer_decode(&stream, &memLimit, NULL, indexBuf, &indexPos,
+                                         footer.backward_size) != LZMA_OK ||
+                pos - LZMA_STREAM_HEADER_SIZE < lzma_index_total_size(stream)) {
+                result = EINVAL;
+            } else {
+                pos -= LZMA_STREAM_HEADER_SIZE + lzma_index_total_size(stream);
+                if (IOReadRaw(fd, buf, sizeof(buf), pos) != sizeof(buf) ||
+                    lzma_stream_header_decode(&header, buf) != LZMA_OK ||
+                    lzma_stream_flags_compare(&header, &footer) != LZMA_OK ||
+                    lzma_index_stream_flags(stream, &footer) != LZMA_OK ||
+                    lzma_index_stream_padding(stream, padding) != LZMA_OK ||
+                    (index && lzma_index_cat(stream, index, NULL) != LZMA_OK)) {
+                    result = EINVAL;
+                } else {
+                    index = stream; // the streams after it are now part of it
+                    stream = NULL;
+                }
+            }
+        }
+        free(indexBuf);
+        if (stream) { lzma_index_end(stream, NULL); }
+    }
+    if (result == 0 && (!index || lzma_index_block_count(index) == 0)) { result = EINVAL; }
+    if (result == 0) {
+        lzma_index_iter_init(&iter, index);
+        while (result == 0 && !lzma_index_iter_next(&iter, LZMA_INDEX_ITER_NONEMPTY_BLOCK)) {
+            result = AddPoint(image, iter.block.uncompressed_file_offset,
+                              iter.block.compressed_file_offset, 0, NULL, 0);
+            if (result == 0) {
+                image->points[image->summary.points - 1].check = iter.stream.flags->check;
+            }
+        }
+        image->summary.imageSize = lzma_index_uncompressed_size(index);
+        image->summary.storedSize = lzma_index_file_size(index);
+        image->summary.members = lzma_index_stream_count(index);
+    }
+    if (index) { lzma_index_end(index, NULL); }
+    return result;
+}
+#endif
+
+int StreamAttach(int fd) {
+    uchar magic[6];
+    StreamImage *image = NULL;
+    IOFilter filter = {0};
+    uchar *input = NULL, *scratch = NULL;
+    ulonglong next;
+    ssize_t got;
+    size_t i;
+    int result;
+    memset(magic, 0, sizeof(magic));
+    if ((got = IOReadRaw(fd, magic, sizeof(magic), 0)) < 0) { return errno; }
+    if (got < (ssize_t)sizeof(magic)) { return -1; }
+#ifndef HAVE_ZSTD
+    if (IsZstdFrame(magic) || IsSkippableFrame(magic)) { return ENOTSUP; }
+#endif
+#ifndef HAVE_XZ
+    if (!memcmp(magic, "\xFD" "7zXZ\0", 6)) { return ENOTSUP; }
+#endif
+    if (!(image = calloc(1, sizeof(StreamImage)))) { return ENOMEM; }
+    if (magic[0] == 0x1F && magic[1] == 0x8B && magic[2] == 8) {
+        image->summary.format = kStreamGzip;
+    } else if (magic[0] == 'B' && magic[1] == 'Z' && magic[2] == 'h' &&
+               magic[3] >= '1' && magic[3] <= '9') {
+        image->summary.format = kStreamBzip2;
+    } else if (IsZstdFrame(magic) || IsSkippableFrame(magic)) {
+        image->summary.format = kStreamZstd;
+    } else if (!memcmp(magic, "\xFD" "7zXZ\0", 6)) {
+        image->summary.format = kStreamXz;
+    } else {
+        free(image);
+        return -1;
+    }
+    pthread_mutex_init(&image->lock, NULL);
+    input = malloc(kStreamInput);
+    scratch = malloc(kStreamInput);
+    if (!input || !scratch) {
+        result = ENOMEM;
+    } else if (image->summary.format == kStreamGzip) {
+        result = IndexGzip(image, fd, input, scratch);
+#ifdef HAVE_ZSTD
+    } else if (image->summary.format == kStreamZstd) {
+        result = IndexZstd(image, fd, input, scratch);
+#endif
+#ifdef HAVE_XZ
+    } else if (image->summary.format == kStreamXz) {
+        result = IndexXz(image, fd);
+#endif
+    } else {
+        result = IndexBzip2(image, fd, input, scratch);
+    }
+    free(input);
+    free(scratch);
+    if (result == 0) {
+        image->summary.seekable = 1;
+        for (i = 0; i < image->summary.points; i++) {
+            next = (i + 1 < image->summary.points) ? image->points[i + 1].out :
+                   image->summary.imageSize;
+            if (next - image->points[i].out > kStreamMaxSpan) { image->summary.seekable = 0; }
+        }
+        filter.read = StreamRead;
+        filter.close = StreamClose;
+        filter.refCon = image;
+        filter.size = image->summary.imageSize;
+        result = IOSetFilter(fd, &filter);
+    }
+    if (result != 0) { StreamClose(image); }
+    return result;
+}
+
+const char *StreamFormatName(StreamFormat format) {
+    switch (format) {
+        case kStreamGzip: return "gzip";
+        case kStreamBzip2: return "bzip2";
+        case kStreamZstd: return "zstd";
+        case kStreamXz: return "xz";
+        default: return "none";
+    }
+}
+
+int StreamAttached(int fd, StreamSummary *summary) {
+    IOFilter filter;
+    if (IOGetFilter(fd, &filter) != 0 || filter.read != StreamRead) { return 0; }
+    if (summary) { *summary = ((StreamImage*)filter.refCon)->summary; }
+    return 1;
+}
@@ -0,0 +1,77 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageStream.h
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//  Fri Oct 16 2026 -- zstd and xz, in builds with their decoders
+//
+//----------------------------------------------------------------------
+
+#ifndef __diskimagestream_h__
+#define __diskimagestream_h__
+
+#include "DiskImageUtils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Images kept gzip- or bzip2-compressed (.gz, .bz2) are read in place,
+// decompressed as they are read. Neither format records the size of what
+// it holds, so StreamAttach decodes the file once to measure it, and on
+// the way notes restart points: the start of every gzip member and bzip2
+// stream, and a point every couple of MB inside a gzip member, with the
+// 32 KB of history inflate needs to carry on from there. A read then
+// decodes from the nearest point before it, and reads on several
+// threads (the copy engine's stripes) decode their parts of the image
+// side by side. Decoders are kept between reads, so reads which follow
+// on from one another decode the image only once.
+//
+// A bzip2 stream can only be decoded from its start, so a file written
+// by bzip2 itself (one stream) has to be read in order. pbzip2 writes a
+// stream per block, which reads as well as gzip does.
+//
+// zstd and xz images are read the same way in a build with their
+// decoders (make ZSTD=1 XZ=1). A zstd frame can only be decoded from its
+// start, like a bzip2 stream: zstd itself writes one frame, and pzstd
+// one per block. An xz file records where its blocks start, so attaching
+// one reads that index instead of decoding it; xz -T writes several
+// blocks, plain xz one.
+
+typedef enum StreamFormat {
+    kStreamNone = 0,
+    kStreamGzip,
+    kStreamBzip2,
+    kStreamZstd,
+    kStreamXz
+}   StreamFormat;
+
+typedef struct StreamSummary {
+    StreamFormat format;
+    ulonglong imageSize; // bytes decompressed
+    ulonglong storedSize; // bytes of compressed data
+    size_t members; // gzip members, bzip2 streams, zstd frames or xz streams
+    size_t points; // places decoding can start, including each member
+    int seekable; // points are close enough together for reads out of order
+}   StreamSummary;
+
+// Look for a gzip, bzip2, zstd or xz header at the start of fd (opened
+// with IOOpen) and, if there is one, index the stream and filter fd
+// through it. Returns 0, -1 if the file isn't compressed, ENOTSUP for a
+// zstd or xz file when the build has no decoder for it, or EINVAL if the
+// stream is damaged or cut short.
+int StreamAttach(int fd);
+
+// "gzip", "bzip2", "zstd" or "xz"
+const char *StreamFormatName(StreamFormat format);
+
+// Whether StreamAttach has filtered fd, with what it found if summary
+// isn't NULL
+int StreamAttached(int fd, StreamSummary *summary);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __diskimagestream_h__ */
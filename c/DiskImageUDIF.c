@@ -0,0 +1,748 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageUDIF.c
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//  Fri Oct 16 2026 -- added UDIFWriteImage, compressing on a thread pool
+//
+//----------------------------------------------------------------------
+
+#include <pthread.h>
+#include <zlib.h>
+#include <bzlib.h>
+#include "DiskImageUtils.h"
+#include "DiskImageUDIF.h"
+#include "DiskImageIO.h"
+#include "DiskImagePool.h"
+
+#define kUDIFTrailerSize 512
+#define kUDIFSectorSize 512
+#define kUDIFTableHeaderSize 204 // mish header, before the chunk entries
+#define kUDIFChunkEntrySize 40
+#define kUDIFMaxPlist (64*1024*1024) // bounds a corrupt XMLLength
+#define kUDIFMaxChunk (64*1024*1024) // and a corrupt chunk's sector count
+#define kUDIFCacheSlots 32 // decompressed chunks kept for the reads after
+#define kUDIFChunkSize (kUDIFChunkSectors * kUDIFSectorSize)
+#define kUDIFChecksumCRC32 2
+#define kUDIFBase64Line 52 // characters per line of a <data> value
+
+// One run of the image stored in the file. Zero and free runs aren't
+// kept; reads of the gaps they leave are answered with zeros.
+typedef struct UDIFChunk {
+    ulong type;
+    ulonglong start; // byte offset in the image
+    ulonglong length; // bytes in the image
+    ulonglong stored; // offset of the data in the file
+    ulonglong storedLength;
+}   UDIFChunk;
+
+typedef struct UDIFSlot {
+    size_t chunk; // index of the chunk held in data
+    char *data; // or NULL if the slot is unused
+    ulonglong used; // when last read, for eviction
+}   UDIFSlot;
+
+typedef struct UDIFImage {
+    UDIFChunk *chunks; // sorted by start
+    size_t count;
+    size_t capacity;
+    UDIFSummary summary;
+    pthread_mutex_t lock; // guards the slots
+    UDIFSlot slots[kUDIFCacheSlots];
+    ulonglong clock;
+}   UDIFImage;
+
+static ulong GetBE32(const uchar *p) {
+    return ((ulong)p[0] << 24) | ((ulong)p[1] << 16) | ((ulong)p[2] << 8) | p[3];
+}
+
+static ulonglong GetBE64(const uchar *p) {
+    return ((ulonglong)GetBE32(p) << 32) | GetBE32(p + 4);
+}
+
+static void PutBE32(uchar *p, ulong value) {
+    p[0] = (uchar)(value >> 24);
+    p[1] = (uchar)(value >> 16);
+    p[2] = (uchar)(value >> 8);
+    p[3] = (uchar)value;
+}
+
+static void PutBE64(uchar *p, ulonglong value) {
+    PutBE32(p, (ulong)(value >> 32));
+    PutBE32(p + 4, (ulong)value);
+}
+
+// Apple Data Compression: literal runs, and copies of up to 18 bytes
+// from the last 1 KB or up to 67 bytes from the last 64 KB of output
+static int ADCDecompress(const uchar *in, size_t inLength, uchar *out, size_t length) {
+    size_t ip = 0, op = 0, run, dist, i;
+    uchar b;
+    while (ip < inLength && op < length) {
+        b = in[ip++];
+        if (b & 0x80) {
+            run = (b & 0x7F) + 1;
+            if (run > inLength - ip || run > length - op) { return EINVAL; }
+            memcpy(out + op, in + ip, run);
+            ip += run;
+            op += run;
+            continue;
+        }
+        if (b & 0x40) {
+            if (inLength - ip < 2) { return EINVAL; }
+            run = (b & 0x3F) + 4;
+            dist = ((size_t)in[ip] << 8 | in[ip + 1]) + 1;
+            ip += 2;
+        } else {
+            if (inLength - ip < 1) { return EINVAL; }
+            run = ((b & 0x3F) >> 2) + 3;
+            dist = ((size_t)(b & 0x03) << 8 | in[ip]) + 1;
+            ip += 1;
+        }
+        if (dist > op || run > length - op) { return EINVAL; }
+        for (i = 0; i < run; i++, op++) { out[op] = out[op - dist]; } // may overlap
+    }
+    return (op == length) ? 0 : EINVAL;
+}
+
+static int UDIFDecompress(ulong type, const void *in, size_t inLength, void *out,
+                          size_t length) {
+    uLongf zlibLength = length;
+    unsigned int bzLength = (unsigned int)length;
+    switch (type) {
+        case kUDIFChunkZlib:
+            if (uncompress(out, &zlibLength, in, inLength) != Z_OK) { return EINVAL; }
+            return (zlibLength == length) ? 0 : EINVAL;
+        case kUDIFChunkBzip2:
+            if (BZ2_bzBuffToBuffDecompress(out, &bzLength, (char*)in, (unsigned int)inLength,
+                                           0, 0) != BZ_OK) {
+                return EINVAL;
+            }
+            return (bzLength == length) ? 0 : EINVAL;
+        case kUDIFChunkADC:
+            return ADCDecompress(in, inLength, out, length);
+    }
+    return ENOTSUP;
+}
+
+// Copy n bytes from within bytes into chunk number index, decompressing
+// it unless a slot still holds it
+static int ReadCompressedChunk(UDIFImage *image, int fd, size_t index, ulonglong within,
+                               char *buf, size_t n) {
+    const UDIFChunk *chunk = &image->chunks[index];
+    UDIFSlot *slot, *victim;
+    char *in = NULL, *out = NULL, *old;
+    ssize_t got;
+    int i, result = 0;
+    pthread_mutex_lock(&image->lock);
+    for (i = 0; i < kUDIFCacheSlots; i++) {
+        slot = &image->slots[i];
+        if (slot->data && slot->chunk == index) {
+            slot->used = ++image->clock;
+            memcpy(buf, slot->data + within, n);
+            pthread_mutex_unlock(&image->lock);
+            return 0;
+        }
+    }
+    pthread_mutex_unlock(&image->lock);
+
+    // two threads may both miss and decompress the same chunk, which
+    // costs time but is otherwise harmless
+    in = malloc(chunk->storedLength);
+    out = malloc(chunk->length);
+    if (!in || !out) {
+        result = ENOMEM;
+    } else if ((got = IOReadRaw(fd, in, chunk->storedLength, chunk->stored)) !=
+               (ssize_t)chunk->storedLength) {
+        result = (got < 0) ? errno : EIO;
+    } else {
+        result = UDIFDecompress(chunk->type, in, chunk->storedLength, out, chunk->length);
+    }
+    free(in);
+    if (result != 0) {
+        free(out);
+        return result;
+    }
+    pthread_mutex_lock(&image->lock);
+    victim = &image->slots[0];
+    for (i = 0; i < kUDIFCacheSlots; i++) {
+        slot = &image->slots[i];
+        if (!slot->data) { victim = slot; break; }
+        if (slot->used < victim->used) { victim = slot; }
+    }
+    old = victim->data;
+    victim->data = out;
+    victim->chunk = index;
+    victim->used = ++image->clock;
+    memcpy(buf, out + within, n);
+    pthread_mutex_unlock(&image->lock);
+    free(old);
+    return 0;
+}
+
+static ssize_t UDIFRead(void *refCon, int fd, void *buf, size_t length, off_t offset) {
+    UDIFImage *image = (UDIFImage*)refCon;
+    const UDIFChunk *chunk;
+    ulonglong at, next;
+    size_t lo = 0, hi = image->count, mid, pos = 0, n;
+    ssize_t got;
+    int result;
+    if (offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((ulonglong)offset >= image->summary.imageSize) { return 0; }
+    if (length > image->summary.imageSize - offset) {
+        length = image->summary.imageSize - offset;
+    }
+    // the first chunk ending past offset
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        chunk = &image->chunks[mid];
+        if (chunk->start + chunk->length <= (ulonglong)offset) { lo = mid + 1; } else { hi = mid; }
+    }
+    while (pos < length) {
+        at = offset + pos;
+        chunk = (lo < image->count) ? &image->chunks[lo] : NULL;
+        if (!chunk || chunk->start > at) { // a gap of zeros
+            next = (chunk) ? chunk->start : image->summary.imageSize;
+            n = (next - at < length - pos) ? next - at : length - pos;
+            memset((char*)buf + pos, 0, n);
+            pos += n;
+            continue;
+        }
+        n = (chunk->start + chunk->length - at < length - pos) ?
+            chunk->start + chunk->length - at : length - pos;
+        if (chunk->type == kUDIFChunkRaw) {
+            got = IOReadRaw(fd, (char*)buf + pos, n, chunk->stored + (at - chunk->start));
+            if (got != (ssize_t)n) {
+                if (got >= 0) { errno = EIO; } // the file ends inside the chunk
+                return -1;
+            }
+        } else if ((result = ReadCompressedChunk(image, fd, lo, at - chunk->start,
+                                                 (char*)buf + pos, n)) != 0) {
+            errno = result;
+            return -1;
+        }
+        pos += n;
+        lo++;
+    }
+    return length;
+}
+
+static void UDIFClose(void *refCon) {
+    UDIFImage *image = (UDIFImage*)refCon;
+    int i;
+    for (i = 0; i < kUDIFCacheSlots; i++) { free(image->slots[i].data); }
+    pthread_mutex_destroy(&image->lock);
+    free(image->chunks);
+    free(image);
+}
+
+static int Base64Value(int c) {
+    if (c >= 'A' && c <= 'Z') { return c - 'A'; }
+    if (c >= 'a' && c <= 'z') { return c - 'a' + 26; }
+    if (c >= '0' && c <= '9') { return c - '0' + 52; }
+    if (c == '+') { return 62; }
+    if (c == '/') { return 63; }
+    return -1;
+}
+
+// Decode the base64 text from start up to end (a plist <data> value,
+// whitespace and all) in place; returns the decoded length
+static size_t Base64Decode(char *start, const char *end) {
+    const char *p;
+    ulong bits = 0;
+    int value, count = 0;
+    size_t length = 0;
+    for (p = start; p < end && *p != '='; p++) {
+        if ((value = Base64Value((uchar)*p)) < 0) { continue; } // whitespace
+        bits = (bits << 6) | value;
+        if (++count == 4) {
+            start[length++] = (char)(bits >> 16);
+            start[length++] = (char)(bits >> 8);
+            start[length++] = (char)bits;
+            bits = 0;
+            count = 0;
+        }
+    }
+    if (count == 3) {
+        start[length++] = (char)(bits >> 10);
+        start[length++] = (char)(bits >> 2);
+    } else if (count == 2) {
+        start[length++] = (char)(bits >> 4);
+    }
+    return length;
+}
+
+static int AddChunk(UDIFImage *image, const UDIFChunk *chunk) {
+    if (image->count == image->capacity) {
+        size_t capacity = (image->capacity) ? image->capacity * 2 : 256;
+        UDIFChunk *p = realloc(image->chunks, capacity * sizeof(UDIFChunk));
+        if (!p) { return ENOMEM; }
+        image->chunks = p;
+        image->capacity = capacity;
+    }
+    image->chunks[image->count++] = *chunk;
+    return 0;
+}
+
+// Add the chunks of one mish block table, length bytes at table
+static int ReadBlockTable(UDIFImage *image, const uchar *table, size_t length,
+                          ulonglong dataFork, ulonglong fileSize) {
+    const uchar *entry;
+    UDIFChunk chunk;
+    ulonglong firstSector, sectors, dataStart;
+    ulong i, count;
+    int result;
+    if (length < kUDIFTableHeaderSize || GetBE32(table) != 0x6D697368) { // 'mish'
+        return EINVAL;
+    }
+    firstSector = GetBE64(table + 8);
+    sectors = GetBE64(table + 16);
+    dataStart = GetBE64(table + 24);
+    count = GetBE32(table + 200);
+    if (count > (length - kUDIFTableHeaderSize) / kUDIFChunkEntrySize) { return EINVAL; }
+    if ((firstSector + sectors) * kUDIFSectorSize > image->summary.imageSize) {
+        image->summary.imageSize = (firstSector + sectors) * kUDIFSectorSize;
+    }
+    image->summary.tables++;
+    for (i = 0; i < count; i++) {
+        entry = table + kUDIFTableHeaderSize + i * kUDIFChunkEntrySize;
+        chunk.type = GetBE32(entry);
+        if (chunk.type == kUDIFChunkEnd) { break; }
+        if (chunk.type == kUDIFChunkComment) { continue; }
+        chunk.start = (firstSector + GetBE64(entry + 8)) * kUDIFSectorSize;
+        chunk.length = GetBE64(entry + 16) * kUDIFSectorSize;
+        chunk.stored = dataFork + dataStart + GetBE64(entry + 24);
+        chunk.storedLength = GetBE64(entry + 32);
+        image->summary.chunks++;
+        switch (chunk.type) {
+            case kUDIFChunkZero:
+            case kUDIFChunkIgnore:
+                image->summary.zero++;
+                continue; // left as a gap
+            case kUDIFChunkRaw: image->summary.raw++; break;
+            case kUDIFChunkADC: image->summary.adc++; break;
+            case kUDIFChunkZlib: image->summary.zlib++; break;
+            case kUDIFChunkBzip2: image->summary.bzip2++; break;
+            case kUDIFChunkLZFSE:
+            case kUDIFChunkLZMA:
+                return ENOTSUP;
+            default:
+                return EINVAL;
+        }
+        if (!chunk.length) { continue; }
+        if (chunk.stored > fileSize || chunk.storedLength > fileSize - chunk.stored ||
+            (chunk.type == kUDIFChunkRaw && chunk.storedLength < chunk.length) ||
+            (chunk.type != kUDIFChunkRaw && chunk.length > kUDIFMaxChunk)) {
+            return EINVAL;
+        }
+        image->summary.storedSize += chunk.storedLength;
+        if ((result = AddChunk(image, &chunk)) != 0) { return result; }
+    }
+    return 0;
+}
+
+// Decode each <data> value of the blkx array in the plist (NUL-terminated)
+static int ReadBlockTables(UDIFImage *image, char *plist, ulonglong dataFork,
+                           ulonglong fileSize) {
+    char *p, *end, *data;
+    size_t length;
+    int result;
+    if (!(p = strstr(plist, "<key>blkx</key>")) || !(p = strstr(p, "<array>"))) {
+        return EINVAL;
+    }
+    if ((end = strstr(p, "</array>")) != NULL) { *end = 0; } // the entries hold no arrays
+    while ((p = strstr(p, "<key>Data</key>")) != NULL) {
+        if (!(data = strstr(p, "<data>")) || !(p = strstr(data, "</data>"))) {
+            return EINVAL;
+        }
+        data += strlen("<data>");
+        length = Base64Decode(data, p);
+        if ((result = ReadBlockTable(image, (uchar*)data, length, dataFork, fileSize)) != 0) {
+            return result;
+        }
+    }
+    return 0;
+}
+
+static int CompareChunks(const void *a, const void *b) {
+    const UDIFChunk *x = a, *y = b;
+    return (x->start < y->start) ? -1 : (x->start > y->start);
+}
+
+int UDIFAttach(int fd) {
+    uchar trailer[kUDIFTrailerSize];
+    UDIFImage *image = NULL;
+    IOFilter filter = {0};
+    char *plist = NULL;
+    ulonglong dataFork, plistOffset, plistLength, sectors;
+    off_t fileSize;
+    ssize_t got;
+    size_t i;
+    int result = 0;
+    if ((fileSize = IOSize(fd)) < 0) { return errno; }
+    if (fileSize < kUDIFTrailerSize) { return -1; }
+    if ((got = IOReadRaw(fd, trailer, kUDIFTrailerSize, fileSize - kUDIFTrailerSize)) !=
+        kUDIFTrailerSize) {
+        return (got < 0) ? errno : EIO;
+    }
+    if (GetBE32(trailer) != 0x6B6F6C79) { return -1; } // 'koly'
+    if (GetBE32(trailer + 4) != 4 || GetBE32(trailer + 8) != kUDIFTrailerSize) {
+        return EINVAL;
+    }
+    if (GetBE32(trailer + 60) > 1) { return ENOTSUP; } // segmented image
+    dataFork = GetBE64(trailer + 24);
+    plistOffset = GetBE64(trailer + 216);
+    plistLength = GetBE64(trailer + 224);
+    sectors = GetBE64(trailer + 492);
+    if (plistLength == 0) { return ENOTSUP; } // tables in a resource fork only
+    if (plistLength > kUDIFMaxPlist || plistOffset > (ulonglong)fileSize ||
+        plistLength > fileSize - plistOffset) {
+        return EINVAL;
+    }
+
+    if (!(image = calloc(1, sizeof(UDIFImage))) || !(plist = malloc(plistLength + 1))) {
+        free(image);
+        return ENOMEM;
+    }
+    pthread_mutex_init(&image->lock, NULL);
+    image->summary.imageSize = sectors * kUDIFSectorSize;
+    if ((got = IOReadRaw(fd, plist, plistLength, plistOffset)) != (ssize_t)plistLength) {
+        result = (got < 0) ? errno : EIO;
+        goto done;
+    }
+    plist[plistLength] = 0;
+    if ((result = ReadBlockTables(image, plist, dataFork, fileSize)) != 0) { goto done; }
+    qsort(image->chunks, image->count, sizeof(UDIFChunk), CompareChunks);
+    for (i = 1; i < image->count; i++) {
+        if (image->chunks[i].start < image->chunks[i-1].start + image->chunks[i-1].length) {
+            result = EINVAL; // overlapping runs
+            goto done;
+        }
+    }
+    filter.read = UDIFRead;
+    filter.close = UDIFClose;
+    filter.refCon = image;
+    filter.size = image->summary.imageSize;
+    result = IOSetFilter(fd, &filter);
+done:
+    free(plist);
+    if (result != 0) { UDIFClose(image); }
+    return result;
+}
+
+int UDIFAttached(int fd, UDIFSummary *summary) {
+    IOFilter filter;
+    if (IOGetFilter(fd, &filter) != 0 || filter.read != UDIFRead) { return 0; }
+    if (summary) { *summary = ((UDIFImage*)filter.refCon)->summary; }
+    return 1;
+}
+
+// One chunk of a window of the image being written, read and compressed
+// by a pool worker
+typedef struct UDIFPending {
+    size_t region; // blkx entry it belongs to
+    ulonglong start; // byte offset in the image
+    size_t length;
+    char *in; // the chunk as read
+    char *out; // compressed, if type says so
+    size_t outLength; // bytes to store
+    ulong type;
+    uLong crc; // of the chunk as read
+}   UDIFPending;
+
+typedef struct UDIFWriter {
+    UDIFSourceProc source;
+    void *refCon;
+    ulong compression;
+    UDIFPending *pending;
+}   UDIFWriter;
+
+static int CompressChunk(void *refCon, size_t taskIndex, unsigned worker) {
+    UDIFWriter *writer = (UDIFWriter*)refCon;
+    UDIFPending *p = &writer->pending[taskIndex];
+    uLongf zlibLength = p->length - 1; // no use unless it's smaller
+    unsigned int bzLength = (unsigned int)p->length - 1;
+    int result;
+    if ((result = writer->source(writer->refCon, p->in, p->length, p->start)) != 0) {
+        return result;
+    }
+    p->crc = crc32(0, (Bytef*)p->in, (uInt)p->length);
+    if (!p->in[0] && !memcmp(p->in, p->in + 1, p->length - 1)) {
+        p->type = kUDIFChunkZero;
+        p->outLength = 0;
+    } else if (writer->compression == kUDIFChunkZlib &&
+               compress2((Bytef*)p->out, &zlibLength, (Bytef*)p->in, p->length,
+                         Z_DEFAULT_COMPRESSION) == Z_OK) {
+        p->type = kUDIFChunkZlib;
+        p->outLength = zlibLength;
+    } else if (writer->compression == kUDIFChunkBzip2 &&
+               BZ2_bzBuffToBuffCompress(p->out, &bzLength, p->in, (unsigned int)p->length,
+                                        9, 0, 0) == BZ_OK) {
+        p->type = kUDIFChunkBzip2;
+        p->outLength = bzLength;
+    } else {
+        p->type = kUDIFChunkRaw; // didn't shrink (or out of room trying)
+        p->outLength = p->length;
+    }
+    return 0;
+}
+
+static const char kBase64Digits[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Space Base64Encode needs for length bytes
+static size_t Base64Size(size_t length) {
+    size_t chars = (length + 2) / 3 * 4;
+    return chars + (chars / kUDIFBase64Line + 1) * 6;
+}
+
+// Encode length bytes at out as a <data> value, in indented lines as
+// Apple's tools write them; returns the characters written
+static size_t Base64Encode(const uchar *in, size_t length, char *out) {
+    char *p = out;
+    ulong bits;
+    size_t i, n, column = 0;
+    for (i = 0; i < length; i += 3) {
+        n = (length - i < 3) ? length - i : 3;
+        bits = (ulong)in[i] << 16;
+        if (n > 1) { bits |= (ulong)in[i + 1] << 8; }
+        if (n > 2) { bits |= in[i + 2]; }
+        if (column == 0) { p += sprintf(p, "\t\t\t\t"); }
+        *p++ = kBase64Digits[(bits >> 18) & 0x3F];
+        *p++ = kBase64Digits[(bits >> 12) & 0x3F];
+        *p++ = (n > 1) ? kBase64Digits[(bits >> 6) & 0x3F] : '=';
+        *p++ = (n > 2) ? kBase64Digits[bits & 0x3F] : '=';
+        if ((column += 4) >= kUDIFBase64Line) {
+            *p++ = '\n';
+            column = 0;
+        }
+    }
+    if (column) { *p++ = '\n'; }
+    return p - out;
+}
+
+// The plist holding a blkx entry for each of the tables
+static char *BuildPlist(const UDIFRegion *regions, uchar **tables, const size_t *lengths,
+                        size_t count, size_t *plistLength) {
+    static const char head[] =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" "
+        "\"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+        "<plist version=\"1.0\">\n<dict>\n\t<key>resource-fork</key>\n\t<dict>\n"
+        "\t\t<key>blkx</key>\n\t\t<array>\n";
+    static const char tail[] = "\t\t</array>\n\t</dict>\n</dict>\n</plist>\n";
+    size_t i, size = sizeof(head) + sizeof(tail);
+    char *plist, *p;
+    for (i = 0; i < count; i++) {
+        size += 400 + 2 * sizeof(regions[i].name) + Base64Size(lengths[i]);
+    }
+    if (!(plist = malloc(size))) { return NULL; }
+    p = plist + sprintf(plist, "%s", head);
+    for (i = 0; i < count; i++) {
+        p += sprintf(p, "\t\t\t<dict>\n\t\t\t\t<key>Attributes</key>\n"
+                        "\t\t\t\t<string>0x0050</string>\n\t\t\t\t<key>CFName</key>\n"
+                        "\t\t\t\t<string>%.80s</string>\n\t\t\t\t<key>Data</key>\n"
+                        "\t\t\t\t<data>\n", regions[i].name);
+        p += Base64Encode(tables[i], lengths[i], p);
+        p += sprintf(p, "\t\t\t\t</data>\n\t\t\t\t<key>ID</key>\n\t\t\t\t<string>%d</string>\n"
+                        "\t\t\t\t<key>Name</key>\n\t\t\t\t<string>%.80s</string>\n\t\t\t</dict>\n",
+                     (int)i - 1, regions[i].name);
+    }
+    p += sprintf(p, "%s", tail);
+    *plistLength = p - plist;
+    return plist;
+}
+
+// Write the chunks of a window, compressed, in order from dataLength;
+// fill in their table entries and the checksums
+static int StoreWindow(int ofd, const UDIFRegion *regions, uchar **tables, size_t *entries,
+                       uLong *tableCRCs, const UDIFPending *pending, size_t n,
+                       ulonglong *dataLength, uLong *dataCRC, UDIFSummary *summary) {
+    struct iovec iov[kIOMaxVectors];
+    const UDIFPending *p;
+    uchar *entry;
+    off_t offset = *dataLength;
+    size_t i, bytes = 0;
+    int vectors = 0;
+    for (i = 0; i < n; i++) {
+        p = &pending[i];
+        entry = tables[p->region] + kUDIFTableHeaderSize +
+                entries[p->region]++ * kUDIFChunkEntrySize;
+        PutBE32(entry, p->type);
+        PutBE32(entry + 4, 0); // comment
+        PutBE64(entry + 8, p->start / kUDIFSectorSize - regions[p->region].start);
+        PutBE64(entry + 16, p->length / kUDIFSectorSize);
+        PutBE64(entry + 24, *dataLength);
+        PutBE64(entry + 32, p->outLength);
+        tableCRCs[p->region] = crc32_combine(tableCRCs[p->region], p->crc, p->length);
+        summary->chunks++;
+        switch (p->type) {
+            case kUDIFChunkZero: summary->zero++; break;
+            case kUDIFChunkRaw: summary->raw++; break;
+            case kUDIFChunkZlib: summary->zlib++; break;
+            case kUDIFChunkBzip2: summary->bzip2++; break;
+        }
+        if (!p->outLength) { continue; }
+        iov[vectors].iov_base = (p->type == kUDIFChunkRaw) ? p->in : p->out;
+        iov[vectors].iov_len = p->outLength;
+        *dataCRC = crc32(*dataCRC, iov[vectors].iov_base, (uInt)p->outLength);
+        *dataLength += p->outLength;
+        bytes += p->outLength;
+        if (++vectors == kIOMaxVectors) {
+            if (IOWritev(ofd, iov, vectors, offset) < 0) { return errno; }
+            offset += bytes;
+            bytes = 0;
+            vectors = 0;
+        }
+    }
+    if (vectors && IOWritev(ofd, iov, vectors, offset) < 0) { return errno; }
+    return 0;
+}
+
+int UDIFWriteImage(int ofd, const UDIFRegion *regions, size_t count,
+                   UDIFSourceProc source, void *refCon,
+                   const UDIFWriteOptions *options, UDIFSummary *summary) {
+    UDIFWriter writer = { source, refCon, options->compression, NULL };
+    UDIFSummary written = {0};
+    ProgressTracker tracker;
+    unsigned threads = (options->threads) ? options->threads : PoolDefaultThreads();
+    size_t window = (size_t)threads * 2; // chunks read and compressed at once
+    uchar **tables = NULL, trailer[kUDIFTrailerSize] = {0}, sums[4];
+    size_t *lengths = NULL, *entries = NULL;
+    uLong *tableCRCs = NULL, dataCRC = crc32(0, NULL, 0), masterCRC = crc32(0, NULL, 0);
+    ulonglong sectors = 0, next = 0, dataLength = 0;
+    size_t i, n, region = 0, plistLength = 0;
+    char *plist = NULL;
+    int result = 0;
+    uchar *t;
+
+    if (count < 1 || (options->compression != kUDIFChunkZlib &&
+                      options->compression != kUDIFChunkBzip2)) {
+        return EINVAL;
+    }
+    for (i = 0; i < count; i++) {
+        if (regions[i].start != sectors || !regions[i].sectors) { return EINVAL; }
+        sectors += regions[i].sectors;
+    }
+    tables = calloc(count, sizeof(uchar*));
+    lengths = calloc(count, sizeof(size_t));
+    entries = calloc(count, sizeof(size_t));
+    tableCRCs = calloc(count, sizeof(uLong));
+    writer.pending = calloc(window, sizeof(UDIFPending));
+    if (!tables || !lengths || !entries || !tableCRCs || !writer.pending) {
+        result = ENOMEM;
+        goto done;
+    }
+    for (i = 0; i < count; i++) {
+        n = (regions[i].sectors + kUDIFChunkSectors - 1) / kUDIFChunkSectors + 1; // and the end
+        lengths[i] = kUDIFTableHeaderSize + n * kUDIFChunkEntrySize;
+        if (!(tables[i] = calloc(1, lengths[i]))) {
+            result = ENOMEM;
+            goto done;
+        }
+        tableCRCs[i] = crc32(0, NULL, 0);
+    }
+    for (i = 0; i < window; i++) {
+        writer.pending[i].in = IOAllocBuffer(kUDIFChunkSize);
+        writer.pending[i].out = IOAllocBuffer(kUDIFChunkSize);
+        if (!writer.pending[i].in || !writer.pending[i].out) {
+            result = ENOMEM;
+            goto done;
+        }
+    }
+
+    // read and compress a window of chunks at a time, then store them in order
+    ProgressStart(&tracker, options->progress, sectors * kUDIFSectorSize);
+    while (result == 0 && next < sectors) {
+        ulonglong bytes = 0;
+        for (n = 0; n < window && next < sectors; n++) {
+            UDIFPending *p = &writer.pending[n];
+            ulonglong end = regions[region].start + regions[region].sectors;
+            ulonglong chunk = (end - next < kUDIFChunkSectors) ? end - next : kUDIFChunkSectors;
+            p->region = region;
+            p->start = next * kUDIFSectorSize;
+            p->length = chunk * kUDIFSectorSize;
+            bytes += p->length;
+            if ((next += chunk) == end) { region++; } // chunks don't cross regions
+        }
+        if ((result = PoolRun(threads, n, CompressChunk, &writer)) == 0) {
+            result = StoreWindow(ofd, regions, tables, entries, tableCRCs, writer.pending, n,
+                                 &dataLength, &dataCRC, &written);
+        }
+        if (result == 0) { result = ProgressAdvance(&tracker, bytes); }
+    }
+    if (result != 0) { goto done; }
+    ProgressFinish(&tracker);
+
+    // finish the tables, each with an end entry, and checksum them all
+    for (i = 0; i < count; i++) {
+        t = tables[i];
+        PutBE32(t, 0x6D697368); // 'mish'
+        PutBE32(t + 4, 1); // version
+        PutBE64(t + 8, regions[i].start);
+        PutBE64(t + 16, regions[i].sectors);
+        PutBE64(t + 24, 0); // chunk offsets are from the start of the data fork
+        PutBE32(t + 32, 0x208); // buffers needed, as hdiutil sets it
+        PutBE32(t + 36, (ulong)i); // block descriptor
+        PutBE32(t + 64, kUDIFChecksumCRC32);
+        PutBE32(t + 68, 32); // bits
+        PutBE32(t + 72, tableCRCs[i]);
+        PutBE32(t + 200, (ulong)entries[i] + 1);
+        t += kUDIFTableHeaderSize + entries[i] * kUDIFChunkEntrySize;
+        PutBE32(t, kUDIFChunkEnd);
+        PutBE64(t + 8, regions[i].sectors);
+        PutBE64(t + 24, dataLength);
+        PutBE32(sums, tableCRCs[i]);
+        masterCRC = crc32(masterCRC, sums, sizeof(sums));
+    }
+    if (!(plist = BuildPlist(regions, tables, lengths, count, &plistLength))) {
+        result = ENOMEM;
+        goto done;
+    }
+    PutBE32(trailer, 0x6B6F6C79); // 'koly'
+    PutBE32(trailer + 4, 4); // version
+    PutBE32(trailer + 8, kUDIFTrailerSize);
+    PutBE32(trailer + 12, 1); // flattened
+    PutBE64(trailer + 32, dataLength); // the data fork starts the file
+    PutBE32(trailer + 56, 1); // segment 1 of 1
+    PutBE32(trailer + 60, 1);
+    PutBE32(trailer + 80, kUDIFChecksumCRC32);
+    PutBE32(trailer + 84, 32);
+    PutBE32(trailer + 88, dataCRC);
+    PutBE64(trailer + 216, dataLength); // the plist follows the data
+    PutBE64(trailer + 224, plistLength);
+    PutBE32(trailer + 352, kUDIFChecksumCRC32);
+    PutBE32(trailer + 356, 32);
+    PutBE32(trailer + 360, masterCRC);
+    PutBE32(trailer + 488, 1); // image variant
+    PutBE64(trailer + 492, sectors);
+    if (IOWrite(ofd, plist, plistLength, dataLength) < 0 ||
+        IOWrite(ofd, trailer, kUDIFTrailerSize, dataLength + plistLength) < 0) {
+        result = errno;
+        goto done;
+    }
+    written.imageSize = sectors * kUDIFSectorSize;
+    written.storedSize = dataLength;
+    written.tables = count;
+    if (summary) { *summary = written; }
+done:
+    free(plist);
+    if (writer.pending) {
+        for (i = 0; i < window; i++) {
+            free(writer.pending[i].in);
+            free(writer.pending[i].out);
+        }
+    }
+    if (tables) {
+        for (i = 0; i < count; i++) { free(tables[i]); }
+    }
+    free(writer.pending);
+    free(tables);
+    free(lengths);
+    free(entries);
+    free(tableCRCs);
+    return result;
+}
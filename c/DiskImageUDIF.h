@@ -0,0 +1,100 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageUDIF.h
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//  Fri Oct 16 2026 -- added UDIFWriteImage
+//
+//----------------------------------------------------------------------
+
+#ifndef __diskimageudif_h__
+#define __diskimageudif_h__
+
+#include "DiskImageUtils.h"
+#include "DiskImageProgress.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// UDIF (.dmg) images are read in place. The koly trailer at the end of
+// the file locates a plist whose blkx entries each hold a mish block
+// table: runs of 512-byte sectors of the image, stored raw, as zeros, or
+// compressed. UDIFAttach parses them and sets an IOFilter on the
+// descriptor, so that IORead returns the image's own bytes, decompressed
+// chunk by chunk as they are read. Reads may come from several threads
+// at once (the copy engine's stripes), and recently decompressed chunks
+// are kept for reads which follow on.
+
+// Chunk types from the mish tables
+#define kUDIFChunkZero    0x00000000 // sectors of zeros
+#define kUDIFChunkRaw     0x00000001 // stored as they are
+#define kUDIFChunkIgnore  0x00000002 // free space, read as zeros
+#define kUDIFChunkADC     0x80000004 // Apple Data Compression
+#define kUDIFChunkZlib    0x80000005
+#define kUDIFChunkBzip2   0x80000006
+#define kUDIFChunkLZFSE   0x80000007 // not supported
+#define kUDIFChunkLZMA    0x80000008 // not supported
+#define kUDIFChunkComment 0x7FFFFFFE
+#define kUDIFChunkEnd     0xFFFFFFFF
+
+typedef struct UDIFSummary {
+    ulonglong imageSize; // bytes in the image the chunks make up
+    ulonglong storedSize; // bytes of chunk data in the file
+    size_t tables; // blkx entries
+    size_t chunks;
+    size_t zlib, bzip2, adc, raw, zero; // chunks of each kind
+}   UDIFSummary;
+
+// Look for a koly trailer at the end of fd (opened with IOOpen). If there
+// is one, read its block tables and filter fd through them. Returns 0,
+// -1 if the file isn't a UDIF image, ENOTSUP for images with LZFSE or
+// LZMA chunks or which are split into segments, or EINVAL if the tables
+// are damaged.
+int UDIFAttach(int fd);
+
+// Whether UDIFAttach has filtered fd, with what it found if summary isn't NULL
+int UDIFAttached(int fd, UDIFSummary *summary);
+
+// UDIFWriteImage stores an image the same way, as a flat (unsegmented)
+// UDIF file of the kind hdiutil makes: chunk data, then the plist, then
+// the koly trailer. The image is read in chunks of kUDIFChunkSectors on a
+// thread pool, and each chunk is compressed where it's read; all-zero
+// chunks become zero-fill entries, and chunks which don't get smaller are
+// stored raw. Chunks go out in image order, so the same image always
+// makes the same file.
+
+#define kUDIFChunkSectors 2048 // sectors per chunk written (1 MB)
+
+// Fill length bytes of buf with the image from offset. Returns 0 or an
+// errno value. Called on several threads at once.
+typedef int (*UDIFSourceProc)(void *refCon, char *buf, size_t length, off_t offset);
+
+// A run of the image with a blkx entry of its own. hdiutil makes one for
+// each partition map entry, named as "Apple (Apple_partition_map : 1)".
+typedef struct UDIFRegion {
+    char name[80];
+    ulonglong start; // first sector
+    ulonglong sectors;
+}   UDIFRegion;
+
+typedef struct UDIFWriteOptions {
+    ulong compression; // kUDIFChunkZlib or kUDIFChunkBzip2
+    unsigned threads; // compress on this many threads (0 for one per CPU)
+    const Progress *progress; // reporting and cancellation (NULL for a bar on stdout)
+}   UDIFWriteOptions;
+
+// Write the image made up of count regions, which must follow one another
+// from sector 0, to ofd (opened with IOOpen, and empty). summary (if not
+// NULL) gets what was written. Returns 0, ECANCELED if the progress
+// token was set, EINVAL for bad regions or compression, or an errno value.
+int UDIFWriteImage(int ofd, const UDIFRegion *regions, size_t count,
+                   UDIFSourceProc source, void *refCon,
+                   const UDIFWriteOptions *options, UDIFSummary *summary);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __diskimageudif_h__ */
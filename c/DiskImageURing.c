@@ -0,0 +1,252 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageURing.c
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//  Fri Oct 16 2026 -- the progress callback can stop a copy
+//  Fri Oct 16 2026 -- counts ring entries, short transfers and retries for --stats
+//
+//----------------------------------------------------------------------
+
+#ifdef __linux__
+#define _GNU_SOURCE // syscall, MAP_POPULATE
+#endif
+#include "DiskImageUtils.h"
+#include "DiskImageURing.h"
+#include "DiskImageStats.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+#ifndef HAVE_IO_URING
+
+int URingCopyRange(int ofd, int fd, off_t rdPos, off_t wrPos, size_t length,
+                   unsigned queueDepth, URingProgressProc proc, void *refCon) {
+    return ENOSYS;
+}
+
+#else
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#define kURingChunkSize (256*1024)
+
+// The parts of an io_uring we need, mapped from the kernel. We talk to
+// the kernel directly rather than through liburing to avoid a dependency.
+typedef struct URing {
+    int fd;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sqRing, *cqRing;
+    size_t sqRingLen, cqRingLen, sqesLen;
+    unsigned pending; // queued entries not yet submitted
+}   URing;
+
+// One registered buffer and the chunk it is currently moving
+typedef struct URingSlot {
+    char *buf;
+    off_t offset; // source offset of the chunk
+    size_t length;
+    size_t done; // bytes of the current read or write completed so far
+    int writing;
+    int busy;
+}   URingSlot;
+
+static void URingTeardown(URing *ring) {
+    if (ring->sqes && ring->sqes != MAP_FAILED) { munmap(ring->sqes, ring->sqesLen); }
+    if (ring->cqRing && ring->cqRing != MAP_FAILED && ring->cqRing != ring->sqRing) {
+        munmap(ring->cqRing, ring->cqRingLen);
+    }
+    if (ring->sqRing && ring->sqRing != MAP_FAILED) { munmap(ring->sqRing, ring->sqRingLen); }
+    if (ring->fd >= 0) { close(ring->fd); }
+}
+
+static int URingSetup(URing *ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(URing));
+    if ((ring->fd = syscall(__NR_io_uring_setup, entries, &params)) < 0) {
+        return errno;
+    }
+    ring->sqRingLen = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingLen = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cqRingLen > ring->sqRingLen) { ring->sqRingLen = ring->cqRingLen; }
+        ring->cqRingLen = ring->sqRingLen;
+    }
+    ring->sqRing = mmap(NULL, ring->sqRingLen, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sqRing == MAP_FAILED) { goto error; }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cqRing = ring->sqRing;
+    } else {
+        ring->cqRing = mmap(NULL, ring->cqRingLen, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cqRing == MAP_FAILED) { goto error; }
+    }
+    ring->sqesLen = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqesLen, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) { goto error; }
+
+    ring->sqHead = (unsigned*)((char*)ring->sqRing + params.sq_off.head);
+    ring->sqTail = (unsigned*)((char*)ring->sqRing + params.sq_off.tail);
+    ring->sqMask = (unsigned*)((char*)ring->sqRing + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned*)((char*)ring->sqRing + params.sq_off.array);
+    ring->cqHead = (unsigned*)((char*)ring->cqRing + params.cq_off.head);
+    ring->cqTail = (unsigned*)((char*)ring->cqRing + params.cq_off.tail);
+    ring->cqMask = (unsigned*)((char*)ring->cqRing + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)((char*)ring->cqRing + params.cq_off.cqes);
+    return 0;
+error:
+    URingTeardown(ring);
+    return ENOSYS;
+}
+
+// Queue a read or write of the unfinished part of a slot's chunk
+static void URingQueue(URing *ring, URingSlot *slots, unsigned index,
+                       int ofd, int fd, off_t delta, int fixed) {
+    URingSlot *slot = &slots[index];
+    unsigned tail = *ring->sqTail;
+    unsigned sqIndex = tail & *ring->sqMask;
+    struct io_uring_sqe *sqe = &ring->sqes[sqIndex];
+    memset(sqe, 0, sizeof(*sqe));
+    if (slot->writing) {
+        sqe->opcode = (fixed) ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe->fd = ofd;
+        sqe->off = slot->offset + delta + slot->done;
+    } else {
+        sqe->opcode = (fixed) ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe->fd = fd;
+        sqe->off = slot->offset + slot->done;
+    }
+    sqe->addr = (unsigned long)(slot->buf + slot->done);
+    sqe->len = slot->length - slot->done;
+    sqe->buf_index = (fixed) ? index : 0;
+    sqe->user_data = index;
+    ring->sqArray[sqIndex] = sqIndex;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+    ring->pending++;
+}
+
+static int URingSubmitAndWait(URing *ring) {
+    int count;
+    for (;;) {
+        count = syscall(__NR_io_uring_enter, ring->fd, ring->pending, 1,
+                        IORING_ENTER_GETEVENTS, NULL, 0);
+        StatsCount(kStatsOtherCalls, 1);
+        if (count >= 0) { break; }
+        if (errno != EINTR && errno != EAGAIN) { return errno; }
+        StatsCount(kStatsRetries, 1);
+    }
+    ring->pending -= count;
+    return 0;
+}
+
+int URingCopyRange(int ofd, int fd, off_t rdPos, off_t wrPos, size_t length,
+                   unsigned queueDepth, URingProgressProc proc, void *refCon) {
+    int result = 0, err, fixed = 0;
+    URing ring;
+    URingSlot slots[kURingMaxQueueDepth];
+    struct iovec iovs[kURingMaxQueueDepth];
+    const off_t delta = wrPos - rdPos;
+    const off_t end = rdPos + length;
+    off_t next = rdPos;
+    size_t moved = 0;
+    unsigned i, inflight = 0;
+
+    if (queueDepth == 0) { queueDepth = kURingDefaultQueueDepth; }
+    if (queueDepth > kURingMaxQueueDepth) { queueDepth = kURingMaxQueueDepth; }
+    if (URingSetup(&ring, queueDepth) != 0) { return ENOSYS; }
+    memset(slots, 0, sizeof(slots));
+    for (i = 0; i < queueDepth; i++) {
+        if (posix_memalign((void**)&slots[i].buf, 4096, kURingChunkSize) != 0) {
+            result = ENOMEM;
+            goto cleanup;
+        }
+        iovs[i].iov_base = slots[i].buf;
+        iovs[i].iov_len = kURingChunkSize;
+    }
+    // registered buffers save the kernel from mapping pages on every I/O;
+    // without them (e.g. RLIMIT_MEMLOCK too low) plain READ/WRITE still work
+    fixed = (syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_BUFFERS,
+                     iovs, queueDepth) == 0);
+
+    for (;;) {
+        // keep every idle buffer busy reading the next chunk
+        for (i = 0; i < queueDepth && result == 0 && next < end; i++) {
+            if (slots[i].busy) { continue; }
+            slots[i].busy = 1;
+            slots[i].writing = 0;
+            slots[i].offset = next;
+            slots[i].length = (end - next < kURingChunkSize) ? end - next : kURingChunkSize;
+            slots[i].done = 0;
+            next += slots[i].length;
+            URingQueue(&ring, slots, i, ofd, fd, delta, fixed);
+            inflight++;
+        }
+        if (inflight == 0) { break; }
+        if ((err = URingSubmitAndWait(&ring)) != 0) {
+            if (result == 0) { result = err; }
+            if (ring.pending == inflight) { break; } // nothing in the kernel to drain
+            continue;
+        }
+        // reap completions: a finished read turns straight into a write of
+        // the same buffer, while the other slots' reads are still running
+        unsigned head = *ring.cqHead;
+        unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cqMask];
+            URingSlot *slot = &slots[cqe->user_data];
+            int res = cqe->res;
+            if (res == -EAGAIN || res == -EINTR) {
+                StatsCount(kStatsRetries, 1);
+                URingQueue(&ring, slots, cqe->user_data, ofd, fd, delta, fixed);
+                continue;
+            }
+            if (res <= 0 || result != 0) {
+                if (result == 0) { result = (res < 0) ? -res : EIO; }
+                slot->busy = 0;
+                inflight--;
+                continue;
+            }
+            slot->done += res;
+            if (slot->done < slot->length) { // short read or write
+                StatsCount((slot->writing) ? kStatsShortWrites : kStatsShortReads, 1);
+                URingQueue(&ring, slots, cqe->user_data, ofd, fd, delta, fixed);
+            } else if (!slot->writing) {
+                slot->writing = 1;
+                slot->done = 0;
+                URingQueue(&ring, slots, cqe->user_data, ofd, fd, delta, fixed);
+            } else {
+                moved += slot->length;
+                StatsCount(kStatsBytesCopied, slot->length);
+                if (proc && (err = proc(refCon, slot->length)) != 0 && result == 0) {
+                    result = err;
+                }
+                slot->busy = 0;
+                inflight--;
+            }
+        }
+        __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+    }
+    // an opcode this kernel doesn't know means io_uring isn't usable here
+    if (moved == 0 && (result == EINVAL || result == EOPNOTSUPP)) {
+        result = ENOSYS;
+    }
+cleanup:
+    URingTeardown(&ring);
+    for (i = 0; i < queueDepth; i++) { free(slots[i].buf); }
+    return result;
+}
+
+#endif /* HAVE_IO_URING */
@@ -0,0 +1,39 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageURing.h
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//  Fri Oct 16 2026 -- the progress callback can stop a copy
+//
+//----------------------------------------------------------------------
+
+#ifndef __diskimageuring_h__
+#define __diskimageuring_h__
+
+#include "DiskImageUtils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define kURingDefaultQueueDepth 8
+#define kURingMaxQueueDepth 64
+
+// Called as each chunk has been both read and written; a non-zero
+// return stops the copy (once the I/O in flight has drained) with
+// that result
+typedef int (*URingProgressProc)(void *refCon, size_t count);
+
+// Copy length bytes at rdPos in fd to wrPos in ofd through an io_uring,
+// keeping up to queueDepth reads and writes in flight over a ring of
+// registered buffers. Returns ENOSYS without having touched the output
+// if io_uring is not available (not Linux, old kernel, or disabled).
+int URingCopyRange(int ofd, int fd, off_t rdPos, off_t wrPos, size_t length,
+                   unsigned queueDepth, URingProgressProc proc, void *refCon);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __diskimageuring_h__ */
@@ -14,10 +14,19 @@
 // point to remove this dependency.
 #include <CoreFoundation/CoreFoundation.h>
 #include "DiskImageUtils.h"
+#include "DiskImageIO.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+extern int quiet;
 
 void tabprint(int tabstop, char *format, ...) {
     FILE *stream = stdout;
     int i = 0, tabsize = 4;
+    if (quiet) { return; }
     for (; i<tabstop*tabsize; i++) { fprintf(stream, " "); }
     va_list args;
     va_start(args, format);
@@ -26,18 +35,6 @@ void tabprint(int tabstop, char *format, ...) {
     fflush(stream);
 }
 
-#define kPBStr "##################################################"
-#define kPBWidth 50
-
-int progress(double percentComplete) {
-    int val = (int) (percentComplete * 100);
-    int lpad = (int) (percentComplete * kPBWidth);
-    int rpad = kPBWidth - lpad;
-    fprintf(stdout, "\r%3d%% [%.*s%*s]", val, lpad, kPBStr, rpad, "");
-    fflush(stdout);
-    return val;
-}
-
 static inline ushort rotl16(ushort n, unsigned int c) {
     const unsigned int mask = (CHAR_BIT*sizeof(n) - 1);
     c &= mask;
@@ -65,18 +62,91 @@ ushort Checksum16(uchar *bytes, size_t length) {
 
 ushort ComputeChecksum(int fd, off_t driverOffset, off_t length) {
     ushort result = 0xFFFF;
-    off_t count;
     void *p = 0;
-    if ((count = lseek(fd, driverOffset, SEEK_SET)) == -1) { return 1; }
     p = malloc(length);
     if (!p) { goto done; }
-    if ((count = read(fd, p, length)) < 0) { goto done; }
+    if (IORead(fd, p, length, driverOffset) < 0) { goto done; }
     result = Checksum16(p, length);
 done:
     free(p);
     return result;
 }
 
+int IsZeroFilled(const void *bytes, size_t length) {
+    // OR together 64 bytes per pass in vector registers and only test the
+    // accumulator once per pass; the tail is checked a byte at a time.
+    const uchar *p = bytes;
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 64 <= length; i += 64) {
+        __m128i acc = _mm_or_si128(
+            _mm_or_si128(_mm_loadu_si128((const __m128i*)(p+i)),
+                         _mm_loadu_si128((const __m128i*)(p+i+16))),
+            _mm_or_si128(_mm_loadu_si128((const __m128i*)(p+i+32)),
+                         _mm_loadu_si128((const __m128i*)(p+i+48))));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xFFFF) {
+            return 0;
+        }
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; i + 64 <= length; i += 64) {
+        uint8x16_t acc = vorrq_u8(vorrq_u8(vld1q_u8(p+i), vld1q_u8(p+i+16)),
+                                  vorrq_u8(vld1q_u8(p+i+32), vld1q_u8(p+i+48)));
+        if (vmaxvq_u8(acc) != 0) {
+            return 0;
+        }
+    }
+#else
+    for (; i + 32 <= length; i += 32) {
+        ulonglong a, b, c, d;
+        memcpy(&a, p+i, 8); memcpy(&b, p+i+8, 8);
+        memcpy(&c, p+i+16, 8); memcpy(&d, p+i+24, 8);
+        if (a | b | c | d) { return 0; }
+    }
+#endif
+    for (; i < length; i++) {
+        if (p[i]) { return 0; }
+    }
+    return 1;
+}
+
+size_t FirstDifference(const void *a, const void *b, size_t length) {
+    // compare 64 bytes per pass and only look for the exact byte once a
+    // pass has found a difference; the tail is checked a byte at a time.
+    const uchar *p = a, *q = b;
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 64 <= length; i += 64) {
+        __m128i eq = _mm_and_si128(
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p+i)),
+                                         _mm_loadu_si128((const __m128i*)(q+i))),
+                          _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p+i+16)),
+                                         _mm_loadu_si128((const __m128i*)(q+i+16)))),
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p+i+32)),
+                                         _mm_loadu_si128((const __m128i*)(q+i+32))),
+                          _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p+i+48)),
+                                         _mm_loadu_si128((const __m128i*)(q+i+48)))));
+        if (_mm_movemask_epi8(eq) != 0xFFFF) { break; }
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; i + 64 <= length; i += 64) {
+        uint8x16_t eq = vandq_u8(vandq_u8(vceqq_u8(vld1q_u8(p+i), vld1q_u8(q+i)),
+                                          vceqq_u8(vld1q_u8(p+i+16), vld1q_u8(q+i+16))),
+                                 vandq_u8(vceqq_u8(vld1q_u8(p+i+32), vld1q_u8(q+i+32)),
+                                          vceqq_u8(vld1q_u8(p+i+48), vld1q_u8(q+i+48))));
+        if (vminvq_u8(eq) != 0xFF) { break; }
+    }
+#else
+    for (; i + 32 <= length; i += 32) {
+        if (memcmp(p+i, q+i, 32)) { break; }
+    }
+#endif
+    for (; i < length; i++) {
+        if (p[i] != q[i]) { break; }
+    }
+    return i;
+}
+
 static double hfsEpoch = -3061152000.0; // 1904-01-01T00:00:00Z
 
 void DateStringForHFSDate(uint32_t hfsDate, uint32_t maxLen, char *str) {
@@ -99,25 +169,19 @@ void DateStringForHFSDate(uint32_t hfsDate, uint32_t maxLen, char *str) {
 }
 
 int ReadUShort(int fd, size_t offset, ushort *value) {
-    off_t count;
-    if ((count = lseek(fd, offset, SEEK_SET)) == -1) { return 1; }
-    if ((count = read(fd, value, sizeof(ushort))) < 0) { return 1; }
+    if (IORead(fd, value, sizeof(ushort), offset) < 0) { return 1; }
     *value = (ushort) ntohs(*value);
     return 0;
 }
 
 int ReadULong(int fd, size_t offset, ulong *value) {
-    off_t count;
-    if ((count = lseek(fd, offset, SEEK_SET)) == -1) { return 1; }
-    if ((count = read(fd, value, sizeof(ulong))) < 0) { return 1; }
+    if (IORead(fd, value, sizeof(ulong), offset) < 0) { return 1; }
     *value = (ulong) ntohl(*value);
     return 0;
 }
 
 int ReadDriverDescriptorRecord(int fd, size_t offset, DDRecord *ddr) {
-    off_t count;
-    if ((count = lseek(fd, offset, SEEK_SET)) == -1) { return 1; }
-    if ((count = read(fd, ddr, sizeof(DDRecord))) < 0) { return 1; }
+    if (IORead(fd, ddr, sizeof(DDRecord), offset) < 0) { return 1; }
     // convert numeric values to host endian
     ddr->sbSig = (ushort) ntohs(ddr->sbSig);
     ddr->sbBlkSize = (ushort) ntohs(ddr->sbBlkSize);
@@ -133,9 +197,12 @@ int ReadDriverDescriptorRecord(int fd, size_t offset, DDRecord *ddr) {
 }
 
 int ReadPartitionMapEntry(int fd, size_t offset, Partition *pme) {
-    off_t count;
-    if ((count = lseek(fd, offset, SEEK_SET)) == -1) { return 1; }
-    if ((count = read(fd, pme, sizeof(Partition))) < 0) { return 1; }
+    if (IORead(fd, pme, sizeof(Partition), offset) < 0) { return 1; }
+    SwapPartitionMapEntry(pme);
+    return 0;
+}
+
+void SwapPartitionMapEntry(Partition *pme) {
     // convert numeric values to host endian
     pme->pmSig = (ushort) ntohs(pme->pmSig);
     pme->pmSigPad = (ushort) ntohs(pme->pmSigPad);
@@ -152,13 +219,10 @@ int ReadPartitionMapEntry(int fd, size_t offset, Partition *pme) {
     pme->pmBootEntry = (ulong) ntohl(pme->pmBootEntry);
     pme->pmBootEntry2 = (ulong) ntohl(pme->pmBootEntry2);
     pme->pmBootCksum = (ulong) ntohl(pme->pmBootCksum);
-    return 0;
 }
 
 int ReadBootBlockHeader(int fd, size_t offset, BootBlockHeader *bb) {
-    off_t count;
-    if ((count = lseek(fd, offset, SEEK_SET)) == -1) { return 1; }
-    if ((count = read(fd, bb, sizeof(BootBlockHeader))) < 0) { return 1; }
+    if (IORead(fd, bb, sizeof(BootBlockHeader), offset) < 0) { return 1; }
     // convert numeric values to host endian
     bb->bbID = (ushort) ntohs(bb->bbID);
     bb->bbEntry = (ulong) ntohl(bb->bbEntry);
@@ -177,9 +241,7 @@ int ReadBootBlockHeader(int fd, size_t offset, BootBlockHeader *bb) {
 
 int ReadMasterDirectoryBlock(int fd, size_t offset, MasterDirectoryBlock *mdb) {
     int i;
-    off_t count;
-    if ((count = lseek(fd, offset, SEEK_SET)) == -1) { return 1; }
-    if ((count = read(fd, mdb, sizeof(MasterDirectoryBlock))) < 0) { return 1; }
+    if (IORead(fd, mdb, sizeof(MasterDirectoryBlock), offset) < 0) { return 1; }
     // convert numeric values to host endian
     mdb->drSigWord = (ushort) ntohs(mdb->drSigWord);
     mdb->drCrDate = (ulong) ntohl(mdb->drCrDate);
@@ -212,11 +274,15 @@ int ReadMasterDirectoryBlock(int fd, size_t offset, MasterDirectoryBlock *mdb) {
     return 0;
 }
 
+static void SwapHFSPlusForkData(HFSPlusForkData *fork) {
+    fork->logicalSize = (ulonglong) OSSwapBigToHostInt64(fork->logicalSize);
+    fork->clumpSize = (ulong) ntohl(fork->clumpSize);
+    fork->totalBlocks = (ulong) ntohl(fork->totalBlocks);
+}
+
 int ReadHFSPlusVolumeHeader(int fd, size_t offset, HFSPlusVolumeHeader *vh) {
     int i;
-    off_t count;
-    if ((count = lseek(fd, offset, SEEK_SET)) == -1) { return 1; }
-    if ((count = read(fd, vh, sizeof(HFSPlusVolumeHeader))) < 0) { return 1; }
+    if (IORead(fd, vh, sizeof(HFSPlusVolumeHeader), offset) < 0) { return 1; }
     // convert numeric values to host endian
     vh->signature = (ushort) ntohs(vh->signature);
     vh->version = (ushort) ntohs(vh->version);
@@ -242,7 +308,52 @@ int ReadHFSPlusVolumeHeader(int fd, size_t offset, HFSPlusVolumeHeader *vh) {
     for (i=0; i<8; i++) {
         vh->finderInfo[i] = (ulong) ntohl(vh->finderInfo[i]);
     }
-    // allocationFile, extentsFile, etc.: do we care yet?
+    // fork extents are left big-endian, as they are only walked as raw bytes
+    SwapHFSPlusForkData(&vh->allocationFile);
+    SwapHFSPlusForkData(&vh->extentsFile);
+    SwapHFSPlusForkData(&vh->catalogFile);
+    SwapHFSPlusForkData(&vh->attributesFile);
+    SwapHFSPlusForkData(&vh->startupFile);
     return 0;
 }
 
+
+#define kHeaderProbeSize (64*1024) // DDR, a 126-entry map, and most first volumes
+#define kHeaderMaxSize (1024*1024)
+
+int ReadImageHeader(int fd) {
+    // Load the parts of an image that ProbeFile and DescribeFile parse with
+    // a single read, so the Read* calls above are served from memory. The
+    // first read covers the DDR, the start of the partition map, and the
+    // boot blocks and MDB of a bare volume. A partition map can then grow
+    // the cache to cover the whole map, the driver code, and the boot
+    // blocks and MDB of each HFS partition, up to kHeaderMaxSize.
+    const size_t kBlockSize = 512;
+    DDRecord ddr;
+    Partition pme;
+    size_t want, end, i, mapBlocks;
+    if (IOCacheHead(fd, kHeaderProbeSize) != 0) { return 1; }
+    if (ReadDriverDescriptorRecord(fd, 0, &ddr) != 0 || ddr.sbSig != 0x4552) {
+        return 0; // not a device image; nothing more to fetch
+    }
+    if (ReadPartitionMapEntry(fd, kBlockSize, &pme) != 0 || pme.pmSig != 0x504D) {
+        return 0;
+    }
+    mapBlocks = pme.pmMapBlkCnt;
+    want = (mapBlocks + 1) * kBlockSize;
+    if (want > kHeaderMaxSize) { want = kHeaderMaxSize; }
+    if (want > kHeaderProbeSize && IOCacheHead(fd, want) != 0) { return 1; }
+    for (i = 1; i <= mapBlocks && (i + 1) * kBlockSize <= want; i++) {
+        if (ReadPartitionMapEntry(fd, i * kBlockSize, &pme) != 0) { break; }
+        if (pme.pmSig != 0x504D) { break; } // 'PM'
+        if (!strncmp((char*)pme.pmPartType, "Apple_Driver", 12)) {
+            end = pme.pmPyPartStart * kBlockSize + pme.pmBootSize;
+        } else if (!strncmp((char*)pme.pmPartType, "Apple_HFS", 9)) {
+            end = pme.pmPyPartStart * kBlockSize + 0x400 + sizeof(HFSPlusVolumeHeader);
+        } else {
+            continue;
+        }
+        if (end > want && end <= kHeaderMaxSize) { want = end; }
+    }
+    return IOCacheHead(fd, want) ? 1 : 0;
+}
@@ -190,18 +190,22 @@ typedef struct __attribute__((aligned(2), packed)) HFSPlusVolumeHeader {
 
 
 void tabprint(int tabstop, char *format, ...);
-int progress(double percentComplete);
 ushort Checksum16(uchar *bytes, size_t length);
 ushort ComputeChecksum(int fd, off_t driverOffset, off_t length);
 void DateStringForHFSDate(uint32_t hfsDate, uint32_t maxLen, char *str);
+int IsZeroFilled(const void *bytes, size_t length);
+// offset of the first byte where a and b differ, or length if none
+size_t FirstDifference(const void *a, const void *b, size_t length);
 
 int ReadUShort(int fd, size_t offset, ushort *value);
 int ReadULong(int fd, size_t offset, ulong *value);
 int ReadDriverDescriptorRecord(int fd, size_t offset, DDRecord *ddr);
 int ReadPartitionMapEntry(int fd, size_t offset, Partition *pme);
+void SwapPartitionMapEntry(Partition *pme); // for entries read in bulk
 int ReadBootBlockHeader(int fd, size_t offset, BootBlockHeader *bb);
 int ReadMasterDirectoryBlock(int fd, size_t offset, MasterDirectoryBlock *mdb);
 int ReadHFSPlusVolumeHeader(int fd, size_t offset, HFSPlusVolumeHeader *vh);
+int ReadImageHeader(int fd);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,285 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageVerify.c
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//  Fri Oct 16 2026 -- the source partition can be selected
+//  Fri Oct 16 2026 -- either image can be a UDIF image
+//  Fri Oct 16 2026 -- one read in order (a bzip2 stream) is compared serially
+//
+//----------------------------------------------------------------------
+
+#include <pthread.h>
+#include "DiskImageUtils.h"
+#include "DiskImageVerify.h"
+#include "DiskImageConvert.h"
+#include "DiskImageIO.h"
+#include "DiskImageDescribe.h"
+#include "DiskImagePool.h"
+#include "DiskImageStream.h"
+
+#define kVerifyChunkSize (4*1024*1024) // unit of work for the threads
+#define kVerifyBlockSize 512 // differences are reported in whole blocks
+#define kVerifyListedRanges 10 // ranges listed, unless very verbose
+#define kVerifyAttrOffset ((512*2) + 10) // drAtrb, from the start of the volume
+
+extern int verbose;
+
+typedef struct VerifyRange {
+    off_t offset; // from the start of the volume
+    size_t length;
+}   VerifyRange;
+
+typedef struct VerifyJob {
+    int fd; // source
+    int ofd; // converted file
+    off_t srcStart;
+    off_t dstStart;
+    size_t length; // bytes compared
+    int full;
+    char **buffers; // two chunks per worker, allocated on first use
+    pthread_mutex_t lock; // guards the fields below
+    ProgressTracker tracker;
+    off_t firstDifference; // lowest found so far (length if none)
+    int lockBitsDiffer;
+    VerifyRange *ranges;
+    size_t rangeCount;
+    size_t rangeCapacity;
+}   VerifyJob;
+
+// Point at length bytes of fd, reading them into buf unless mapped
+static const char *VerifyRead(int fd, char *buf, off_t offset, size_t length) {
+    const char *p = IOMapped(fd, offset, length);
+    ssize_t count;
+    if (p) { return p; }
+    if ((count = IORead(fd, buf, length, offset)) < 0) { return NULL; }
+    if (count < length) { errno = EIO; return NULL; } // file ended early
+    return buf;
+}
+
+// Position of the next difference in [pos, end) of two chunks which start
+// at volume offset base, passing over differences in the lock bits only
+static size_t NextDifference(const char *a, const char *b, off_t base, size_t pos,
+                             size_t end, int *lockBits) {
+    const ushort lockMask = (1 << HFSVolumeHardwareLockBit) | (1 << HFSVolumeSoftwareLockBit);
+    uchar allowed;
+    off_t at;
+    while ((pos += FirstDifference(a + pos, b + pos, end - pos)) < end) {
+        at = base + pos;
+        if (at != kVerifyAttrOffset && at != kVerifyAttrOffset + 1) { break; }
+        allowed = (at == kVerifyAttrOffset) ? (lockMask >> 8) : (lockMask & 0xFF); // big-endian
+        if (((uchar)a[pos] ^ (uchar)b[pos]) & ~allowed) { break; }
+        *lockBits = 1;
+        pos++;
+    }
+    return pos;
+}
+
+static int VerifyAddRange(VerifyJob *job, off_t offset, size_t length) {
+    int result = 0;
+    pthread_mutex_lock(&job->lock);
+    if (job->rangeCount == job->rangeCapacity) {
+        size_t capacity = (job->rangeCapacity) ? job->rangeCapacity * 2 : 64;
+        VerifyRange *p = realloc(job->ranges, capacity * sizeof(VerifyRange));
+        if (p) {
+            job->ranges = p;
+            job->rangeCapacity = capacity;
+        } else {
+            result = ENOMEM;
+        }
+    }
+    if (result == 0) {
+        job->ranges[job->rangeCount].offset = offset;
+        job->ranges[job->rangeCount].length = length;
+        job->rangeCount++;
+        if (offset < job->firstDifference) { job->firstDifference = offset; }
+    }
+    pthread_mutex_unlock(&job->lock);
+    return result;
+}
+
+static int VerifyTask(void *refCon, size_t taskIndex, unsigned worker) {
+    VerifyJob *job = (VerifyJob*)refCon;
+    char **buffers = &job->buffers[worker * 2];
+    const off_t offset = (off_t)taskIndex * kVerifyChunkSize;
+    size_t length = job->length - offset;
+    size_t pos, end, next;
+    const char *a, *b;
+    int lockBits = 0, skip, result = 0;
+    if (length > kVerifyChunkSize) { length = kVerifyChunkSize; }
+    pthread_mutex_lock(&job->lock);
+    skip = (!job->full && offset > job->firstDifference); // can't hold the first one
+    pthread_mutex_unlock(&job->lock);
+    if (!skip) {
+        if ((!buffers[0] && !(buffers[0] = IOAllocBuffer(kVerifyChunkSize))) ||
+            (!buffers[1] && !(buffers[1] = IOAllocBuffer(kVerifyChunkSize)))) {
+            return ENOMEM;
+        }
+        if (!(a = VerifyRead(job->fd, buffers[0], job->srcStart + offset, length)) ||
+            !(b = VerifyRead(job->ofd, buffers[1], job->dstStart + offset, length))) {
+            return (errno) ? errno : EIO;
+        }
+        pos = NextDifference(a, b, offset, 0, length, &lockBits);
+        while (pos < length) {
+            // widen the difference to whole blocks, taking in any following
+            // blocks which differ too
+            pos -= pos % kVerifyBlockSize;
+            end = (pos + kVerifyBlockSize < length) ? pos + kVerifyBlockSize : length;
+            while (end < length) {
+                next = (end + kVerifyBlockSize < length) ? end + kVerifyBlockSize : length;
+                if (NextDifference(a, b, offset, end, next, &lockBits) == next) { break; }
+                end = next;
+            }
+            if ((result = VerifyAddRange(job, offset + pos, end - pos)) != 0) { return result; }
+            if (!job->full) { break; }
+            pos = NextDifference(a, b, offset, end, length, &lockBits);
+        }
+    }
+    pthread_mutex_lock(&job->lock);
+    if (lockBits) { job->lockBitsDiffer = 1; }
+    result = ProgressAdvance(&job->tracker, length);
+    pthread_mutex_unlock(&job->lock);
+    return result;
+}
+
+static int CompareRanges(const void *a, const void *b) {
+    off_t x = ((const VerifyRange*)a)->offset, y = ((const VerifyRange*)b)->offset;
+    return (x < y) ? -1 : (x > y);
+}
+
+// Sort the ranges and join those which meet across chunk boundaries
+static void MergeRanges(VerifyJob *job) {
+    size_t i, count = 0;
+    VerifyRange *r = job->ranges;
+    if (!job->rangeCount) { return; }
+    qsort(r, job->rangeCount, sizeof(VerifyRange), CompareRanges);
+    for (i = 1; i < job->rangeCount; i++) {
+        if (r[i].offset <= r[count].offset + (off_t)r[count].length) {
+            r[count].length = r[i].offset + r[i].length - r[count].offset;
+        } else {
+            r[++count] = r[i];
+        }
+    }
+    job->rangeCount = count + 1;
+}
+
+static void PrintDifferences(VerifyJob *job) {
+    size_t i, bytes = 0, listed;
+    MergeRanges(job);
+    listed = (verbose > 1) ? job->rangeCount : kVerifyListedRanges;
+    if (!job->full) {
+        tabprint(0, "Volumes differ at offset %lld (block %lld of the volume)\n",
+            (long long)job->ranges[0].offset, (long long)job->ranges[0].offset / kVerifyBlockSize);
+        tabprint(1, "Use \"-v verify\" to compare the whole volume\n");
+        return;
+    }
+    for (i = 0; i < job->rangeCount; i++) { bytes += job->ranges[i].length; }
+    tabprint(0, "Volumes differ in %zu blocks (%.1f MB) in %zu range%s\n",
+        (bytes + kVerifyBlockSize - 1) / kVerifyBlockSize, bytes / (1024.0*1024.0),
+        job->rangeCount, (job->rangeCount == 1) ? "" : "s");
+    for (i = 0; i < job->rangeCount && i < listed; i++) {
+        tabprint(1, "offset %lld, %zu bytes (blocks %lld-%lld)\n",
+            (long long)job->ranges[i].offset, job->ranges[i].length,
+            (long long)job->ranges[i].offset / kVerifyBlockSize,
+            (long long)(job->ranges[i].offset + job->ranges[i].length - 1) / kVerifyBlockSize);
+    }
+    if (i < job->rangeCount) {
+        tabprint(1, "... and %zu more (use \"-v -v verify\" to list them all)\n",
+            job->rangeCount - i);
+    }
+}
+
+// Whether fd is a stream which can only be decoded from its start, so
+// that chunks compared out of order would each decode it again
+static int ReadInOrder(int fd) {
+    StreamSummary stream;
+    return StreamAttached(fd, &stream) && !stream.seekable;
+}
+
+// Open path and find its HFS volume, saying where it is
+static int VerifyOpen(const char *label, const char *path, IOBackend backend,
+                      ImageIndex *index, unsigned partition, int *fd,
+                      off_t *hfsStart, size_t *hfsLen) {
+    size_t fileSize = 0;
+    int result;
+    if ((*fd = OpenImage(path, backend)) == -1) {
+        tabprint(0, "Unable to open \"%s\" (%d)\n", path, errno);
+        return errno;
+    }
+    tabprint(0, "%s: \"%s\"\n", label, path);
+    if ((result = ProbeFile(*fd, path, index, partition, &fileSize, hfsStart, hfsLen)) != 0) {
+        if (result == -1 && partition) {
+            tabprint(1, "Partition %u is not an HFS volume in this image\n", partition - 1);
+        } else {
+            tabprint(1, "Unable to find HFS volume (error %d)\n", result);
+        }
+        return result;
+    }
+    tabprint(1, "HFS volume found at offset %lld, length %lld\n", (long long)*hfsStart,
+        (long long)*hfsLen);
+    return 0;
+}
+
+int VerifyFile(const char *srcPath, const char *dstPath, const VerifyOptions *options,
+               ImageIndex *index) {
+    VerifyJob job = {0};
+    IOBackend backend = (options) ? options->backend : kIOBackendPread;
+    unsigned threads = (options && options->threads) ? options->threads : PoolDefaultThreads();
+    size_t srcLen = 0, dstLen = 0, count, i;
+    int result = 0;
+
+    job.fd = job.ofd = -1;
+    if ((result = VerifyOpen("Source file", srcPath, backend, index,
+                             (options) ? options->partition : 0, &job.fd,
+                             &job.srcStart, &srcLen)) != 0 ||
+        (result = VerifyOpen("Converted file", dstPath, backend, index, 0, &job.ofd,
+                             &job.dstStart, &dstLen)) != 0) {
+        goto done;
+    }
+    job.length = (srcLen < dstLen) ? srcLen : dstLen;
+    job.full = (options) ? options->full : 0;
+    job.firstDifference = job.length;
+    count = (job.length + kVerifyChunkSize - 1) / kVerifyChunkSize;
+    if (ReadInOrder(job.fd) || ReadInOrder(job.ofd)) { threads = 1; }
+    if (threads > count) { threads = (count) ? count : 1; }
+    if (!(job.buffers = calloc(threads * 2, sizeof(char*)))) {
+        result = ENOMEM;
+        goto done;
+    }
+    tabprint(0, "Comparing %.1f MB on %u thread%s\n", job.length / (1024.0*1024.0), threads,
+        (threads == 1) ? "" : "s");
+    pthread_mutex_init(&job.lock, NULL);
+    ProgressStart(&job.tracker, (options) ? options->progress : NULL, job.length);
+    result = PoolRun(threads, count, VerifyTask, &job);
+    if (result == 0) { ProgressFinish(&job.tracker); }
+    pthread_mutex_destroy(&job.lock);
+    for (i = 0; i < threads * 2; i++) { free(job.buffers[i]); }
+    free(job.buffers);
+    tabprint(0, "\n");
+
+    if (result == ECANCELED) {
+        tabprint(0, "Verification cancelled\n");
+    } else if (result != 0) {
+        tabprint(0, "An error occurred reading the images: %d\n", result);
+    } else {
+        if (srcLen != dstLen) {
+            tabprint(0, "Volume lengths differ: %zu bytes in the source, %zu converted\n",
+                srcLen, dstLen);
+            result = kVerifyMismatch;
+        }
+        if (job.rangeCount) {
+            PrintDifferences(&job);
+            result = kVerifyMismatch;
+        } else {
+            tabprint(0, "Volume data %s%s\n", (srcLen == dstLen) ? "matches" :
+                "matches up to the shorter length",
+                (job.lockBitsDiffer) ? " (apart from the drAtrb lock bits)" : "");
+        }
+    }
+done:
+    free(job.ranges);
+    if (job.fd != -1) { IOClose(job.fd); }
+    if (job.ofd != -1) { IOClose(job.ofd); }
+    return result;
+}
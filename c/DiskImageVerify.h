@@ -0,0 +1,46 @@
+//----------------------------------------------------------------------
+//
+//  DiskImageVerify.h
+//
+//  Modification History:
+//  Fri Oct 16 2026 -- initial version
+//  Fri Oct 16 2026 -- the source partition can be selected
+//
+//----------------------------------------------------------------------
+
+#ifndef __diskimageverify_h__
+#define __diskimageverify_h__
+
+#include "DiskImageUtils.h"
+#include "DiskImageIO.h"
+#include "DiskImageIndex.h"
+#include "DiskImageProgress.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define kVerifyMismatch (-2) // VerifyFile result when the volumes differ
+
+typedef struct VerifyOptions {
+    unsigned threads; // compare chunks on this many threads (0 for one per CPU)
+    IOBackend backend; // how the two files are read
+    int full; // compare everything and summarize the differences, rather
+              // than stopping at the first one
+    const Progress *progress; // reporting and cancellation (NULL for a bar on stdout)
+    unsigned partition; // source map entry plus one, or 0 for the first HFS partition
+}   VerifyOptions;
+
+// Check that the HFS volume in dstPath (made by cvt2hfs or cvt2iso) is
+// the same as the one in srcPath, allowing for the drAtrb lock bits the
+// conversion sets or clears. Returns 0 if the volumes match,
+// kVerifyMismatch if they don't, -1 if either file holds no HFS volume,
+// or an errno value (ECANCELED if the progress options' token was set).
+int VerifyFile(const char *srcPath, const char *dstPath, const VerifyOptions *options,
+               ImageIndex *index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __diskimageverify_h__ */
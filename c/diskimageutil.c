@@ -12,22 +12,101 @@
 #include "DiskImageConvert.h"
 #include "DiskImageDescribe.h"
 #include "DiskImageUtils.h"
+#include "DiskImagePool.h"
+#include "DiskImageURing.h"
+#include "DiskImageIndex.h"
+#include "DiskImageBatch.h"
+#include "DiskImageScan.h"
+#include "DiskImageProgress.h"
+#include "DiskImageStats.h"
+#include "DiskImageVerify.h"
+#include "DiskImageSplit.h"
+#include "DiskImageAssemble.h"
+#include "DiskImageUDIF.h"
+#include <signal.h>
 
 const char *kVersionStr = "Version 1.0, 09 Jul 2025";
 int verbose = 0;
+int quiet = 0;
+static CancelToken cancelToken;
 
 static void usage(const char *arg0) {
     fprintf(stderr, "%s\n\n", kVersionStr);
-    fprintf(stderr, "Usage: %s [-v] [-w] <verb> <file> [dstfile]\n", arg0);
+    fprintf(stderr, "Usage: %s [-v] [-w] [-s] [-a] [-d] [-u] [-q depth] [-j threads] [-p workers] [-P partition] [-b backend] [-z compression] [-f format] [-x index] [-H] [--stats[=json]] <verb> <file> [dstfile]\n", arg0);
     fprintf(stderr, "<verb> is one of the following options:\n");
     fprintf(stderr, "  info      Prints type, size, and other info about <file>.\n");
     fprintf(stderr, "            Use \"-v info\" to see more verbose detail.\n");
+    fprintf(stderr, "  scan      Prints one line of JSON describing each disk image in the\n");
+    fprintf(stderr, "            directory tree <file>, probing \"-p workers\" files at once.\n");
+    fprintf(stderr, "            Use \"-v scan\" to include files that aren't disk images.\n");
+    fprintf(stderr, "  reindex   Re-checks every entry in the probe index <file> (see -x),\n");
+    fprintf(stderr, "            dropping images that are gone and re-probing changed ones.\n");
     fprintf(stderr, "  cvt2hfs   Converts input file to an HFS volume image.\n");
 
     fprintf(stderr, "            If dstfile not specified, will create <file>.dsk.\n");
     fprintf(stderr, "  cvt2iso   Converts input file to an ISO device image.\n");
     fprintf(stderr, "            If dstfile not specified, will create <file>.iso.\n");
     fprintf(stderr, "            Use \"-w cvt2iso\" for a writable image (default is read-only)\n");
+    fprintf(stderr, "            Use \"-s\" with either cvt verb to leave unused (all-zero)\n");
+    fprintf(stderr, "            space as holes in a sparse output file.\n");
+    fprintf(stderr, "            Use \"-a\" with either cvt verb to copy only the blocks the\n");
+    fprintf(stderr, "            volume bitmap marks as in use; free space becomes holes.\n");
+    fprintf(stderr, "            Use \"-u\" to copy through io_uring (Linux), keeping up to\n");
+    fprintf(stderr, "            \"-q depth\" chunks in flight (default %d).\n", kURingDefaultQueueDepth);
+    fprintf(stderr, "            Use \"-j threads\" to copy stripes of the volume in parallel\n");
+    fprintf(stderr, "            (\"-j 0\" uses one thread per CPU).\n");
+    fprintf(stderr, "            Press ^C while a volume is copying to cancel the conversion\n");
+    fprintf(stderr, "            and remove the partial output file.\n");
+    fprintf(stderr, "            Use \"-d\" to write SHA-256 and CRC32C digests of the output,\n");
+    fprintf(stderr, "            and of the source volume, to <dstfile>.digests as they copy.\n");
+    fprintf(stderr, "            Use \"-P partition\" to convert the HFS partition with that\n");
+    fprintf(stderr, "            number (as info lists them) rather than the first one.\n");
+    fprintf(stderr, "            Use \"-z zlib\" or \"-z bzip2\" with either cvt verb to write the\n");
+    fprintf(stderr, "            image compressed in a UDIF container (<file>.dmg if dstfile\n");
+    fprintf(stderr, "            not specified), on \"-j threads\" (default one per CPU). All-zero\n");
+    fprintf(stderr, "            chunks take no space; -s and -d don't apply.\n");
+    fprintf(stderr, "            Use \"-f qcow2\" with either cvt verb to write a qcow2 image\n");
+    fprintf(stderr, "            for QEMU (<file>.qcow2 if dstfile not specified), read on\n");
+    fprintf(stderr, "            \"-j threads\" (default one per CPU). All-zero clusters take\n");
+    fprintf(stderr, "            no space; -s and -d don't apply, and it can't be used with -z.\n");
+    fprintf(stderr, "            Give \"-\" as <file> to read the image from standard input, and\n");
+    fprintf(stderr, "            as dstfile (the default then) to write it to standard output,\n");
+    fprintf(stderr, "            strictly in order, for use in a pipeline. A piped input is\n");
+    fprintf(stderr, "            read once, in order; -a doesn't apply to it. Standard output\n");
+    fprintf(stderr, "            can't take -z or -f qcow2, and -s and -d don't apply.\n");
+    fprintf(stderr, "  verify    Checks that the HFS volume in dstfile, made by cvt2hfs or\n");
+    fprintf(stderr, "            cvt2iso, matches the one in <file> (apart from the lock\n");
+    fprintf(stderr, "            bits). Stops at the first difference; use \"-v verify\" to\n");
+    fprintf(stderr, "            compare everything and summarize the differing blocks.\n");
+    fprintf(stderr, "            Use \"-j threads\" to set how many threads compare chunks\n");
+    fprintf(stderr, "            (default one per CPU). Exits with status 1 unless they match.\n");
+    fprintf(stderr, "            Use \"-P partition\" if <file> was converted with it.\n");
+    fprintf(stderr, "  split     Writes every partition of the device image <file> to its own\n");
+    fprintf(stderr, "            file, beside it or in the directory dstfile: HFS volumes as\n");
+    fprintf(stderr, "            cvt2hfs would (<file>.p<n>.dsk), others as raw data\n");
+    fprintf(stderr, "            (<file>.p<n>.bin). The partitions are copied at once, or\n");
+    fprintf(stderr, "            \"-p workers\" at a time; -w, -s, -a and -d apply as for cvt.\n");
+    fprintf(stderr, "  assemble  \"assemble <dstfile> <file> [file ...]\" builds one device image\n");
+    fprintf(stderr, "            with a partition for the HFS volume of each file, in order,\n");
+    fprintf(stderr, "            and the driver, copying the volumes at once (or \"-p workers\"\n");
+    fprintf(stderr, "            at a time). Use \"-w\" for writable volumes.\n");
+    fprintf(stderr, "  -b        Selects how files are read and written: pread (default),\n");
+    fprintf(stderr, "            mmap (input is memory-mapped), or direct (bypasses the\n");
+    fprintf(stderr, "            file cache, for images much larger than memory).\n");
+    fprintf(stderr, "  -x        Keeps probe results in the given index file, so info and\n");
+    fprintf(stderr, "            the cvt verbs skip reading unchanged images' headers.\n");
+    fprintf(stderr, "            Entries are keyed by device, inode, size and mtime; add -H\n");
+    fprintf(stderr, "            to also key on a hash of the first 64 KB of each image.\n");
+    fprintf(stderr, "  --stats   Prints the time spent in each phase of the work (open, probe,\n");
+    fprintf(stderr, "            header, copy, attributes, close) with its system calls, bytes\n");
+    fprintf(stderr, "            moved, short transfers and retries to stderr at exit.\n");
+    fprintf(stderr, "            --stats=json prints the same as one JSON object.\n");
+    fprintf(stderr, "  batch2hfs Converts every file in the directory tree <file>, or every\n");
+    fprintf(stderr, "  batch2iso file listed in the manifest <file>, as cvt2hfs or cvt2iso\n");
+    fprintf(stderr, "            would. Outputs go beside the inputs, or under the directory\n");
+    fprintf(stderr, "            dstfile if given. A manifest line may name an output path\n");
+    fprintf(stderr, "            after a tab. Use \"-p workers\" to set how many files are\n");
+    fprintf(stderr, "            converted at once (default one per CPU).\n");
     fprintf(stderr, "\nExamples:\n");
     fprintf(stderr, "  # Print info about contents of a disk image\n");
     fprintf(stderr, "    %s info \"System 7.5.3.dmg\"\n", arg0);
@@ -35,22 +114,65 @@ static void usage(const char *arg0) {
     fprintf(stderr, "    %s cvt2hfs \"System 7.5.3.iso\" System753.dsk\n", arg0);
     fprintf(stderr, "  # Convert a disk image to an ISO device image\n");
     fprintf(stderr, "    %s cvt2iso MinivMac.dsk\n", arg0);
+    fprintf(stderr, "  # Convert a disk image to a compressed device image\n");
+    fprintf(stderr, "    %s -z zlib cvt2iso MinivMac.dsk\n", arg0);
+    fprintf(stderr, "  # Convert a disk image to a qcow2 device image for QEMU\n");
+    fprintf(stderr, "    %s -f qcow2 cvt2iso MinivMac.dsk\n", arg0);
+    fprintf(stderr, "  # Convert a compressed volume in a pipeline, with no temporary files\n");
+    fprintf(stderr, "    xz -dc MinivMac.dsk.xz | %s cvt2iso - | ssh host 'cat > MinivMac.iso'\n", arg0);
     fprintf(stderr, "\nNotes:\n");
     fprintf(stderr, "  Always keep a copy of your original source disk image, even if conversion is successful.\n\n");
     fprintf(stderr, "  Use cvt2hfs to create a disk image for emulator software that expects a raw HFS volume, such as Mini vMac. Use cvt2iso for a device image that can be used with pre-10.15 versions of macOS/OS X, as well as in Basilisk, SheepShaver, Snow, QEMU, and other emulators.\n\n");
-    fprintf(stderr, "  Conversion to ISO format (even if the source image is already ISO) can repair readability problems with some device images, such as those made from old CD-ROMs. However, this process is lossy: it currently copies only the Apple_HFS partition, ignoring others. The intent is to make a working copy that can be used in an emulator, and is not a solution for archiving source media. ALWAYS keep your original disk image to avoid losing data!\n");
+    fprintf(stderr, "  UDIF (.dmg) images are read in place by every verb: raw, zlib, bzip2 and ADC compressed chunks are decompressed as they are copied, on one thread per CPU unless -j is given, so no uncompressed copy is ever written to disk.\n\n");
+    fprintf(stderr, "  Disk Copy 4.2 and DART floppy images are read in place too. DART blocks (RLE or LZH compressed) are decoded as they are read, and cvt2hfs and cvt2iso check Disk Copy 4.2 checksums as the volume copies, failing if the data checksum doesn't match.\n\n");
+    fprintf(stderr, "  gzip (.gz) and bzip2 (.bz2) compressed images are read in place as well, decompressed as they are read, so they needn't be unpacked first. Opening one decodes it once to find its size and the places decoding can restart; conversions then decode stripes of the volume side by side on one thread per CPU unless -j is given. A file from bzip2 itself holds a single stream, which can only be read in order; pbzip2's output, a stream per block, reads in parallel like gzip. Images inside a compressed UDIF, Disk Copy 4.2 or DART file aren't read.\n\n");
+    fprintf(stderr, "  zstd (.zst) and xz (.xz) compressed images are read the same way by a build with their decoders, made with \"make ZSTD=1 XZ=1\" (the macOS SDK has neither library; Homebrew's zstd and xz provide them). A zstd frame can only be decoded from its start: a file from zstd itself holds one frame and is read in order, while pzstd writes a frame per block, which reads in parallel. Opening an xz file reads the index at its end instead of decoding it, and every block is a place decoding can restart, so output of \"xz -T\" with blocks of 16 MB or less (\"--block-size=16MiB\") reads in parallel, and plain xz's single block is read in order.\n\n");
+    fprintf(stderr, "  Images written with -z are flat UDIF images of the kind hdiutil makes, with a block table for each partition, and open in Disk Utility and hdiutil on any version of OS X and in emulators that read .dmg files. Classic Mac OS and emulators that need a raw image can use the device image inside after a plain cvt2iso of the .dmg.\n\n");
+    fprintf(stderr, "  Images written with -f qcow2 hold the same device image (or volume) a plain cvt2iso (or cvt2hfs) would write, in 64 KB clusters, with only the clusters that aren't all zeros stored. QEMU opens them directly, with no \"qemu-img convert\" pass; use them with \"-drive file=<file>.qcow2,format=qcow2\".\n\n");
+    fprintf(stderr, "  Reading from standard input and writing to standard output never seeks. A piped input's size comes from its own headers (the driver descriptor record and partition map, or the volume's MDB or HFS+ volume header), and it is read once, holding back only what the probe has read past. The output goes out front to back, the header first, with the volume's lock bits set in memory before the block holding them is written; everything printed goes to standard error instead. A piped input that is compressed or in a container (gzip, bzip2, zstd, xz, UDIF or Disk Copy 4.2) is refused, saying which: give its file instead, or unpack it before the pipe, as in the example above.\n\n");
+    fprintf(stderr, "  Conversion to ISO format (even if the source image is already ISO) can repair readability problems with some device images, such as those made from old CD-ROMs. However, this process is lossy: it copies only one HFS partition (the first, or the one chosen with -P), ignoring others. The intent is to make a working copy that can be used in an emulator, and is not a solution for archiving source media. ALWAYS keep your original disk image to avoid losing data!\n");
     fprintf(stderr, "\nLimitations:\n");
-    fprintf(stderr, "  This program does not yet recognize many disk image formats, such as Disk Copy or DART images, or the GUID device partition scheme. It also does not yet correctly handle multiple HFS partitions in a device image. This software may contain bugs. Use at your own risk.\n");
+    fprintf(stderr, "  This program does not yet recognize many disk image formats, such as NDIF images, UDIF images compressed with LZFSE or LZMA, zstd or xz compressed images (unless built with \"ZSTD=1 XZ=1\"), or the GUID device partition scheme. This software may contain bugs. Use at your own risk.\n");
     fflush(stderr);
 }
 
+// The first ^C stops a conversion cleanly; a second one kills us
+static void HandleInterrupt(int sig) {
+    CancelTokenCancel(&cancelToken);
+    signal(sig, SIG_DFL);
+}
+
+// Only the verbs which check cancelToken catch ^C; for the others (scan,
+// reindex, info) it kills us as it always has
+static void CatchInterrupt(int cancellable) {
+    signal(SIGINT, (cancellable) ? HandleInterrupt : SIG_DFL);
+}
+
+static ImageIndex *OpenIndex(const char *path, int hash) {
+    ImageIndex *index = IndexOpen(path, hash);
+    if (!index) {
+        // carry on without it; the index is only a cache
+        tabprint(0, "Unable to open index \"%s\" (%d)\n", path, errno);
+    }
+    return index;
+}
+
 int main (int argc, char **argv)
 {
     int idx, minArgs=3, rw=0;
+    CopyOptions copyOptions = {0};
+    BatchOptions batchOptions = {0};
+    Progress progress = { ProgressPrintBar, NULL, 0, &cancelToken };
+    ImageIndex *index = NULL;
+    char *indexPath = NULL;
+    int stats = 0, statsJSON = 0;
+    int indexHash = 0;
+    int status = 0;
     char *path;
 
     /* need at least 3 arguments: app, verb, file */
     if (argc < minArgs) { goto usage_error_exit; }
+    copyOptions.progress = &progress;
 
     for (idx = 1; idx < argc; idx++) {
         if (!strcmp(argv[idx], "-v")) {
@@ -61,26 +183,209 @@ int main (int argc, char **argv)
             ++rw;
             /* re-check arg count to make sure we have enough */
             if (argc < ++minArgs) { goto usage_error_exit; }
+        } else if (!strcmp(argv[idx], "-s")) {
+            copyOptions.sparse = 1;
+            /* re-check arg count to make sure we have enough */
+            if (argc < ++minArgs) { goto usage_error_exit; }
+        } else if (!strcmp(argv[idx], "-a")) {
+            copyOptions.allocatedOnly = 1;
+            /* re-check arg count to make sure we have enough */
+            if (argc < ++minArgs) { goto usage_error_exit; }
+        } else if (!strcmp(argv[idx], "-d")) {
+            copyOptions.writeDigests = 1;
+            /* re-check arg count to make sure we have enough */
+            if (argc < ++minArgs) { goto usage_error_exit; }
+        } else if (!strcmp(argv[idx], "-u")) {
+            copyOptions.uring = 1;
+            /* re-check arg count to make sure we have enough */
+            if (argc < ++minArgs) { goto usage_error_exit; }
+        } else if (!strcmp(argv[idx], "-q")) {
+            /* option takes a value, so needs two more arguments */
+            minArgs += 2;
+            if (argc < minArgs) { goto usage_error_exit; }
+            copyOptions.queueDepth = atoi(argv[++idx]);
+        } else if (!strcmp(argv[idx], "-j")) {
+            /* option takes a value, so needs two more arguments */
+            minArgs += 2;
+            if (argc < minArgs) { goto usage_error_exit; }
+            copyOptions.threads = atoi(argv[++idx]);
+            if (copyOptions.threads == 0) {
+                copyOptions.threads = PoolDefaultThreads();
+            }
+        } else if (!strcmp(argv[idx], "-b")) {
+            /* option takes a value, so needs two more arguments */
+            minArgs += 2;
+            if (argc < minArgs) { goto usage_error_exit; }
+            if (IOBackendForName(argv[++idx], &copyOptions.backend) != 0) {
+                fprintf(stderr, "\nInvalid I/O backend: %s\n\n", argv[idx]);
+                goto usage_error_exit;
+            }
+        } else if (!strcmp(argv[idx], "-z")) {
+            /* option takes a value, so needs two more arguments */
+            minArgs += 2;
+            if (argc < minArgs) { goto usage_error_exit; }
+            if (!strcmp(argv[++idx], "zlib")) {
+                copyOptions.compression = kUDIFChunkZlib;
+            } else if (!strcmp(argv[idx], "bzip2")) {
+                copyOptions.compression = kUDIFChunkBzip2;
+            } else {
+                fprintf(stderr, "\nInvalid compression: %s\n\n", argv[idx]);
+                goto usage_error_exit;
+            }
+            if (copyOptions.qcow2) {
+                fprintf(stderr, "\n-z and \"-f qcow2\" can't be used together\n\n");
+                goto usage_error_exit;
+            }
+        } else if (!strcmp(argv[idx], "-f")) {
+            /* option takes a value, so needs two more arguments */
+            minArgs += 2;
+            if (argc < minArgs) { goto usage_error_exit; }
+            if (!strcmp(argv[++idx], "qcow2")) {
+                copyOptions.qcow2 = 1;
+            } else if (!strcmp(argv[idx], "raw")) {
+                copyOptions.qcow2 = 0;
+            } else {
+                fprintf(stderr, "\nInvalid output format: %s\n\n", argv[idx]);
+                goto usage_error_exit;
+            }
+            if (copyOptions.qcow2 && copyOptions.compression) {
+                fprintf(stderr, "\n-z and \"-f qcow2\" can't be used together\n\n");
+                goto usage_error_exit;
+            }
+        } else if (!strcmp(argv[idx], "-p")) {
+            /* option takes a value, so needs two more arguments */
+            minArgs += 2;
+            if (argc < minArgs) { goto usage_error_exit; }
+            batchOptions.workers = atoi(argv[++idx]);
+        } else if (!strcmp(argv[idx], "-P")) {
+            /* option takes a value, so needs two more arguments */
+            char *end;
+            long n;
+            minArgs += 2;
+            if (argc < minArgs) { goto usage_error_exit; }
+            n = strtol(argv[++idx], &end, 10);
+            if (*end || end == argv[idx] || n < 0 || n > 0xFFFF) {
+                fprintf(stderr, "\nInvalid partition number: %s\n\n", argv[idx]);
+                goto usage_error_exit;
+            }
+            copyOptions.partition = (unsigned)n + 1;
+        } else if (!strcmp(argv[idx], "-x")) {
+            /* option takes a value, so needs two more arguments */
+            minArgs += 2;
+            if (argc < minArgs) { goto usage_error_exit; }
+            indexPath = argv[++idx];
+        } else if (!strcmp(argv[idx], "--stats") || !strcmp(argv[idx], "--stats=json")) {
+            stats = 1;
+            statsJSON = (argv[idx][7] == '=');
+            StatsEnable();
+            /* re-check arg count to make sure we have enough */
+            if (argc < ++minArgs) { goto usage_error_exit; }
+        } else if (!strcmp(argv[idx], "-H")) {
+            indexHash = 1;
+            /* re-check arg count to make sure we have enough */
+            if (argc < ++minArgs) { goto usage_error_exit; }
+        } else if (!strcmp(argv[idx], "scan")) {
+            CatchInterrupt(0);
+            ScanOptions scanOptions = {0};
+            scanOptions.workers = batchOptions.workers;
+            scanOptions.backend = copyOptions.backend;
+            scanOptions.all = verbose;
+            if (indexPath && !index) { index = OpenIndex(indexPath, indexHash); }
+            if (ScanTree(argv[++idx], &scanOptions, index) != 0) {
+                status = 1; // some files couldn't be read
+            }
+        } else if (!strcmp(argv[idx], "reindex")) {
+            CatchInterrupt(0);
+            // an index that isn't there has nothing to re-check
+            ImageIndex *rebuilt = IndexOpenExisting(argv[++idx], indexHash);
+            int result;
+            if (!rebuilt) {
+                tabprint(0, "Unable to open index \"%s\" (%d)\n", argv[idx], errno);
+                status = 1;
+            } else if ((result = IndexRebuild(rebuilt, ProbeImagePath)) != 0) {
+                tabprint(0, "Unable to rebuild \"%s\" (%d)\n", argv[idx], result);
+                status = 1;
+            }
+            IndexClose(rebuilt);
         } else if (!strcmp(argv[idx], "info")) {
-            DescribeFile(argv[++idx]);
+            CatchInterrupt(0);
+            if (indexPath && !index) { index = OpenIndex(indexPath, indexHash); }
+            DescribeFile(argv[++idx], copyOptions.backend, index);
         } else if (!strcmp(argv[idx], "cvt2hfs") ||
                    !strcmp(argv[idx], "cvt2iso")) {
+            CatchInterrupt(1);
             int iso = (!strcmp(argv[idx], "cvt2iso")) ? 1 : 0;
+            if (indexPath && !index) { index = OpenIndex(indexPath, indexHash); }
             int pathLen = strlen(argv[++idx]);
-            char *buf = (char*)malloc(pathLen+6);
+            char *buf = (char*)malloc(pathLen+8);
             buf[0]='\0';
             strncpy(buf, argv[idx], pathLen);
-            strncpy(buf+pathLen, (iso) ? ".iso" : ".dsk", 4);
-            ConvertFile(iso, argv[idx],(idx+1 < argc) ? argv[idx+1] : buf, rw);
+            strcpy(buf+pathLen, (copyOptions.compression) ? ".dmg" :
+                   (copyOptions.qcow2) ? ".qcow2" : (iso) ? ".iso" : ".dsk");
+            if (!strcmp(argv[idx], "-")) { strcpy(buf, "-"); } // a filter, stdin to stdout
+            if (ConvertFile(iso, argv[idx],(idx+1 < argc) ? argv[idx+1] : buf, rw, &copyOptions,
+                            index) != 0) {
+                status = 1; // so a pipeline sees a failed conversion
+            }
             free(buf);
             ++idx;
+        } else if (!strcmp(argv[idx], "verify")) {
+            CatchInterrupt(1);
+            VerifyOptions verifyOptions = {0};
+            if (idx+2 >= argc) { goto usage_error_exit; } /* needs both files */
+            verifyOptions.threads = copyOptions.threads;
+            verifyOptions.backend = copyOptions.backend;
+            verifyOptions.full = verbose;
+            verifyOptions.progress = &progress;
+            verifyOptions.partition = copyOptions.partition;
+            if (indexPath && !index) { index = OpenIndex(indexPath, indexHash); }
+            if (VerifyFile(argv[idx+1], argv[idx+2], &verifyOptions, index) != 0) {
+                status = 1;
+            }
+            idx += 2;
+        } else if (!strcmp(argv[idx], "split")) {
+            CatchInterrupt(1);
+            SplitOptions splitOptions = {0};
+            char *source = argv[++idx];
+            splitOptions.rw = rw;
+            splitOptions.workers = batchOptions.workers;
+            splitOptions.outDir = (idx+1 < argc) ? argv[++idx] : NULL;
+            if (SplitFile(source, &splitOptions, &copyOptions) != 0) {
+                status = 1;
+            }
+        } else if (!strcmp(argv[idx], "assemble")) {
+            CatchInterrupt(1);
+            AssembleOptions assembleOptions = {0};
+            if (idx+2 >= argc) { goto usage_error_exit; } /* output and a volume */
+            assembleOptions.rw = rw;
+            assembleOptions.workers = batchOptions.workers;
+            if (indexPath && !index) { index = OpenIndex(indexPath, indexHash); }
+            if (AssembleImage(&argv[idx+2], argc - (idx+2), argv[idx+1], &assembleOptions,
+                              &copyOptions, index) != 0) {
+                status = 1;
+            }
+            idx = argc; /* the rest of the arguments were volumes */
+        } else if (!strcmp(argv[idx], "batch2hfs") ||
+                   !strcmp(argv[idx], "batch2iso")) {
+            CatchInterrupt(1);
+            char *source = argv[++idx];
+            batchOptions.iso = (!strcmp(argv[idx-1], "batch2iso")) ? 1 : 0;
+            batchOptions.rw = rw;
+            batchOptions.outDir = (idx+1 < argc) ? argv[++idx] : NULL;
+            if (indexPath && !index) { index = OpenIndex(indexPath, indexHash); }
+            if (BatchConvert(source, &batchOptions, &copyOptions, index) != 0) {
+                status = 1; // some files failed
+            }
         } else {
             fprintf(stderr, "\nInvalid parameter: %s\n\n", argv[idx]);
             goto usage_error_exit;
         }
     }
-    return 0;
+    IndexClose(index);
+    if (stats) { StatsPrint(stderr, statsJSON); }
+    return status;
 usage_error_exit:
+    IndexClose(index);
     usage(argv[0]);
     return 1;
 }